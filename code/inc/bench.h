@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    bench.h
+  * @brief   lwIP memory pool, send path and context switch benchmarks, pbuf
+  *          stress test.
+  ******************************************************************************
+  */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CPU cycles per operation pair, averaged over a number of loops.
+struct bench_memp_result
+{
+	uint32_t memp;              // memp_malloc() + memp_free()
+	uint32_t protect;           // sys_arch_protect() + sys_arch_unprotect()
+	uint32_t mutex;             // osMutexWait() + osMutexRelease()
+	uint32_t pool_protect;      // pool get + put, each under sys_arch_protect()
+	uint32_t pool_mutex;        // pool get + put, each under a mutex
+};
+
+struct bench_stress_result
+{
+	uint32_t allocs;            // pbufs allocated by the threads
+	uint32_t alloc_failures;    // allocations that found the pool empty
+	uint32_t errors;            // corrupted pbuf payloads seen by the threads
+	uint32_t isr_calls;         // simulated interrupts taken
+	uint32_t isr_errors;        // corrupted pbuf payloads seen by the interrupt
+	uint32_t pool_before;       // free pool pbufs before the test
+	uint32_t pool_after;        // free pool pbufs after the test
+	uint32_t msecs;             // duration of the test
+};
+
+// CPU cycles of context switches.
+struct bench_switch_result
+{
+	uint32_t wake_min;          // osSignalSet() until the woken thread runs
+	uint32_t wake_avg;
+	uint32_t wake_max;
+	uint32_t yield;             // osThreadYield() to the next thread of the same priority
+};
+
+// CPU cycles of sending a small UDP datagram from a thread.
+struct bench_send_result
+{
+	uint32_t mbox;              // udp_sendto() run by the tcpip thread, posted to its mbox
+	uint32_t locked;            // udp_sendto() run here under the core lock, 0 without it
+	uint32_t socket;            // lwip_sendto(), by whichever path the build uses
+};
+
+void bench_memp(struct bench_memp_result *result);
+bool bench_send(struct bench_send_result *result);
+bool bench_switch(struct bench_switch_result *result);
+bool bench_pbuf_stress(uint32_t iterations, struct bench_stress_result *result);
+void bench_pbuf_isr(void);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,37 @@
+/**
+  ******************************************************************************
+  * @file    config.h
+  * @brief   Persistent configuration values in flash.
+  ******************************************************************************
+  */
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Number of keys, values are kept for keys 0 to CONFIG_KEYS - 1.
+#define CONFIG_KEYS         32
+
+// State of the store.
+struct config_stats
+{
+	int32_t sector;         // active flash sector, -1 if nothing was stored yet
+	uint32_t generation;    // incremented each time the store moves to the other sector
+	uint32_t used;          // bytes in use of the active sector
+	uint32_t size;          // bytes of a sector
+	uint32_t scanned;       // records read at boot
+	uint32_t writes;        // records written since boot
+	uint32_t erases;        // sectors erased since boot
+	uint32_t errors;        // failed flash operations since boot
+};
+
+void config_init(void);
+bool config_get(int key, int32_t *value);
+bool config_set(int key, int32_t value);
+bool config_clear(int key);
+bool config_reset(void);
+void config_read_stats(struct config_stats *stats);
+
+#endif /* __CONFIG_H__ */
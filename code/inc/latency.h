@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    latency.h
+  * @brief   Cycle counter latency of received PTP messages.
+  ******************************************************************************
+  */
+
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Set to 0 to compile the latency stamps out.
+#ifndef LATENCY_ENABLE
+#define LATENCY_ENABLE      1
+#endif
+
+// Stages a received message passes, in order. The stamps up to the PTP
+// callback travel in the pbuf, the later ones belong to the message the
+// PTP thread is handling.
+#define LATENCY_ETH_IRQ     0   // ETH_IRQHandler() signalled the frame
+#define LATENCY_DEQUEUE     1   // ethernetif_input() took it off the RX ring
+#define LATENCY_TCPIP       2   // tcpip_thread() passed it to the stack
+#define LATENCY_UDP_INPUT   3   // udp_input() received it
+#define LATENCY_CALLBACK    4   // the PTP receive callback queued it
+#define LATENCY_RECV        5   // netRecv() copied it for the PTP thread
+#define LATENCY_HANDLE      6   // handle() dispatched it
+#define LATENCY_CLOCK       7   // updateClock() ran for it
+#define LATENCY_STAGES      8
+
+// Statistics of the whole path from the interrupt to updateClock().
+#define LATENCY_TOTAL       LATENCY_STAGES
+
+// Stamps carried by each pbuf.
+#define LATENCY_PBUF_STAMPS (LATENCY_CALLBACK + 1)
+
+// Histogram buckets, bucket n counts latencies of 2^n to 2^(n+1)-1 cycles.
+#define LATENCY_BUCKETS     24
+
+// Statistics of a stage in cycles since the previous stage the message
+// passed, or since the interrupt for the total.
+struct latency_stats
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t histogram[LATENCY_BUCKETS];
+};
+
+#if LATENCY_ENABLE
+void latency_init(void);
+void latency_irq(void);
+void latency_frame(uint32_t *stamps);
+void latency_stamp(uint32_t *stamps, int stage);
+void latency_recv(const uint32_t *stamps);
+void latency_mark(int stage);
+void latency_reset(void);
+void latency_read(int stage, struct latency_stats *stats);
+const char *latency_name(int stage);
+#else
+#define latency_init() ((void) 0)
+#define latency_irq() ((void) 0)
+#define latency_frame(stamps) ((void) 0)
+#define latency_stamp(stamps, stage) ((void) 0)
+#define latency_recv(stamps) ((void) 0)
+#define latency_mark(stage) ((void) 0)
+#define latency_reset() ((void) 0)
+#define latency_read(stage, stats) ((void) 0)
+#define latency_name(stage) ""
+#endif
+
+#endif /* __LATENCY_H__ */
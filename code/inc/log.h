@@ -0,0 +1,39 @@
+/**
+  ******************************************************************************
+  * @file    log.h
+  * @brief   Non-blocking log output through the USART TX DMA.
+  ******************************************************************************
+  */
+
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Log levels, most severe first.
+#define LOG_ERROR         0
+#define LOG_WARNING       1
+#define LOG_INFO          2
+#define LOG_DEBUG         3
+#define LOG_VERBOSE       4
+
+// Longest formatted message, longer ones are truncated.
+#define LOG_LINE_SIZE     128
+
+// Most arguments a deferred message can take.
+#define LOG_DEFERRED_ARGS 4
+
+// Messages above this level are discarded before they are formatted.
+extern volatile int log_level;
+
+#define log_enabled(level) ((level) <= log_level)
+
+void log_init(void);
+void log_write(const char *str, int len);
+void log_printf(int level, const char *fmt, ...);
+void log_deferred(int level, const char *fmt, int argc, ...);
+uint32_t log_dropped(void);
+void log_dma_irq(void);
+
+#endif /* __LOG_H__ */
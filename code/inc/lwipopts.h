@@ -12,8 +12,10 @@
 
 /* SYS_LIGHTWEIGHT_PROT==1: if you want inter-task protection for certain
  * critical regions during buffer allocation, deallocation and memory
- * allocation and deallocation. */
-#define SYS_LIGHTWEIGHT_PROT    0
+ * allocation and deallocation. The port masks interrupts up to
+ * SYS_ARCH_PROTECT_PRIORITY (see sys_arch.h), so pbufs and memp pools
+ * can also be allocated and freed from the Ethernet interrupt. */
+#define SYS_LIGHTWEIGHT_PROT    1
 
 #define ETHARP_TRUST_IP_MAC     0
 #define IP_REASSEMBLY           0
@@ -39,6 +41,17 @@
  * a lot of data that needs to be copied, this should be set high. */
 #define MEM_SIZE                				(4 * 1024)
 
+/* MEM_LIBC_MALLOC==1: the heap is a dynamic memory pool of the RTX kernel
+ * of MEM_SIZE bytes instead of mem.c, see sys_arch.c. With __MEM_TLSF it
+ * allocates and frees in constant time. */
+#define MEM_LIBC_MALLOC         1
+#define mem_malloc              sys_mem_malloc
+#define mem_calloc              sys_mem_calloc
+#define mem_free                sys_mem_free
+void *sys_mem_malloc(size_t size);
+void *sys_mem_calloc(size_t count, size_t size);
+void sys_mem_free(void *mem);
+
 /* ---------- Internal Memory Pool Sizes ---------- */
 
 /* MEMP_NUM_PBUF: the number of memp struct pbufs (used for PBUF_ROM and PBUF_REF).
@@ -120,6 +133,19 @@
  * TCP_MSS, IP header, and link header. */
 #define PBUF_POOL_BUFSIZE       LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
 
+/* PBUF_SMALL_BUFSIZE: frames up to this size, which take in all PTP event
+ * messages, are received into and sent from small custom pbufs instead of
+ * the pbuf pool and the heap, see pbuf_small.c. */
+#define PBUF_SMALL_BUFSIZE      128
+
+/* PBUF_SMALL_RX_NUM, PBUF_SMALL_TX_NUM: the number of small pbufs for
+ * received frames and for frames sent. */
+#define PBUF_SMALL_RX_NUM       16
+#define PBUF_SMALL_TX_NUM       4
+
+/* LWIP_SUPPORT_CUSTOM_PBUF==1: the small pbufs are custom pbufs. */
+#define LWIP_SUPPORT_CUSTOM_PBUF        1
+
 /* ---------- UDP options ---------- */
 
 /* LWIP_UDP==1: Turn on UDP. */
@@ -181,12 +207,39 @@
 /* ---------- PTP options ---------- */
 #define LWIP_PTP												1
 
+/* ---------- Latency options ---------- */
+
+/* Cycle counter stamps of received packets at each stage of the stack,
+ * see latency.h. */
+#include "latency.h"
+#if LATENCY_ENABLE
+#define LWIP_PBUF_STAMPS                LATENCY_PBUF_STAMPS
+#define LWIP_HOOK_TCPIP_INPKT(p)        latency_stamp((p)->stamps, LATENCY_TCPIP)
+#define LWIP_HOOK_UDP_INPUT(p)          latency_stamp((p)->stamps, LATENCY_UDP_INPUT)
+#endif
+
 /* ---------- Statistics options ---------- */
 
-/* LWIP_STATS==1: Enable statistics collection in lwip_stats. */
-#define LWIP_STATS                      0
+/* LWIP_STATS==1: Enable statistics collection in lwip_stats. Only the
+ * memory counters are kept, one update per allocation: the used, peak and
+ * failure counts of each memp pool, and the failures of the heap. */
+#define LWIP_STATS                      1
+#define LINK_STATS                      0
+#define ETHARP_STATS                    0
+#define IP_STATS                        0
+#define IPFRAG_STATS                    0
+#define ICMP_STATS                      0
+#define IGMP_STATS                      0
+#define UDP_STATS                       0
+#define TCP_STATS                       0
+#define SYS_STATS                       0
+#define MEMP_STATS                      1
+#define MEM_STATS                       1
 #define LWIP_PROVIDE_ERRNO 							1
 
+/* SYS_TIMEOUT_STATS==1: Record how late each timeout handler is called. */
+#define SYS_TIMEOUT_STATS               1
+
 /* ---------- Checksum options ---------- */
 
 /* The STM32F4x7 allows computing and verifying the IP, UDP, TCP and ICMP checksums by hardware:
@@ -235,6 +288,14 @@
  * timers running in tcpip_thread from another thread. */
 #define LWIP_TCPIP_TIMEOUT              1
 
+/* LWIP_TCPIP_CORE_LOCKING==1: Run the netconn and socket API calls in the
+ * calling thread while it holds the core mutex, instead of posting each one
+ * to the tcpip thread and waiting for it. The core mutex is an RTX mutex,
+ * so a thread holding it is raised to the priority of any thread waiting
+ * for it. Threads calling the raw API must hold it as well, see
+ * LOCK_TCPIP_CORE() in lwip/tcpip.h. */
+#define LWIP_TCPIP_CORE_LOCKING         1
+
 /* ---------- Socket options ---------- */
 
 /* LWIP_SOCKET==1: Enable Socket API (require to use sockets.c) */
@@ -12,7 +12,21 @@
 #define __SHELL_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
-void shell_process(void);
+// Watch subscription of a telnet session, kept with the session.
+struct shell_watch
+{
+	uint32_t every;             // clock updates per line, 0 when not watching
+	uint32_t updates;           // clock updates at the last line
+	uint32_t msecs;             // sys_now() at the last line
+	uint32_t dropped;           // lines dropped for a full output ring
+};
+
+// Called by the telnet server for the session it is serving.
+void shell_start(void);
+bool shell_line(char *cmdline);
+void shell_watch_update(struct shell_watch *watch);
+void shell_watch_stop(struct shell_watch *watch);
 
 #endif /* __SHELL_H__ */
@@ -2,6 +2,10 @@
 #define __TELNET_SHELL_H__
 
 #include <stdbool.h>
+#include "shell.h"
+
+// Signal of the telnet thread for a new clock update to watch.
+#define TELNET_SIGNAL_WATCH   0x04
 
 void telnet_shell_init(void);
 
@@ -9,7 +13,8 @@ void telnet_putc(char c);
 void telnet_puts(char *str);
 void telnet_printf(const char *fmt, ...);
 int telnet_flush(void);
-int telnet_getc(void);
-bool telnet_gets(char *buff, int len, int tocase, bool echo);
+int telnet_room(void);
+struct shell_watch *telnet_watch(void);
+bool telnet_watching(void);
 
 #endif /* __TELNET_SHELL_H__ */
@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file    tick.h
+  * @brief   RTX kernel timer on TIM2 with tickless idle.
+  ******************************************************************************
+  */
+
+#ifndef __TICK_H__
+#define __TICK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Histogram buckets, bucket n counts lateness of 2^n to 2^(n+1)-1 cycles.
+#define TICK_BUCKETS        24
+
+// Timed wake-ups are tick interrupts, idle sleeps that ran to their
+// timeout and the ends of tick_sleep_us(). Their lateness is measured in CPU cycles from the compare time
+// to the interrupt or the end of the sleep.
+struct tick_stats
+{
+	bool enabled;               // measurement on
+	uint32_t ticks;             // tick interrupts
+	uint32_t sleeps;            // idle sleeps
+	uint32_t slept;             // ticks passed asleep
+	uint32_t early;             // sleeps ended before their timeout by another interrupt
+	uint32_t wakes;             // tick_sleep_us() compares
+	uint32_t count;             // timed wake-ups
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t histogram[TICK_BUCKETS];
+};
+
+// Called by the RTX configuration in RTX_Conf_CM.c.
+int tick_init(uint32_t clock, uint32_t usecs);
+uint32_t tick_val(void);
+uint32_t tick_ovf(void);
+void tick_irqack(void);
+void tick_idle(void);
+
+bool tick_sleep_us(uint32_t usecs);
+
+void tick_measure(bool enable);
+void tick_reset(void);
+void tick_read_stats(struct tick_stats *stats);
+
+#endif /* __TICK_H__ */
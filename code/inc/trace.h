@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    trace.h
+  * @brief   Binary trace of protocol and servo events.
+  ******************************************************************************
+  */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Set to 0 to compile the trace points out.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE      1
+#endif
+
+// Number of records in the ring, a power of two.
+#define TRACE_RING_SIZE   256
+
+// TCP port the trace is drained from.
+#define TRACE_PORT        4000
+
+// Stream header sent to each client, followed by raw records.
+#define TRACE_MAGIC       "PTRC"
+#define TRACE_VERSION     1
+
+// Event ids and the meaning of their arguments.
+#define TRACE_MSG_RECV      1   // arg0 messageType, sequenceId, length, receive sec, nsec
+#define TRACE_STATE         2   // arg0 new state, old state
+#define TRACE_OFFSET        3   // arg0 filtered, Tms sec, nsec, offsetFromMaster sec, nsec
+#define TRACE_DELAY         4   // Tsm sec, nsec, meanPathDelay sec, nsec
+#define TRACE_PEER_DELAY    5   // peerMeanPathDelay sec, nsec
+#define TRACE_CLOCK         6   // offsetFromMaster sec, nsec, observedDrift
+#define TRACE_ADJ_FREQ      7   // requested adj, applied adj
+#define TRACE_TIMER_START   8   // arg0 timer, interval ms
+#define TRACE_TIMER_STOP    9   // arg0 timer
+#define TRACE_TIMER_EXPIRED 10  // arg0 timer
+#define TRACE_NETQ_PUT      11  // arg0 queue, queued, depth
+#define TRACE_NETQ_GET      12  // arg0 queue, depth
+
+// Queue ids of the TRACE_NETQ events.
+#define TRACE_QUEUE_EVENT   0
+#define TRACE_QUEUE_GENERAL 1
+
+// A trace record. The timestamp is the raw PTP system time, the
+// subseconds count 2^31 per second.
+struct trace_record
+{
+	uint32_t seq;               // number of the record since boot
+	uint32_t seconds;           // PTP time seconds
+	uint32_t subseconds;        // PTP time subseconds
+	uint16_t event;             // event id
+	uint16_t arg0;              // small event argument
+	int32_t arg[4];             // event arguments
+};
+
+struct trace_header
+{
+	char magic[4];              // TRACE_MAGIC
+	uint16_t version;           // TRACE_VERSION
+	uint16_t record_size;       // sizeof(struct trace_record)
+};
+
+#if TRACE_ENABLE
+void trace_init(void);
+void trace_event(uint16_t event, uint16_t arg0, int32_t arg1, int32_t arg2, int32_t arg3, int32_t arg4);
+uint32_t trace_count(void);
+bool trace_read(uint32_t seq, struct trace_record *record);
+#else
+#define trace_init() ((void) 0)
+#define trace_event(event, arg0, arg1, arg2, arg3, arg4) ((void) 0)
+#define trace_count() 0
+#define trace_read(seq, record) false
+#endif
+
+#endif /* __TRACE_H__ */
@@ -0,0 +1,31 @@
+/**
+  ******************************************************************************
+  * @file    usage.h
+  * @brief   Stack watermarks of the threads, scanned by the idle thread.
+  ******************************************************************************
+  */
+
+#ifndef __USAGE_H__
+#define __USAGE_H__
+
+#include <stdint.h>
+#include "cmsis_os.h"
+
+// Task ids with a watermark, 0 is the idle thread.
+#define USAGE_THREADS       16
+
+// Stack use of a thread at its last scan. The fill pattern is only
+// written when the thread is created, so used only grows while it lives.
+struct usage_stack
+{
+	os_pthread pthread;         // thread function, NULL for a free task id
+	uint32_t size;              // bytes of stack
+	uint32_t used;              // most bytes ever used
+};
+
+// Called by the idle thread in RTX_Conf_CM.c.
+void usage_idle(void);
+
+void usage_stacks(struct usage_stack stacks[USAGE_THREADS]);
+
+#endif /* __USAGE_H__ */
@@ -33,6 +33,8 @@
  *---------------------------------------------------------------------------*/
 
 #include "cmsis_os.h"
+#include "tick.h"
+#include "usage.h"
 
 
 /*----------------------------------------------------------------------------
@@ -48,7 +50,7 @@
 //   <i> Defines max. number of threads that will run at the same time.
 //   <i> Default: 6
 #ifndef OS_TASKCNT
- #define OS_TASKCNT     6
+ #define OS_TASKCNT     12
 #endif
 
 //   <o>Default Thread stack size [bytes] <64-4096:8><#/4>
@@ -86,6 +88,14 @@
  #define OS_STKCHECK    1
 #endif
 
+// <q>Stack usage watermark
+// <i> Fills the thread stacks with a pattern when threads are created,
+// <i> so the stack used can be found with os_stack_stat.
+// <i> Note that the fill makes creating threads slower.
+#ifndef OS_STKINIT
+ #define OS_STKINIT     1
+#endif
+
 // <o>Processor mode for thread execution 
 //   <0=> Unprivileged mode 
 //   <1=> Privileged mode
@@ -101,7 +111,7 @@
 // <q> Use Cortex-M SysTick timer as RTX Kernel Timer
 // <i> Use the Cortex-M SysTick timer as a time-base for RTX.
 #ifndef OS_SYSTICK
- #define OS_SYSTICK     1
+ #define OS_SYSTICK     0
 #endif
 //
 //   <o>Timer clock value [Hz] <1-1000000000>
@@ -216,7 +226,12 @@ void os_idle_demon (void) {
   /* ready to run.                                                           */
 
   for (;;) {
-    /* HERE: include optional user code to be executed when no thread runs.*/
+    /* Scan one thread stack for its watermark, see usage.c.               */
+    usage_idle ();
+#if (OS_SYSTICK == 0)
+    /* Sleep until the next timeout, see tick.c.                            */
+    tick_idle ();
+#endif
   }
 }
 
@@ -227,14 +242,14 @@ void os_idle_demon (void) {
 // Initialize alternative hardware timer as RTX kernel timer
 // Return: IRQ number of the alternative hardware timer
 int os_tick_init (void) {
-  return (-1);  /* Return IRQ number of timer (0..239) */
+  return (tick_init (OS_CLOCK, OS_TICK));  /* TIM2 compare, see tick.c     */
 }
 
 /*--------------------------- os_tick_val -----------------------------------*/
 
 // Get alternative hardware timer current value (0 .. OS_TRV)
 uint32_t os_tick_val (void) {
-  return (0);
+  return (tick_val ());
 }
 
 /*--------------------------- os_tick_ovf -----------------------------------*/
@@ -242,14 +257,14 @@ uint32_t os_tick_val (void) {
 // Get alternative hardware timer overflow flag
 // Return: 1 - overflow, 0 - no overflow
 uint32_t os_tick_ovf (void) {
-  return (0);
+  return (tick_ovf ());
 }
 
 /*--------------------------- os_tick_irqack --------------------------------*/
 
 // Acknowledge alternative hardware timer interrupt
 void os_tick_irqack (void) {
-  /* ... */
+  tick_irqack ();
 }
 
 #endif   // (OS_SYSTICK == 0)
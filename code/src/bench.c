@@ -0,0 +1,509 @@
+#include <string.h>
+#include "cmsis_os.h"
+#include "stm32f4xx.h"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/mem.h"
+#include "lwip/memp.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/tcpip.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+#include "bench.h"
+
+// Loops averaged by the memp benchmark, and the elements of the pool it
+// protects both ways.
+#define BENCH_LOOPS           1000
+#define BENCH_POOL_ELEMS      4
+
+// Datagrams sent by each path of the send benchmark. They are broadcast
+// to the discard port, so no ARP lookup is timed, and few enough that the
+// transmit descriptors keep up.
+#define BENCH_SEND_LOOPS      200
+#define BENCH_SEND_LEN        44
+#define BENCH_SEND_PORT       9
+
+// Context switches timed by the switch benchmark. The woken thread runs
+// above all others, the yielding threads at a priority the shell thread
+// running the benchmark is raised above while it starts them.
+#define BENCH_SWITCH_LOOPS    1000
+#define BENCH_WAKE_PRIO       ( osPriorityRealtime )
+#define BENCH_YIELD_THREADS   3
+#define BENCH_YIELD_PRIO      ( osPriorityAboveNormal )
+#define BENCH_SIGNAL          0x01
+
+// Threads hammering the pbuf pool, plus the simulated interrupt.
+#define BENCH_STRESS_THREADS  3
+#define BENCH_STRESS_PRIO     ( osPriorityNormal )
+
+// The simulated interrupt is a software triggered EXTI line, taken at the
+// most urgent priority sys_arch_protect() still masks.
+#define BENCH_ISR_LINE        EXTI_Line1
+#define BENCH_ISR_IRQ         EXTI1_IRQn
+#define BENCH_ISR_PRIO        SYS_ARCH_PROTECT_PRIORITY
+
+// Payload fill pattern of the pbufs allocated by the interrupt.
+#define BENCH_ISR_PATTERN     0xa5
+
+static void bench_wake_thread(void const *arg);
+static void bench_yield_thread(void const *arg);
+static void bench_stress_thread(void const *arg);
+
+osThreadDef(bench_wake_thread, BENCH_WAKE_PRIO, 1, 0);
+osThreadDef(bench_yield_thread, BENCH_YIELD_PRIO, BENCH_YIELD_THREADS, 0);
+osThreadDef(bench_stress_thread, BENCH_STRESS_PRIO, BENCH_STRESS_THREADS, 0);
+osSemaphoreDef(bench_done);
+osMutexDef(bench_mutex);
+
+// Free list of the memp benchmark, the same singly linked list a memp pool is.
+struct bench_elem
+{
+	struct bench_elem *next;
+};
+static struct bench_elem bench_elems[BENCH_POOL_ELEMS];
+static struct bench_elem *bench_pool;
+
+// Shared with the stress threads and the simulated interrupt.
+static volatile bool bench_isr_enabled = false;
+static struct pbuf *bench_isr_pbuf = NULL;
+static uint32_t bench_iterations;
+static osSemaphoreId bench_done_id;
+static struct bench_stress_result *bench_result;
+
+// Shared with the send benchmark callback in the tcpip thread.
+static struct udp_pcb *bench_send_pcb;
+
+// Shared with the switch benchmark threads.
+static volatile uint32_t bench_wake_start;
+static uint32_t bench_wake_total;
+static struct bench_switch_result *bench_switch_result;
+
+// Fill the payload of a pbuf chain.
+static void bench_fill(struct pbuf *p, uint8_t pattern)
+{
+	for (; p != NULL; p = p->next) memset(p->payload, pattern, p->len);
+}
+
+// Check the payload of a pbuf chain. Returns false if it was overwritten.
+static bool bench_check(struct pbuf *p, uint8_t pattern)
+{
+	uint16_t i;
+
+	for (; p != NULL; p = p->next)
+	{
+		for (i = 0; i < p->len; ++i)
+		{
+			if (((uint8_t *) p->payload)[i] != pattern) return false;
+		}
+	}
+	return true;
+}
+
+// Count the pbufs free in the pool right now. The pool statistics are
+// read rather than the pool drained, so the receive path keeps its pbufs.
+static uint32_t bench_pool_free(void)
+{
+	uint32_t count;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	count = lwip_stats.memp[MEMP_PBUF_POOL].avail - lwip_stats.memp[MEMP_PBUF_POOL].used;
+	SYS_ARCH_UNPROTECT(lev);
+
+	return count;
+}
+
+// Take an element off the benchmark pool, or NULL.
+static struct bench_elem *bench_pool_get(void)
+{
+	struct bench_elem *elem = bench_pool;
+
+	if (elem) bench_pool = elem->next;
+	return elem;
+}
+
+// Return an element to the benchmark pool.
+static void bench_pool_put(struct bench_elem *elem)
+{
+	elem->next = bench_pool;
+	bench_pool = elem;
+}
+
+// Time memp pool operations against the protection they rely on. The
+// pool of the benchmark is also timed under a mutex, the way
+// sys_arch_protect() used to protect memp.
+void bench_memp(struct bench_memp_result *result)
+{
+	int i;
+	void *mem;
+	uint32_t start;
+	sys_prot_t lev;
+	osMutexId mutex;
+	struct bench_elem *elem;
+
+	bench_pool = NULL;
+	for (i = 0; i < BENCH_POOL_ELEMS; ++i) bench_pool_put(&bench_elems[i]);
+
+	// Allocate and free a pool element.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_LOOPS; ++i)
+	{
+		mem = memp_malloc(MEMP_PBUF);
+		if (mem) memp_free(MEMP_PBUF, mem);
+	}
+	result->memp = (osKernelSysTick() - start) / BENCH_LOOPS;
+
+	// Enter and leave the lightweight protection.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_LOOPS; ++i)
+	{
+		lev = sys_arch_protect();
+		sys_arch_unprotect(lev);
+	}
+	result->protect = (osKernelSysTick() - start) / BENCH_LOOPS;
+
+	// Take and release an uncontended mutex.
+	mutex = osMutexCreate(osMutex(bench_mutex));
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_LOOPS; ++i)
+	{
+		osMutexWait(mutex, osWaitForever);
+		osMutexRelease(mutex);
+	}
+	result->mutex = (osKernelSysTick() - start) / BENCH_LOOPS;
+
+	// Get and put a pool element, each under the lightweight protection.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_LOOPS; ++i)
+	{
+		lev = sys_arch_protect();
+		elem = bench_pool_get();
+		sys_arch_unprotect(lev);
+		lev = sys_arch_protect();
+		if (elem) bench_pool_put(elem);
+		sys_arch_unprotect(lev);
+	}
+	result->pool_protect = (osKernelSysTick() - start) / BENCH_LOOPS;
+
+	// The same under the mutex.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_LOOPS; ++i)
+	{
+		osMutexWait(mutex, osWaitForever);
+		elem = bench_pool_get();
+		osMutexRelease(mutex);
+		osMutexWait(mutex, osWaitForever);
+		if (elem) bench_pool_put(elem);
+		osMutexRelease(mutex);
+	}
+	result->pool_mutex = (osKernelSysTick() - start) / BENCH_LOOPS;
+	osMutexDelete(mutex);
+}
+
+// Send a datagram on the benchmark pcb. Runs in the tcpip thread or under
+// the core lock.
+static void bench_send_datagram(void)
+{
+	struct pbuf *p;
+
+	p = pbuf_alloc(PBUF_TRANSPORT, BENCH_SEND_LEN, PBUF_RAM);
+	if (p == NULL) return;
+	memset(p->payload, 0, BENCH_SEND_LEN);
+	udp_sendto(bench_send_pcb, p, IP_ADDR_BROADCAST, BENCH_SEND_PORT);
+	pbuf_free(p);
+}
+
+// Runs in the tcpip thread, then wakes the benchmark. Sending this way
+// is the round trip every API call took before core locking.
+static void bench_send_callback(void *arg)
+{
+	bench_send_datagram();
+	osSemaphoreRelease(bench_done_id);
+}
+
+// Time the paths a thread has to send a UDP datagram. Returns false if
+// the benchmark could not be set up.
+bool bench_send(struct bench_send_result *result)
+{
+	int i;
+	int sock;
+	uint32_t start;
+	struct sockaddr_in addr;
+	uint8_t payload[BENCH_SEND_LEN];
+
+	memset(result, 0, sizeof(*result));
+	memset(payload, 0, sizeof(payload));
+
+	bench_done_id = osSemaphoreCreate(osSemaphore(bench_done), 0);
+	if (bench_done_id == NULL) return false;
+
+	LOCK_TCPIP_CORE();
+	bench_send_pcb = udp_new();
+	UNLOCK_TCPIP_CORE();
+	if (bench_send_pcb == NULL)
+	{
+		osSemaphoreDelete(bench_done_id);
+		return false;
+	}
+
+	// Post to the tcpip thread and wait for it to have sent.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_SEND_LOOPS; ++i)
+	{
+		if (tcpip_callback(bench_send_callback, NULL) != ERR_OK) break;
+		osSemaphoreWait(bench_done_id, osWaitForever);
+	}
+	if (i) result->mbox = (osKernelSysTick() - start) / i;
+
+#if LWIP_TCPIP_CORE_LOCKING
+	// Send from this thread, taking the core lock for each datagram.
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_SEND_LOOPS; ++i)
+	{
+		LOCK_TCPIP_CORE();
+		bench_send_datagram();
+		UNLOCK_TCPIP_CORE();
+	}
+	result->locked = (osKernelSysTick() - start) / BENCH_SEND_LOOPS;
+#endif
+
+	LOCK_TCPIP_CORE();
+	udp_remove(bench_send_pcb);
+	UNLOCK_TCPIP_CORE();
+	bench_send_pcb = NULL;
+	osSemaphoreDelete(bench_done_id);
+
+	// The socket API adds its own copy and netconn to either path.
+	sock = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(BENCH_SEND_PORT);
+	addr.sin_addr.s_addr = IPADDR_BROADCAST;
+	start = osKernelSysTick();
+	for (i = 0; i < BENCH_SEND_LOOPS; ++i)
+	{
+		lwip_sendto(sock, payload, sizeof(payload), 0, (struct sockaddr *) &addr, sizeof(addr));
+	}
+	result->socket = (osKernelSysTick() - start) / BENCH_SEND_LOOPS;
+	lwip_close(sock);
+
+	return true;
+}
+
+// Waits for the signal and times how long after it was set it runs.
+static void bench_wake_thread(void const *arg)
+{
+	uint32_t i;
+	uint32_t cycles;
+
+	for (i = 0; i < BENCH_SWITCH_LOOPS; ++i)
+	{
+		osSignalWait(BENCH_SIGNAL, osWaitForever);
+		cycles = osKernelSysTick() - bench_wake_start;
+
+		if (cycles < bench_switch_result->wake_min) bench_switch_result->wake_min = cycles;
+		if (cycles > bench_switch_result->wake_max) bench_switch_result->wake_max = cycles;
+		bench_wake_total += cycles;
+	}
+
+	osSemaphoreRelease(bench_done_id);
+	osThreadTerminate(osThreadGetId());
+}
+
+// Passes the CPU to the next thread of the same priority.
+static void bench_yield_thread(void const *arg)
+{
+	uint32_t i;
+
+	for (i = 0; i < BENCH_SWITCH_LOOPS; ++i) osThreadYield();
+
+	osSemaphoreRelease(bench_done_id);
+	osThreadTerminate(osThreadGetId());
+}
+
+// Time waking a higher priority thread and yielding among threads of the
+// same priority, the paths through the RTX ready list. Returns false if
+// the threads could not be started.
+bool bench_switch(struct bench_switch_result *result)
+{
+	uint32_t i;
+	uint32_t start;
+	uint32_t started = 0;
+	osThreadId thread;
+	osThreadId self = osThreadGetId();
+	osPriority priority = osThreadGetPriority(self);
+
+	memset(result, 0, sizeof(*result));
+	result->wake_min = UINT32_MAX;
+	bench_switch_result = result;
+	bench_wake_total = 0;
+
+	bench_done_id = osSemaphoreCreate(osSemaphore(bench_done), 0);
+	if (bench_done_id == NULL) return false;
+
+	// The woken thread preempts this one at once each time.
+	thread = osThreadCreate(osThread(bench_wake_thread), NULL);
+	if (thread == NULL)
+	{
+		osSemaphoreDelete(bench_done_id);
+		return false;
+	}
+	for (i = 0; i < BENCH_SWITCH_LOOPS; ++i)
+	{
+		bench_wake_start = osKernelSysTick();
+		osSignalSet(thread, BENCH_SIGNAL);
+	}
+	osSemaphoreWait(bench_done_id, osWaitForever);
+	result->wake_avg = bench_wake_total / BENCH_SWITCH_LOOPS;
+
+	// Start the yielding threads all ready before any of them runs.
+	osThreadSetPriority(self, osPriorityHigh);
+	for (i = 0; i < BENCH_YIELD_THREADS; ++i)
+	{
+		if (osThreadCreate(osThread(bench_yield_thread), NULL) != NULL) ++started;
+	}
+	start = osKernelSysTick();
+	for (i = 0; i < started; ++i)
+	{
+		osSemaphoreWait(bench_done_id, osWaitForever);
+	}
+	if (started) result->yield = (osKernelSysTick() - start) / (started * BENCH_SWITCH_LOOPS);
+	osThreadSetPriority(self, priority);
+
+	osSemaphoreDelete(bench_done_id);
+
+	return started == BENCH_YIELD_THREADS;
+}
+
+// Allocates, checks and frees pool pbufs while triggering the simulated
+// interrupt, which does the same, in the middle of each allocation.
+static void bench_stress_thread(void const *arg)
+{
+	uint32_t i;
+	uint16_t len;
+	uint8_t pattern;
+	struct pbuf *p;
+	sys_prot_t lev;
+	uint32_t allocs = 0;
+	uint32_t failures = 0;
+	uint32_t errors = 0;
+	uint32_t id = (uint32_t) arg;
+
+	for (i = 0; i < bench_iterations; ++i)
+	{
+		// Vary the length so that some allocations are chains.
+		len = (uint16_t) (1 + (i * 97 + id * 31) % (2 * PBUF_POOL_BUFSIZE));
+		pattern = (uint8_t) (id + i);
+		if (pattern == BENCH_ISR_PATTERN) ++pattern;
+
+		p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+		if (p == NULL)
+		{
+			++failures;
+			osThreadYield();
+			continue;
+		}
+		++allocs;
+		bench_fill(p, pattern);
+
+		// Let the interrupt and the other threads run while the pbuf is held.
+		EXTI_GenerateSWInterrupt(BENCH_ISR_LINE);
+		if ((i & 3) == 0) osThreadYield();
+
+		if (!bench_check(p, pattern)) ++errors;
+		pbuf_free(p);
+	}
+
+	// Add to the totals.
+	lev = sys_arch_protect();
+	bench_result->allocs += allocs;
+	bench_result->alloc_failures += failures;
+	bench_result->errors += errors;
+	sys_arch_unprotect(lev);
+
+	osSemaphoreRelease(bench_done_id);
+	osThreadTerminate(osThreadGetId());
+}
+
+// Body of the simulated interrupt. Frees the pbuf it allocated last time
+// and allocates a new one, so interrupt and thread allocations interleave.
+void bench_pbuf_isr(void)
+{
+	EXTI_ClearITPendingBit(BENCH_ISR_LINE);
+
+	if (!bench_isr_enabled) return;
+
+	++bench_result->isr_calls;
+	if (bench_isr_pbuf)
+	{
+		if (!bench_check(bench_isr_pbuf, BENCH_ISR_PATTERN)) ++bench_result->isr_errors;
+		pbuf_free(bench_isr_pbuf);
+	}
+	bench_isr_pbuf = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE / 2, PBUF_POOL);
+	if (bench_isr_pbuf) bench_fill(bench_isr_pbuf, BENCH_ISR_PATTERN);
+}
+
+// Run the pbuf stress test. Each thread does the given number of
+// allocations. Returns false if the test could not be started.
+bool bench_pbuf_stress(uint32_t iterations, struct bench_stress_result *result)
+{
+	uint32_t i;
+	uint32_t start;
+	uint32_t started = 0;
+	EXTI_InitTypeDef EXTI_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	memset(result, 0, sizeof(*result));
+	bench_result = result;
+	bench_iterations = iterations;
+
+	bench_done_id = osSemaphoreCreate(osSemaphore(bench_done), 0);
+	if (bench_done_id == NULL) return false;
+
+	result->pool_before = bench_pool_free();
+
+	// Set up the software triggered interrupt.
+	EXTI_InitStructure.EXTI_Line = BENCH_ISR_LINE;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = BENCH_ISR_IRQ;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = BENCH_ISR_PRIO;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	bench_isr_enabled = true;
+
+	// Start the threads and wait for them to finish.
+	start = sys_now();
+	for (i = 0; i < BENCH_STRESS_THREADS; ++i)
+	{
+		if (osThreadCreate(osThread(bench_stress_thread), (void *) i) != NULL) ++started;
+	}
+	for (i = 0; i < started; ++i)
+	{
+		osSemaphoreWait(bench_done_id, osWaitForever);
+	}
+	result->msecs = sys_now() - start;
+
+	// Shut down the interrupt and free its last pbuf.
+	NVIC_InitStructure.NVIC_IRQChannelCmd = DISABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	EXTI_InitStructure.EXTI_LineCmd = DISABLE;
+	EXTI_Init(&EXTI_InitStructure);
+	bench_isr_enabled = false;
+	if (bench_isr_pbuf)
+	{
+		pbuf_free(bench_isr_pbuf);
+		bench_isr_pbuf = NULL;
+	}
+
+	result->pool_after = bench_pool_free();
+
+	osSemaphoreDelete(bench_done_id);
+
+	return started == BENCH_STRESS_THREADS;
+}
@@ -0,0 +1,391 @@
+#include <string.h>
+#include "stm32f4xx.h"
+#include "cmsis_os.h"
+#include "config.h"
+
+// The values are kept in a log of records in one of the last two 128KB
+// sectors of the flash, which IROM1 of the project keeps free of code.
+// Setting a value appends a record and the latest record of a key wins.
+// When a sector is full the current values are copied to the other one,
+// so each sector is erased only once every few thousand writes. Erasing
+// stalls the CPU for a second or two as the code runs from the same bank.
+//
+// All current values are appended again after every
+// CONFIG_SNAPSHOT_INTERVAL records. Boot reads the log backwards from its
+// end to the last complete snapshot, a few dozen records however full the
+// sector is, and after that the values are only read from RAM.
+
+#define CONFIG_SECTOR_SIZE        0x20000
+#define CONFIG_SLOTS              (CONFIG_SECTOR_SIZE / sizeof(struct config_record))
+#define CONFIG_SNAPSHOT_INTERVAL  32
+
+// Record types.
+#define CONFIG_HEADER       1   // first record of a sector, the value is the generation
+#define CONFIG_SET          2   // the value of the key
+#define CONFIG_CLEAR        3   // the key has no value
+#define CONFIG_SNAPSHOT     4   // the value is the number of snapshot records before it
+
+#define CONFIG_TAG_MAGIC    0xC0F10000
+#define CONFIG_TAG(type, key) (CONFIG_TAG_MAGIC | ((type) << 8) | (key))
+#define CONFIG_TYPE(tag)    (((tag) >> 8) & 0xff)
+#define CONFIG_KEY(tag)     ((tag) & 0xff)
+
+#define CONFIG_FLASH_FLAGS  (FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | \
+                             FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+// The words are programmed in this order, so a record with an erased tag
+// was interrupted.
+struct config_record
+{
+	uint32_t value;
+	uint32_t crc;
+	uint32_t tag;
+};
+
+struct config_sector
+{
+	uint32_t sector;
+	const struct config_record *records;
+};
+
+static const struct config_sector config_sectors[2] =
+{
+	{FLASH_Sector_10, (const struct config_record *) 0x080C0000},
+	{FLASH_Sector_11, (const struct config_record *) 0x080E0000}
+};
+
+// CRC-32 of IEEE 802.3, a nibble at a time.
+static const uint32_t config_crc_table[16] =
+{
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+osMutexDef(config_mutex);
+static osMutexId config_mutex;
+
+// Index of the active sector, -1 until something is stored.
+static int config_active = -1;
+static uint32_t config_generation;
+
+// First free slot of the active sector, and the slot after the last snapshot.
+static uint32_t config_tail;
+static uint32_t config_snapshot;
+
+// The current values, with a bit set for each key that has one.
+static int32_t config_values[CONFIG_KEYS];
+static volatile uint32_t config_present;
+
+static struct config_stats config_stats;
+
+static uint32_t config_crc(uint32_t value, uint32_t tag)
+{
+	int i;
+	uint32_t crc = 0xffffffff;
+
+	crc ^= value;
+	for (i = 0; i < 8; ++i) crc = (crc >> 4) ^ config_crc_table[crc & 0x0f];
+	crc ^= tag;
+	for (i = 0; i < 8; ++i) crc = (crc >> 4) ^ config_crc_table[crc & 0x0f];
+
+	return ~crc;
+}
+
+static bool config_valid(const struct config_record *record)
+{
+	return ((record->tag & 0xffff0000) == CONFIG_TAG_MAGIC) &&
+	       (record->crc == config_crc(record->value, record->tag));
+}
+
+static bool config_erased(const struct config_record *record)
+{
+	return (record->value == 0xffffffff) && (record->crc == 0xffffffff) && (record->tag == 0xffffffff);
+}
+
+// Number of keys with a value.
+static uint32_t config_count(void)
+{
+	int key;
+	uint32_t count = 0;
+
+	for (key = 0; key < CONFIG_KEYS; ++key)
+	{
+		if (config_present & (1UL << key)) ++count;
+	}
+
+	return count;
+}
+
+// Binary search for the first free slot, all slots after it are erased.
+static uint32_t config_find_tail(const struct config_record *records)
+{
+	uint32_t mid;
+	uint32_t low = 1;
+	uint32_t high = CONFIG_SLOTS;
+
+	while (low < high)
+	{
+		mid = (low + high) / 2;
+		if (config_erased(&records[mid]))
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return low;
+}
+
+// Read the current values from the end of the log back to the last
+// complete snapshot. Records with a bad CRC are skipped.
+static void config_scan(void)
+{
+	int32_t slot;
+	int32_t stop = 1;
+	uint32_t key;
+	uint32_t bit;
+	uint32_t seen = 0;
+	bool snapshot = false;
+	const struct config_record *record;
+	const struct config_record *records = config_sectors[config_active].records;
+
+	config_snapshot = 1;
+
+	for (slot = (int32_t) config_tail - 1; slot >= stop; --slot)
+	{
+		record = &records[slot];
+		if (!config_valid(record)) continue;
+
+		config_stats.scanned++;
+
+		switch (CONFIG_TYPE(record->tag))
+		{
+			case CONFIG_SNAPSHOT:
+				// The records before the snapshot hold no newer values.
+				if (!snapshot && (record->value < (uint32_t) slot))
+				{
+					snapshot = true;
+					stop = slot - (int32_t) record->value;
+					config_snapshot = slot + 1;
+				}
+				break;
+			case CONFIG_SET:
+			case CONFIG_CLEAR:
+				key = CONFIG_KEY(record->tag);
+				if (key >= CONFIG_KEYS) break;
+				bit = 1UL << key;
+				if (seen & bit) break;
+				seen |= bit;
+				if (CONFIG_TYPE(record->tag) == CONFIG_SET)
+				{
+					config_values[key] = (int32_t) record->value;
+					config_present |= bit;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+// Program a record into a slot of a sector. The flash must be unlocked.
+static bool config_program(int sector, uint32_t slot, uint32_t type, uint32_t key, uint32_t value)
+{
+	bool ok;
+	uint32_t tag = CONFIG_TAG(type, key);
+	uint32_t address = (uint32_t) &config_sectors[sector].records[slot];
+
+	ok = (FLASH_ProgramWord(address, value) == FLASH_COMPLETE) &&
+	     (FLASH_ProgramWord(address + 4, config_crc(value, tag)) == FLASH_COMPLETE) &&
+	     (FLASH_ProgramWord(address + 8, tag) == FLASH_COMPLETE);
+
+	config_stats.writes++;
+	if (!ok) config_stats.errors++;
+
+	return ok;
+}
+
+// Append all current values followed by a snapshot record.
+static bool config_write_snapshot(int sector)
+{
+	int key;
+	uint32_t count = 0;
+
+	for (key = 0; key < CONFIG_KEYS; ++key)
+	{
+		if (!(config_present & (1UL << key))) continue;
+		if (!config_program(sector, config_tail++, CONFIG_SET, key, config_values[key])) return false;
+		++count;
+	}
+
+	if (!config_program(sector, config_tail++, CONFIG_SNAPSHOT, 0, count)) return false;
+	config_snapshot = config_tail;
+
+	return true;
+}
+
+// Erase the other sector and copy the current values to it. The old sector
+// stays active until the header of the new one is written.
+static bool config_swap(void)
+{
+	int sector = (config_active == 0) ? 1 : 0;
+	uint32_t tail = config_tail;
+	uint32_t snapshot = config_snapshot;
+
+	config_stats.erases++;
+	if (FLASH_EraseSector(config_sectors[sector].sector, VoltageRange_3) != FLASH_COMPLETE)
+	{
+		config_stats.errors++;
+		return false;
+	}
+
+	config_tail = 1;
+	if (!config_write_snapshot(sector) ||
+	    !config_program(sector, 0, CONFIG_HEADER, 0, config_generation + 1))
+	{
+		config_tail = tail;
+		config_snapshot = snapshot;
+		return false;
+	}
+
+	config_active = sector;
+	config_generation++;
+
+	return true;
+}
+
+// Append a record and update the values. The sectors are swapped first if
+// there is no room for the record and a snapshot after it.
+static bool config_append(uint32_t type, int key, int32_t value)
+{
+	bool ok;
+	uint32_t bit = 1UL << key;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(CONFIG_FLASH_FLAGS);
+
+	ok = ((config_active >= 0) && (config_tail + config_count() + 3 <= CONFIG_SLOTS)) || config_swap();
+	if (ok) ok = config_program(config_active, config_tail++, type, key, value);
+
+	if (ok)
+	{
+		if (type == CONFIG_SET)
+		{
+			config_values[key] = value;
+			config_present |= bit;
+		}
+		else
+		{
+			config_present &= ~bit;
+		}
+
+		// A failed snapshot is counted, the value itself was stored.
+		if (config_tail - config_snapshot >= CONFIG_SNAPSHOT_INTERVAL) config_write_snapshot(config_active);
+	}
+
+	FLASH_Lock();
+
+	return ok;
+}
+
+// Find the active sector and read the current values.
+void config_init(void)
+{
+	int i;
+	const struct config_record *header;
+
+	config_mutex = osMutexCreate(osMutex(config_mutex));
+
+	// The sector with the latest valid header is active.
+	for (i = 0; i < 2; ++i)
+	{
+		header = &config_sectors[i].records[0];
+		if (!config_valid(header) || (CONFIG_TYPE(header->tag) != CONFIG_HEADER)) continue;
+		if ((config_active < 0) || ((int32_t) (header->value - config_generation) > 0))
+		{
+			config_active = i;
+			config_generation = header->value;
+		}
+	}
+
+	if (config_active < 0) return;
+
+	config_tail = config_find_tail(config_sectors[config_active].records);
+	config_scan();
+}
+
+// Get the value of a key from RAM, false if it has none.
+bool config_get(int key, int32_t *value)
+{
+	if ((key < 0) || (key >= CONFIG_KEYS) || !(config_present & (1UL << key))) return false;
+
+	*value = config_values[key];
+
+	return true;
+}
+
+// Set and store the value of a key.
+bool config_set(int key, int32_t value)
+{
+	bool ok = true;
+	int32_t current;
+
+	if ((key < 0) || (key >= CONFIG_KEYS)) return false;
+
+	osMutexWait(config_mutex, osWaitForever);
+	if (!config_get(key, &current) || (current != value)) ok = config_append(CONFIG_SET, key, value);
+	osMutexRelease(config_mutex);
+
+	return ok;
+}
+
+// Remove the value of a key.
+bool config_clear(int key)
+{
+	bool ok = true;
+
+	if ((key < 0) || (key >= CONFIG_KEYS)) return false;
+
+	osMutexWait(config_mutex, osWaitForever);
+	if (config_present & (1UL << key)) ok = config_append(CONFIG_CLEAR, key, 0);
+	osMutexRelease(config_mutex);
+
+	return ok;
+}
+
+// Remove all values by moving to the other sector with none.
+bool config_reset(void)
+{
+	bool ok;
+	uint32_t present;
+
+	osMutexWait(config_mutex, osWaitForever);
+
+	present = config_present;
+	config_present = 0;
+
+	FLASH_Unlock();
+	FLASH_ClearFlag(CONFIG_FLASH_FLAGS);
+	ok = config_swap();
+	FLASH_Lock();
+
+	if (!ok) config_present = present;
+
+	osMutexRelease(config_mutex);
+
+	return ok;
+}
+
+void config_read_stats(struct config_stats *stats)
+{
+	osMutexWait(config_mutex, osWaitForever);
+
+	*stats = config_stats;
+
+	// FLASH_Sector_x is the sector number shifted by 3.
+	stats->sector = (config_active < 0) ? -1 : (int32_t) (config_sectors[config_active].sector >> 3);
+	stats->generation = config_generation;
+	stats->used = (config_active < 0) ? 0 : config_tail * sizeof(struct config_record);
+	stats->size = CONFIG_SECTOR_SIZE;
+
+	osMutexRelease(config_mutex);
+}
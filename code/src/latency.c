@@ -0,0 +1,158 @@
+#include <string.h>
+#include "stm32f4xx.h"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "latency.h"
+
+#if LATENCY_ENABLE
+
+// The DWT registers, which the CMSIS core_cm4.h of this tree does not
+// define yet.
+#define DWT_CTRL            (*(volatile uint32_t *) 0xE0001000)
+#define DWT_CYCCNT          (*(volatile uint32_t *) 0xE0001004)
+#define DWT_CTRL_CYCCNTENA  (1UL << 0)
+
+// Cycle count of the last ETH receive interrupt. A frame gets the stamp of
+// the last interrupt before it was taken off the RX ring.
+static volatile uint32_t latency_irq_cycles;
+
+// Stamps of the message the PTP thread is handling.
+static uint32_t latency_current[LATENCY_STAGES];
+
+// Updated by the PTP thread, read and cleared by the shell.
+static struct latency_stats latency_stats[LATENCY_STAGES + 1];
+
+static const char *const latency_names[LATENCY_STAGES + 1] =
+{
+	"eth irq",
+	"dequeue",
+	"tcpip",
+	"udp input",
+	"callback",
+	"netRecv",
+	"handle",
+	"updateClock",
+	"total"
+};
+
+// Zero marks a stage the message did not pass, so stamps are odd.
+static __INLINE uint32_t latency_now(void)
+{
+	return DWT_CYCCNT | 1;
+}
+
+// Add a latency to the statistics of a stage.
+static void latency_record(int stage, uint32_t cycles)
+{
+	int bucket;
+	sys_prot_t lev;
+	struct latency_stats *stats = &latency_stats[stage];
+
+	bucket = cycles ? 31 - __CLZ(cycles) : 0;
+	if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+
+	lev = sys_arch_protect();
+	if ((stats->count == 0) || (cycles < stats->min)) stats->min = cycles;
+	if (cycles > stats->max) stats->max = cycles;
+	stats->sum += cycles;
+	stats->count++;
+	stats->histogram[bucket]++;
+	sys_arch_unprotect(lev);
+}
+
+// Record the time from the previous stage the current message passed.
+static void latency_close(int stage)
+{
+	int prev;
+
+	if (latency_current[stage] == 0) return;
+
+	for (prev = stage - 1; prev >= 0; --prev)
+	{
+		if (latency_current[prev] == 0) continue;
+		latency_record(stage, latency_current[stage] - latency_current[prev]);
+		break;
+	}
+
+	if ((stage == LATENCY_CLOCK) && latency_current[LATENCY_ETH_IRQ])
+	{
+		latency_record(LATENCY_TOTAL, latency_current[stage] - latency_current[LATENCY_ETH_IRQ]);
+	}
+}
+
+// Start the DWT cycle counter.
+void latency_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+// Called from the ETH interrupt when a frame was received.
+void latency_irq(void)
+{
+	latency_irq_cycles = latency_now();
+}
+
+// Start the stamps of a frame taken off the RX ring. pbuf_alloc() cleared
+// the others.
+void latency_frame(uint32_t *stamps)
+{
+	stamps[LATENCY_ETH_IRQ] = latency_irq_cycles;
+	stamps[LATENCY_DEQUEUE] = latency_now();
+}
+
+// Stamp a frame on its way through the stack.
+void latency_stamp(uint32_t *stamps, int stage)
+{
+	stamps[stage] = latency_now();
+}
+
+// The PTP thread received the message with the stamps. It becomes the
+// current message and the stages it passed so far are recorded.
+void latency_recv(const uint32_t *stamps)
+{
+	int stage;
+
+	memcpy(latency_current, stamps, LATENCY_PBUF_STAMPS * sizeof(uint32_t));
+	memset(&latency_current[LATENCY_PBUF_STAMPS], 0, (LATENCY_STAGES - LATENCY_PBUF_STAMPS) * sizeof(uint32_t));
+	latency_current[LATENCY_RECV] = latency_now();
+
+	for (stage = LATENCY_DEQUEUE; stage <= LATENCY_RECV; ++stage) latency_close(stage);
+}
+
+// The current message reached a later stage in the PTP thread.
+void latency_mark(int stage)
+{
+	if (latency_current[LATENCY_RECV] == 0) return;
+
+	latency_current[stage] = latency_now();
+	latency_close(stage);
+}
+
+// Clear the statistics.
+void latency_reset(void)
+{
+	sys_prot_t lev;
+
+	lev = sys_arch_protect();
+	memset(latency_stats, 0, sizeof(latency_stats));
+	sys_arch_unprotect(lev);
+}
+
+// Copy the statistics of a stage, or of LATENCY_TOTAL.
+void latency_read(int stage, struct latency_stats *stats)
+{
+	sys_prot_t lev;
+
+	lev = sys_arch_protect();
+	*stats = latency_stats[stage];
+	sys_arch_unprotect(lev);
+}
+
+const char *latency_name(int stage)
+{
+	return latency_names[stage];
+}
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "log.h"
+
+// The console USART (USART6) transmit requests are served by DMA2 stream 6
+// channel 5. The transfer complete interrupt has the lowest priority.
+#define LOG_DMA_STREAM    DMA2_Stream6
+#define LOG_DMA_CHANNEL   DMA_Channel_5
+#define LOG_DMA_CLK       RCC_AHB1Periph_DMA2
+#define LOG_DMA_IRQ       DMA2_Stream6_IRQn
+#define LOG_DMA_IT_TC     DMA_IT_TCIF6
+#define LOG_DMA_FLAGS     (DMA_FLAG_TCIF6 | DMA_FLAG_HTIF6 | DMA_FLAG_TEIF6 | DMA_FLAG_DMEIF6 | DMA_FLAG_FEIF6)
+#define LOG_DMA_PRIO      15
+
+// Size of the message ring, a power of two.
+#define LOG_RING_SIZE     4096
+#define LOG_RING_MASK     (LOG_RING_SIZE - 1)
+
+// Size of the DMA buffer. Always holds a message with each LF expanded to
+// CRLF, several short messages are sent in one transfer.
+#define LOG_DMA_SIZE      (4 * LOG_LINE_SIZE)
+
+// Each message in the ring starts with a header word holding the length
+// of the payload that follows and these flags.
+#define LOG_READY         0x80000000UL    // message is complete
+#define LOG_PAD           0x40000000UL    // unused space at the end of the ring
+#define LOG_DEFERRED      0x20000000UL    // payload is a format and arguments
+#define LOG_LEN_MASK      0x0000ffffUL
+
+#define LOG_ALIGN(len)    (((len) + 3) & ~3UL)
+
+volatile int log_level = LOG_INFO;
+
+// Producers reserve space at the head with LDREX/STREX, the DMA interrupt
+// consumes complete messages at the tail and zeroes the space it frees.
+static uint32_t log_ring[LOG_RING_SIZE / 4];
+static volatile uint32_t log_head = 0;
+static volatile uint32_t log_tail = 0;
+static volatile uint32_t log_drops = 0;
+static volatile bool log_busy = false;
+static char log_dma_buf[LOG_DMA_SIZE];
+
+// Count a message that did not fit into the ring.
+static void log_drop(void)
+{
+	uint32_t drops;
+
+	do
+	{
+		drops = __LDREXW(&log_drops);
+	} while (__STREXW(drops + 1, &log_drops) != 0);
+}
+
+// Reserve contiguous space for a message with a payload of the given length.
+// Returns a pointer to the header word or NULL if the ring is full.
+static uint32_t *log_reserve(uint32_t len)
+{
+	uint32_t head;
+	uint32_t offset;
+	uint32_t pad;
+	uint32_t size = 4 + LOG_ALIGN(len);
+
+	do
+	{
+		head = __LDREXW(&log_head);
+		offset = head & LOG_RING_MASK;
+
+		// Messages do not wrap, skip the end of the ring if it is too short.
+		pad = (offset + size > LOG_RING_SIZE) ? LOG_RING_SIZE - offset : 0;
+		if (head + pad + size - log_tail > LOG_RING_SIZE)
+		{
+			__CLREX();
+			log_drop();
+			return NULL;
+		}
+	} while (__STREXW(head + pad + size, &log_head) != 0);
+
+	if (pad)
+	{
+		log_ring[offset / 4] = LOG_READY | LOG_PAD | pad;
+		offset = 0;
+	}
+
+	return &log_ring[offset / 4];
+}
+
+// Mark a reserved message as complete and start sending it if the DMA is idle.
+static void log_commit(uint32_t *header, uint32_t flags)
+{
+	__DMB();
+	*header = LOG_READY | flags;
+	if (!log_busy) NVIC_SetPendingIRQ(LOG_DMA_IRQ);
+}
+
+// Expand each LF to CRLF in place. The buffer must have room for the
+// expanded string. Returns the new length.
+static int log_crlf(char *str, int len)
+{
+	int i;
+	int lf = 0;
+	int total;
+
+	for (i = 0; i < len; ++i)
+	{
+		if (str[i] == '\n') ++lf;
+	}
+	total = len + lf;
+
+	// Move the characters up from the end.
+	for (i = len - 1; lf > 0; --i)
+	{
+		str[i + lf] = str[i];
+		if (str[i] == '\n') str[i + --lf] = '\r';
+	}
+
+	return total;
+}
+
+// Copy the complete messages at the tail of the ring into the DMA buffer,
+// formatting deferred messages on the way, and start the transfer.
+static void log_dma_start(void)
+{
+	int n = 0;
+	int len;
+	uint32_t size;
+	uint32_t header;
+	uint32_t *msg;
+
+	while (log_tail != log_head)
+	{
+		msg = &log_ring[(log_tail & LOG_RING_MASK) / 4];
+		header = msg[0];
+
+		// Stop at a message that is still being written.
+		if (!(header & LOG_READY)) break;
+
+		len = header & LOG_LEN_MASK;
+		if (header & LOG_PAD)
+		{
+			size = len;
+		}
+		else if (header & LOG_DEFERRED)
+		{
+			if (n + 2 * LOG_LINE_SIZE > LOG_DMA_SIZE) break;
+			len = snprintf(&log_dma_buf[n], LOG_LINE_SIZE, (const char *) msg[1], msg[2], msg[3], msg[4], msg[5]);
+			if (len < 0) len = 0;
+			if (len >= LOG_LINE_SIZE) len = LOG_LINE_SIZE - 1;
+			n += log_crlf(&log_dma_buf[n], len);
+			size = 4 + LOG_ALIGN(header & LOG_LEN_MASK);
+		}
+		else
+		{
+			if (n + 2 * len > LOG_DMA_SIZE) break;
+			memcpy(&log_dma_buf[n], &msg[1], len);
+			n += log_crlf(&log_dma_buf[n], len);
+			size = 4 + LOG_ALIGN(len);
+		}
+
+		// Free the space, producers expect it zeroed.
+		memset(msg, 0, size);
+		__DMB();
+		log_tail += size;
+	}
+
+	if (n > 0)
+	{
+		log_busy = true;
+		LOG_DMA_STREAM->M0AR = (uint32_t) log_dma_buf;
+		DMA_SetCurrDataCounter(LOG_DMA_STREAM, n);
+		DMA_ClearFlag(LOG_DMA_STREAM, LOG_DMA_FLAGS);
+		DMA_Cmd(LOG_DMA_STREAM, ENABLE);
+	}
+}
+
+// Set up the USART TX DMA. Messages logged before this are kept in the ring.
+void log_init(void)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+
+	RCC_AHB1PeriphClockCmd(LOG_DMA_CLK, ENABLE);
+
+	DMA_DeInit(LOG_DMA_STREAM);
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_Channel = LOG_DMA_CHANNEL;
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &EVAL_COM1->DR;
+	DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t) log_dma_buf;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+	DMA_Init(LOG_DMA_STREAM, &DMA_InitStructure);
+	DMA_ITConfig(LOG_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+	USART_DMACmd(EVAL_COM1, USART_DMAReq_Tx, ENABLE);
+
+	NVIC_SetPriority(LOG_DMA_IRQ, LOG_DMA_PRIO);
+	NVIC_SetPendingIRQ(LOG_DMA_IRQ);
+	NVIC_EnableIRQ(LOG_DMA_IRQ);
+}
+
+// Queue a string for output. Never blocks, the string is dropped if the
+// ring is full. Safe to call from threads and interrupts.
+void log_write(const char *str, int len)
+{
+	int chunk;
+	uint32_t *msg;
+
+	while (len > 0)
+	{
+		chunk = (len > LOG_LINE_SIZE) ? LOG_LINE_SIZE : len;
+		msg = log_reserve(chunk);
+		if (msg == NULL) return;
+		memcpy(&msg[1], str, chunk);
+		log_commit(msg, chunk);
+		str += chunk;
+		len -= chunk;
+	}
+}
+
+// Format and queue a message if its level is enabled.
+void log_printf(int level, const char *fmt, ...)
+{
+	int len;
+	va_list ap;
+	char buf[LOG_LINE_SIZE];
+
+	if (!log_enabled(level)) return;
+
+	va_start(ap, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (len < 0) return;
+	if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+	log_write(buf, len);
+}
+
+// Queue a message that is formatted later by the DMA interrupt. Only the
+// format pointer and up to LOG_DEFERRED_ARGS 32-bit arguments are stored,
+// so the format and any %s strings must stay valid, and the arguments must
+// be integers or pointers.
+void log_deferred(int level, const char *fmt, int argc, ...)
+{
+	int i;
+	va_list ap;
+	uint32_t *msg;
+
+	if (!log_enabled(level)) return;
+
+	msg = log_reserve(4 * (1 + LOG_DEFERRED_ARGS));
+	if (msg == NULL) return;
+
+	msg[1] = (uint32_t) fmt;
+	va_start(ap, argc);
+	for (i = 0; i < LOG_DEFERRED_ARGS; ++i)
+	{
+		msg[2 + i] = (i < argc) ? va_arg(ap, uint32_t) : 0;
+	}
+	va_end(ap);
+
+	log_commit(msg, LOG_DEFERRED | (4 * (1 + LOG_DEFERRED_ARGS)));
+}
+
+// Number of messages dropped because the ring was full.
+uint32_t log_dropped(void)
+{
+	return log_drops;
+}
+
+// Called from the DMA stream interrupt, which is also pended by the
+// producers to start a transfer.
+void log_dma_irq(void)
+{
+	if (DMA_GetITStatus(LOG_DMA_STREAM, LOG_DMA_IT_TC) != RESET)
+	{
+		DMA_ClearITPendingBit(LOG_DMA_STREAM, LOG_DMA_IT_TC);
+		log_busy = false;
+	}
+
+	if (!log_busy) log_dma_start();
+}
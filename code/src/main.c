@@ -44,9 +44,13 @@
 #include "stm32f4x7_eth.h"
 #include "netconf.h"
 #include "main.h"
+#include "config.h"
 #include "tcpip.h"
 #include "telnet.h"
 #include "ptpd.h"
+#include "latency.h"
+#include "log.h"
+#include "trace.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -89,6 +93,12 @@ int main(void)
 	/* Initialize LCD and Leds */
   LCD_LED_Init();
   
+  /* Start the cycle counter of the latency statistics */
+  latency_init();
+
+  /* Read the stored configuration */
+  config_init();
+
   /* Configure ethernet (GPIOs, clocks, MAC, DMA) */ 
   ETH_BSP_Config();
     
@@ -101,6 +111,9 @@ int main(void)
   /* Initialize telnet shell server. */
   telnet_shell_init();
 
+  /* Initialize the trace stream server. */
+  trace_init();
+
 #ifdef USE_DHCP
   /* Start DHCP Client */
 	sys_thread_new("DHCP", LwIP_DHCP_task, NULL, DEFAULT_THREAD_STACKSIZE, DHCP_TASK_PRIO);
@@ -135,6 +148,9 @@ void UART_Init(void)
   USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
   STM_EVAL_COMInit(COM1, &USART_InitStructure);
 
+  // Send the log output through the USART TX DMA.
+  log_init();
+
   // Output a message using printf function.
   printf("\nUSART Initialized\n");
 }
@@ -169,21 +185,77 @@ void LCD_LED_Init(void)
 #endif
 }
 
+/* Lines of printf output not yet queued to the log, one for each thread
+   printing at the same time. A line belongs to the thread whose id is
+   set, and is free again once queued. */
+#define FPUTC_LINES     4
+
+struct fputc_line
+{
+  volatile uint32_t thread;
+  int len;
+  char buf[LOG_LINE_SIZE];
+};
+
+static struct fputc_line fputc_lines[FPUTC_LINES];
+
+/* The line of the thread, claiming a free one if it has none. Returns
+   NULL if all are taken. */
+static struct fputc_line *fputc_find(uint32_t thread)
+{
+  int i;
+
+  for (i = 0; i < FPUTC_LINES; ++i)
+  {
+    if (fputc_lines[i].thread == thread) return &fputc_lines[i];
+  }
+
+  for (i = 0; i < FPUTC_LINES; ++i)
+  {
+    if (__LDREXW(&fputc_lines[i].thread) != 0)
+    {
+      __CLREX();
+      continue;
+    }
+    if (__STREXW(thread, &fputc_lines[i].thread) == 0)
+    {
+      fputc_lines[i].len = 0;
+      return &fputc_lines[i];
+    }
+  }
+
+  return NULL;
+}
+
 /**
-  * @brief  Retargets the C library printf function to the USART.
+  * @brief  Retargets the C library printf function to the log output.
+  *         The characters of each thread are collected up to the end of
+  *         the line and queued as one log message without blocking. The
+  *         log output sends a CRLF for each LF.
   * @param  None
   * @retval None
   */
 int fputc(int ch, FILE *f)
 {
-	/* Send a CRLF for each LF. */
-	if (ch == '\n') fputc('\r', f);
+  char c = (char) ch;
+  uint32_t thread = (uint32_t) osThreadGetId();
+  struct fputc_line *line = thread ? fputc_find(thread) : NULL;
 
-	/* Send the character. */
-  USART_SendData(EVAL_COM1, (uint8_t) ch);
+  /* Without a line of its own, the character goes out alone. */
+  if (line == NULL)
+  {
+    log_write(&c, 1);
+    return ch;
+  }
 
-  /* Loop until the end of transmission. */
-  while (USART_GetFlagStatus(EVAL_COM1, USART_FLAG_TC) == RESET);
+  line->buf[line->len++] = c;
+  if ((c == '\n') || (line->len == sizeof(line->buf)))
+  {
+    log_write(line->buf, line->len);
+    line->len = 0;
+    __DMB();
+    line->thread = 0;
+  }
 
   return ch;
 }
@@ -116,7 +116,9 @@ void LwIP_Init(void)
   or fill them with sane numbers otherwise. The state pointer may be NULL.
 
   The init function pointer must point to a initialization function for
-  your ethernet netif interface. The following code illustrates it's use.*/
+  your ethernet netif interface. The following code illustrates it's use.
+  The tcpip thread is already running, so this holds the lwIP core lock.*/
+  LOCK_TCPIP_CORE();
   netif_add(&xnetif, &ipaddr, &netmask, &gw, NULL, &ethernetif_init, &tcpip_input);
 
  /*  Registers the default network interface. */
@@ -124,6 +126,7 @@ void LwIP_Init(void)
 
  /*  When the netif is fully configured this function must be called.*/
   netif_set_up(&xnetif); 
+  UNLOCK_TCPIP_CORE();
 }
 
 #ifdef USE_DHCP
@@ -149,7 +152,10 @@ void LwIP_DHCP_task(void * pvParameters)
     {
       case DHCP_START:
       {
+        /* Raw API calls from this thread hold the lwIP core lock */
+        LOCK_TCPIP_CORE();
         dhcp_start(&xnetif);
+        UNLOCK_TCPIP_CORE();
         IPaddress = 0;
         DHCP_state = DHCP_WAIT_ADDRESS;
 #ifdef USE_LCD
@@ -169,7 +175,9 @@ void LwIP_DHCP_task(void * pvParameters)
           DHCP_state = DHCP_ADDRESS_ASSIGNED;	
           
           /* Stop DHCP */
+          LOCK_TCPIP_CORE();
           dhcp_stop(&xnetif);
+          UNLOCK_TCPIP_CORE();
 
 #ifdef USE_LCD      
           iptab[0] = (uint8_t)(IPaddress >> 24);
@@ -193,14 +201,16 @@ void LwIP_DHCP_task(void * pvParameters)
           if (xnetif.dhcp->tries > MAX_DHCP_TRIES) {
             DHCP_state = DHCP_TIMEOUT;
 
-            /* Stop DHCP */
-            dhcp_stop(&xnetif);
-
             /* Static address used */
             IP4_ADDR(&ipaddr, IP_ADDR0 ,IP_ADDR1 , IP_ADDR2 , IP_ADDR3 );
             IP4_ADDR(&netmask, NETMASK_ADDR0, NETMASK_ADDR1, NETMASK_ADDR2, NETMASK_ADDR3);
             IP4_ADDR(&gw, GW_ADDR0, GW_ADDR1, GW_ADDR2, GW_ADDR3);
+
+            /* Stop DHCP */
+            LOCK_TCPIP_CORE();
+            dhcp_stop(&xnetif);
             netif_set_addr(&xnetif, &ipaddr , &netmask, &gw);
+            UNLOCK_TCPIP_CORE();
 
 #ifdef USE_LCD   
             LCD_DisplayStringLine(Line7, (uint8_t*)"    DHCP timeout    ");
@@ -4,8 +4,24 @@
 #include <time.h>
 #include "cmsis_os.h"
 #include "ptpd.h"
+#include "bench.h"
+#include "config.h"
+#include "latency.h"
+#include "log.h"
 #include "shell.h"
 #include "telnet.h"
+#include "tick.h"
+#include "usage.h"
+#include "lwip/sys.h"
+#include "lwip/stats.h"
+
+// Milliseconds between watch lines at least, and the room a line needs in
+// the output of the session.
+#define SHELL_WATCH_MSECS     250
+#define SHELL_WATCH_ROOM      128
+
+// Exact sleeps timed by TICK SLEEP.
+#define SHELL_TICK_SLEEPS     100
 
 typedef bool (*shell_func)(int argc, char **argv);
 
@@ -15,20 +31,165 @@ struct shell_command
 	shell_func funcptr;
 };
 
+static bool shell_bench(int argc, char **argv);
+static bool shell_config(int argc, char **argv);
 static bool shell_exit(int argc, char **argv);
 static bool shell_help(int argc, char **argv);
 static bool shell_date(int argc, char **argv);
+static bool shell_latency(int argc, char **argv);
+static bool shell_log(int argc, char **argv);
+static bool shell_memory(int argc, char **argv);
 static bool shell_ptpd(int argc, char **argv);
+static bool shell_stacks(int argc, char **argv);
+static bool shell_stress(int argc, char **argv);
+static bool shell_switch(int argc, char **argv);
+static bool shell_telemetry(int argc, char **argv);
+static bool shell_tick(int argc, char **argv);
+static bool shell_watch(int argc, char **argv);
 
 // Must be sorted in ascending order.
 const struct shell_command commands[] = 
 {
+	{"BENCH", shell_bench},
+	{"CONFIG", shell_config},
 	{"DATE", shell_date},
 	{"EXIT", shell_exit},
 	{"HELP", shell_help},
+	{"LATENCY", shell_latency},
+	{"LOG", shell_log},
+	{"MEMORY", shell_memory},
 	{"PTPD", shell_ptpd},
+	{"STACKS", shell_stacks},
+	{"STRESS", shell_stress},
+	{"SWITCH", shell_switch},
+	{"TELEMETRY", shell_telemetry},
+	{"TICK", shell_tick},
+	{"WATCH", shell_watch},
 };
 
+static bool shell_bench(int argc, char **argv)
+{
+	struct bench_memp_result result;
+	struct bench_send_result send;
+
+	// Time the memory pools and the protection they use.
+	bench_memp(&result);
+
+	telnet_printf("memp alloc/free: %u cycles\n", result.memp);
+	telnet_printf("protect/unprotect: %u cycles\n", result.protect);
+	telnet_printf("mutex wait/release: %u cycles\n", result.mutex);
+
+	// The same pool operations under both protections.
+	telnet_printf("pool get/put with protect: %u cycles\n", result.pool_protect);
+	telnet_printf("pool get/put with mutex: %u cycles\n", result.pool_mutex);
+
+	// Time sending a datagram through the tcpip thread and under the core lock.
+	if (!bench_send(&send)) telnet_printf("udp send pcb or socket not opened\n");
+	telnet_printf("udp send via tcpip thread: %u cycles\n", send.mbox);
+	if (send.locked) telnet_printf("udp send under core lock: %u cycles\n", send.locked);
+	telnet_printf("socket sendto: %u cycles\n", send.socket);
+
+	return true;
+}
+
+// Print an option with its value.
+static void shell_config_option(int index)
+{
+	int32_t value;
+	bool stored;
+	const struct ptpd_option *option = ptpd_option(index);
+
+	stored = ptpd_option_get(index, &value);
+	telnet_printf("%-18s %8d  %s%s\n", option->name, value,
+					stored ? "stored" : "default", option->restart ? ", restarts port" : "");
+}
+
+static bool shell_config(int argc, char **argv)
+{
+	int i;
+	int n;
+	bool ok;
+	char *end;
+	int32_t value;
+	const struct ptpd_option *option;
+	struct config_stats stats;
+
+	// State of the flash store.
+	if ((argc > 1) && !strcasecmp(argv[1], "STATS"))
+	{
+		config_read_stats(&stats);
+		if (stats.sector < 0)
+		{
+			telnet_printf("sector: none\n");
+		}
+		else
+		{
+			telnet_printf("sector: %d, generation %u\n", stats.sector, stats.generation);
+		}
+		telnet_printf("used: %u of %u bytes\n", stats.used, stats.size);
+		telnet_printf("boot: %u records read\n", stats.scanned);
+		telnet_printf("since boot: %u records written, %u erases, %u errors\n",
+						stats.writes, stats.erases, stats.errors);
+		return true;
+	}
+
+	// Return all options to their defaults.
+	if ((argc > 1) && !strcasecmp(argv[1], "RESET"))
+	{
+		if (ptpd_options_reset())
+			telnet_printf("options reset to defaults\n");
+		else
+			telnet_printf("cannot reset options\n");
+		return true;
+	}
+
+	// List all options.
+	if (argc < 2)
+	{
+		for (i = 0; i < ptpd_option_count(); ++i) shell_config_option(i);
+		return true;
+	}
+
+	i = ptpd_option_find(argv[1]);
+	if (i < 0)
+	{
+		telnet_printf("usage: config [stats | reset | option [value | default]]\n");
+		return true;
+	}
+	option = ptpd_option(i);
+
+	// Store and apply a value, or return to the default.
+	if (argc > 2)
+	{
+		if (!strcasecmp(argv[2], "DEFAULT"))
+		{
+			ok = ptpd_option_default(i);
+		}
+		else
+		{
+			value = strtol(argv[2], &end, 0);
+			if ((*end != 0) || !ptpd_option_valid(option, value))
+			{
+				if (option->values)
+				{
+					telnet_printf("%s: one of", option->name);
+					for (n = 0; n < option->count; ++n) telnet_printf(" %d", option->values[n]);
+					telnet_printf("\n");
+				}
+				else
+					telnet_printf("%s: %d to %d\n", option->name, option->min, option->max);
+				return true;
+			}
+			ok = ptpd_option_set(i, value);
+		}
+		if (!ok) telnet_printf("cannot store %s\n", option->name);
+	}
+
+	shell_config_option(i);
+
+	return true;
+}
+
 static bool shell_exit(int argc, char **argv)
 {
 	// Exit the shell interpreter.
@@ -69,14 +230,174 @@ static bool shell_date(int argc, char **argv)
 	return true;
 }
 
+static bool shell_latency(int argc, char **argv)
+{
+#if LATENCY_ENABLE
+	int stage;
+	int bucket;
+	struct latency_stats stats;
+
+	// Clear the statistics.
+	if ((argc > 1) && !strcasecmp(argv[1], "RESET"))
+	{
+		latency_reset();
+		telnet_printf("latency statistics cleared\n");
+		return true;
+	}
+
+	// Cycles from the previous stage of each received message.
+	telnet_printf("cycles at %u MHz\n", SystemCoreClock / 1000000);
+	telnet_printf("%-12s %8s %8s %8s %8s\n", "stage", "count", "min", "avg", "max");
+	for (stage = LATENCY_DEQUEUE; stage <= LATENCY_TOTAL; ++stage)
+	{
+		latency_read(stage, &stats);
+		telnet_printf("%-12s %8u %8u %8u %8u\n", latency_name(stage), stats.count, stats.min,
+						stats.count ? (uint32_t) (stats.sum / stats.count) : 0, stats.max);
+	}
+
+	// Log2 histograms, the count of each non-empty 2^n cycles bucket.
+	for (stage = LATENCY_DEQUEUE; stage <= LATENCY_TOTAL; ++stage)
+	{
+		latency_read(stage, &stats);
+		if (stats.count == 0) continue;
+
+		telnet_printf("%s:", latency_name(stage));
+		for (bucket = 0; bucket < LATENCY_BUCKETS; ++bucket)
+		{
+			if (stats.histogram[bucket]) telnet_printf(" 2^%d:%u", bucket, stats.histogram[bucket]);
+		}
+		telnet_printf("\n");
+	}
+#else
+	telnet_printf("latency statistics not compiled in\n");
+#endif
+
+	return true;
+}
+
+static bool shell_log(int argc, char **argv)
+{
+	// The log level may be given.
+	if (argc > 1) log_level = atoi(argv[1]);
+
+	telnet_printf("log level: %d\n", log_level);
+	telnet_printf("dropped: %u\n", log_dropped());
+
+	return true;
+}
+
+static void shell_memory_pool(const char *name, os_mem_stat_t *stat)
+{
+	telnet_printf("%-8s %8u %8u %8u %8u\n", name, stat->size, stat->used, stat->peak, stat->largest);
+}
+
+static void shell_memory_pbufs(const char *name, pbuf_small_pool pool)
+{
+	struct pbuf_small_stats stats;
+
+	pbuf_small_stats(pool, &stats);
+	telnet_printf("%-8s %8u %8u %8u %8u\n", name, stats.num, stats.used, stats.peak, stats.fails);
+}
+
+// Names of the memp pools, in the order of their types.
+static const char * const shell_memp_names[] =
+{
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/memp_std.h"
+};
+
+static bool shell_memory(int argc, char **argv)
+{
+	int i;
+	os_mem_stat_t stat;
+	os_queue_stat_t queues;
+	os_isr_stat_t channel;
+	extern uint64_t os_stack_mem[];
+
+	// Bytes of the dynamic memory pools, with block headers.
+#ifdef __MEM_TLSF
+	telnet_printf("allocator: tlsf\n");
+#else
+	telnet_printf("allocator: first fit\n");
+#endif
+	telnet_printf("%-8s %8s %8s %8s %8s\n", "pool", "size", "used", "peak", "largest");
+#if MEM_LIBC_MALLOC
+	sys_mem_stat(&stat);
+	shell_memory_pool("lwip", &stat);
+#endif
+
+	// The kernel allocates thread stacks in a service call.
+	os_suspend();
+	os_mem_stat(os_stack_mem, &stat);
+	os_resume(0);
+	shell_memory_pool("stacks", &stat);
+
+	// Pbufs of the small frame pools.
+	telnet_printf("%-8s %8s %8s %8s %8s\n", "pbufs", "num", "used", "peak", "fails");
+	shell_memory_pbufs("rx small", PBUF_SMALL_RX);
+	shell_memory_pbufs("tx small", PBUF_SMALL_TX);
+#if MEM_STATS
+	telnet_printf("lwip heap fails: %u\n", lwip_stats.mem.err);
+#endif
+
+	// Counts of the lwIP memp pools, the pbuf pool among them.
+#if MEMP_STATS
+	telnet_printf("%-16s %8s %8s %8s %8s\n", "memp", "num", "used", "peak", "fails");
+	for (i = 0; i < MEMP_MAX; ++i)
+	{
+		telnet_printf("%-16s %8u %8u %8u %8u\n", shell_memp_names[i], lwip_stats.memp[i].avail,
+						lwip_stats.memp[i].used, lwip_stats.memp[i].max, lwip_stats.memp[i].err);
+	}
+#endif
+
+	// Requests of interrupts waiting for the kernel, and timer callbacks
+	// waiting for the timer thread. A full ISR FIFO stops the kernel.
+	os_queue_stat(&queues);
+	telnet_printf("%-8s %8s %8s %8s\n", "queue", "size", "peak", "drops");
+	telnet_printf("%-8s %8u %8u %8s\n", "isr fifo", queues.fifo_size, queues.fifo_peak, "-");
+	telnet_printf("%-8s %8u %8u %8u\n", "timer", queues.timer_size, queues.timer_peak, queues.timer_drops);
+
+	// Posts of the ISR channels, those made before the thread was woken
+	// by an earlier one are coalesced.
+	telnet_printf("%-8s %8s %8s %8s\n", "channel", "posts", "wakeups", "merged");
+	for (i = 0; i < OS_ISR_CHANNELS; ++i)
+	{
+		os_isr_stat(i, &channel);
+		if (channel.posts == 0) continue;
+		telnet_printf("%-8d %8u %8u %8u\n", i, channel.posts, channel.wakeups, channel.coalesced);
+	}
+
+	return true;
+}
+
+// Name of a port state.
+static const char *shell_port_state(uint8_t state)
+{
+	switch (state)
+	{
+		case PTP_INITIALIZING:  return "init";
+		case PTP_FAULTY:        return "faulty";
+		case PTP_LISTENING:     return "listening";
+		case PTP_PASSIVE:       return "passive";
+		case PTP_UNCALIBRATED:  return "uncalibrated";
+		case PTP_SLAVE:         return "slave";
+		case PTP_PRE_MASTER:    return "pre master";
+		case PTP_MASTER:        return "master";
+		case PTP_DISABLED:      return "disabled";
+		default:                return "?";
+	}
+}
+
 static bool shell_ptpd(int argc, char **argv)
 {
 	char sign;
-	const char *s;
 	unsigned char *uuid;
-	extern PtpClock ptpClock;
+	PtpSnapshot snapshot;
 
-	uuid = (unsigned char*) ptpClock.parentDS.parentPortIdentity.clockIdentity;
+	// A consistent copy of the state, published by the PTP thread.
+	snapshotRead(&snapshot);
+
+	uuid = (unsigned char*) snapshot.parentClockIdentity;
 
 	/* Master clock UUID */
 	telnet_printf("master id: %02x%02x%02x%02x%02x%02x%02x%02x\n",
@@ -85,33 +406,19 @@ static bool shell_ptpd(int argc, char **argv)
 					uuid[4], uuid[5],
 					uuid[6], uuid[7]);
 
-	switch (ptpClock.portDS.portState)
-	{
-		case PTP_INITIALIZING:  s = "init";  break;
-		case PTP_FAULTY:        s = "faulty";   break;
-		case PTP_LISTENING:     s = "listening";  break;
-		case PTP_PASSIVE:       s = "passive";  break;
-		case PTP_UNCALIBRATED:  s = "uncalibrated";  break;
-		case PTP_SLAVE:         s = "slave";   break;
-		case PTP_PRE_MASTER:    s = "pre master";  break;
-		case PTP_MASTER:        s = "master";   break;
-		case PTP_DISABLED:      s = "disabled";  break;
-		default:                s = "?";     break;
-	}
-
 	/* State of the PTP */
-	telnet_printf("state: %s\n", s);
+	telnet_printf("state: %s\n", shell_port_state(snapshot.portState));
 
 	/* One way delay */
-	switch (ptpClock.portDS.delayMechanism)
+	switch (snapshot.delayMechanism)
 	{
 		case E2E:
 			telnet_puts("mode: end to end\n");
-			telnet_printf("path delay: %d nsec\n", ptpClock.currentDS.meanPathDelay.nanoseconds);
+			telnet_printf("path delay: %d nsec\n", snapshot.meanPathDelay.nanoseconds);
 			break;
 		case P2P:
 			telnet_puts("mode: peer to peer\n");
-			telnet_printf("path delay: %d nsec\n", ptpClock.portDS.peerMeanPathDelay.nanoseconds);
+			telnet_printf("path delay: %d nsec\n", snapshot.meanPathDelay.nanoseconds);
 			break;
 		default:
 			telnet_puts("mode: unknown\n");
@@ -121,25 +428,272 @@ static bool shell_ptpd(int argc, char **argv)
 	}
 
 	/* Offset from master */
-	if (ptpClock.currentDS.offsetFromMaster.seconds)
+	if (snapshot.offsetFromMaster.seconds)
 	{
-		telnet_printf("offset: %d sec\n", ptpClock.currentDS.offsetFromMaster.seconds);
+		telnet_printf("offset: %d sec\n", snapshot.offsetFromMaster.seconds);
 	}
 	else
 	{
-		telnet_printf("offset: %d nsec\n", ptpClock.currentDS.offsetFromMaster.nanoseconds);
+		telnet_printf("offset: %d nsec\n", snapshot.offsetFromMaster.nanoseconds);
 	}
 
 	/* Observed drift from master */
 	sign = ' ';
-	if (ptpClock.observedDrift > 0) sign = '+';
-	if (ptpClock.observedDrift < 0) sign = '-';
+	if (snapshot.observedDrift > 0) sign = '+';
+	if (snapshot.observedDrift < 0) sign = '-';
 
-	telnet_printf("drift: %c%d.%03d ppm\n", sign, abs(ptpClock.observedDrift / 1000), abs(ptpClock.observedDrift % 1000));
+	telnet_printf("drift: %c%d.%03d ppm\n", sign, abs(snapshot.observedDrift / 1000), abs(snapshot.observedDrift % 1000));
 
 	return true;
 }
 
+static bool shell_stacks(int argc, char **argv)
+{
+	int id;
+	struct usage_stack stacks[USAGE_THREADS];
+
+	// Watermarks from the last scan of each stack by the idle thread.
+	usage_stacks(stacks);
+	telnet_printf("%3s %10s %8s %8s %8s\n", "id", "function", "size", "used", "free");
+	for (id = 0; id < USAGE_THREADS; ++id)
+	{
+		if (stacks[id].pthread == NULL) continue;
+		telnet_printf("%3d 0x%08x %8u %8u %8u\n", id, (uint32_t) stacks[id].pthread,
+						stacks[id].size, stacks[id].used, stacks[id].size - stacks[id].used);
+	}
+
+	return true;
+}
+
+static bool shell_stress(int argc, char **argv)
+{
+	bool ok;
+	uint32_t iterations = 10000;
+	struct bench_stress_result result;
+
+	// The number of allocations per thread may be given.
+	if (argc > 1) iterations = strtoul(argv[1], NULL, 0);
+
+	telnet_printf("stressing pbuf pool...\n");
+	telnet_flush();
+
+	ok = bench_pbuf_stress(iterations, &result);
+	if (!ok) telnet_printf("not all threads started\n");
+
+	telnet_printf("allocs: %u (%u failed)\n", result.allocs, result.alloc_failures);
+	telnet_printf("interrupts: %u\n", result.isr_calls);
+	telnet_printf("errors: %u thread, %u interrupt\n", result.errors, result.isr_errors);
+	telnet_printf("pool free: %u before, %u after\n", result.pool_before, result.pool_after);
+	telnet_printf("time: %u msec\n", result.msecs);
+
+	return true;
+}
+
+static bool shell_switch(int argc, char **argv)
+{
+	bool ok;
+	struct bench_switch_result result;
+
+	// Time context switches through the RTX ready list.
+	ok = bench_switch(&result);
+	if (!ok) telnet_printf("not all threads started\n");
+
+#ifdef __RDY_BITMAP
+	telnet_printf("ready list: bitmap\n");
+#else
+	telnet_printf("ready list: sorted\n");
+#endif
+	telnet_printf("wake: %u min, %u avg, %u max cycles\n", result.wake_min, result.wake_avg, result.wake_max);
+	telnet_printf("yield: %u cycles\n", result.yield);
+
+	return true;
+}
+
+static bool shell_telemetry(int argc, char **argv)
+{
+	struct in_addr addr;
+	TelemetryStats stats;
+
+	telemetryStats(&stats);
+
+	// Either OFF or the collector address, optionally followed by the
+	// port and the number of clock updates per sample.
+	if (argc > 1)
+	{
+		if (!strcasecmp(argv[1], "OFF"))
+		{
+			addr.s_addr = 0;
+		}
+		else if (!inet_aton(argv[1], &addr))
+		{
+			telnet_printf("usage: telemetry [off | address [port [decimation]]]\n");
+			return true;
+		}
+		if (argc > 2) stats.port = (uint16_t) strtoul(argv[2], NULL, 0);
+		if (argc > 3) stats.decimation = strtoul(argv[3], NULL, 0);
+		telemetryConfig(addr.s_addr, stats.port, stats.decimation);
+		telemetryStats(&stats);
+	}
+
+	if (stats.collector)
+	{
+		addr.s_addr = stats.collector;
+		telnet_printf("collector: %s:%u\n", inet_ntoa(addr), stats.port);
+	}
+	else
+	{
+		telnet_printf("collector: off\n");
+	}
+	telnet_printf("decimation: %u\n", stats.decimation);
+	telnet_printf("samples: %u\n", stats.samples);
+	telnet_printf("batches: %u sent\n", stats.batches);
+	telnet_printf("dropped: %u samples\n", stats.dropped);
+
+	return true;
+}
+
+static bool shell_tick(int argc, char **argv)
+{
+	int i;
+	int bucket;
+	char *end;
+	uint32_t usecs;
+	struct tick_stats stats;
+
+	// Turn the measurement on or off, clear the statistics, or sleep to
+	// exact times to measure their lateness.
+	if (argc > 1)
+	{
+		if (!strcasecmp(argv[1], "ON"))
+			tick_measure(true);
+		else if (!strcasecmp(argv[1], "OFF"))
+			tick_measure(false);
+		else if (!strcasecmp(argv[1], "RESET"))
+			tick_reset();
+		else if (!strcasecmp(argv[1], "SLEEP") && (argc > 2))
+		{
+			usecs = strtoul(argv[2], &end, 10);
+			if (*end != 0)
+			{
+				telnet_printf("usage: tick sleep usecs\n");
+				return true;
+			}
+			for (i = 0; i < SHELL_TICK_SLEEPS; ++i)
+			{
+				if (!tick_sleep_us(usecs))
+				{
+					telnet_printf("tick sleep: another thread is sleeping\n");
+					break;
+				}
+			}
+		}
+		else
+		{
+			telnet_printf("usage: tick [on | off | reset | sleep usecs]\n");
+			return true;
+		}
+	}
+
+	tick_read_stats(&stats);
+	telnet_printf("measurement: %s\n", stats.enabled ? "on" : "off");
+	telnet_printf("ticks: %u\n", stats.ticks);
+	telnet_printf("sleeps: %u, %u ticks asleep, %u woken early\n", stats.sleeps, stats.slept, stats.early);
+	telnet_printf("exact wakes: %u\n", stats.wakes);
+
+	// Lateness of the timed wake-ups past their compare time.
+	telnet_printf("late: %u wake-ups, %u min, %u avg, %u max cycles at %u MHz\n", stats.count, stats.min,
+					stats.count ? (uint32_t) (stats.sum / stats.count) : 0, stats.max, SystemCoreClock / 1000000);
+	if (stats.count)
+	{
+		telnet_printf("histogram:");
+		for (bucket = 0; bucket < TICK_BUCKETS; ++bucket)
+		{
+			if (stats.histogram[bucket]) telnet_printf(" 2^%d:%u", bucket, stats.histogram[bucket]);
+		}
+		telnet_printf("\n");
+	}
+
+	return true;
+}
+
+static bool shell_watch(int argc, char **argv)
+{
+	char *end;
+	uint32_t every = 1;
+	PtpSnapshot snapshot;
+	struct shell_watch *watch = telnet_watch();
+
+	if ((argc > 1) && !strcasecmp(argv[1], "OFF"))
+	{
+		shell_watch_stop(watch);
+		telnet_printf("watch: off\n");
+		return true;
+	}
+
+	// Optionally the number of clock updates per line.
+	if (argc > 1)
+	{
+		every = strtoul(argv[1], &end, 10);
+		if ((*end != 0) || (every == 0))
+		{
+			telnet_printf("usage: WATCH [updates|OFF]\n");
+			return true;
+		}
+	}
+
+	// Start from the current update, woken by the following ones.
+	snapshotRead(&snapshot);
+	watch->updates = snapshot.updates;
+	watch->msecs = sys_now();
+	watch->dropped = 0;
+	watch->every = every;
+	snapshotNotify(osThreadGetId(), TELNET_SIGNAL_WATCH);
+
+	telnet_printf("watch: every %u clock updates, WATCH OFF to stop\n", every);
+
+	return true;
+}
+
+// Print a line for the latest clock update if the watch is due. Called by
+// the telnet server for a watching session when the clock was updated.
+// Lines are at least SHELL_WATCH_MSECS apart, and dropped rather than
+// waited for when the client is slow, so the updates in between are lost.
+void shell_watch_update(struct shell_watch *watch)
+{
+	uint32_t now = sys_now();
+	PtpSnapshot snapshot;
+
+	snapshotRead(&snapshot);
+	if (snapshot.updates - watch->updates < watch->every) return;
+	if (now - watch->msecs < SHELL_WATCH_MSECS) return;
+	watch->updates = snapshot.updates;
+	watch->msecs = now;
+
+	if (telnet_room() < SHELL_WATCH_ROOM)
+	{
+		++watch->dropped;
+		return;
+	}
+
+	telnet_printf("%u %s offset ", snapshot.updates, shell_port_state(snapshot.portState));
+	if (snapshot.offsetFromMaster.seconds)
+		telnet_printf("%d sec", snapshot.offsetFromMaster.seconds);
+	else
+		telnet_printf("%d nsec", snapshot.offsetFromMaster.nanoseconds);
+	telnet_printf(" delay %d nsec drift %d ppb adj %d", snapshot.meanPathDelay.nanoseconds,
+					snapshot.observedDrift, snapshot.adj);
+	if (watch->dropped) telnet_printf(" dropped %u", watch->dropped);
+	telnet_putc('\n');
+}
+
+// Stop the watch of a session. The clock updates stop waking the telnet
+// server when no session watches any more.
+void shell_watch_stop(struct shell_watch *watch)
+{
+	watch->every = 0;
+	if (!telnet_watching()) snapshotNotify(NULL, 0);
+}
+
 // Parse out the next non-space word from a string.
 // str		Pointer to pointer to the string
 // word		Pointer to pointer of next word.
@@ -186,27 +740,28 @@ static bool shell_command(char *cmdline)
 	return rv;
 }
 
-// Runs the shell by printing the prompt and processing each shell command typed in.
-void shell_process() 
+// Greets a new session with the first prompt.
+void shell_start(void)
 {
-	char cmdbuf[64];
-
 	// Tell the user the shell is starting.
 	telnet_printf("Starting Shell...\n");
 
 	// Send a prompt.
 	telnet_puts("> ");
 	telnet_flush();
+}
 
-	// Get a string.
-  while (telnet_gets(cmdbuf, sizeof(cmdbuf), 0, true))
-  {
-		// Process the line as a command.
-		if (!shell_command(cmdbuf)) break;
+// Runs a command line typed in and prompts for the next one. Returns
+// false when the session should end.
+bool shell_line(char *cmdline)
+{
+	// Process the line as a command.
+	if (!shell_command(cmdline)) return false;
 
-		// Send a prompt.
-		telnet_puts("> ");
-		telnet_flush();
-	}
+	// Send a prompt.
+	telnet_puts("> ");
+	telnet_flush();
+
+	return true;
 }
 
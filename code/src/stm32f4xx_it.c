@@ -53,12 +53,16 @@
 
 /* lwIP includes */
 #include "lwip/sys.h"
+#include "ethernetif.h"
+
+#include "bench.h"
+#include "latency.h"
+#include "log.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-extern sys_sem_t s_xRxSemaphore;
 /* Private function prototypes -----------------------------------------------*/
 extern void xPortSysTickHandler(void); 
 /* Private functions ---------------------------------------------------------*/
@@ -147,8 +151,12 @@ void ETH_IRQHandler(void)
   /* Frame received */
   if (ETH_GetDMAFlagStatus(ETH_DMA_FLAG_R) == SET) 
   {
-    /* Give the semaphore to wakeup LwIP task */
-		sys_sem_signal(&s_xRxSemaphore);
+    /* Stamp the frame arrival for the latency statistics */
+    latency_irq();
+
+    /* Post the channel of the input thread, frames received before it */
+    /* runs wake it only once */
+    os_isr_post(ETHERNETIF_RX_CHANNEL);
   }
 	
   /* Clear the interrupt flags. */
@@ -163,6 +171,27 @@ void ETH_IRQHandler(void)
 /*  available peripheral interrupt handler's name please refer to the startup */
 /*  file (startup_stm32f4xx.s).                                               */
 /******************************************************************************/
+/**
+  * @brief  This function handles the software triggered EXTI line 1
+  *         interrupt, used as the simulated interrupt of the pbuf stress test.
+  * @param  None
+  * @retval None
+  */
+void EXTI1_IRQHandler(void)
+{
+  bench_pbuf_isr();
+}
+
+/**
+  * @brief  This function handles the log output USART TX DMA interrupt.
+  * @param  None
+  * @retval None
+  */
+void DMA2_Stream6_IRQHandler(void)
+{
+  log_dma_irq();
+}
+
 /**
   * @brief  This function handles PPP interrupt request.
   * @param  None
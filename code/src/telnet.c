@@ -4,16 +4,36 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "stm32f4xx.h"
+#include "cmsis_os.h"
 #include "lwip/opt.h"
 #include "lwip/arch.h"
-#include "lwip/api.h"
 #include "lwip/inet.h"
-#include "lwip/sockets.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
 #include "string.h"
 #include "shell.h"
+#include "log.h"
 #include "telnet.h"
 
 #define TELNET_THREAD_PRIO    ( osPriorityNormal )
+#define TELNET_PORT           23
+
+// Sessions served at once. One shell thread runs the commands of all of
+// them, so there is no thread per session.
+#define TELNET_SESSIONS       3
+
+// Input and output rings of a session, powers of two. The output of a
+// command must fit in the output ring and the TCP send buffer, as the
+// shell thread does not wait for a client to acknowledge it.
+#define TELNET_IN_SIZE        256
+#define TELNET_OUT_SIZE       2048
+#define TELNET_IN_MASK        (TELNET_IN_SIZE - 1)
+#define TELNET_OUT_MASK       (TELNET_OUT_SIZE - 1)
+
+// Signal of the shell thread besides TELNET_SIGNAL_WATCH, for a connect,
+// input or a close.
+#define TELNET_SIGNAL_EVENT   0x01
 
 // Telnet states
 #define STATE_NORMAL 0
@@ -66,8 +86,6 @@
 #define TERM_CONSOLE 1
 #define TERM_VT100   2
 
-#define TELNET_BUF_SIZE 512
-
 struct term
 {
   int type;
@@ -75,35 +93,47 @@ struct term
   int lines;
 };
 
-struct telbuf
-{
-  unsigned char data[TELNET_BUF_SIZE];
-  unsigned char *start;
-  unsigned char *end;
-};
-
+// The lwIP callbacks run in the tcpip thread and fill the input ring and
+// drain the output ring. The shell thread drains the input ring and fills
+// the output ring, so each ring index has a single writer. The callbacks
+// and the shell thread touch the pcb only while holding the core lock.
 struct termstate
 {
-  int sock;
+  struct tcp_pcb *pcb;                  // NULL once reset by the client
+  volatile bool used;                   // set on accept, cleared by the shell thread
+  volatile bool closed;                 // closed by the client or timed out
+  bool started;                         // greeting sent by the shell thread
+  struct shell_watch watch;
   int state;
   int code;
   unsigned char optdata[256];
   int optlen;
   struct term term;
-  struct telbuf bi;
-  struct telbuf bo;
+  char line[64];
+  int linelen;
+  unsigned char in[TELNET_IN_SIZE];
+  volatile uint32_t in_head;
+  volatile uint32_t in_tail;
+  unsigned char out[TELNET_OUT_SIZE];
+  volatile uint32_t out_head;
+  volatile uint32_t out_tail;
 };
 
-static struct termstate tstate;
-struct termstate *ts = &tstate;
+static struct termstate telnet_sessions[TELNET_SESSIONS];
+static struct tcp_pcb *telnet_listen_pcb;
+static osThreadId telnet_thread_id;
+
+// Session the shell thread is running a command for.
+static struct termstate *ts = NULL;
 
+// Send a telnet option. Called with the core lock held.
 static void telnet_sendopt(struct termstate *ts, int code, int option)
 {
   unsigned char buf[3];
   buf[0] = TELNET_IAC;
   buf[1] = (unsigned char) code;
   buf[2] = (unsigned char) option;
-  send(ts->sock, buf, 3, 0);
+  if (ts->pcb) tcp_write(ts->pcb, buf, 3, TCP_WRITE_FLAG_COPY);
 }
 
 static void telnet_parseopt(struct termstate *ts, int code, int option)
@@ -152,186 +182,324 @@ static void telnet_parseoptdat(struct termstate *ts, int option, unsigned char *
   }
 }
 
-static void telnet_process(struct termstate *ts)
+// Store a character typed by the client, dropping it if the ring is full.
+static void telnet_store(struct termstate *ts, unsigned char c)
 {
-  unsigned char *p = ts->bi.start;
-  unsigned char *q = p;
-  while (p < ts->bi.end)
-  {
-    int c = *p++;
-    switch (ts->state) 
-    {
-      case STATE_NORMAL:
-        if (c == TELNET_IAC)
-          ts->state = STATE_IAC;
-        else
-          *q++ = c;
-        break;
-      case STATE_IAC:
-        switch (c) 
-        {
-          case TELNET_IAC:
-            *q++ = c;
-            ts->state = STATE_NORMAL;
-            break;
-          case TELNET_WILL:
-          case TELNET_WONT:
-          case TELNET_DO:
-          case TELNET_DONT:
-            ts->code = c;
-            ts->state = STATE_OPT;
-            break;
-          case TELNET_SB:
-            ts->state = STATE_SB;
-            break;
-          default:
-            ts->state = STATE_NORMAL;
-        }
-        break;
-      case STATE_OPT:
-        telnet_parseopt(ts, ts->code, c);
-        ts->state = STATE_NORMAL;
-        break;
-      case STATE_SB:
-        ts->code = c;
-        ts->optlen = 0;
-        ts->state = STATE_OPTDAT;
-        break;
-      case STATE_OPTDAT:
-        if (c == TELNET_IAC)
-          ts->state = STATE_SE;
-        else if (ts->optlen < sizeof(ts->optdata))
-          ts->optdata[ts->optlen++] = c;
-        break;
-      case STATE_SE:
-        if (c == TELNET_SE)
-          telnet_parseoptdat(ts, ts->code, ts->optdata, ts->optlen);
-        ts->state = STATE_NORMAL;
-        break;
-    } 
-  }
-  ts->bi.end = q;
+	if (ts->in_head - ts->in_tail >= TELNET_IN_SIZE) return;
+	ts->in[ts->in_head & TELNET_IN_MASK] = c;
+	__DMB();
+	++ts->in_head;
 }
 
-static int telnet_write(char *str, int size, bool flush)
+// Run a received byte through the telnet protocol, storing the data.
+static void telnet_input(struct termstate *ts, int c)
 {
-  int i;
-	int n;
-	int len;
-  fd_set data_write;
-  struct timeval tv;
-  unsigned char *ptr = (unsigned char *) str;
-
-	n = 0;
-  do
+  switch (ts->state) 
   {
-    len = TELNET_BUF_SIZE - (int)(ts->bo.start - ts->bo.data);
-    if (size < len) len = size;
-    if (len >= 0)
-    {
-      memcpy(ts->bo.start, str, len);
-      size -= len;
-      ts->bo.start += len;
-      str += len;  
-    }
-    if (((int)(ts->bo.start - ts->bo.data) >= TELNET_BUF_SIZE) || flush)
-    {
-      len = n = 0;
-      ptr = ts->bo.data;
-      do
+    case STATE_NORMAL:
+      if (c == TELNET_IAC)
+        ts->state = STATE_IAC;
+      else
+        telnet_store(ts, c);
+      break;
+    case STATE_IAC:
+      switch (c) 
       {
-        FD_ZERO(&data_write);
-        FD_SET(ts->sock, &data_write);
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        i = select(FD_SETSIZE, NULL, &data_write, NULL, &tv);
-        if ((i > 0) && (FD_ISSET(ts->sock, &data_write) != 0))
-        {
-          n = send(ts->sock, ptr, (int) (ts->bo.start - ts->bo.data) - len, 0);
-          if (n >= 0)
-          {
-            ptr += n;
-            len += n;
-          }
-        }
+        case TELNET_IAC:
+          telnet_store(ts, c);
+          ts->state = STATE_NORMAL;
+          break;
+        case TELNET_WILL:
+        case TELNET_WONT:
+        case TELNET_DO:
+        case TELNET_DONT:
+          ts->code = c;
+          ts->state = STATE_OPT;
+          break;
+        case TELNET_SB:
+          ts->state = STATE_SB;
+          break;
+        default:
+          ts->state = STATE_NORMAL;
       }
-      while ((n >= 0) && (len < (int) (ts->bo.start - ts->bo.data)) && (i > 0));
-      ts->bo.start = ts->bo.data;
-    }
-  }
-  while (size > 0);
+      break;
+    case STATE_OPT:
+      telnet_parseopt(ts, ts->code, c);
+      ts->state = STATE_NORMAL;
+      break;
+    case STATE_SB:
+      ts->code = c;
+      ts->optlen = 0;
+      ts->state = STATE_OPTDAT;
+      break;
+    case STATE_OPTDAT:
+      if (c == TELNET_IAC)
+        ts->state = STATE_SE;
+      else if (ts->optlen < sizeof(ts->optdata))
+        ts->optdata[ts->optlen++] = c;
+      break;
+    case STATE_SE:
+      if (c == TELNET_SE)
+        telnet_parseoptdat(ts, ts->code, ts->optdata, ts->optlen);
+      ts->state = STATE_NORMAL;
+      break;
+  } 
+}
+
+// Hand the output ring to TCP as far as its send buffer allows. Called
+// with the core lock held, by the shell thread or the sent callback.
+static void telnet_push(struct termstate *ts)
+{
+	uint32_t len;
+	uint32_t tail = ts->out_tail;
+
+	if (ts->pcb == NULL) return;
+
+	while (tail != ts->out_head)
+	{
+		// Up to the end of the ring, the rest on the next pass.
+		len = ts->out_head - tail;
+		if (len > TELNET_OUT_SIZE - (tail & TELNET_OUT_MASK)) len = TELNET_OUT_SIZE - (tail & TELNET_OUT_MASK);
+		if (len > tcp_sndbuf(ts->pcb)) len = tcp_sndbuf(ts->pcb);
+		if (len == 0) break;
+
+		// Copied, so the ring space is free again at once.
+		if (tcp_write(ts->pcb, &ts->out[tail & TELNET_OUT_MASK], (u16_t) len, TCP_WRITE_FLAG_COPY) != ERR_OK) break;
+		tail += len;
+	}
+	ts->out_tail = tail;
+
+	tcp_output(ts->pcb);
+}
+
+static err_t telnet_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+	u16_t i;
+	struct pbuf *q;
+	struct termstate *ts = (struct termstate *) arg;
+
+	// The client closed its side.
+	if (p == NULL)
+	{
+		ts->closed = true;
+		osSignalSet(telnet_thread_id, TELNET_SIGNAL_EVENT);
+		return ERR_OK;
+	}
+
+	// Leave the data with lwIP, which offers it again later, until the
+	// shell thread has made room for it. An empty ring takes anything and
+	// drops what does not fit.
+	if ((ts->in_head != ts->in_tail) && (TELNET_IN_SIZE - (ts->in_head - ts->in_tail) < p->tot_len)) return ERR_MEM;
+
+	for (q = p; q != NULL; q = q->next)
+	{
+		for (i = 0; i < q->len; ++i) telnet_input(ts, ((unsigned char *) q->payload)[i]);
+	}
+	tcp_recved(pcb, p->tot_len);
+	pbuf_free(p);
+
+	// Replies to options go out with the acknowledgment.
+	tcp_output(pcb);
 
-  return n < 0 ? n : len;
+	osSignalSet(telnet_thread_id, TELNET_SIGNAL_EVENT);
+
+	return ERR_OK;
+}
+
+static err_t telnet_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+	struct termstate *ts = (struct termstate *) arg;
+
+	// The window opened, send more.
+	telnet_push(ts);
+
+	return ERR_OK;
 }
 
-static void telnet_shell(int s) 
+static void telnet_err(void *arg, err_t err)
 {
-  int off;
+	struct termstate *ts = (struct termstate *) arg;
+
+	// The pcb was already freed by lwIP.
+	ts->pcb = NULL;
+	ts->closed = true;
+	osSignalSet(telnet_thread_id, TELNET_SIGNAL_EVENT);
+}
 
-	// TCP_NODELAY is used to disable the Nagle buffering algorithm. It 
-	// should only be set for applications such as telnet that send frequent
-  // small bursts of information without getting an immediate response,
-  // where timely delivery of data is required.
-	off = 0; setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char *) &off, sizeof(off));
+static err_t telnet_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	int i;
+	struct termstate *ts = NULL;
+
+	tcp_accepted(telnet_listen_pcb);
+
+	// Find a free session, refusing the connection without one.
+	for (i = 0; (i < TELNET_SESSIONS) && (ts == NULL); ++i)
+	{
+		if (!telnet_sessions[i].used) ts = &telnet_sessions[i];
+	}
+	if (ts == NULL)
+	{
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
 
 	// Initialize terminal state.
 	memset(ts, 0, sizeof(struct termstate));
-	ts->sock = s;
+	ts->pcb = pcb;
 	ts->state = STATE_NORMAL;
 	ts->term.type = TERM_VT100;
 	ts->term.cols = 80;
 	ts->term.lines = 25;
+	ts->used = true;
+
+	tcp_arg(pcb, ts);
+	tcp_recv(pcb, telnet_recv);
+	tcp_sent(pcb, telnet_sent);
+	tcp_err(pcb, telnet_err);
+
+	// Disable the Nagle buffering algorithm. It should only be disabled for
+	// applications such as telnet that send frequent small bursts of
+	// information without getting an immediate response, where timely
+	// delivery of data is required.
+	tcp_nagle_disable(pcb);
 
 	// Send initial option that we'll echo on this side.
 	telnet_sendopt(ts, TELNET_WILL, TELOPT_ECHO);
+	tcp_output(pcb);
+
+	osSignalSet(telnet_thread_id, TELNET_SIGNAL_EVENT);
+
+	return ERR_OK;
+}
+
+// Close the connection of a session and free it.
+static void telnet_release(struct termstate *ts)
+{
+	// Stop the watch before the session can be accepted again.
+	if (ts->watch.every) shell_watch_stop(&ts->watch);
+
+	LOCK_TCPIP_CORE();
+	if (ts->pcb)
+	{
+		tcp_arg(ts->pcb, NULL);
+		tcp_recv(ts->pcb, NULL);
+		tcp_sent(ts->pcb, NULL);
+		tcp_err(ts->pcb, NULL);
+		if (tcp_close(ts->pcb) != ERR_OK) tcp_abort(ts->pcb);
+		ts->pcb = NULL;
+	}
+	ts->used = false;
+	UNLOCK_TCPIP_CORE();
+}
+
+// Edit the command line with a character typed by the client, running
+// it at the end of the line. Returns false when the shell ends the session.
+static bool telnet_edit(struct termstate *ts, int c)
+{
+	// End of line?
+	if (c == '\r')
+	{
+		ts->line[ts->linelen] = 0;
+		ts->linelen = 0;
+		telnet_putc('\n');
+		return shell_line(ts->line);
+	}
+
+	// Back space?
+	if (c == '\b' && ts->linelen)
+	{
+		ts->linelen--;
+		telnet_putc(c); telnet_putc(' '); telnet_putc(c);
+	}
+
+	// Visible chars.
+	if ((c >= ' ') && (ts->linelen < (sizeof(ts->line) - 1)))
+	{
+		ts->line[ts->linelen++] = c;
+		telnet_putc(c);
+	}
 
-	// Reset the output buffer.
-	ts->bo.start = ts->bo.data;
+	return true;
+}
+
+// Run the input of a session through the shell, and the clock update
+// through its watch.
+static void telnet_service(struct termstate *session, bool update)
+{
+	int c;
+	bool open = true;
 
-	// Run the shell.
-	shell_process();
+	ts = session;
 
-	// Close the socket.
-	if (ts->sock >= 0)
+	// Greet a new client.
+	if (!ts->started)
 	{
-		close(ts->sock);
-		ts->sock = -1;
+		ts->started = true;
+		shell_start();
 	}
+
+	while (open && !ts->closed && (ts->in_tail != ts->in_head))
+	{
+		c = ts->in[ts->in_tail & TELNET_IN_MASK];
+		__DMB();
+		++ts->in_tail;
+		open = telnet_edit(ts, c);
+	}
+	if (open && update && ts->watch.every) shell_watch_update(&ts->watch);
+	telnet_flush();
+
+	if (!open || ts->closed) telnet_release(ts);
+
+	ts = NULL;
 }
 
 static void telnet_shell_thread(void *arg)
 {
-  int sock, newconn, size;
-  struct sockaddr_in address, remotehost;
+	int i;
+	osEvent event;
+	struct tcp_pcb *pcb;
 
-	// Create a TCP socket.
-  if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) 
-  {
-    printf("TELNET: cannot create socket");
-    return;
-  }
-  
-  // Bind to port 23 at any interface.
-  address.sin_family = AF_INET;
-  address.sin_port = htons(23);
-  address.sin_addr.s_addr = INADDR_ANY;
+	telnet_thread_id = osThreadGetId();
 
-  if (bind(sock, (struct sockaddr *)&address, sizeof (address)) < 0)
-  {
-    printf("TELNET: cannot bind socket");
-    return;
-  }
-  
-  // Listen for incoming connections (TCP listen backlog = 1).
-  listen(sock, 1);
-  
-  size = sizeof(remotehost);
-  
-  for (;;) 
-  {
-    newconn = accept(sock, (struct sockaddr *)&remotehost, (socklen_t *)&size);
-    if (newconn > 0) telnet_shell(newconn);
-  }
+	// Listen on port 23 at any interface.
+	LOCK_TCPIP_CORE();
+	pcb = tcp_new();
+	if (pcb == NULL)
+	{
+		UNLOCK_TCPIP_CORE();
+		log_printf(LOG_ERROR, "TELNET: cannot create pcb\n");
+		return;
+	}
+	if (tcp_bind(pcb, IP_ADDR_ANY, TELNET_PORT) == ERR_OK)
+	{
+		telnet_listen_pcb = tcp_listen_with_backlog(pcb, TELNET_SESSIONS);
+	}
+	if (telnet_listen_pcb == NULL)
+	{
+		tcp_close(pcb);
+		UNLOCK_TCPIP_CORE();
+		log_printf(LOG_ERROR, "TELNET: cannot listen on pcb\n");
+		return;
+	}
+	tcp_accept(telnet_listen_pcb, telnet_accept);
+	UNLOCK_TCPIP_CORE();
+
+	// Sleep until a client connects, types or leaves, or the clock is
+	// updated while watched.
+	for (;;)
+	{
+		event = osSignalWait(0, osWaitForever);
+		if (event.status != osEventSignal) continue;
+
+		for (i = 0; i < TELNET_SESSIONS; ++i)
+		{
+			if (telnet_sessions[i].used)
+			{
+				telnet_service(&telnet_sessions[i], (event.value.signals & TELNET_SIGNAL_WATCH) != 0);
+			}
+		}
+	}
 }
 
 void telnet_shell_init(void)
@@ -342,7 +510,27 @@ void telnet_shell_init(void)
 void telnet_putc(char c)
 {
 	if (c == '\n') telnet_putc('\r');
-	if (ts->sock > 0) telnet_write(&c, 1, (c == '\n') ? true : false);
+	if ((ts == NULL) || ts->closed) return;
+
+	// Hand the ring to TCP when it is full. If TCP has no room either the
+	// client is not keeping up. The shell thread serves all sessions, so
+	// rather than wait for this one, it is closed and the rest go on.
+	if (ts->out_head - ts->out_tail >= TELNET_OUT_SIZE)
+	{
+		telnet_flush();
+		if (ts->out_head - ts->out_tail >= TELNET_OUT_SIZE)
+		{
+			log_printf(LOG_WARNING, "TELNET: client not reading, session closed\n");
+			ts->closed = true;
+			return;
+		}
+	}
+
+	ts->out[ts->out_head & TELNET_OUT_MASK] = c;
+	__DMB();
+	++ts->out_head;
+
+	if (c == '\n') telnet_flush();
 }
 
 void telnet_puts(char *str)
@@ -466,147 +654,42 @@ void telnet_printf(const char *fmt, ...)
 	va_end(arp);
 }
 
-// Flush the telnet output buffers.
+// Push the output of the current session to the client. Returns the
+// bytes still waiting for the window to open, or -1 without a session.
 int telnet_flush(void)
 {
-  int i;
-	int n;
-	int len;
-  fd_set data_write;
-  struct timeval tv;
-  unsigned char *ptr;
+	if ((ts == NULL) || ts->closed) return -1;
 
-	len = n = 0;
-
-	// Is there data to flush?
-	if (ts->bo.start > ts->bo.data)
-	{
-		ptr = ts->bo.data;
-		do
-		{
-			FD_ZERO(&data_write);
-			FD_SET(ts->sock, &data_write);
-			tv.tv_sec = 1;
-			tv.tv_usec = 0;
-			i = select(FD_SETSIZE, NULL, &data_write, NULL, &tv);
-			if ((i > 0) && (FD_ISSET(ts->sock, &data_write) != 0))
-			{
-				n = send(ts->sock, ptr, (int) (ts->bo.start - ts->bo.data) - len, 0);
-				if (n >= 0)
-				{
-					ptr += n;
-					len += n;
-				}
-			}
-		}
-		while ((n >= 0) && (len < (int) (ts->bo.start - ts->bo.data)) && (i > 0));
-		ts->bo.start = ts->bo.data;
-	}
+	LOCK_TCPIP_CORE();
+	telnet_push(ts);
+	UNLOCK_TCPIP_CORE();
 
-  return n < 0 ? n : len;
+	return (int) (ts->out_head - ts->out_tail);
 }
 
-// Get the next character from the buffer.
-int telnet_getc(void)
+// Room left in the output of the current session.
+int telnet_room(void)
 {
-  int i;
-	int n;
-	int ch;
-  fd_set fdsr;
-  struct timeval tv_timeout;
-
-	// Do we need to fill the input buffer with new data?
-	while (ts->bi.start == ts->bi.end)
-	{
-		FD_ZERO(&fdsr);
-		FD_SET(ts->sock, &fdsr);
-		tv_timeout.tv_sec = 1;
-		tv_timeout.tv_usec = 0;
-
-		// Wait for input activity on the socket.
-		i = select(FD_SETSIZE, &fdsr, NULL, NULL, &tv_timeout);
-
-		// Was a error returned?
-		if (i < 0) break;
-
-		// Do we have data to read?
-    if ((i > 0) && FD_ISSET(ts->sock, &fdsr))
-    {
-			// Read data from user.
-			n = recv(ts->sock, ts->bi.data, sizeof(ts->bi.data), 0);
-
-			// Was a error returned?
-			if (n < 0) break;
-	
-			// End of stream?
-			if (n == 0) break;
-
-			// Set the input buffer.
-			ts->bi.start = ts->bi.data;
-			ts->bi.end = ts->bi.data + n;        
-
-			// Process input for telnet options.
-			telnet_process(ts);
-		}
-
-		telnet_flush();
-	}
+	if ((ts == NULL) || ts->closed) return 0;
 
-	// If no data then either error or end of stream.
-	if (ts->bi.start == ts->bi.end) return -1;
-
-	// Get the next character in the buffer.
-	ch = (unsigned char) *(ts->bi.start++);
+	return TELNET_OUT_SIZE - (int) (ts->out_head - ts->out_tail);
+}
 
-	return ch;
+// Watch subscription of the current session.
+struct shell_watch *telnet_watch(void)
+{
+	return &ts->watch;
 }
 
-bool telnet_gets(char *buff, int len, int tocase, bool echo)
+// Whether any session watches the clock updates.
+bool telnet_watching(void)
 {
-	int c;
 	int i;
 
-	i = 0;
-	for (;;)
-	{
-		// Get a char from the incoming stream.
-		c = telnet_getc();
-
-		// End of stream?
-		if (c < 0) return false;
-
-		// Convert to upper/lower case?
-		if (tocase > 0) c = toupper(c);
-		if (tocase < 0) c = tolower(c);
-
-		// End of line?
-		if (c == '\r') break;
-
-		// Back space?
-		if (c == '\b' && i)
-		{
-			i--;
-			if (echo) { telnet_putc(c); telnet_putc(' '); telnet_putc(c); }
-		}
-
-		// Visible chars.
-		if ((c >= ' ') && (i < (len - 1)))
-		{
-			buff[i++] = c;
-			if (echo) telnet_putc(c);
-		}
-
-		telnet_flush();
-	}
-
-	// Null terminate.
-	buff[i] = 0;
-	if (echo)
+	for (i = 0; i < TELNET_SESSIONS; ++i)
 	{
-		telnet_puts("\r\n");
-		telnet_flush();
+		if (telnet_sessions[i].used && telnet_sessions[i].watch.every) return true;
 	}
 
-	return true;
+	return false;
 }
-
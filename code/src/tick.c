@@ -0,0 +1,302 @@
+#include <string.h>
+#include "stm32f4xx.h"
+#include "cmsis_os.h"
+#include "tick.h"
+
+// The kernel ticks are compare interrupts of the free running 32-bit TIM2
+// rather than SysTick reloads, so the phase within a tick can be read at
+// any time and a tick is due at an exact count however late the one
+// before it was handled.
+//
+// While no thread is ready the idle thread suspends the kernel, which
+// masks the tick interrupt in the NVIC, moves the compare to the next
+// kernel timeout and sleeps in WFE. The compare still wakes the core
+// through SEVONPEND, as does any other interrupt, and the ticks that
+// passed are handed to the kernel at once when it is resumed.
+//
+// Kernel delays and timeouts are counted in whole ticks by the RTX delay
+// list. A thread that needs to wake at an exact time sleeps in
+// tick_sleep_us() instead, woken by a compare of channel 2 at the exact
+// timer count. That compare shares the TIM2 interrupt but does not count
+// a kernel tick.
+
+// Longest sleep in timer counts, times are compared as signed differences.
+#define TICK_SLEEP_MAX      0x7fffffffUL
+
+// Signal of the thread sleeping in tick_sleep_us().
+#define TICK_WAKE_SIGNAL    0x8000
+
+// Whether the compare of tick_sleep_us() is pending.
+#define TICK_WAKE_PENDING() ((TIM2->DIER & TIM_DIER_CC2IE) && (TIM2->SR & TIM_SR_CC2IF))
+
+// Post service queue of RTX (struct OS_PSQ in rt_TypeDef.h), holding the
+// requests interrupts made while the kernel was suspended, and the ISR
+// channels they posted (rt_Event.c).
+extern uint32_t os_fifo[];
+extern uint32_t os_ich_pend;
+#define TICK_PSQ_COUNT      (((volatile uint8_t *) os_fifo)[2])
+#define TICK_ICH_PEND       (*(volatile uint32_t *) &os_ich_pend)
+
+// Timer counts per second and per tick, and kernel clock cycles per timer
+// count.
+static uint32_t tick_clock;
+static uint32_t tick_period;
+static uint32_t tick_scale;
+
+// Compare time of the last tick the kernel counted, and of the next one.
+static uint32_t tick_last;
+static uint32_t tick_next;
+
+// Thread sleeping in tick_sleep_us() and the compare time it wakes at.
+static osThreadId tick_wake_thread;
+static uint32_t tick_wake_target;
+
+// Updated by the tick interrupt and the idle thread, which never run at
+// the same time as the kernel masks the interrupt before the thread sleeps.
+static struct tick_stats tick_stats;
+
+// Add the lateness of a timed wake-up to the statistics.
+static void tick_record(uint32_t counts)
+{
+	int bucket;
+	uint32_t cycles = counts * tick_scale;
+
+	bucket = cycles ? 31 - __CLZ(cycles) : 0;
+	if (bucket >= TICK_BUCKETS) bucket = TICK_BUCKETS - 1;
+
+	if ((tick_stats.count == 0) || (cycles < tick_stats.min)) tick_stats.min = cycles;
+	if (cycles > tick_stats.max) tick_stats.max = cycles;
+	tick_stats.sum += cycles;
+	tick_stats.count++;
+	tick_stats.histogram[bucket]++;
+}
+
+// Set the compare to the next tick. If that time has passed already the
+// compare event is generated at once, so ticks are caught up one by one.
+static void tick_arm(void)
+{
+	TIM2->CCR1 = tick_next;
+	if ((int32_t) (TIM2->CNT - tick_next) >= 0) TIM2->EGR = TIM_EGR_CC1G;
+}
+
+// Start TIM2 counting at the APB1 timer clock with a compare interrupt
+// every tick. The clock is the kernel clock osKernelSysTick() counts.
+// Returns the interrupt for RTX to enable at the lowest priority.
+int tick_init(uint32_t clock, uint32_t usecs)
+{
+	uint32_t timer_clock;
+	RCC_ClocksTypeDef clocks;
+
+	// The APB1 timers run at twice PCLK1 when it is divided.
+	RCC_GetClocksFreq(&clocks);
+	timer_clock = clocks.PCLK1_Frequency;
+	if (clocks.PCLK1_Frequency != clocks.HCLK_Frequency) timer_clock *= 2;
+
+	tick_clock = timer_clock;
+	tick_scale = clock / timer_clock;
+	tick_period = (uint32_t) (((uint64_t) timer_clock * usecs) / 1000000);
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+
+	// Stop with the core in the debugger, as SysTick does.
+	DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_TIM2_STOP;
+
+	// Free running over the full 32 bits, channels 1 and 2 only set flags.
+	TIM2->CR1 = 0;
+	TIM2->PSC = 0;
+	TIM2->ARR = 0xffffffff;
+	TIM2->CCMR1 = 0;
+	TIM2->EGR = TIM_EGR_UG;
+	TIM2->SR = 0;
+
+	tick_last = TIM2->CNT;
+	tick_next = tick_last + tick_period;
+	TIM2->CCR1 = tick_next;
+	TIM2->DIER = TIM_DIER_CC1IE;
+	TIM2->CR1 = TIM_CR1_CEN;
+
+	// A compare pending while the kernel is suspended ends WFE.
+	SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+
+	return TIM2_IRQn;
+}
+
+// Kernel clock cycles since the last tick. While a tick is pending they
+// are counted from that tick, as the SysTick value would be.
+uint32_t tick_val(void)
+{
+	uint32_t phase = TIM2->CNT - tick_last;
+
+	if (phase >= tick_period) phase -= tick_period;
+	if (phase >= tick_period) phase = tick_period - 1;
+
+	return phase * tick_scale;
+}
+
+// Returns 1 while a tick is pending.
+uint32_t tick_ovf(void)
+{
+	return (TIM2->CNT - tick_last) >= tick_period;
+}
+
+// Called by OS_Tick_Handler before the kernel counts the tick.
+void tick_irqack(void)
+{
+	TIM2->SR = ~TIM_SR_CC1IF;
+
+	tick_last = tick_next;
+	tick_next += tick_period;
+
+	if (tick_stats.enabled)
+	{
+		tick_stats.ticks++;
+		tick_record(TIM2->CNT - tick_last);
+	}
+
+	tick_arm();
+}
+
+// Wake the thread in tick_sleep_us() if its compare passed. Returns
+// whether a kernel tick is due as well.
+static uint32_t tick_wake_irq(void)
+{
+	if (TICK_WAKE_PENDING())
+	{
+		TIM2->DIER &= ~TIM_DIER_CC2IE;
+		TIM2->SR = ~TIM_SR_CC2IF;
+
+		if (tick_stats.enabled)
+		{
+			tick_stats.wakes++;
+			tick_record(TIM2->CNT - tick_wake_target);
+		}
+
+		osSignalSet(tick_wake_thread, TICK_WAKE_SIGNAL);
+		tick_wake_thread = NULL;
+	}
+
+	return (TIM2->SR & TIM_SR_CC1IF) != 0;
+}
+
+// The RTX tick handler switches threads when it returns, so the vector
+// branches to it when a tick is due and returns directly otherwise.
+__asm void TIM2_IRQHandler(void)
+{
+	IMPORT  OS_Tick_Handler
+	PRESERVE8
+
+	PUSH    {R4, LR}
+	BL      __cpp(tick_wake_irq)
+	POP     {R4, LR}
+	CBZ     R0, tick_none
+	B       OS_Tick_Handler
+tick_none
+	BX      LR
+}
+
+// Sleep the calling thread for the given microseconds, woken by a compare
+// at the exact timer count rather than at the next kernel tick. One thread
+// sleeps at a time, returns false if another one is sleeping already.
+bool tick_sleep_us(uint32_t usecs)
+{
+	osThreadId thread = osThreadGetId();
+	uint32_t counts = (uint32_t) (((uint64_t) tick_clock * usecs) / 1000000);
+
+	if (counts > TICK_SLEEP_MAX) counts = TICK_SLEEP_MAX;
+
+	__disable_irq();
+	if (tick_wake_thread != NULL)
+	{
+		__enable_irq();
+		return false;
+	}
+	tick_wake_thread = thread;
+	tick_wake_target = TIM2->CNT + counts;
+	TIM2->CCR2 = tick_wake_target;
+	TIM2->SR = ~TIM_SR_CC2IF;
+	TIM2->DIER |= TIM_DIER_CC2IE;
+	if ((int32_t) (TIM2->CNT - tick_wake_target) >= 0) TIM2->EGR = TIM_EGR_CC2G;
+	__enable_irq();
+
+	osSignalWait(TICK_WAKE_SIGNAL, osWaitForever);
+
+	return true;
+}
+
+// Body of the idle thread. Sleeps until the next kernel timeout or until
+// an interrupt, then counts the ticks that passed.
+void tick_idle(void)
+{
+	uint32_t now;
+	uint32_t ticks;
+	uint32_t target;
+	uint32_t elapsed;
+
+	// Suspend the kernel, which masks the tick interrupt, and get the
+	// ticks to its next timeout.
+	ticks = os_suspend();
+	if (ticks == 0) ticks = 1;
+	if (ticks > TICK_SLEEP_MAX / tick_period) ticks = TICK_SLEEP_MAX / tick_period;
+	target = tick_last + ticks * tick_period;
+
+	TIM2->CCR1 = target;
+	TIM2->SR = ~TIM_SR_CC1IF;
+	NVIC_ClearPendingIRQ(TIM2_IRQn);
+
+	// Clear the event register, then sleep unless an interrupt already
+	// left a request for the kernel or the timeout has passed. Any
+	// interrupt pending after this sets the event again through SEVONPEND,
+	// as does the compare of a thread in tick_sleep_us().
+	__SEV();
+	__WFE();
+	if ((TICK_PSQ_COUNT == 0) && (TICK_ICH_PEND == 0) && !TICK_WAKE_PENDING() &&
+		((int32_t) (TIM2->CNT - target) < 0)) __WFE();
+
+	now = TIM2->CNT;
+	elapsed = (now - tick_last) / tick_period;
+
+	if (tick_stats.enabled)
+	{
+		tick_stats.sleeps++;
+		tick_stats.slept += elapsed;
+		if ((int32_t) (now - target) >= 0)
+			tick_record(now - target);
+		else
+			tick_stats.early++;
+	}
+
+	// Go back to a compare every tick, the ticks that passed are counted
+	// by the kernel when it is resumed.
+	tick_last += elapsed * tick_period;
+	tick_next = tick_last + tick_period;
+	TIM2->SR = ~TIM_SR_CC1IF;
+	NVIC_ClearPendingIRQ(TIM2_IRQn);
+	tick_arm();
+
+	os_resume(elapsed);
+}
+
+// Turn the measurement of the wake-up lateness on or off.
+void tick_measure(bool enable)
+{
+	tick_stats.enabled = enable;
+}
+
+// Clear the statistics.
+void tick_reset(void)
+{
+	bool enabled;
+
+	__disable_irq();
+	enabled = tick_stats.enabled;
+	memset(&tick_stats, 0, sizeof(tick_stats));
+	tick_stats.enabled = enabled;
+	__enable_irq();
+}
+
+void tick_read_stats(struct tick_stats *stats)
+{
+	__disable_irq();
+	*stats = tick_stats;
+	__enable_irq();
+}
@@ -0,0 +1,186 @@
+#include <string.h>
+#include "stm32f4xx.h"
+#include "cmsis_os.h"
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/sockets.h"
+#include "log.h"
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+#define TRACE_THREAD_PRIO   ( osPriorityBelowNormal )
+
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+
+// Records sent per socket write.
+#define TRACE_BATCH         16
+
+// How often the drain thread polls the ring for new records.
+#define TRACE_POLL_MS       20
+
+// Records that are still being written carry this sequence number.
+#define TRACE_SEQ_BUSY      0xffffffffUL
+
+// Writers claim a record at the head with a single LDREX/STREX increment
+// and fill it in place. Readers check the sequence number before and after
+// copying a record, so a record overwritten during the copy is discarded.
+static struct trace_record trace_ring[TRACE_RING_SIZE];
+static volatile uint32_t trace_head = 0;
+
+// Send buffer of the drain thread.
+static struct trace_record trace_batch[TRACE_BATCH];
+
+// Add an event to the trace. Safe to call from threads and interrupts.
+void trace_event(uint16_t event, uint16_t arg0, int32_t arg1, int32_t arg2, int32_t arg3, int32_t arg4)
+{
+	uint32_t seq;
+	uint32_t seconds;
+	uint32_t subseconds;
+	struct trace_record *record;
+
+	do
+	{
+		seq = __LDREXW(&trace_head);
+	} while (__STREXW(seq + 1, &trace_head) != 0);
+
+	// Read the PTP time, again if the seconds rolled over in between.
+	do
+	{
+		seconds = ETH->PTPTSHR;
+		subseconds = ETH->PTPTSLR;
+	} while (seconds != ETH->PTPTSHR);
+
+	record = &trace_ring[seq & TRACE_RING_MASK];
+	record->seq = TRACE_SEQ_BUSY;
+	__DMB();
+	record->seconds = seconds;
+	record->subseconds = subseconds;
+	record->event = event;
+	record->arg0 = arg0;
+	record->arg[0] = arg1;
+	record->arg[1] = arg2;
+	record->arg[2] = arg3;
+	record->arg[3] = arg4;
+	__DMB();
+	record->seq = seq;
+}
+
+// Number of records written since boot.
+uint32_t trace_count(void)
+{
+	return trace_head;
+}
+
+// Copy the record with the given sequence number. Returns false if it is
+// not written yet or was already overwritten.
+bool trace_read(uint32_t seq, struct trace_record *record)
+{
+	const struct trace_record *slot = &trace_ring[seq & TRACE_RING_MASK];
+
+	if (slot->seq != seq) return false;
+	__DMB();
+	memcpy(record, slot, sizeof(*record));
+	__DMB();
+
+	return (slot->seq == seq) && (record->seq == seq);
+}
+
+// Stream the trace to a connected client until it disconnects.
+static void trace_drain(int sock)
+{
+	int n;
+	uint32_t head;
+	uint32_t next;
+	struct trace_header header;
+
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.record_size = sizeof(struct trace_record);
+	if (send(sock, &header, sizeof(header), 0) != sizeof(header)) return;
+
+	// Start with the records still in the ring.
+	head = trace_head;
+	next = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+
+	for (;;)
+	{
+		head = trace_head;
+
+		// Skip records overwritten while the client was behind. The
+		// client sees them as a gap in the sequence numbers.
+		if (head - next > TRACE_RING_SIZE) next = head - TRACE_RING_SIZE;
+
+		// Collect a batch of complete records.
+		n = 0;
+		while ((n < TRACE_BATCH) && (next != head))
+		{
+			if (trace_read(next, &trace_batch[n]))
+			{
+				++n;
+			}
+			else if (trace_head - next <= TRACE_RING_SIZE)
+			{
+				// Still being written, try again later.
+				break;
+			}
+			++next;
+		}
+
+		if (n > 0)
+		{
+			if (send(sock, trace_batch, n * sizeof(struct trace_record), 0) < 0) return;
+		}
+		else
+		{
+			osDelay(TRACE_POLL_MS);
+		}
+	}
+}
+
+static void trace_thread(void *arg)
+{
+	int sock, newconn, size;
+	struct sockaddr_in address, remotehost;
+
+	// Create a TCP socket.
+	if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	{
+		log_printf(LOG_ERROR, "TRACE: cannot create socket\n");
+		return;
+	}
+
+	// Bind to the trace port at any interface.
+	address.sin_family = AF_INET;
+	address.sin_port = htons(TRACE_PORT);
+	address.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(sock, (struct sockaddr *)&address, sizeof (address)) < 0)
+	{
+		log_printf(LOG_ERROR, "TRACE: cannot bind socket\n");
+		return;
+	}
+
+	// Serve one client at a time.
+	listen(sock, 1);
+
+	size = sizeof(remotehost);
+
+	for (;;)
+	{
+		newconn = accept(sock, (struct sockaddr *)&remotehost, (socklen_t *)&size);
+		if (newconn >= 0)
+		{
+			trace_drain(newconn);
+			close(newconn);
+		}
+	}
+}
+
+// Start the thread serving the trace stream.
+void trace_init(void)
+{
+	sys_thread_new("TRACE", trace_thread, NULL, DEFAULT_THREAD_STACKSIZE, TRACE_THREAD_PRIO);
+}
+
+#endif /* TRACE_ENABLE */
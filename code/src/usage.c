@@ -0,0 +1,49 @@
+#include <string.h>
+#include "stm32f4xx.h"
+#include "cmsis_os.h"
+#include "usage.h"
+
+// Scanning a stack for the fill pattern costs a read of each word never
+// used, so it is kept out of the threads. The idle thread scans one stack
+// each time it runs, before it sleeps, and any thread made ready preempts
+// the scan. The shell only copies the results.
+
+// Written by the idle thread only.
+static struct usage_stack usage_table[USAGE_THREADS];
+static uint32_t usage_next;
+
+// Scan the stack of the next task id.
+void usage_idle(void)
+{
+	os_stack_stat_t stat;
+	struct usage_stack entry;
+
+	switch (os_stack_stat(usage_next, &stat))
+	{
+		case osOK:
+			entry.pthread = stat.pthread;
+			entry.size = stat.size;
+			entry.used = stat.size - stat.unused;
+			break;
+		case osErrorResource:
+			memset(&entry, 0, sizeof(entry));
+			break;
+		default:
+			// Past the last task id of the kernel.
+			usage_next = 0;
+			return;
+	}
+
+	__disable_irq();
+	usage_table[usage_next] = entry;
+	__enable_irq();
+
+	if (++usage_next >= USAGE_THREADS) usage_next = 0;
+}
+
+void usage_stacks(struct usage_stack stacks[USAGE_THREADS])
+{
+	__disable_irq();
+	memcpy(stacks, usage_table, sizeof(usage_table));
+	__enable_irq();
+}
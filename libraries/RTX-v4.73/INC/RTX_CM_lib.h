@@ -93,8 +93,12 @@ OS_RESULT _os_mut_wait    (uint32_t p, OS_ID mutex, uint16_t timeout) __svc_indi
 #define OS_STACK_SZ (4*(OS_PRIVSTKSIZE+OS_MAINSTKSIZE))
 #endif
 
+#ifndef OS_STKINIT
+ #define OS_STKINIT     0
+#endif
+
 uint16_t const os_maxtaskrun = OS_TASK_CNT;
-uint32_t const os_stackinfo  = (OS_STKCHECK<<24)| (OS_PRIV_CNT<<16) | (OS_STKSIZE*4);
+uint32_t const os_stackinfo  = (OS_STKINIT<<28)| (OS_STKCHECK<<24)| (OS_PRIV_CNT<<16) | (OS_STKSIZE*4);
 uint32_t const os_rrobin     = (OS_ROBIN << 16) | OS_ROBINTOUT;
 uint32_t const os_tickfreq   = OS_CLOCK;
 uint16_t const os_tickus_i   = OS_CLOCK/1000000;
@@ -117,7 +121,12 @@ _declare_box8 (mp_stk, OS_STKSIZE*4, OS_TASK_CNT-OS_PRIV_CNT+1);
 uint32_t const mp_stk_size = sizeof(mp_stk);
 
 /* Memory pool for user specified stack allocation (+main, +timer) */
+#ifdef __MEM_TLSF
+/* The TLSF pool also holds its control block, and rounds blocks to 8 bytes.*/
+uint64_t       os_stack_mem[(OS_MEM_OVERHEAD/8)+2*OS_PRIV_CNT+(OS_STACK_SZ/8)];
+#else
 uint64_t       os_stack_mem[2+OS_PRIV_CNT+(OS_STACK_SZ/8)];
+#endif
 uint32_t const os_stack_sz = sizeof(os_stack_mem);
 
 #ifndef OS_FIFOSZ
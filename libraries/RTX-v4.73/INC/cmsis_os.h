@@ -806,6 +806,71 @@ uint32_t os_suspend (void);
 /// os_resume: http://www.keil.com/support/man/docs/rlarm/rlarm_os_resume.htm
 void os_resume (uint32_t sleep_time);
 
+/// Bytes of a dynamic memory pool besides its blocks: the control block and end marker.
+#ifdef __MEM_TLSF
+#define OS_MEM_OVERHEAD 424
+#else
+#define OS_MEM_OVERHEAD 16
+#endif
+
+/// Statistics of a dynamic memory pool, sizes include the 8 byte block headers.
+typedef struct os_mem_stat  {
+  uint32_t                    size;    ///< bytes for blocks
+  uint32_t                    used;    ///< bytes of allocated blocks
+  uint32_t                    peak;    ///< highest value of used, 0 with first fit
+  uint32_t                 largest;    ///< largest free block, less its header
+} os_mem_stat_t;
+
+/// Dynamic memory pools of the kernel, first fit or TLSF with __MEM_TLSF.
+/// They are not locked: the caller serializes the use of each pool.
+int os_mem_init (void *pool, uint32_t size);
+void *os_mem_alloc (void *pool, uint32_t size);
+int os_mem_free (void *pool, void *mem);
+int os_mem_stat (void *pool, os_mem_stat_t *stat);
+
+/// Stack use of a thread, counted from the pattern the stack is filled with
+/// when OS_STKINIT is set.
+typedef struct os_stack_stat  {
+  os_pthread               pthread;    ///< thread function
+  uint32_t                    size;    ///< bytes of stack
+  uint32_t                  unused;    ///< bytes never written, 0 without OS_STKINIT
+} os_stack_stat_t;
+
+/// Scans the stack of the thread with the task id \a task_id, 0 for the idle
+/// demon. Returns osErrorResource for an unused task id and osErrorParameter
+/// past the last one.
+osStatus os_stack_stat (uint32_t task_id, os_stack_stat_t *stat);
+
+/// Statistics of the queues of the kernel.
+typedef struct os_queue_stat  {
+  uint32_t               fifo_size;    ///< requests the ISR FIFO holds, OS_FIFOSZ
+  uint32_t               fifo_peak;    ///< most requests waiting in it at once
+  uint32_t              timer_size;    ///< callbacks the timer queue holds, OS_TIMERCBQS
+  uint32_t              timer_peak;    ///< most callbacks waiting in it at once
+  uint32_t             timer_drops;    ///< callbacks lost as it was full
+} os_queue_stat_t;
+
+void os_queue_stat (os_queue_stat_t *stat);
+
+/// ISR channels. An interrupt posts a channel with os_isr_post, which sets
+/// a bit and never blocks or overflows. The kernel sets the signal flags
+/// bound to the channel once, however often it was posted since the last
+/// delivery, and the thread then handles all the work pending.
+#define OS_ISR_CHANNELS 8
+
+/// Counts of an ISR channel.
+typedef struct os_isr_stat  {
+  uint32_t                   posts;    ///< posts by interrupts
+  uint32_t                 wakeups;    ///< signal flags set in the thread
+  uint32_t               coalesced;    ///< posts that did not wake the thread on their own
+} os_isr_stat_t;
+
+/// Deliver channel \a channel to thread \a thread_id as \a signals, NULL
+/// stops the delivery. The binding must be removed before the thread ends.
+osStatus os_isr_bind (uint32_t channel, osThreadId thread_id, int32_t signals);
+void os_isr_post (uint32_t channel);
+osStatus os_isr_stat (uint32_t channel, os_isr_stat_t *stat);
+
 
 #ifdef  __cplusplus
 }
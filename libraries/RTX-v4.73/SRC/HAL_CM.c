@@ -92,6 +92,14 @@ void rt_init_stack (P_TCB p_TCB, FUNCP task_body) {
 
   /* Set a magic word for checking of stack overflow. */
   p_TCB->stack[0] = MAGIC_WORD;
+
+  /* Fill the stack below the frame with a pattern, the words still holding */
+  /* it were never used.                                                    */
+  if (os_stackinfo & 0x10000000) {
+    for (i = 1; &p_TCB->stack[i] < stk; i++) {
+      p_TCB->stack[i] = MAGIC_PATTERN;
+    }
+  }
 }
 
 
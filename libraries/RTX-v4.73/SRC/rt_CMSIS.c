@@ -897,6 +897,8 @@ typedef struct os_timer_cb_ {                   // Timer Control Block
 
 // Timer variables
 os_timer_cb *os_timer_head;                     // Pointer to first active Timer
+static uint32_t os_timer_peak;                  // Most callbacks queued at once
+static uint32_t os_timer_drops;                 // Callbacks lost to a full queue
 
 
 // Timer Helper Functions
@@ -1100,7 +1102,9 @@ void sysTimerTick (void) {
     pt = p;
     p = p->next;
     os_timer_head = p;
-    isrMessagePut(osMessageQId_osTimerMessageQ, (uint32_t)pt, 0);
+    if (isrMessagePut(osMessageQId_osTimerMessageQ, (uint32_t)pt, 0) != osOK) {
+      os_timer_drops++;
+    }
     if (pt->type == osTimerPeriodic) {
       rt_timer_insert(pt, pt->icnt);
     } else {
@@ -1176,10 +1180,15 @@ os_InRegs osCallback osTimerCall (osTimerId timer_id) {
 __NO_RETURN void osTimerThread (void const *argument) {
   osCallback cb;
   osEvent    evt;
+  uint32_t   depth;
 
   for (;;) {
     evt = osMessageGet(osMessageQId_osTimerMessageQ, osWaitForever);
     if (evt.status == osEventMessage) {
+      depth = ((P_MCB)osMessageQId_osTimerMessageQ)->count + 1;
+      if (depth > os_timer_peak) {
+        os_timer_peak = depth;
+      }
       cb = osTimerCall(evt.value.p);
       if (cb.fp != NULL) {
         (*(os_ptimer)cb.fp)(cb.arg);
@@ -2030,3 +2039,115 @@ uint32_t os_suspend (void) {
 void os_resume (uint32_t sleep_time) {
   __rt_resume(sleep_time);
 }
+
+#ifdef __MEM_TLSF
+// OS_MEM_OVERHEAD must hold the control block and the end marker
+typedef char os_mem_overhead_check[(((sizeof(MEMCTRL)+7)&~7)+8 <= OS_MEM_OVERHEAD) ? 1 : -1];
+#endif
+
+/// Initialize a dynamic memory pool
+int os_mem_init (void *pool, uint32_t size) {
+  return rt_init_mem(pool, size);
+}
+
+/// Allocate memory from a dynamic memory pool
+void *os_mem_alloc (void *pool, uint32_t size) {
+  return rt_alloc_mem(pool, size);
+}
+
+/// Return memory to a dynamic memory pool
+int os_mem_free (void *pool, void *mem) {
+  return rt_free_mem(pool, mem);
+}
+
+/// Get the statistics of a dynamic memory pool
+int os_mem_stat (void *pool, os_mem_stat_t *stat) {
+  MEMSTAT mem_stat;
+
+  if ((stat == NULL) || rt_stat_mem(pool, &mem_stat)) return 1;
+  stat->size    = mem_stat.size;
+  stat->used    = mem_stat.used;
+  stat->peak    = mem_stat.peak;
+  stat->largest = mem_stat.largest;
+  return 0;
+}
+
+/// Get the stack use of a thread
+osStatus os_stack_stat (uint32_t task_id, os_stack_stat_t *stat) {
+  P_TCB ptcb;
+  U32  *stk, size, i;
+
+  if ((stat == NULL) || (task_id > os_maxtaskrun)) return osErrorParameter;
+  ptcb = (task_id == 0) ? &os_idle_TCB : (P_TCB)os_active_TCB[task_id - 1];
+  if (ptcb == NULL) return osErrorResource;
+
+  // The thread may end while its stack is scanned, as the scan is not
+  // locked. The stack is then only read after it is freed.
+  stk  = ptcb->stack;
+  size = ptcb->priv_stack;
+  if (size == 0) {
+    size = (U16)os_stackinfo;
+  }
+  stat->pthread = (os_pthread)ptcb->ptask;
+  stat->size    = size;
+
+  // Word 0 holds the magic word of the overflow check.
+  i = 1;
+  if (os_stackinfo & 0x10000000) {
+    while ((i < size/4) && (stk[i] == MAGIC_PATTERN)) {
+      i++;
+    }
+  }
+  stat->unused = (i - 1) * 4;
+  return osOK;
+}
+
+// OS_ISR_CHANNELS of cmsis_os.h must match the kernel
+typedef char os_isr_channels_check[(OS_ISR_CHANNELS == OS_ICH_COUNT) ? 1 : -1];
+
+/// Deliver the posts of an ISR channel to a thread as signal flags
+osStatus os_isr_bind (uint32_t channel, osThreadId thread_id, int32_t signals) {
+  P_TCB ptcb = NULL;
+
+  if (channel >= OS_ICH_COUNT) return osErrorParameter;
+  if (thread_id != NULL) {
+    ptcb = rt_tid2ptcb(thread_id);              // Get TCB pointer
+    if (ptcb == NULL) return osErrorParameter;
+  }
+  if (((uint32_t)signals & ~((1<<osFeature_Signals)-1)) != 0) return osErrorValue;
+
+  rt_ich_bind(channel, ptcb, (U16)signals);
+  return osOK;
+}
+
+/// Post an ISR channel from an interrupt
+void os_isr_post (uint32_t channel) {
+  if (channel < OS_ICH_COUNT) {
+    isr_ich_post(channel);
+  }
+}
+
+/// Get the counts of an ISR channel
+osStatus os_isr_stat (uint32_t channel, os_isr_stat_t *stat) {
+  U32 posts, wakeups;
+
+  if ((channel >= OS_ICH_COUNT) || (stat == NULL)) return osErrorParameter;
+  wakeups = os_ich[channel].wakeups;
+  posts   = os_ich[channel].posts;
+  stat->posts     = posts;
+  stat->wakeups   = wakeups;
+  stat->coalesced = (posts > wakeups) ? (posts - wakeups) : 0;
+  return osOK;
+}
+
+/// Get the statistics of the kernel queues
+void os_queue_stat (os_queue_stat_t *stat) {
+  stat->fifo_size   = os_fifo_size;
+  stat->fifo_peak   = os_psq_peak;
+  stat->timer_size  = 0;
+  if (osMessageQId_osTimerMessageQ != NULL) {
+    stat->timer_size = ((P_MCB)osMessageQId_osTimerMessageQ)->size;
+  }
+  stat->timer_peak  = os_timer_peak;
+  stat->timer_drops = os_timer_drops;
+}
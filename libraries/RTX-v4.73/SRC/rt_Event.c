@@ -41,6 +41,15 @@
 #include "rt_HAL_CM.h"
 
 
+/*----------------------------------------------------------------------------
+ *      Global Variables
+ *---------------------------------------------------------------------------*/
+
+/* ISR channels posted and not yet delivered, bit n for channel n */
+U32 os_ich_pend;
+struct OS_ICH os_ich[OS_ICH_COUNT];
+
+
 /*----------------------------------------------------------------------------
  *      Functions
  *---------------------------------------------------------------------------*/
@@ -185,6 +194,52 @@ rdy:  p_CB->events &= ~event_flags;
   }
 }
 
+
+/*--------------------------- rt_ich_bind -----------------------------------*/
+
+void rt_ich_bind (U32 channel, P_TCB p_task, U16 flags) {
+  /* Deliver the posts of ISR channel "channel" to task "p_task" as its     */
+  /* event flags "flags", NULL stops the delivery. The task pointer is      */
+  /* written last, as the post service handler may read the channel.        */
+  struct OS_ICH *p_ich = &os_ich[channel];
+
+  p_ich->task  = NULL;
+  p_ich->flags = flags;
+  p_ich->task  = p_task;
+}
+
+
+/*--------------------------- isr_ich_post ----------------------------------*/
+
+void isr_ich_post (U32 channel) {
+  /* Post ISR channel "channel". Unlike the post service queue the channels */
+  /* are bits, so posts made before the kernel delivers them are coalesced  */
+  /* into one and can never overflow.                                       */
+  os_ich[channel].posts++;
+  rt_or (&os_ich_pend, 1U << channel);
+  rt_psh_req ();
+}
+
+
+/*--------------------------- rt_ich_psh ------------------------------------*/
+
+void rt_ich_psh (void) {
+  /* Deliver the posted ISR channels, called by the post service handler.   */
+  struct OS_ICH *p_ich;
+  U32 pend, channel;
+
+  pend = rt_xchg (&os_ich_pend, 0);
+  while (pend) {
+    channel = 31 - __clz (pend);
+    pend   &= ~(1U << channel);
+    p_ich   = &os_ich[channel];
+    if (p_ich->task != NULL) {
+      p_ich->wakeups++;
+      rt_evt_psh (p_ich->task, p_ich->flags);
+    }
+  }
+}
+
 /*----------------------------------------------------------------------------
  * end of file
  *---------------------------------------------------------------------------*/
@@ -32,6 +32,20 @@
  * POSSIBILITY OF SUCH DAMAGE.
  *---------------------------------------------------------------------------*/
 
+/* ISR channels, posted by interrupts and delivered as event flags */
+#define OS_ICH_COUNT    8
+
+struct OS_ICH {
+  P_TCB  task;                    /* Task the channel is delivered to        */
+  U16    flags;                   /* Event flags set in the task             */
+  U32    posts;                   /* Posts by interrupts                     */
+  U32    wakeups;                 /* Deliveries, posts less those coalesced  */
+};
+
+/* Variables */
+extern U32 os_ich_pend;
+extern struct OS_ICH os_ich[OS_ICH_COUNT];
+
 /* Functions */
 extern OS_RESULT rt_evt_wait (U16 wait_flags,  U16 timeout, BOOL and_wait);
 extern void      rt_evt_set  (U16 event_flags, OS_TID task_id);
@@ -39,6 +53,9 @@ extern void      rt_evt_clr  (U16 clear_flags, OS_TID task_id);
 extern void      isr_evt_set (U16 event_flags, OS_TID task_id);
 extern U16       rt_evt_get  (void);
 extern void      rt_evt_psh  (P_TCB p_CB, U16 set_flags);
+extern void      rt_ich_bind (U32 channel, P_TCB p_task, U16 flags);
+extern void      isr_ich_post (U32 channel);
+extern void      rt_ich_psh  (void);
 
 /*----------------------------------------------------------------------------
  * end of file
@@ -37,6 +37,7 @@
 #define DEMCR_TRCENA    0x01000000
 #define ITM_ITMENA      0x00000001
 #define MAGIC_WORD      0xE25A2EA5
+#define MAGIC_PATTERN   0xCCCCCCCC
 
 #if defined (__CC_ARM)          /* ARM Compiler */
 
@@ -191,11 +192,28 @@ extern BIT dbg_msg;
 #ifdef __USE_EXCLUSIVE_ACCESS
  #define rt_inc(p)     while(__strex((__ldrex(p)+1),p))
  #define rt_dec(p)     while(__strex((__ldrex(p)-1),p))
+ #define rt_or(p,v)    while(__strex((__ldrex(p)|(v)),p))
 #else
  #define rt_inc(p)     __disable_irq();(*p)++;__enable_irq();
  #define rt_dec(p)     __disable_irq();(*p)--;__enable_irq();
+ #define rt_or(p,v)    __disable_irq();(*p)|=(v);__enable_irq();
 #endif
 
+__inline static U32 rt_xchg (U32 *p, U32 val) {
+  U32 old;
+#ifdef __USE_EXCLUSIVE_ACCESS
+  do {
+    old = __ldrex(p);
+  } while (__strex(val, p));
+#else
+  __disable_irq();
+  old = *p;
+  *p  = val;
+  __enable_irq();
+#endif
+  return (old);
+}
+
 __inline static U32 rt_inc_qi (U32 size, U8 *count, U8 *first) {
   U32 cnt,c2;
 #ifdef __USE_EXCLUSIVE_ACCESS
@@ -48,12 +48,174 @@
 struct OS_XCB  os_rdy;
 /* List head of chained delay tasks */
 struct OS_XCB  os_dly;
+/* Most requests that were waiting in the post service queue at once */
+U8 os_psq_peak;
+
+#ifdef __RDY_BITMAP
+/* With the ready queue bitmap the ready tasks of each priority level are   */
+/* chained in FIFO order with their own head and tail, and bit n of         */
+/* "os_rdy_map" is set while level n has tasks. "os_rdy.p_lnk" still points */
+/* to the first task of the highest level, so the code reading the head of  */
+/* the ready list is the same for both versions.                            */
+struct OS_RDYQ {
+  P_TCB  first;                   /* First task of the level                 */
+  P_TCB  last;                    /* Last task of the level                  */
+};
+
+static struct OS_RDYQ os_rdyq[OS_RDY_LEVELS];
+U32 os_rdy_map;
+
+#if (__TARGET_ARCH_6S_M)
+ #error "The ready queue bitmap needs the CLZ instruction."
+#endif
+#endif
 
 
 /*----------------------------------------------------------------------------
  *      Functions
  *---------------------------------------------------------------------------*/
 
+#ifdef __RDY_BITMAP
+
+/*--------------------------- rt_rdy_top ------------------------------------*/
+
+static __inline U32 rt_rdy_top (void) {
+  /* Return the highest priority level with ready tasks. */
+  return (31 - __clz (os_rdy_map));
+}
+
+
+/*--------------------------- rt_rdy_head -----------------------------------*/
+
+static __inline void rt_rdy_head (void) {
+  /* Point the ready list head to the first task of the highest level. */
+  if (os_rdy_map == 0) {
+    os_rdy.p_lnk = NULL;
+  }
+  else {
+    os_rdy.p_lnk = os_rdyq[rt_rdy_top()].first;
+  }
+}
+
+
+/*--------------------------- rt_rdy_put ------------------------------------*/
+
+static void rt_rdy_put (P_TCB p_task) {
+  /* Put task "p_task" at the end of the ready tasks of its priority. */
+  U32 level = OS_RDY_LEVEL(p_task->prio);
+  struct OS_RDYQ *p_q = &os_rdyq[level];
+
+  p_task->p_lnk  = NULL;
+  p_task->p_rlnk = NULL;
+  if (p_q->first == NULL) {
+    p_q->first  = p_task;
+    os_rdy_map |= 1U << level;
+  }
+  else {
+    p_q->last->p_lnk = p_task;
+  }
+  p_q->last = p_task;
+  rt_rdy_head ();
+}
+
+
+/*--------------------------- rt_rdy_get ------------------------------------*/
+
+static P_TCB rt_rdy_get (void) {
+  /* Remove and return the first task of the highest level. */
+  U32 level = rt_rdy_top();
+  struct OS_RDYQ *p_q = &os_rdyq[level];
+  P_TCB p_first;
+
+  p_first    = p_q->first;
+  p_q->first = p_first->p_lnk;
+  if (p_q->first == NULL) {
+    p_q->last   = NULL;
+    os_rdy_map &= ~(1U << level);
+  }
+  p_first->p_lnk = NULL;
+  rt_rdy_head ();
+  return (p_first);
+}
+
+
+/*--------------------------- rt_rdy_unlink ---------------------------------*/
+
+static BOOL rt_rdy_unlink (P_TCB p_task, U32 level) {
+  /* Remove task "p_task" from the tasks of priority level "level". Return  */
+  /* __FALSE if it is not there.                                            */
+  struct OS_RDYQ *p_q = &os_rdyq[level];
+  P_TCB p_prev = NULL;
+  P_TCB p;
+
+  for (p = p_q->first; p != p_task; p = p->p_lnk) {
+    if (p == NULL) {
+      return (__FALSE);
+    }
+    p_prev = p;
+  }
+  if (p_prev == NULL) {
+    p_q->first = p_task->p_lnk;
+  }
+  else {
+    p_prev->p_lnk = p_task->p_lnk;
+  }
+  if (p_q->last == p_task) {
+    p_q->last = p_prev;
+  }
+  if (p_q->first == NULL) {
+    os_rdy_map &= ~(1U << level);
+  }
+  p_task->p_lnk = NULL;
+  rt_rdy_head ();
+  return (__TRUE);
+}
+
+
+/*--------------------------- rt_rdy_rmv ------------------------------------*/
+
+static void rt_rdy_rmv (P_TCB p_task) {
+  /* Remove task "p_task" from the ready queue if enqueued. It is looked    */
+  /* for at the level of its priority first. When the priority was changed  */
+  /* while the task was ready (rt_resort_prio) the other levels are tried.  */
+  U32 level = OS_RDY_LEVEL(p_task->prio);
+  U32 map;
+
+  if (os_rdy_map & (1U << level)) {
+    if (rt_rdy_unlink (p_task, level)) {
+      return;
+    }
+  }
+  map = os_rdy_map & ~(1U << level);
+  while (map) {
+    level = 31 - __clz (map);
+    if (rt_rdy_unlink (p_task, level)) {
+      return;
+    }
+    map &= ~(1U << level);
+  }
+}
+
+#endif
+
+
+/*--------------------------- rt_init_rdy -----------------------------------*/
+
+void rt_init_rdy (void) {
+  /* Set up the ready list: initially empty. */
+#ifdef __RDY_BITMAP
+  U32 i;
+
+  for (i = 0; i < OS_RDY_LEVELS; i++) {
+    os_rdyq[i].first = NULL;
+    os_rdyq[i].last  = NULL;
+  }
+  os_rdy_map = 0;
+#endif
+  os_rdy.cb_type = HCB;
+  os_rdy.p_lnk   = NULL;
+}
+
 
 /*--------------------------- rt_put_prio -----------------------------------*/
 
@@ -65,6 +227,12 @@ void rt_put_prio (P_XCB p_CB, P_TCB p_task) {
   U32 prio;
   BOOL sem_mbx = __FALSE;
 
+#ifdef __RDY_BITMAP
+  if (p_CB == &os_rdy) {
+    rt_rdy_put (p_task);
+    return;
+  }
+#endif
   if (p_CB->cb_type == SCB || p_CB->cb_type == MCB || p_CB->cb_type == MUCB) {
     sem_mbx = __TRUE;
   }
@@ -97,6 +265,11 @@ P_TCB rt_get_first (P_XCB p_CB) {
   /* "p_CB" points to head of list. */
   P_TCB p_first;
 
+#ifdef __RDY_BITMAP
+  if (p_CB == &os_rdy) {
+    return (rt_rdy_get ());
+  }
+#endif
   p_first = p_CB->p_lnk;
   p_CB->p_lnk = p_first->p_lnk;
   if (p_CB->cb_type == SCB || p_CB->cb_type == MCB || p_CB->cb_type == MUCB) {
@@ -118,9 +291,23 @@ P_TCB rt_get_first (P_XCB p_CB) {
 void rt_put_rdy_first (P_TCB p_task) {
   /* Put task identified with "p_task" at the head of the ready list. The   */
   /* task must have at least a priority equal to highest priority in list.  */
+#ifdef __RDY_BITMAP
+  U32 level = OS_RDY_LEVEL(p_task->prio);
+  struct OS_RDYQ *p_q = &os_rdyq[level];
+
+  p_task->p_lnk  = p_q->first;
+  p_task->p_rlnk = NULL;
+  if (p_q->first == NULL) {
+    p_q->last   = p_task;
+    os_rdy_map |= 1U << level;
+  }
+  p_q->first = p_task;
+  rt_rdy_head ();
+#else
   p_task->p_lnk = os_rdy.p_lnk;
   p_task->p_rlnk = NULL;
   os_rdy.p_lnk = p_task;
+#endif
 }
 
 
@@ -133,8 +320,12 @@ P_TCB rt_get_same_rdy_prio (void) {
 
   p_first = os_rdy.p_lnk;
   if (p_first->prio == os_tsk.run->prio) {
+#ifdef __RDY_BITMAP
+    return (rt_rdy_get ());
+#else
     os_rdy.p_lnk = os_rdy.p_lnk->p_lnk;
     return (p_first);
+#endif
   }
   return (NULL);
 }
@@ -249,7 +440,9 @@ void rt_dec_dly (void) {
 void rt_rmv_list (P_TCB p_task) {
   /* Remove task identified with "p_task" from ready, semaphore or mailbox  */
   /* waiting list if enqueued.                                              */
+#ifndef __RDY_BITMAP
   P_TCB p_b;
+#endif
 
   if (p_task->p_rlnk != NULL) {
     /* A task is enqueued in semaphore / mailbox waiting list. */
@@ -260,6 +453,9 @@ void rt_rmv_list (P_TCB p_task) {
     return;
   }
 
+#ifdef __RDY_BITMAP
+  rt_rdy_rmv (p_task);
+#else
   p_b = (P_TCB)&os_rdy;
   while (p_b != NULL) {
     /* Search the ready list for task "p_task" */
@@ -269,6 +465,7 @@ void rt_rmv_list (P_TCB p_task) {
     }
     p_b = p_b->p_lnk;
   }
+#endif
 }
 
 
@@ -307,6 +504,9 @@ void rt_psq_enq (OS_ID entry, U32 arg) {
   if (idx < os_psq->size) {
     os_psq->q[idx].id  = entry;
     os_psq->q[idx].arg = arg;
+    if (os_psq->count > os_psq_peak) {
+      os_psq_peak = os_psq->count;
+    }
   }
   else {
     os_error (OS_ERR_FIFO_OVF);
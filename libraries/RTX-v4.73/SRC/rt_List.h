@@ -41,11 +41,22 @@
 #define MUCB            3
 #define HCB             4
 
+#ifdef __RDY_BITMAP
+/* Priority levels of the ready queue, higher priorities share the top one */
+#define OS_RDY_LEVELS   32
+#define OS_RDY_LEVEL(prio) (((prio) < OS_RDY_LEVELS) ? (prio) : (OS_RDY_LEVELS - 1))
+#endif
+
 /* Variables */
 extern struct OS_XCB os_rdy;
 extern struct OS_XCB os_dly;
+extern U8 os_psq_peak;
+#ifdef __RDY_BITMAP
+extern U32 os_rdy_map;
+#endif
 
 /* Functions */
+extern void  rt_init_rdy      (void);
 extern void  rt_put_prio      (P_XCB p_CB, P_TCB p_task);
 extern P_TCB rt_get_first     (P_XCB p_CB);
 extern void  rt_put_rdy_first (P_TCB p_task);
@@ -35,9 +35,15 @@
 #include "rt_TypeDef.h"
 #include "rt_Memory.h"
 
+#if defined(__MEM_TLSF) && (__TARGET_ARCH_6S_M)
+ #error "The TLSF memory pools need the CLZ instruction."
+#endif
+
 
 /* Functions */
 
+#ifndef __MEM_TLSF
+
 // Initialize Dynamic Memory pool
 //   Parameters:
 //     pool:    Pointer to memory pool
@@ -138,3 +144,321 @@ int rt_free_mem (void *pool, void *mem) {
 
   return (0);
 }
+
+// Get statistics of a Memory pool
+//   Parameters:
+//     pool:    Pointer to memory pool
+//     stat:    Statistics, "peak" is not tracked by first fit and is 0
+//   Return:    0 - OK, 1 - Error
+
+int rt_stat_mem (void *pool, MEMSTAT *stat) {
+  MEMP *p_search;
+  U32   hole_size;
+
+  if ((pool == NULL) || (stat == NULL)) return (1);
+
+  stat->size    = 0;
+  stat->used    = 0;
+  stat->peak    = 0;
+  stat->largest = 0;
+  for (p_search = (MEMP *)pool; p_search->next != NULL; p_search = p_search->next) {
+    hole_size  = (U32)p_search->next - (U32)p_search;
+    stat->size += hole_size;
+    stat->used += p_search->len;
+    hole_size -= p_search->len;
+    if ((hole_size > sizeof(MEMP)) && (hole_size - sizeof(MEMP) > stat->largest)) {
+      stat->largest = hole_size - sizeof(MEMP);
+    }
+  }
+
+  return (0);
+}
+
+#else
+
+/* Two-level segregated fit. Free blocks are kept in lists by size class,  */
+/* power of two ranges split in MEM_SL_CNT sub-ranges, with a bitmap of the */
+/* non-empty lists. Allocation takes the first block of the smallest class */
+/* whose blocks all fit, found with two bit scans, and splits it. Freeing   */
+/* merges the block with free neighbours. Both take constant time.          */
+
+#define MEM_FREE        1U
+#define MEM_HDR_SIZE    (2*sizeof(void *))
+#define MEM_MIN_SIZE    sizeof(MEMBLK)
+#define MEM_CTRL_SIZE   ((sizeof(MEMCTRL) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1))
+
+#define MEM_SIZE(b)     ((b)->size & ~MEM_FREE)
+#define MEM_NEXT(b)     ((MEMBLK *)((U8 *)(b) + MEM_SIZE(b)))
+
+
+/*--------------------------- rt_mem_ffs ------------------------------------*/
+
+static __inline U32 rt_mem_ffs (U32 map) {
+  /* Return the lowest bit set in "map", which is not 0. */
+  return (31 - __clz (map & (0 - map)));
+}
+
+
+/*--------------------------- rt_mem_fls ------------------------------------*/
+
+static __inline U32 rt_mem_fls (U32 map) {
+  /* Return the highest bit set in "map", which is not 0. */
+  return (31 - __clz (map));
+}
+
+
+/*--------------------------- rt_mem_class ----------------------------------*/
+
+static void rt_mem_class (U32 size, U32 *fl, U32 *sl) {
+  /* Return the class of blocks of "size" bytes. Below 2^MEM_FL_SHIFT the   */
+  /* sub-ranges of class 0 are MEM_ALIGN bytes wide.                        */
+  U32 t;
+
+  if (size < (1U << MEM_FL_SHIFT)) {
+    *fl = 0;
+    *sl = size >> MEM_ALIGN_LOG2;
+  }
+  else {
+    t   = rt_mem_fls (size);
+    *fl = t - MEM_FL_SHIFT + 1;
+    *sl = (size >> (t - MEM_SL_LOG2)) & (MEM_SL_CNT - 1);
+  }
+}
+
+
+/*--------------------------- rt_mem_insert ---------------------------------*/
+
+static void rt_mem_insert (MEMCTRL *p_ctrl, MEMBLK *p_blk) {
+  /* Put free block "p_blk" at the head of the list of its class. */
+  U32 fl, sl;
+
+  rt_mem_class (MEM_SIZE(p_blk), &fl, &sl);
+  p_blk->size     |= MEM_FREE;
+  p_blk->prev_free = NULL;
+  p_blk->next_free = p_ctrl->free[fl][sl];
+  if (p_blk->next_free != NULL) {
+    p_blk->next_free->prev_free = p_blk;
+  }
+  p_ctrl->free[fl][sl] = p_blk;
+  p_ctrl->fl_map    |= 1U << fl;
+  p_ctrl->sl_map[fl] |= (U8)(1U << sl);
+}
+
+
+/*--------------------------- rt_mem_remove ---------------------------------*/
+
+static void rt_mem_remove (MEMCTRL *p_ctrl, MEMBLK *p_blk) {
+  /* Take free block "p_blk" out of the list of its class. */
+  U32 fl, sl;
+
+  rt_mem_class (MEM_SIZE(p_blk), &fl, &sl);
+  if (p_blk->prev_free != NULL) {
+    p_blk->prev_free->next_free = p_blk->next_free;
+  }
+  else {
+    p_ctrl->free[fl][sl] = p_blk->next_free;
+    if (p_blk->next_free == NULL) {
+      p_ctrl->sl_map[fl] &= (U8)~(1U << sl);
+      if (p_ctrl->sl_map[fl] == 0) {
+        p_ctrl->fl_map &= ~(1U << fl);
+      }
+    }
+  }
+  if (p_blk->next_free != NULL) {
+    p_blk->next_free->prev_free = p_blk->prev_free;
+  }
+  p_blk->size &= ~MEM_FREE;
+}
+
+
+/*--------------------------- rt_mem_find -----------------------------------*/
+
+static MEMBLK *rt_mem_find (MEMCTRL *p_ctrl, U32 size) {
+  /* Return a free block of at least "size" bytes, NULL if there is none.   */
+  /* The size is rounded up to the start of a sub-range, so that any block  */
+  /* found fits. Failing that the head of the list of "size" may still fit. */
+  U32 fl, sl, map;
+  MEMBLK *p_fit;
+
+  rt_mem_class (size, &fl, &sl);
+  p_fit = p_ctrl->free[fl][sl];
+  if (size >= (1U << MEM_FL_SHIFT)) {
+    rt_mem_class (size + (1U << (rt_mem_fls (size) - MEM_SL_LOG2)) - 1, &fl, &sl);
+  }
+  if (fl < MEM_FL_CNT) {
+    map = p_ctrl->sl_map[fl] & (~0U << sl);
+    if (map == 0) {
+      map = p_ctrl->fl_map & (~0U << (fl + 1));
+      if (map != 0) {
+        fl  = rt_mem_ffs (map);
+        map = p_ctrl->sl_map[fl];
+      }
+    }
+    if (map != 0) {
+      return (p_ctrl->free[fl][rt_mem_ffs (map)]);
+    }
+  }
+  if ((p_fit != NULL) && (MEM_SIZE(p_fit) >= size)) {
+    return (p_fit);
+  }
+  return (NULL);
+}
+
+
+// Initialize Dynamic Memory pool
+//   Parameters:
+//     pool:    Pointer to memory pool, aligned to MEM_ALIGN
+//     size:    Size of memory pool in bytes
+//   Return:    0 - OK, 1 - Error
+
+int rt_init_mem (void *pool, U32 size) {
+  MEMCTRL *p_ctrl;
+  MEMBLK  *p_blk, *p_end;
+  U32 i, j;
+
+  if ((pool == NULL) || ((U32)pool & (MEM_ALIGN - 1))) return (1);
+
+  size &= ~(MEM_ALIGN - 1);
+  if (size < MEM_CTRL_SIZE + MEM_MIN_SIZE + MEM_HDR_SIZE) return (1);
+  size -= MEM_CTRL_SIZE + MEM_HDR_SIZE;
+  if (size >> (MEM_FL_MAX + 1)) return (1);
+
+  p_ctrl = (MEMCTRL *)pool;
+  p_ctrl->size   = size;
+  p_ctrl->used   = 0;
+  p_ctrl->peak   = 0;
+  p_ctrl->fl_map = 0;
+  for (i = 0; i < MEM_FL_CNT; i++) {
+    p_ctrl->sl_map[i] = 0;
+    for (j = 0; j < MEM_SL_CNT; j++) {
+      p_ctrl->free[i][j] = NULL;
+    }
+  }
+
+  /* One free block, followed by an allocated end marker of size 0. */
+  p_blk = (MEMBLK *)((U8 *)pool + MEM_CTRL_SIZE);
+  p_blk->prev = NULL;
+  p_blk->size = size;
+  p_end = MEM_NEXT(p_blk);
+  p_end->prev = p_blk;
+  p_end->size = 0;
+  rt_mem_insert (p_ctrl, p_blk);
+
+  return (0);
+}
+
+// Allocate Memory from Memory pool
+//   Parameters:
+//     pool:    Pointer to memory pool
+//     size:    Size of memory in bytes to allocate
+//   Return:    Pointer to allocated memory
+
+void *rt_alloc_mem (void *pool, U32 size) {
+  MEMCTRL *p_ctrl = (MEMCTRL *)pool;
+  MEMBLK  *p_blk, *p_rest;
+
+  if ((pool == NULL) || (size == 0) || (size > p_ctrl->size)) return NULL;
+
+  /* Add header offset to 'size' and align it */
+  size = (size + MEM_HDR_SIZE + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+  if (size < MEM_MIN_SIZE) {
+    size = MEM_MIN_SIZE;
+  }
+
+  p_blk = rt_mem_find (p_ctrl, size);
+  if (p_blk == NULL) {
+    return NULL;
+  }
+  rt_mem_remove (p_ctrl, p_blk);
+
+  /* Return the rest to the pool if it can hold a free block */
+  if (p_blk->size - size >= MEM_MIN_SIZE) {
+    p_rest = (MEMBLK *)((U8 *)p_blk + size);
+    p_rest->prev = p_blk;
+    p_rest->size = p_blk->size - size;
+    MEM_NEXT(p_rest)->prev = p_rest;
+    p_blk->size = size;
+    rt_mem_insert (p_ctrl, p_rest);
+  }
+
+  p_ctrl->used += p_blk->size;
+  if (p_ctrl->used > p_ctrl->peak) {
+    p_ctrl->peak = p_ctrl->used;
+  }
+
+  return ((U8 *)p_blk + MEM_HDR_SIZE);
+}
+
+// Free Memory and return it to Memory pool
+//   Parameters:
+//     pool:    Pointer to memory pool
+//     mem:     Pointer to memory to free
+//   Return:    0 - OK, 1 - Error
+
+int rt_free_mem (void *pool, void *mem) {
+  MEMCTRL *p_ctrl = (MEMCTRL *)pool;
+  MEMBLK  *p_blk, *p_next;
+  U32 offset;
+
+  if ((pool == NULL) || (mem == NULL)) return (1);
+
+  /* The block must be an allocated one inside the pool */
+  offset = (U32)((U8 *)mem - MEM_HDR_SIZE - ((U8 *)pool + MEM_CTRL_SIZE));
+  if ((offset >= p_ctrl->size) || (offset & (MEM_ALIGN - 1))) return (1);
+  p_blk = (MEMBLK *)((U8 *)mem - MEM_HDR_SIZE);
+  if ((p_blk->size & MEM_FREE) || (p_blk->size == 0)) return (1);
+
+  p_ctrl->used -= p_blk->size;
+
+  /* Merge with the following and the preceding block when they are free */
+  p_next = MEM_NEXT(p_blk);
+  if (p_next->size & MEM_FREE) {
+    rt_mem_remove (p_ctrl, p_next);
+    p_blk->size += p_next->size;
+    MEM_NEXT(p_blk)->prev = p_blk;
+  }
+  if ((p_blk->prev != NULL) && (p_blk->prev->size & MEM_FREE)) {
+    rt_mem_remove (p_ctrl, p_blk->prev);
+    p_blk->prev->size += p_blk->size;
+    p_blk = p_blk->prev;
+    MEM_NEXT(p_blk)->prev = p_blk;
+  }
+  rt_mem_insert (p_ctrl, p_blk);
+
+  return (0);
+}
+
+// Get statistics of a Memory pool
+//   Parameters:
+//     pool:    Pointer to memory pool
+//     stat:    Statistics
+//   Return:    0 - OK, 1 - Error
+
+int rt_stat_mem (void *pool, MEMSTAT *stat) {
+  MEMCTRL *p_ctrl = (MEMCTRL *)pool;
+  MEMBLK  *p_blk;
+  U32 fl, sl, size;
+
+  if ((pool == NULL) || (stat == NULL)) return (1);
+
+  stat->size    = p_ctrl->size;
+  stat->used    = p_ctrl->used;
+  stat->peak    = p_ctrl->peak;
+  stat->largest = 0;
+
+  /* The largest free block is in the highest non-empty list */
+  if (p_ctrl->fl_map != 0) {
+    fl = rt_mem_fls (p_ctrl->fl_map);
+    sl = rt_mem_fls (p_ctrl->sl_map[fl]);
+    for (p_blk = p_ctrl->free[fl][sl]; p_blk != NULL; p_blk = p_blk->next_free) {
+      size = MEM_SIZE(p_blk) - MEM_HDR_SIZE;
+      if (size > stat->largest) {
+        stat->largest = size;
+      }
+    }
+  }
+
+  return (0);
+}
+
+#endif
@@ -38,7 +38,44 @@ typedef struct mem {              /* << Memory Pool management struct >>     */
   U32         len;                /* Length of data block                    */
 } MEMP;
 
+#ifdef __MEM_TLSF
+/* Two-level segregated fit: a pool holds its control block, the blocks    */
+/* and an end marker. Block sizes include the header and are multiples of  */
+/* MEM_ALIGN, the classes are 8 sub-ranges of each power of two.           */
+#define MEM_ALIGN       8
+#define MEM_ALIGN_LOG2  3
+#define MEM_SL_LOG2     3
+#define MEM_SL_CNT      (1 << MEM_SL_LOG2)
+#define MEM_FL_SHIFT    (MEM_SL_LOG2 + MEM_ALIGN_LOG2)
+#define MEM_FL_MAX      16        /* Largest block below 2^(MEM_FL_MAX+1)    */
+#define MEM_FL_CNT      (MEM_FL_MAX - MEM_FL_SHIFT + 2)
+
+typedef struct mem_blk {          /* << Memory Pool block header >>          */
+  struct mem_blk *prev;           /* Previous block in memory                */
+  U32             size;           /* Block size, bit 0 set while it is free  */
+  struct mem_blk *next_free;      /* Free list links, only in free blocks    */
+  struct mem_blk *prev_free;
+} MEMBLK;
+
+typedef struct mem_ctrl {         /* << Memory Pool control block >>         */
+  U32     size;                   /* Bytes for blocks, with their headers    */
+  U32     used;                   /* Bytes of allocated blocks               */
+  U32     peak;                   /* Highest value of "used"                 */
+  U32     fl_map;                 /* Bit n set while class n has free blocks */
+  U8      sl_map[MEM_FL_CNT];     /* The same for each sub-range of class n  */
+  MEMBLK *free[MEM_FL_CNT][MEM_SL_CNT];
+} MEMCTRL;
+#endif
+
+typedef struct mem_stat {         /* << Memory Pool statistics >>            */
+  U32 size;                       /* Bytes for blocks, with their headers    */
+  U32 used;                       /* Bytes of allocated blocks               */
+  U32 peak;                       /* Highest value of "used"                 */
+  U32 largest;                    /* Largest free block, less its header     */
+} MEMSTAT;
+
 /* Functions */
 extern int   rt_init_mem  (void *pool, U32  size);
 extern void *rt_alloc_mem (void *pool, U32  size);
 extern int   rt_free_mem  (void *pool, void *mem);
+extern int   rt_stat_mem  (void *pool, MEMSTAT *stat);
@@ -246,6 +246,11 @@ void rt_pop_req (void) {
   }
   os_psq->last = idx;
 
+  /* Deliver the ISR channels posted since the last request. */
+  if (os_ich_pend) {
+    rt_ich_psh ();
+  }
+
   next = rt_get_first (&os_rdy);
   rt_switch_req (next);
 }
@@ -374,8 +374,7 @@ void rt_sys_init (FUNCP first_task, U32 prio_stksz, void *stk) {
   rt_init_context (&os_idle_TCB, 0, os_idle_demon);
 
   /* Set up ready list: initially empty */
-  os_rdy.cb_type = HCB;
-  os_rdy.p_lnk   = NULL;
+  rt_init_rdy ();
   /* Set up delay list: initially empty */
   os_dly.cb_type = HCB;
   os_dly.p_dlnk  = NULL;
@@ -0,0 +1,26 @@
+/*----------------------------------------------------------------------------
+ *      Name:    HOST.H
+ *      Purpose: Compiler definitions for building kernel sources on a host
+ *---------------------------------------------------------------------------*/
+
+/* Forced into each kernel source, which is compiled with __GNUC__ undefined */
+/* so that rt_HAL_CM.h leaves out its Cortex-M inline assembly. The          */
+/* interrupt masking functions do nothing, the tests are single threaded.    */
+
+#define __inline inline
+#define __weak   __attribute__((weak))
+
+static inline unsigned char __clz (unsigned int value) {
+  return (value ? (unsigned char)__builtin_clz (value) : 32);
+}
+
+static inline unsigned int __disable_irq (void) {
+  return (0);
+}
+
+static inline void __enable_irq (void) {
+}
+
+/*----------------------------------------------------------------------------
+ * end of file
+ *---------------------------------------------------------------------------*/
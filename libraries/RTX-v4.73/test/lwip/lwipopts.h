@@ -0,0 +1,22 @@
+/*----------------------------------------------------------------------------
+ *      Name:    LWIPOPTS.H
+ *      Purpose: lwIP options for building its heap (mem.c) on a host
+ *---------------------------------------------------------------------------*/
+
+#ifndef __LWIPOPTS_H__
+#define __LWIPOPTS_H__
+
+/* The heap of the firmware, see code/inc/lwipopts.h, without the system. */
+#define NO_SYS                  1
+#define SYS_LIGHTWEIGHT_PROT    0
+#define MEM_ALIGNMENT           4
+#define MEM_SIZE                (4 * 1024)
+#define LWIP_STATS              0
+#define LWIP_NETCONN            0
+#define LWIP_SOCKET             0
+
+#endif /* __LWIPOPTS_H__ */
+
+/*----------------------------------------------------------------------------
+ * end of file
+ *---------------------------------------------------------------------------*/
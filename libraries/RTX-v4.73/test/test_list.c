@@ -0,0 +1,353 @@
+/*----------------------------------------------------------------------------
+ *      Name:    TEST_LIST.C
+ *      Purpose: Host test of the ready and wait list functions
+ *---------------------------------------------------------------------------*/
+
+/* Random operations on the ready list and a semaphore wait list are       */
+/* checked against a model, a priority sorted array of the tasks in FIFO    */
+/* order within each priority. The same test is linked with both versions  */
+/* of rt_List.c, and ends by timing Round Robin rotation of the ready list. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* rt_TypeDef.h defines its own NULL. */
+#undef NULL
+#include "rt_TypeDef.h"
+#include "RTX_Config.h"
+#include "rt_List.h"
+#include "rt_Task.h"
+
+#define TASKS           24
+#define OPERATIONS      200000
+#define ROTATIONS       1000000
+
+/* Kernel variables used by rt_List.c. */
+struct OS_TSK os_tsk;
+U32 os_time;
+U32 os_fifo[4];
+
+struct MODEL {
+  P_TCB  task[TASKS];
+  int    count;
+};
+
+static struct OS_TCB tasks[TASKS];
+static struct OS_SCB sem;
+static struct MODEL  rdy_model;
+static struct MODEL  sem_model;
+static U32 step;
+
+void os_error (U32 err_code) {
+  printf ("os_error %u\n", err_code);
+  exit (1);
+}
+
+static void fail (const char *what) {
+  printf ("FAIL at operation %u: %s\n", step, what);
+  exit (1);
+}
+
+/*--------------------------- model -----------------------------------------*/
+
+static void model_put (struct MODEL *m, P_TCB p_task) {
+  /* Insert after all tasks with the same or a higher priority. */
+  int i, j;
+
+  for (i = 0; i < m->count && m->task[i]->prio >= p_task->prio; i++);
+  for (j = m->count; j > i; j--) {
+    m->task[j] = m->task[j-1];
+  }
+  m->task[i] = p_task;
+  m->count++;
+}
+
+static void model_put_first (struct MODEL *m, P_TCB p_task) {
+  int j;
+
+  for (j = m->count; j > 0; j--) {
+    m->task[j] = m->task[j-1];
+  }
+  m->task[0] = p_task;
+  m->count++;
+}
+
+static BOOL model_remove (struct MODEL *m, P_TCB p_task) {
+  int i;
+
+  for (i = 0; i < m->count && m->task[i] != p_task; i++);
+  if (i == m->count) {
+    return (__FALSE);
+  }
+  for (m->count--; i < m->count; i++) {
+    m->task[i] = m->task[i+1];
+  }
+  return (__TRUE);
+}
+
+static P_TCB model_head (struct MODEL *m) {
+  return (m->count ? m->task[0] : NULL);
+}
+
+/*--------------------------- checks ----------------------------------------*/
+
+static void check_lists (void) {
+  /* Check the heads, and the whole semaphore list which is doubly linked. */
+  P_TCB p, p_prev;
+  int i;
+
+  if (os_rdy.p_lnk != model_head (&rdy_model)) {
+    fail ("ready list head");
+  }
+#ifdef __RDY_BITMAP
+  {
+    U32 map = 0;
+
+    for (i = 0; i < rdy_model.count; i++) {
+      map |= 1U << OS_RDY_LEVEL(rdy_model.task[i]->prio);
+    }
+    if (map != os_rdy_map) {
+      fail ("ready map");
+    }
+  }
+#endif
+  for (i = 0; i < rdy_model.count; i++) {
+    if (rdy_model.task[i]->p_rlnk != NULL) {
+      fail ("ready task with backward link");
+    }
+  }
+  p_prev = (P_TCB)&sem;
+  for (i = 0, p = sem.p_lnk; p != NULL; i++, p = p->p_lnk) {
+    if (i >= sem_model.count || p != sem_model.task[i]) {
+      fail ("semaphore list order");
+    }
+    if (p->p_rlnk != p_prev) {
+      fail ("semaphore list backward link");
+    }
+    p_prev = p;
+  }
+  if (i != sem_model.count) {
+    fail ("semaphore list length");
+  }
+}
+
+static void check_order (void) {
+  /* Take all ready tasks in order and put them back. */
+  P_TCB p;
+  int i;
+
+  for (i = 0; i < rdy_model.count; i++) {
+    p = rt_get_first (&os_rdy);
+    if (p != rdy_model.task[i]) {
+      fail ("ready list order");
+    }
+  }
+  if (os_rdy.p_lnk != NULL) {
+    fail ("ready list not empty");
+  }
+  for (i = 0; i < rdy_model.count; i++) {
+    rt_put_prio (&os_rdy, rdy_model.task[i]);
+  }
+}
+
+/*--------------------------- operations ------------------------------------*/
+
+static U8 random_prio (void) {
+  /* Mostly a few CMSIS priorities, so that levels have several tasks. The */
+  /* 255 of a starting kernel shares the top level of the ready queue      */
+  /* bitmap, 31 is left out so the two never meet.                         */
+  switch (rand () % 16) {
+    case 0:  return (255);
+    case 1:  return (30);
+    case 2:  return ((U8)(rand () % 30));
+    default: return ((U8)(1 + rand () % 7));
+  }
+}
+
+static P_TCB random_task (U8 state) {
+  /* A random task in state "state", NULL if there is none. */
+  int i, n = 0;
+  P_TCB found = NULL;
+
+  for (i = 0; i < TASKS; i++) {
+    if (tasks[i].state == state && rand () % ++n == 0) {
+      found = &tasks[i];
+    }
+  }
+  return (found);
+}
+
+static void release (P_TCB p_task) {
+  p_task->state  = INACTIVE;
+  p_task->p_lnk  = NULL;
+  p_task->p_rlnk = NULL;
+}
+
+static void operation (void) {
+  P_TCB p_task, p_head, p;
+
+  p_head = model_head (&rdy_model);
+
+  switch (rand () % 9) {
+    case 0:
+    case 1:
+      /* A task becomes ready. */
+      if ((p_task = random_task (INACTIVE)) != NULL) {
+        p_task->prio  = random_prio ();
+        p_task->state = READY;
+        rt_put_prio (&os_rdy, p_task);
+        model_put (&rdy_model, p_task);
+      }
+      break;
+    case 2:
+      /* The highest ready task is dispatched. */
+      if (p_head != NULL) {
+        p = rt_get_first (&os_rdy);
+        if (p != p_head || !model_remove (&rdy_model, p)) {
+          fail ("rt_get_first");
+        }
+        release (p);
+      }
+      break;
+    case 3:
+      /* The running task is preempted. */
+      if ((p_task = random_task (INACTIVE)) != NULL) {
+        p_task->prio = random_prio ();
+        if (p_head != NULL && p_task->prio < p_head->prio) {
+          p_task->prio = p_head->prio;
+        }
+        p_task->state = READY;
+        rt_put_rdy_first (p_task);
+        model_put_first (&rdy_model, p_task);
+      }
+      break;
+    case 4:
+      /* The running task passes to one of its priority. */
+      if ((p_task = random_task (INACTIVE)) != NULL && p_head != NULL) {
+        p_task->prio = (rand () % 2) ? p_head->prio : random_prio ();
+        os_tsk.run = p_task;
+        p = rt_get_same_rdy_prio ();
+        if (p_head->prio == p_task->prio) {
+          if (p != p_head || !model_remove (&rdy_model, p)) {
+            fail ("rt_get_same_rdy_prio");
+          }
+          release (p);
+        }
+        else if (p != NULL) {
+          fail ("rt_get_same_rdy_prio of other priority");
+        }
+      }
+      break;
+    case 5:
+      /* A task is deleted. */
+      p_task = &tasks[rand () % TASKS];
+      rt_rmv_list (p_task);
+      model_remove (&rdy_model, p_task);
+      model_remove (&sem_model, p_task);
+      release (p_task);
+      break;
+    case 6:
+      /* The priority of a ready or waiting task changes. */
+      p_task = &tasks[rand () % TASKS];
+      if (p_task->state == READY || p_task->state == WAIT_SEM) {
+        p_task->prio = random_prio ();
+        rt_resort_prio (p_task);
+        if (model_remove (&rdy_model, p_task)) {
+          model_put (&rdy_model, p_task);
+        }
+        if (model_remove (&sem_model, p_task)) {
+          model_put (&sem_model, p_task);
+        }
+      }
+      break;
+    case 7:
+      /* A task waits for the semaphore. */
+      if ((p_task = random_task (INACTIVE)) != NULL) {
+        p_task->prio  = random_prio ();
+        p_task->state = WAIT_SEM;
+        rt_put_prio ((P_XCB)&sem, p_task);
+        model_put (&sem_model, p_task);
+      }
+      break;
+    case 8:
+      /* The semaphore is released to its first waiting task. */
+      if (sem.p_lnk != NULL) {
+        p = rt_get_first ((P_XCB)&sem);
+        if (p != model_head (&sem_model) || !model_remove (&sem_model, p)) {
+          fail ("rt_get_first of semaphore");
+        }
+        p->state = READY;
+        rt_put_prio (&os_rdy, p);
+        model_put (&rdy_model, p);
+      }
+      break;
+  }
+}
+
+/*--------------------------- rotate ----------------------------------------*/
+
+static void rotate (int count) {
+  /* Time Round Robin rotation among "count" ready tasks of one priority. */
+  struct timespec t0, t1;
+  P_TCB p;
+  double ns;
+  int i;
+
+  rt_init_rdy ();
+  for (i = 0; i < count; i++) {
+    release (&tasks[i]);
+    tasks[i].prio  = 4;
+    tasks[i].state = READY;
+    rt_put_prio (&os_rdy, &tasks[i]);
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < ROTATIONS; i++) {
+    p = rt_get_first (&os_rdy);
+    rt_put_prio (&os_rdy, p);
+  }
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+
+  if (os_rdy.p_lnk != &tasks[ROTATIONS % count]) {
+    fail ("rotation order");
+  }
+  ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ROTATIONS;
+  printf ("  rotate %2d ready tasks: %5.1f ns\n", count, ns);
+}
+
+int main (void) {
+  int i;
+
+  srand (1);
+  rt_init_rdy ();
+  sem.cb_type = SCB;
+  for (i = 0; i < TASKS; i++) {
+    tasks[i].cb_type = TCB;
+    tasks[i].task_id = (U8)(i + 1);
+    release (&tasks[i]);
+  }
+
+  for (step = 0; step < OPERATIONS; step++) {
+    operation ();
+    check_lists ();
+    if (step % 64 == 0) {
+      check_order ();
+    }
+  }
+
+#ifdef __RDY_BITMAP
+  printf ("ready queue bitmap: %u operations ok\n", OPERATIONS);
+#else
+  printf ("sorted ready list: %u operations ok\n", OPERATIONS);
+#endif
+  rotate (2);
+  rotate (8);
+  rotate (TASKS);
+
+  return (0);
+}
+
+/*----------------------------------------------------------------------------
+ * end of file
+ *---------------------------------------------------------------------------*/
@@ -0,0 +1,342 @@
+/*----------------------------------------------------------------------------
+ *      Name:    TEST_MEM.C
+ *      Purpose: Host stress test of the dynamic memory allocators
+ *---------------------------------------------------------------------------*/
+
+/* The same test is linked with the first fit and the TLSF versions of     */
+/* rt_Memory.c, and with the heap of lwIP (mem.c, MEM_LWIP). Each gets a    */
+/* heap with HEAP bytes for blocks and their headers. Random allocations of */
+/* frame sized buffers are checked for overlap with a fill pattern, and     */
+/* their times are taken. The heap is then cut up into small blocks, every  */
+/* second one freed, and an allocation that fits none of the holes timed.   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#ifdef MEM_LWIP
+#include "lwip/opt.h"
+#include "lwip/mem.h"
+typedef u32_t U32;
+#else
+/* rt_TypeDef.h defines its own NULL. */
+#undef NULL
+#include "rt_TypeDef.h"
+#include "rt_Memory.h"
+#define MEM_ALIGNMENT   4
+#endif
+
+#define HEAP            (4 * 1024)
+#define LIVE            64
+#define OPERATIONS      200000
+#define CUTS            1000
+#define SMALL           16
+
+struct BLOCK {
+  unsigned char *mem;
+  U32            size;
+  unsigned char  fill;
+};
+
+static struct BLOCK live[LIVE];
+static int    count;
+static U32    live_bytes;
+static double alloc_ns[OPERATIONS];
+static double free_ns[OPERATIONS];
+static int    allocs, frees;
+static double clock_ns;
+static U32    step;
+
+#ifndef MEM_LWIP
+static void  *pool;
+#endif
+
+static void fail (const char *what) {
+  printf ("FAIL at operation %u: %s\n", step, what);
+  exit (1);
+}
+
+/*--------------------------- heap ------------------------------------------*/
+
+static void heap_init (void) {
+#ifdef MEM_LWIP
+  mem_init ();
+#else
+  /* The first fit version keeps addresses in 32 bits. */
+  U32 size = HEAP;
+
+#ifdef __MEM_TLSF
+  size += ((sizeof(MEMCTRL) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1)) + 2*sizeof(void *);
+#else
+  size += sizeof(MEMP) + sizeof(void *);
+#endif
+  pool = mmap (NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+  if (pool == MAP_FAILED || rt_init_mem (pool, size) != 0) {
+    fail ("heap init");
+  }
+#endif
+}
+
+static void *heap_alloc (U32 size) {
+#ifdef MEM_LWIP
+  return (mem_malloc ((mem_size_t)size));
+#else
+  return (rt_alloc_mem (pool, size));
+#endif
+}
+
+static void heap_free (void *mem) {
+#ifdef MEM_LWIP
+  mem_free (mem);
+#else
+  if (rt_free_mem (pool, mem) != 0) {
+    fail ("rt_free_mem");
+  }
+#endif
+}
+
+static double now (void) {
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return (t.tv_sec * 1e9 + t.tv_nsec);
+}
+
+static double overhead (void) {
+  /* The least time between two readings of the clock, taken off each time. */
+  double t0, t, least = 1e9;
+  int i;
+
+  for (i = 0; i < 10000; i++) {
+    t0 = now ();
+    t  = now () - t0;
+    if (t < least) {
+      least = t;
+    }
+  }
+  return (least);
+}
+
+/*--------------------------- checks ----------------------------------------*/
+
+static void check_block (struct BLOCK *b) {
+  U32 i;
+
+  for (i = 0; i < b->size; i++) {
+    if (b->mem[i] != b->fill) {
+      fail ("block overwritten");
+    }
+  }
+}
+
+#ifdef __MEM_TLSF
+static U32 block_size (U32 size) {
+  /* Bytes of the block for an allocation of "size" bytes. */
+  size = (size + 2*sizeof(void *) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+  return (size < sizeof(MEMBLK) ? sizeof(MEMBLK) : size);
+}
+
+static void check_stat (void) {
+  /* Walk the blocks of the pool: they must be linked back, cover the pool, */
+  /* and no two free ones may be neighbours. The statistics must agree with */
+  /* them and with the live blocks, which may have taken a rest too small   */
+  /* for a free block.                                                      */
+  MEMSTAT stat;
+  MEMBLK *p, *p_prev = NULL;
+  U32 used = 0, blocks = 0, total = 0, largest = 0;
+  int i, was_free = 0;
+
+  for (i = 0; i < count; i++) {
+    used += block_size (live[i].size);
+  }
+  p = (MEMBLK *)((U8 *)pool + ((sizeof(MEMCTRL) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1)));
+  for (; p->size != 0; p_prev = p, p = (MEMBLK *)((U8 *)p + (p->size & ~1U))) {
+    if (p->prev != p_prev) {
+      fail ("block backward link");
+    }
+    if (p->size & 1) {
+      if (was_free) {
+        fail ("free blocks not merged");
+      }
+      if ((p->size & ~1U) - 2*sizeof(void *) > largest) {
+        largest = (p->size & ~1U) - 2*sizeof(void *);
+      }
+    }
+    else {
+      blocks += p->size;
+    }
+    was_free = p->size & 1;
+    total   += p->size & ~1U;
+  }
+  if (p->prev != p_prev) {
+    fail ("end marker backward link");
+  }
+  if (rt_stat_mem (pool, &stat) != 0 || total != stat.size || blocks != stat.used ||
+      stat.used < used || stat.used > used + count * sizeof(MEMBLK) ||
+      stat.peak < stat.used || stat.largest != largest) {
+    fail ("statistics");
+  }
+}
+#endif
+
+/*--------------------------- operations ------------------------------------*/
+
+static U32 random_size (void) {
+  /* Messages and acknowledgements, mid sized segments and full frames. */
+  int r = rand () % 20;
+
+  if (r < 12) return (20 + rand () % 100);
+  if (r < 17) return (200 + rand () % 400);
+  return (1000 + rand () % 600);
+}
+
+static int failures;
+static double fill_at_failure;
+
+static void operation (void) {
+  struct BLOCK *b;
+  double t0, t1;
+  U32 size;
+  int i;
+
+  if (count < LIVE && (count == 0 || rand () % 100 < 55)) {
+    size = random_size ();
+    t0 = now ();
+    b  = &live[count];
+    b->mem = heap_alloc (size);
+    t1 = now ();
+    if (b->mem == NULL) {
+      /* Live bytes, against the heap size, when an allocation fails. */
+      failures++;
+      fill_at_failure += (double)live_bytes / HEAP;
+      return;
+    }
+    alloc_ns[allocs++] = t1 - t0 - clock_ns;
+    if ((size_t)b->mem & (MEM_ALIGNMENT - 1)) {
+      fail ("alignment");
+    }
+    b->size = size;
+    b->fill = (unsigned char)rand ();
+    memset (b->mem, b->fill, size);
+    live_bytes += size;
+    count++;
+  }
+  else {
+    i = rand () % count;
+    b = &live[i];
+    check_block (b);
+    t0 = now ();
+    heap_free (b->mem);
+    t1 = now ();
+    free_ns[frees++] = t1 - t0 - clock_ns;
+    live_bytes -= b->size;
+    *b = live[--count];
+  }
+}
+
+/*--------------------------- report ----------------------------------------*/
+
+static int compare (const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x < y ? -1 : x > y);
+}
+
+static void report (const char *name, double *ns, int n) {
+  double sum = 0;
+  int i;
+
+  qsort (ns, n, sizeof(double), compare);
+  for (i = 0; i < n; i++) {
+    sum += ns[i];
+  }
+  printf ("  %-5s %7d  avg %6.1f  99.9%% %6.1f  max %8.1f ns\n",
+          name, n, n ? sum / n : 0, n ? ns[n - 1 - n / 1000] : 0, n ? ns[n - 1] : 0);
+}
+
+/*--------------------------- cut -------------------------------------------*/
+
+static void cut (void) {
+  /* Fill the heap with small blocks, free every second one, and time an */
+  /* allocation that none of the holes can take.                         */
+  static void *small[HEAP / SMALL];
+  double t0, worst = 0, sum = 0;
+  int n, i, k;
+  void *mem;
+
+  for (n = 0; n < HEAP / SMALL && (small[n] = heap_alloc (SMALL)) != NULL; n++);
+  for (i = 0; i < n; i += 2) {
+    heap_free (small[i]);
+  }
+  for (k = 0; k < CUTS; k++) {
+    t0  = now ();
+    mem = heap_alloc (4 * SMALL);
+    t0  = now () - t0 - clock_ns;
+    if (mem != NULL) {
+      heap_free (mem);
+    }
+    sum += t0;
+    if (t0 > worst) {
+      worst = t0;
+    }
+  }
+  for (i = 1; i < n; i += 2) {
+    heap_free (small[i]);
+  }
+  printf ("  cut   %7d  avg %6.1f  max %8.1f ns with %d holes\n", CUTS, sum / CUTS, worst, (n + 1) / 2);
+}
+
+int main (void) {
+  U32 largest;
+  void *mem;
+
+  srand (1);
+  clock_ns = overhead ();
+  heap_init ();
+
+  /* The largest allocation of the empty heap. */
+  for (largest = HEAP; largest > 0 && (mem = heap_alloc (largest)) == NULL; largest--);
+  heap_free (mem);
+
+  for (step = 0; step < OPERATIONS; step++) {
+    operation ();
+#ifdef __MEM_TLSF
+    if (step % 64 == 0) {
+      check_stat ();
+    }
+#endif
+  }
+  while (count > 0) {
+    check_block (&live[count - 1]);
+    heap_free (live[--count].mem);
+  }
+
+  /* All blocks are merged again. */
+  if ((mem = heap_alloc (largest)) == NULL) {
+    fail ("heap not merged");
+  }
+  heap_free (mem);
+
+#if defined(MEM_LWIP)
+  printf ("lwip heap: %u operations ok\n", OPERATIONS);
+#elif defined(__MEM_TLSF)
+  printf ("tlsf: %u operations ok\n", OPERATIONS);
+#else
+  printf ("first fit: %u operations ok\n", OPERATIONS);
+#endif
+  printf ("  largest allocation %u of %u bytes\n", largest, HEAP);
+  printf ("  failed  %6d  at %.0f%% of the heap allocated on average\n",
+          failures, failures ? 100 * fill_at_failure / failures : 0);
+  report ("alloc", alloc_ns, allocs);
+  report ("free", free_ns, frees);
+  cut ();
+
+  return (0);
+}
+
+/*----------------------------------------------------------------------------
+ * end of file
+ *---------------------------------------------------------------------------*/
@@ -90,4 +90,10 @@ typedef int sys_prot_t;
 
 #define LWIP_PLATFORM_ASSERT(x) //do { if(!(x)) while(1); } while(0)
 
+/* Optimised checksum routines in chksum.c */
+u16_t lwip_fast_chksum(void *dataptr, int len);
+u16_t lwip_fast_chksum_copy(void *dst, const void *src, u16_t len);
+#define LWIP_CHKSUM lwip_fast_chksum
+#define LWIP_CHKSUM_COPY(dst, src, len) lwip_fast_chksum_copy(dst, src, len)
+
 #endif /* __CC_H__ */
@@ -0,0 +1,311 @@
+/**
+ * @file
+ * Internet checksum routines optimised for the Cortex-M4
+ *
+ */
+
+/*
+ * The block loops sum 32 bytes per iteration.  On the Cortex-M4 the even
+ * and odd bytes of each word are accumulated in the two 16-bit lanes of a
+ * pair of registers with the UXTAB16 SIMD instruction, and the lanes are
+ * folded into the 32-bit sum before they can overflow.  The portable C
+ * version adds the two halfwords of each word and folds once per block.
+ * Both produce exactly the same result as lwip_standard_chksum().
+ *
+ * Define CHKSUM_SIMD to 0 to build the portable version.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+
+#include <string.h>
+
+#ifndef CHKSUM_SIMD
+#include "stm32f4xx.h"
+#define CHKSUM_SIMD 1
+#endif
+
+/* Number of bytes summed per block loop iteration. */
+#define CHKSUM_BLOCK_SIZE 32
+
+/* Blocks summed before the SIMD lanes are folded.  Each 16-bit lane gains
+   at most 8 * 255 per block, so 32 blocks stay below 0xffff. */
+#define CHKSUM_LANE_BLOCKS 32
+
+#if CHKSUM_SIMD
+
+/* Add the even and odd bytes of a word to the lane accumulators.  The
+   rotate is plain C, the CMSIS core of this tree has no __ROR, and the
+   compiler emits a single ROR for it. */
+#define CHKSUM_WORD(w) do { \
+  even = __UXTAB16(even, (w)); \
+  odd = __UXTAB16(odd, (((w) >> 8) | ((w) << 24))); } while(0)
+
+/* Fold the lane accumulators into the 32-bit sum. */
+#define CHKSUM_LANES_FOLD() do { \
+  sum += (even & 0xffffUL) + (even >> 16) + \
+         (((odd & 0xffffUL) + (odd >> 16)) << 8); \
+  sum = FOLD_U32T(sum); \
+  even = 0; \
+  odd = 0; } while(0)
+
+/**
+ * Sum 32-byte blocks of word aligned data.
+ *
+ * @param pl word aligned data
+ * @param blocks number of 32-byte blocks
+ * @return partially folded sum of the data in host order
+ */
+static u32_t
+chksum_blocks(const u32_t *pl, int blocks)
+{
+  u32_t sum = 0;
+  u32_t even = 0;
+  u32_t odd = 0;
+  int lane = 0;
+
+  while (blocks-- > 0) {
+    CHKSUM_WORD(pl[0]);
+    CHKSUM_WORD(pl[1]);
+    CHKSUM_WORD(pl[2]);
+    CHKSUM_WORD(pl[3]);
+    CHKSUM_WORD(pl[4]);
+    CHKSUM_WORD(pl[5]);
+    CHKSUM_WORD(pl[6]);
+    CHKSUM_WORD(pl[7]);
+    pl += 8;
+    if (++lane == CHKSUM_LANE_BLOCKS) {
+      CHKSUM_LANES_FOLD();
+      lane = 0;
+    }
+  }
+  CHKSUM_LANES_FOLD();
+
+  return sum;
+}
+
+/**
+ * Copy and sum 32-byte blocks of word aligned data.
+ *
+ * @param dst word aligned destination
+ * @param src word aligned source
+ * @param blocks number of 32-byte blocks
+ * @return partially folded sum of the data in host order
+ */
+static u32_t
+chksum_copy_blocks(u32_t *dst, const u32_t *src, int blocks)
+{
+  u32_t sum = 0;
+  u32_t even = 0;
+  u32_t odd = 0;
+  u32_t w0, w1, w2, w3;
+  int lane = 0;
+
+  while (blocks-- > 0) {
+    w0 = src[0]; w1 = src[1]; w2 = src[2]; w3 = src[3];
+    dst[0] = w0; dst[1] = w1; dst[2] = w2; dst[3] = w3;
+    CHKSUM_WORD(w0);
+    CHKSUM_WORD(w1);
+    CHKSUM_WORD(w2);
+    CHKSUM_WORD(w3);
+    w0 = src[4]; w1 = src[5]; w2 = src[6]; w3 = src[7];
+    dst[4] = w0; dst[5] = w1; dst[6] = w2; dst[7] = w3;
+    CHKSUM_WORD(w0);
+    CHKSUM_WORD(w1);
+    CHKSUM_WORD(w2);
+    CHKSUM_WORD(w3);
+    src += 8;
+    dst += 8;
+    if (++lane == CHKSUM_LANE_BLOCKS) {
+      CHKSUM_LANES_FOLD();
+      lane = 0;
+    }
+  }
+  CHKSUM_LANES_FOLD();
+
+  return sum;
+}
+
+#else /* CHKSUM_SIMD */
+
+/* Add the two halfwords of a word to the sum. */
+#define CHKSUM_WORD(w) do { \
+  sum += ((w) & 0xffffUL) + ((w) >> 16); } while(0)
+
+/**
+ * Sum 32-byte blocks of word aligned data.
+ *
+ * @param pl word aligned data
+ * @param blocks number of 32-byte blocks
+ * @return partially folded sum of the data in host order
+ */
+static u32_t
+chksum_blocks(const u32_t *pl, int blocks)
+{
+  u32_t sum = 0;
+
+  while (blocks-- > 0) {
+    CHKSUM_WORD(pl[0]);
+    CHKSUM_WORD(pl[1]);
+    CHKSUM_WORD(pl[2]);
+    CHKSUM_WORD(pl[3]);
+    CHKSUM_WORD(pl[4]);
+    CHKSUM_WORD(pl[5]);
+    CHKSUM_WORD(pl[6]);
+    CHKSUM_WORD(pl[7]);
+    pl += 8;
+    sum = FOLD_U32T(sum);
+  }
+
+  return sum;
+}
+
+/**
+ * Copy and sum 32-byte blocks of word aligned data.
+ *
+ * @param dst word aligned destination
+ * @param src word aligned source
+ * @param blocks number of 32-byte blocks
+ * @return partially folded sum of the data in host order
+ */
+static u32_t
+chksum_copy_blocks(u32_t *dst, const u32_t *src, int blocks)
+{
+  u32_t sum = 0;
+  u32_t w;
+  int i;
+
+  while (blocks-- > 0) {
+    for (i = 0; i < 8; i++) {
+      w = src[i];
+      dst[i] = w;
+      CHKSUM_WORD(w);
+    }
+    src += 8;
+    dst += 8;
+    sum = FOLD_U32T(sum);
+  }
+
+  return sum;
+}
+
+#endif /* CHKSUM_SIMD */
+
+/**
+ * Sum a buffer, optionally copying it at the same time.
+ *
+ * @param dst destination with the same word alignment as src, or NULL
+ * @param src start of the data at any boundary
+ * @param len length of the data
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+static u16_t
+chksum_common(u8_t *dst, const u8_t *src, int len)
+{
+  u16_t t = 0;
+  u16_t w;
+  u32_t sum = 0;
+  int blocks;
+  int odd = ((mem_ptr_t)src & 1);
+
+  /* Get aligned to u16_t */
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *src;
+    if (dst != NULL) {
+      *dst++ = *src;
+    }
+    src++;
+    len--;
+  }
+
+  /* Get aligned to u32_t */
+  if (((mem_ptr_t)src & 2) && len > 1) {
+    w = *(const u16_t *)(const void *)src;
+    if (dst != NULL) {
+      *(u16_t *)(void *)dst = w;
+      dst += 2;
+    }
+    sum += w;
+    src += 2;
+    len -= 2;
+  }
+
+  /* Add the bulk of the data */
+  blocks = len / CHKSUM_BLOCK_SIZE;
+  if (dst != NULL) {
+    sum += chksum_copy_blocks((u32_t *)(void *)dst, (const u32_t *)(const void *)src, blocks);
+    dst += blocks * CHKSUM_BLOCK_SIZE;
+  } else {
+    sum += chksum_blocks((const u32_t *)(const void *)src, blocks);
+  }
+  src += blocks * CHKSUM_BLOCK_SIZE;
+  len -= blocks * CHKSUM_BLOCK_SIZE;
+
+  /* Add the remaining halfwords */
+  while (len > 1) {
+    w = *(const u16_t *)(const void *)src;
+    if (dst != NULL) {
+      *(u16_t *)(void *)dst = w;
+      dst += 2;
+    }
+    sum += w;
+    src += 2;
+    len -= 2;
+  }
+
+  /* Consume left-over byte, if any */
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *src;
+    if (dst != NULL) {
+      *dst = *src;
+    }
+  }
+
+  /* Add end bytes */
+  sum += t;
+
+  /* Fold 32-bit sum to 16 bits */
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+
+  /* Swap if alignment was odd */
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+
+  return (u16_t)sum;
+}
+
+/**
+ * lwip checksum, used as LWIP_CHKSUM.
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+u16_t
+lwip_fast_chksum(void *dataptr, int len)
+{
+  return chksum_common(NULL, (const u8_t *)dataptr, len);
+}
+
+/**
+ * Copy data and return its lwip checksum, used as LWIP_CHKSUM_COPY.
+ * The copy and the checksum are done in one pass when the source and
+ * destination share the same word alignment.
+ *
+ * @param dst destination of the copy
+ * @param src source of the copy
+ * @param len length of data to be copied and summed
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+u16_t
+lwip_fast_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  if (((mem_ptr_t)dst ^ (mem_ptr_t)src) & 3) {
+    MEMCPY(dst, src, len);
+    return chksum_common(NULL, (const u8_t *)dst, len);
+  }
+  return chksum_common((u8_t *)dst, (const u8_t *)src, len);
+}
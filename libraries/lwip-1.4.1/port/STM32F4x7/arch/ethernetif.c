@@ -53,6 +53,7 @@
 #include "sys_arch.h"
 #include "err.h"
 #include "ethernetif.h"
+#include "pbuf_small.h"
 
 #include "main.h"
 #include "stm32f4x7_eth.h"
@@ -72,9 +73,19 @@
 #define IFNAME1 't'
 
 static struct netif *s_pxNetIf = NULL;
-sys_sem_t s_xRxSemaphore;
 sys_sem_t s_xTxSemaphore;
 
+/* Raw ethertype input hook, bypasses the lwIP stack when set. Written by
+ * ethernetif_set_raw_input from another thread while the input task runs. */
+static volatile u16_t s_rawType = 0;
+static volatile ethernetif_raw_input_fn s_rawInput = NULL;
+static void * volatile s_rawArg = NULL;
+
+/* Multicast MAC addresses held in the MAC perfect filter slots 1..3. */
+static const uint32_t s_filterSlot[ETHERNETIF_MAC_FILTERS] = { ETH_MAC_Address1, ETH_MAC_Address2, ETH_MAC_Address3 };
+static struct eth_addr s_filterAddr[ETHERNETIF_MAC_FILTERS];
+static u8_t s_filterUsed[ETHERNETIF_MAC_FILTERS];
+
 /* Ethernet Rx & Tx DMA Descriptors */
 extern ETH_DMADESCTypeDef  DMARxDscrTab[ETH_RXBUFNB], DMATxDscrTab[ETH_TXBUFNB];
 
@@ -92,7 +103,6 @@ extern ETH_DMADESCTypeDef  *DMARxDescToGet;
 extern ETH_DMA_Rx_Frame_infos *DMA_RX_FRAME_infos;
 
 static void ethernetif_input(void * pvParameters);
-static void arp_timer(void *arg);
 
 #if LWIP_PTP
 static void ETH_PTPStart(uint32_t UpdateMethod);
@@ -131,6 +141,7 @@ void ETH_PTPTime_GetTime(struct ptptime_t * timestamp)
 static void low_level_init(struct netif *netif)
 {
   uint32_t i;
+  sys_thread_t thread;
  
   /* set netif MAC hardware address length */
   netif->hwaddr_len = ETHARP_HWADDR_LEN;
@@ -157,7 +168,6 @@ static void low_level_init(struct netif *netif)
   s_pxNetIf = netif;
  
   /* Create semaphores for managing ethernet resources. */
-	sys_sem_new(&s_xRxSemaphore, 0);
 	sys_sem_new(&s_xTxSemaphore, 1);
 
   /* Initialize MAC address in ethernet MAC */ 
@@ -193,8 +203,10 @@ static void low_level_init(struct netif *netif)
   /* ETH_PTPStart(ETH_PTP_CoarseUpdate); */
 #endif
   
-  /* Create the task that handles the ETH_MAC */
-	sys_thread_new((const char *) "Eth_if", ethernetif_input, NULL, netifINTERFACE_TASK_STACK_SIZE, netifINTERFACE_TASK_PRIORITY);
+  /* Create the task that handles the ETH_MAC, and deliver the received frame */
+  /* interrupts to it before reception starts. */
+	thread = sys_thread_new((const char *) "Eth_if", ethernetif_input, NULL, netifINTERFACE_TASK_STACK_SIZE, netifINTERFACE_TASK_PRIORITY);
+	os_isr_bind(ETHERNETIF_RX_CHANNEL, thread->id, ETHERNETIF_RX_SIGNAL);
   
   /* Enable MAC and DMA transmission and reception */
   ETH_Start();   
@@ -272,10 +284,13 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
  * packet from the interface into the pbuf.
  *
  * @param netif the lwip network interface structure for this ethernetif
+ * @param taken set to 1 if a frame was taken from the DMA descriptors,
+ *        0 if the next descriptor is still owned by the DMA
  * @return a pbuf filled with the received packet (including MAC header)
- *         NULL on memory error
+ *         NULL if there was no frame, or it was dropped for an error
+ *         or a lack of pbufs
  */
-static struct pbuf * low_level_input(struct netif *netif)
+static struct pbuf * low_level_input(struct netif *netif, u8_t *taken)
 {
   struct pbuf *p, *q;
   u16_t len;
@@ -288,6 +303,10 @@ static struct pbuf * low_level_input(struct netif *netif)
   
   /* Get received frame */
   frame = ETH_Get_Received_Frame_interrupt();
+
+  /* No complete frame waiting */
+  *taken = (frame.descriptor != NULL);
+  if (!*taken) return NULL;
   
   /* check that frame has no error */
   if ((frame.descriptor->Status & ETH_DMARxDesc_ES) == (uint32_t)RESET)
@@ -297,8 +316,12 @@ static struct pbuf * low_level_input(struct netif *netif)
     len = frame.length;
     buffer = (u8 *)frame.buffer;
 
-    /* We allocate a pbuf chain of pbufs from the pool. */
-    p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+    /* Small frames, such as PTP messages, take a small pbuf so that they do
+       not use up the pool. Other frames, or any once the small pbufs are
+       all in use, take a pbuf chain of pbufs from the pool. */
+    p = NULL;
+    if (len <= PBUF_SMALL_BUFSIZE) p = pbuf_small_alloc(PBUF_SMALL_RX, PBUF_RAW, len);
+    if (p == NULL) p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
  
     /* Copy received frame from ethernet driver buffer to stack buffer */
     if (p != NULL)
@@ -315,6 +338,9 @@ static struct pbuf * low_level_input(struct netif *netif)
 				p->time_nsec = ETH_PTPSubSecond2NanoSecond(frame.descriptor->TimeStampLow);
 			}
 #endif
+
+      /* Start the latency stamps of the frame */
+      latency_frame(p->stamps);
     }
   }
   
@@ -365,24 +391,40 @@ static struct pbuf * low_level_input(struct netif *netif)
 void ethernetif_input(void * pvParameters)
 {
   struct pbuf *p;
+  ethernetif_raw_input_fn input;
+  void *arg;
+  u8_t taken;
   
   for( ;; )
   {
-		if (sys_arch_sem_wait(&s_xRxSemaphore, emacBLOCK_TIME_WAITING_FOR_INPUT) != SYS_ARCH_TIMEOUT)
-    {
-			do
+		/* The interrupts of all frames received since the last wait set the
+		 * signal once, so each wake-up reads every frame waiting, up to the
+		 * first descriptor still owned by the DMA. Dropped frames do not end
+		 * the loop, or the frames behind them would get no further wake-up.
+		 * A timeout drains as well, in case a wake-up was lost anyway. */
+		osSignalWait(ETHERNETIF_RX_SIGNAL, emacBLOCK_TIME_WAITING_FOR_INPUT);
+		for (;;)
+		{
+			p = low_level_input(s_pxNetIf, &taken);
+			if (!taken) break;
+			if (p == NULL) continue;
+
+			/* Hand frames of the raw ethertype directly to the registered hook.
+			 * The hook is loaded once, before its argument, so it cannot be
+			 * cleared between the test and the call. */
+			input = s_rawInput;
+			arg = s_rawArg;
+			if (input && (p->len >= SIZEOF_ETH_HDR) &&
+					(((struct eth_hdr *) p->payload)->type == htons(s_rawType)))
 			{
-				p = low_level_input(s_pxNetIf);
-				if (p != NULL)
-				{
-					if (s_pxNetIf->input(p, s_pxNetIf) != ERR_OK)
-					{
-						pbuf_free(p);
-						p=NULL;
-					}
-				}
-			} while (p != NULL);			
-    }
+				pbuf_header(p, -SIZEOF_ETH_HDR);
+				input(arg, p);
+			}
+			else if (s_pxNetIf->input(p, s_pxNetIf) != ERR_OK)
+			{
+				pbuf_free(p);
+			}
+		}
   }
 }  
       
@@ -414,20 +456,117 @@ err_t ethernetif_init(struct netif *netif)
   netif->output = etharp_output;
   netif->linkoutput = low_level_output;
 
+  /* initialize the small pbufs before any frame arrives */
+  pbuf_small_init();
+
   /* initialize the hardware */
   low_level_init(netif);
   
   etharp_init();
-  sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
 
   return ERR_OK;
 }
 
 
-static void arp_timer(void *arg)
+/**
+ * Register a hook to receive frames of the given ethertype directly from the
+ * ethernetif input task, bypassing the lwIP stack.  The hook is passed the
+ * pbuf with the ethernet header removed and becomes responsible for freeing
+ * it.  Passing a NULL hook removes the registration.
+ *
+ * @param type the ethertype in host byte order
+ * @param input the hook function
+ * @param arg argument passed to the hook function
+ */
+void ethernetif_set_raw_input(u16_t type, ethernetif_raw_input_fn input, void *arg)
+{
+  /* Clear the hook before changing the type and argument, and set it last.
+   * Removing a hook leaves the argument in place for an input task that
+   * has already loaded the hook. */
+  s_rawInput = NULL;
+  if (input == NULL) return;
+  s_rawType = type;
+  s_rawArg = arg;
+  s_rawInput = input;
+}
+
+
+/**
+ * Send a raw ethernet frame.  The pbuf must have PBUF_LINK_HLEN bytes of
+ * header space available in front of the payload, such as a pbuf allocated
+ * with PBUF_LINK.  When PTP is enabled, the transmit timestamp is returned
+ * in the pbuf.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @param dst the destination MAC address
+ * @param type the ethertype in host byte order
+ * @param p the payload to send
+ * @return ERR_OK if the frame was sent
+ */
+err_t ethernetif_raw_output(struct netif *netif, const struct eth_addr *dst, u16_t type, struct pbuf *p)
+{
+  struct eth_hdr *ethhdr;
+
+  /* Make room for the ethernet header. */
+  if (pbuf_header(p, SIZEOF_ETH_HDR) != 0)
+  {
+    return ERR_BUF;
+  }
+
+  /* Fill in the ethernet header. */
+  ethhdr = (struct eth_hdr *) p->payload;
+  ETHADDR32_COPY(&ethhdr->dest, dst);
+  ETHADDR16_COPY(&ethhdr->src, netif->hwaddr);
+  ethhdr->type = htons(type);
+
+  return netif->linkoutput(netif, p);
+}
+
+
+/**
+ * Add a multicast address to the MAC perfect destination address filter.
+ *
+ * @param addr the multicast MAC address
+ * @return ERR_OK if the address was added, ERR_MEM if no filter slot is free
+ */
+err_t ethernetif_add_mac_filter(const struct eth_addr *addr)
 {
-  etharp_tmr();
-  sys_timeout(ARP_TMR_INTERVAL, arp_timer, NULL);
+  int i;
+
+  for (i = 0; i < ETHERNETIF_MAC_FILTERS; i++)
+  {
+    if (!s_filterUsed[i])
+    {
+      s_filterUsed[i] = 1;
+      s_filterAddr[i] = *addr;
+      ETH_MACAddressConfig(s_filterSlot[i], (uint8_t *) addr->addr);
+      ETH_MACAddressFilterConfig(s_filterSlot[i], ETH_MAC_AddressFilter_DA);
+      ETH_MACAddressPerfectFilterCmd(s_filterSlot[i], ENABLE);
+      return ERR_OK;
+    }
+  }
+
+  return ERR_MEM;
+}
+
+
+/**
+ * Remove a multicast address from the MAC perfect destination address filter.
+ *
+ * @param addr the multicast MAC address
+ */
+void ethernetif_remove_mac_filter(const struct eth_addr *addr)
+{
+  int i;
+
+  for (i = 0; i < ETHERNETIF_MAC_FILTERS; i++)
+  {
+    if (s_filterUsed[i] && !memcmp(&s_filterAddr[i], addr, sizeof(struct eth_addr)))
+    {
+      ETH_MACAddressPerfectFilterCmd(s_filterSlot[i], DISABLE);
+      s_filterUsed[i] = 0;
+    }
+  }
 }
 
 
@@ -453,6 +592,9 @@ static void ETH_PTPStart(uint32_t UpdateMethod)
   /* Program Time stamp register bit 0 to enable time stamping. */
   ETH_PTPTimeStampCmd(ENABLE);
 
+  /* Also snapshot PTP frames sent directly over ethernet (IEEE 802.3 transport). */
+  ETH->PTPTSCR |= ETH_PTPTSSR_TSSPTPOEFE;
+
   /* Program the Subsecond increment register based on the PTP clock frequency. */
   ETH_SetPTPSubSecondIncrement(ADJ_FREQ_BASE_INCREMENT); /* to achieve 20 ns accuracy, the value is ~ 43 */
 
@@ -4,6 +4,19 @@
 #include <stdint.h>
 #include "lwip/err.h"
 #include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "netif/etharp.h"
+
+/* Number of multicast MAC addresses that can be added to the MAC filter. */
+#define ETHERNETIF_MAC_FILTERS    3
+
+/* ISR channel posted by ETH_IRQHandler for received frames, and the
+ * signal it sets in the input thread. */
+#define ETHERNETIF_RX_CHANNEL     0
+#define ETHERNETIF_RX_SIGNAL      0x01
+
+/* Raw ethertype input hook. Responsible for freeing the pbuf. */
+typedef void (*ethernetif_raw_input_fn)(void *arg, struct pbuf *p);
 
 struct ptptime_t {
   s32_t tv_sec;
@@ -11,6 +24,10 @@ struct ptptime_t {
 };
 
 err_t ethernetif_init(struct netif *netif);
+void ethernetif_set_raw_input(u16_t type, ethernetif_raw_input_fn input, void *arg);
+err_t ethernetif_raw_output(struct netif *netif, const struct eth_addr *dst, u16_t type, struct pbuf *p);
+err_t ethernetif_add_mac_filter(const struct eth_addr *addr);
+void ethernetif_remove_mac_filter(const struct eth_addr *addr);
 
 #if LWIP_PTP
 void ETH_PTPTime_SetTime(struct ptptime_t * timestamp);
@@ -0,0 +1,143 @@
+/**
+ * @file
+ * Pools of small custom pbufs
+ *
+ * Received frames and PTP messages are mostly under PBUF_SMALL_BUFSIZE,
+ * yet took a full sized buffer of the pbuf pool or a block of the heap
+ * each. Frames that fit are now received into and sent from pbufs of
+ * their own fixed pools, which lwIP returns through the custom free
+ * function. A pool taking all its pbufs only makes the caller fall back
+ * to the pbuf pool or the heap.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "pbuf_small.h"
+
+#include <string.h>
+
+struct pbuf_small
+{
+  struct pbuf_custom pc;
+  struct pbuf_small *next;    /* next free pbuf of the pool */
+  u8_t data[LWIP_MEM_ALIGN_SIZE(PBUF_SMALL_BUFSIZE)];
+  u8_t pool;
+};
+
+struct pbuf_small_pool_t
+{
+  struct pbuf_small *free;
+  struct pbuf_small_stats stats;
+};
+
+static struct pbuf_small s_rxBufs[PBUF_SMALL_RX_NUM];
+static struct pbuf_small s_txBufs[PBUF_SMALL_TX_NUM];
+static struct pbuf_small_pool_t s_pools[PBUF_SMALL_POOLS];
+
+/**
+ * Custom free function of the small pbufs, which puts one back into its pool.
+ */
+static void pbuf_small_free(struct pbuf *p)
+{
+  struct pbuf_small *s = (struct pbuf_small *) p;
+  struct pbuf_small_pool_t *pool = &s_pools[s->pool];
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  s->next = pool->free;
+  pool->free = s;
+  pool->stats.used--;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/**
+ * Link the pbufs of a pool into its free list.
+ */
+static void pbuf_small_fill(pbuf_small_pool id, struct pbuf_small *bufs, u16_t num)
+{
+  u16_t i;
+  struct pbuf_small_pool_t *pool = &s_pools[id];
+
+  memset(pool, 0, sizeof(*pool));
+  pool->stats.num = num;
+  for (i = 0; i < num; ++i)
+  {
+    bufs[i].pc.custom_free_function = pbuf_small_free;
+    bufs[i].pool = (u8_t) id;
+    bufs[i].next = pool->free;
+    pool->free = &bufs[i];
+  }
+}
+
+/**
+ * Set up the pools. Called before the interface receives or sends.
+ */
+void pbuf_small_init(void)
+{
+  pbuf_small_fill(PBUF_SMALL_RX, s_rxBufs, PBUF_SMALL_RX_NUM);
+  pbuf_small_fill(PBUF_SMALL_TX, s_txBufs, PBUF_SMALL_TX_NUM);
+}
+
+/**
+ * The header room pbuf_alloced_custom() leaves for a layer.
+ */
+static u16_t pbuf_small_offset(pbuf_layer layer)
+{
+  switch (layer)
+  {
+    case PBUF_TRANSPORT: return LWIP_MEM_ALIGN_SIZE(PBUF_LINK_HLEN + PBUF_IP_HLEN + PBUF_TRANSPORT_HLEN);
+    case PBUF_IP:        return LWIP_MEM_ALIGN_SIZE(PBUF_LINK_HLEN + PBUF_IP_HLEN);
+    case PBUF_LINK:      return LWIP_MEM_ALIGN_SIZE(PBUF_LINK_HLEN);
+    default:             return 0;
+  }
+}
+
+/**
+ * Allocate a small pbuf, as pbuf_alloc() would a PBUF_POOL one.
+ *
+ * @param pool the pool to take it from
+ * @param layer the header room to leave before the payload
+ * @param length the size of the payload
+ * @return the pbuf, NULL if the payload does not fit or the pool is empty
+ */
+struct pbuf *pbuf_small_alloc(pbuf_small_pool pool, pbuf_layer layer, u16_t length)
+{
+  struct pbuf_small *s;
+  struct pbuf_small_pool_t *sp = &s_pools[pool];
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (pbuf_small_offset(layer) + length > sizeof(s->data)) return NULL;
+
+  SYS_ARCH_PROTECT(lev);
+  s = sp->free;
+  if (s != NULL)
+  {
+    sp->free = s->next;
+    if (++sp->stats.used > sp->stats.peak) sp->stats.peak = sp->stats.used;
+  }
+  else
+  {
+    sp->stats.fails++;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  if (s == NULL) return NULL;
+
+  /* A PBUF_POOL type lets lwIP move the payload back over headers it took off. */
+  return pbuf_alloced_custom(layer, length, PBUF_POOL, &s->pc, s->data, sizeof(s->data));
+}
+
+/**
+ * Get the number of pbufs of a pool, those in use, the peak of those, and
+ * the allocations that found it empty.
+ */
+void pbuf_small_stats(pbuf_small_pool pool, struct pbuf_small_stats *stats)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  *stats = s_pools[pool].stats;
+  SYS_ARCH_UNPROTECT(lev);
+}
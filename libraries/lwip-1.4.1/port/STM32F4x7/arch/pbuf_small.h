@@ -0,0 +1,27 @@
+#ifndef __PBUF_SMALL_H__
+#define __PBUF_SMALL_H__
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+
+/* Pools of small pbufs, one for received frames and one for frames sent. */
+typedef enum
+{
+  PBUF_SMALL_RX,
+  PBUF_SMALL_TX,
+  PBUF_SMALL_POOLS
+} pbuf_small_pool;
+
+struct pbuf_small_stats
+{
+  u16_t num;                  /* pbufs in the pool */
+  u16_t used;                 /* pbufs allocated */
+  u16_t peak;                 /* highest value of used */
+  u32_t fails;                /* allocations with the pool empty */
+};
+
+void pbuf_small_init(void);
+struct pbuf *pbuf_small_alloc(pbuf_small_pool pool, pbuf_layer layer, u16_t length);
+void pbuf_small_stats(pbuf_small_pool pool, struct pbuf_small_stats *stats);
+
+#endif /* __PBUF_SMALL_H__ */
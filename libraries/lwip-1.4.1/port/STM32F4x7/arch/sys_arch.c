@@ -26,10 +26,23 @@
 #include "lwip/def.h"
 #include "lwip/sys.h"
 #include "lwip/mem.h"
+#include "lwip/stats.h"
 
 /* RTOS includes. */
 #include "cmsis_os.h"
 
+/* Core register access. */
+#include "stm32f4xx.h"
+
+/* RTX kernel tick counter and tick period in microseconds. */
+extern uint32_t os_time;
+extern uint32_t const os_clockrate;
+
+#if MEM_LIBC_MALLOC
+/* The heap, MEM_SIZE bytes for blocks and their headers. */
+static uint64_t sys_mem_heap[(MEM_SIZE + OS_MEM_OVERHEAD + 7) / 8];
+#endif
+
 /*---------------------------------------------------------------------------*
  * Routine:  sys_mbox_new
  *---------------------------------------------------------------------------*
@@ -132,7 +145,7 @@ err_t sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
  *                                  of milliseconds until received.
  *---------------------------------------------------------------------------*/
 u32_t sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout) {
-	u32_t start = osKernelSysTick();
+	u32_t start = sys_now();
 	
 	osEvent event = osMessageGet(mbox->id, (timeout != 0)?(timeout):(osWaitForever));
 	if (event.status != osEventMessage)
@@ -140,7 +153,7 @@ u32_t sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout) {
 	
 	*msg = (void *)event.value.v;
 	
-	return osKernelSysTick() - start;
+	return sys_now() - start;
 }
  
 /*---------------------------------------------------------------------------*
@@ -218,12 +231,12 @@ err_t sys_sem_new(sys_sem_t *sem, u8_t count) {
  *---------------------------------------------------------------------------*/
 u32_t sys_arch_sem_wait(sys_sem_t *sem, u32_t timeout)
 {
-	u32_t start = osKernelSysTick();
+	u32_t start = sys_now();
 	
 	if (osSemaphoreWait(sem->id, (timeout != 0)?(timeout):(osWaitForever)) < 1)
 		return SYS_ARCH_TIMEOUT;
 	
-	return osKernelSysTick() - start;
+	return sys_now() - start;
 }
  
 /*---------------------------------------------------------------------------*
@@ -289,7 +302,8 @@ void sys_timer_stop(sys_timer_t *timer) {
  * @param timer the timer to delete */
 void sys_timer_free(sys_timer_t *timer) {}
  
-/** Create a new mutex
+/** Create a new mutex. RTX mutexes inherit the priority of the threads
+ * waiting for them, which LWIP_TCPIP_CORE_LOCKING relies on.
  * @param mutex pointer to the mutex to create
  * @return a new mutex */
 err_t sys_mutex_new(sys_mutex_t *mutex)
@@ -330,16 +344,95 @@ void sys_mutex_free(sys_mutex_t *mutex) {}
  * Description:
  *      Initialize sys arch
  *---------------------------------------------------------------------------*/
-osMutexId lwip_sys_mutex;
-osMutexDef(lwip_sys_mutex);
- 
 void sys_init(void)
 {
-	lwip_sys_mutex = osMutexCreate(osMutex(lwip_sys_mutex));
-	if (lwip_sys_mutex == NULL)
-		printf("sys_init error\n");
+#if MEM_LIBC_MALLOC
+	os_mem_init(sys_mem_heap, sizeof(sys_mem_heap));
+#endif
+}
+ 
+#if MEM_LIBC_MALLOC
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_mem_malloc
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      mem_malloc() of lwIP. Allocates from the heap pool, which may be
+ *      used from threads and interrupt handlers alike.
+ * Inputs:
+ *      size_t size             -- Bytes to allocate
+ * Outputs:
+ *      void *                  -- Memory allocated, NULL if none is left,
+ *                                 counted in lwip_stats.mem.err
+ *---------------------------------------------------------------------------*/
+void *sys_mem_malloc(size_t size)
+{
+	void *mem;
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	mem = os_mem_alloc(sys_mem_heap, size);
+	if (mem == NULL) MEM_STATS_INC(err);
+	SYS_ARCH_UNPROTECT(lev);
+
+	return mem;
 }
  
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_mem_calloc
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      mem_calloc() of lwIP. Allocates zeroed memory from the heap pool.
+ * Inputs:
+ *      size_t count            -- Number of elements
+ *      size_t size             -- Bytes of each element
+ * Outputs:
+ *      void *                  -- Memory allocated, NULL if none is left
+ *---------------------------------------------------------------------------*/
+void *sys_mem_calloc(size_t count, size_t size)
+{
+	void *mem = sys_mem_malloc(count * size);
+
+	if (mem) memset(mem, 0, count * size);
+
+	return mem;
+}
+ 
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_mem_free
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      mem_free() of lwIP. Returns memory to the heap pool.
+ * Inputs:
+ *      void *mem               -- Memory from sys_mem_malloc()
+ *---------------------------------------------------------------------------*/
+void sys_mem_free(void *mem)
+{
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	os_mem_free(sys_mem_heap, mem);
+	SYS_ARCH_UNPROTECT(lev);
+}
+ 
+/*---------------------------------------------------------------------------*
+ * Routine:  sys_mem_stat
+ *---------------------------------------------------------------------------*
+ * Description:
+ *      Get the used, peak and largest free bytes of the heap pool.
+ * Inputs:
+ *      os_mem_stat_t *stat     -- Statistics
+ *---------------------------------------------------------------------------*/
+void sys_mem_stat(os_mem_stat_t *stat)
+{
+	SYS_ARCH_DECL_PROTECT(lev);
+
+	SYS_ARCH_PROTECT(lev);
+	os_mem_stat(sys_mem_heap, stat);
+	SYS_ARCH_UNPROTECT(lev);
+}
+#endif /* MEM_LIBC_MALLOC */
+ 
+#if SYS_LIGHTWEIGHT_PROT
 /*---------------------------------------------------------------------------*
  * Routine:  sys_arch_protect
  *---------------------------------------------------------------------------*
@@ -356,14 +449,33 @@ void sys_init(void)
  *
  *      sys_arch_protect() is only required if your port is supporting an
  *      operating system.
+ *
+ *      Interrupts at SYS_ARCH_PROTECT_PRIORITY and below are masked by
+ *      raising BASEPRI, so thread switches and the Ethernet interrupt are
+ *      held off while interrupts of a higher priority still run. These
+ *      must not call into lwIP. With SYS_ARCH_PROTECT_PRIORITY set to 0
+ *      all interrupts are masked with PRIMASK instead. This works from
+ *      threads and interrupt handlers alike and never blocks, but nothing
+ *      that ends in an SVC may run while protected, as SVCall is masked
+ *      too: no RTX call, such as signalling a semaphore or a mailbox.
  * Outputs:
- *      sys_prot_t              -- Previous protection level (not used here)
+ *      sys_prot_t              -- Previous protection level
  *---------------------------------------------------------------------------*/
 sys_prot_t sys_arch_protect(void)
 {
-	if (osMutexWait(lwip_sys_mutex, osWaitForever) != osOK)
-		printf("sys_arch_protect error\n");
-	return (sys_prot_t) 1;
+#if SYS_ARCH_PROTECT_PRIORITY
+	uint32_t basepri = __get_BASEPRI();
+
+	/* Only ever raise the mask, a nested call may already mask more. */
+	if ((basepri == 0) || (basepri > SYS_ARCH_PROTECT_BASEPRI))
+		__set_BASEPRI(SYS_ARCH_PROTECT_BASEPRI);
+	return (sys_prot_t) basepri;
+#else
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	return (sys_prot_t) primask;
+#endif
 }
  
 /*---------------------------------------------------------------------------*
@@ -375,23 +487,32 @@ sys_prot_t sys_arch_protect(void)
  *      sys_arch_protect() for more information. This function is only
  *      required if your port is supporting an operating system.
  * Inputs:
- *      sys_prot_t              -- Previous protection level (not used here)
+ *      sys_prot_t              -- Previous protection level
  *---------------------------------------------------------------------------*/
 void sys_arch_unprotect(sys_prot_t p)
 {
-	if (osMutexRelease(lwip_sys_mutex) != osOK)
-		printf("sys_arch_unprotect error\n");
+#if SYS_ARCH_PROTECT_PRIORITY
+	__set_BASEPRI((uint32_t) p);
+#else
+	/* Leave interrupts masked if they were on entry. */
+	if (p == 0)
+		__enable_irq();
+#endif
 }
+#endif /* SYS_LIGHTWEIGHT_PROT */
  
 /*---------------------------------------------------------------------------*
  * Routine:  sys_now
  *---------------------------------------------------------------------------*
  * Description:
- *      Gets the current system tick count
+ *      Gets the current time in milliseconds. osKernelSysTick() counts
+ *      CPU clock cycles, so the kernel tick counter is used instead.
+ *      The product is formed in 64 bits, so ticks shorter than a
+ *      millisecond do not truncate the rate to zero.
  *---------------------------------------------------------------------------*/
 u32_t sys_now(void)
 {
-	return osKernelSysTick();
+	return (u32_t)(((uint64_t) os_time * os_clockrate) / 1000);
 }
  
 // Keep a pool of thread structures
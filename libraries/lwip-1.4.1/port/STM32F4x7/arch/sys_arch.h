@@ -91,6 +91,19 @@ typedef sys_thread_data_t* sys_thread_t;
  
 // === PROTECTION ===
 typedef int sys_prot_t;
+
+// Interrupts of this preemption priority and below are masked by
+// sys_arch_protect(). Must be at least as urgent as any interrupt that
+// calls into lwIP. 0 masks all interrupts with PRIMASK instead.
+#ifndef SYS_ARCH_PROTECT_PRIORITY
+#define SYS_ARCH_PROTECT_PRIORITY           5
+#endif
+#define SYS_ARCH_PROTECT_BASEPRI            ((SYS_ARCH_PROTECT_PRIORITY) << (8 - __NVIC_PRIO_BITS))
+ 
+// === HEAP ===
+#if MEM_LIBC_MALLOC
+void sys_mem_stat(os_mem_stat_t *stat);
+#endif
  
 #endif /* __SYS_RTXC_H__ */
 
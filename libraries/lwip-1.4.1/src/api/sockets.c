@@ -126,9 +126,11 @@ struct lwip_setgetsockopt_data {
 static struct lwip_sock sockets[NUM_SOCKETS];
 /** The global list of tasks waiting for select */
 static struct lwip_select_cb *select_cb_list;
-/** This counter is increased from lwip_select when the list is chagned
-    and checked in event_callback to see if it has changed. */
-static volatile int select_cb_ctr;
+/** Guards select_cb_list. The select semaphores are signalled under this
+    mutex rather than SYS_ARCH_PROTECT, as signalling ends in an SVC, which
+    the protection may mask. Holding it also keeps a select call from
+    taking itself off the list and freeing its semaphore meanwhile. */
+static sys_mutex_t select_lock;
 
 /** Table to quickly map an lwIP error (err_t) to a socket error
   * by using -err as an index */
@@ -183,6 +185,9 @@ static void lwip_setsockopt_internal(void *arg);
 void
 lwip_socket_init(void)
 {
+  if (sys_mutex_new(&select_lock) != ERR_OK) {
+    LWIP_ASSERT("failed to create select_lock", 0);
+  }
 }
 
 /**
@@ -1134,7 +1139,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
     }
 
     /* Protect the select_cb_list */
-    SYS_ARCH_PROTECT(lev);
+    sys_mutex_lock(&select_lock);
 
     /* Put this select_cb on top of list */
     select_cb.next = select_cb_list;
@@ -1142,11 +1147,8 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       select_cb_list->prev = &select_cb;
     }
     select_cb_list = &select_cb;
-    /* Increasing this counter tells even_callback that the list has changed. */
-    select_cb_ctr++;
 
-    /* Now we can safely unprotect */
-    SYS_ARCH_UNPROTECT(lev);
+    sys_mutex_unlock(&select_lock);
 
     /* Increase select_waiting for each socket we are interested in */
     for(i = 0; i < maxfdp1; i++) {
@@ -1194,7 +1196,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       }
     }
     /* Take us off the list */
-    SYS_ARCH_PROTECT(lev);
+    sys_mutex_lock(&select_lock);
     if (select_cb.next != NULL) {
       select_cb.next->prev = select_cb.prev;
     }
@@ -1205,9 +1207,7 @@ lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset,
       LWIP_ASSERT("select_cb.prev != NULL", select_cb.prev != NULL);
       select_cb.prev->next = select_cb.next;
     }
-    /* Increasing this counter tells even_callback that the list has changed. */
-    select_cb_ctr++;
-    SYS_ARCH_UNPROTECT(lev);
+    sys_mutex_unlock(&select_lock);
 
     sys_sem_free(&select_cb.sem);
     if (waitres == SYS_ARCH_TIMEOUT)  {
@@ -1249,7 +1249,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   int s;
   struct lwip_sock *sock;
   struct lwip_select_cb *scb;
-  int last_select_cb_ctr;
+  s16_t rcvevent;
+  u16_t sendevent;
+  u16_t errevent;
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -1312,51 +1314,42 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
     return;
   }
 
-  /* Now decide if anyone is waiting for this socket */
-  /* NOTE: This code goes through the select_cb_list list multiple times
-     ONLY IF a select was actually waiting. We go through the list the number
-     of waiting select calls + 1. This list is expected to be small. */
+  /* Take the events to test the select calls against */
+  rcvevent = sock->rcvevent;
+  sendevent = sock->sendevent;
+  errevent = sock->errevent;
+  SYS_ARCH_UNPROTECT(lev);
 
-  /* At this point, SYS_ARCH is still protected! */
-again:
+  /* Now decide if anyone is waiting for this socket. The list cannot
+     change while select_lock is held. */
+  sys_mutex_lock(&select_lock);
   for (scb = select_cb_list; scb != NULL; scb = scb->next) {
     if (scb->sem_signalled == 0) {
       /* semaphore not signalled yet */
       int do_signal = 0;
       /* Test this select call for our socket */
-      if (sock->rcvevent > 0) {
+      if (rcvevent > 0) {
         if (scb->readset && FD_ISSET(s, scb->readset)) {
           do_signal = 1;
         }
       }
-      if (sock->sendevent != 0) {
+      if (sendevent != 0) {
         if (!do_signal && scb->writeset && FD_ISSET(s, scb->writeset)) {
           do_signal = 1;
         }
       }
-      if (sock->errevent != 0) {
+      if (errevent != 0) {
         if (!do_signal && scb->exceptset && FD_ISSET(s, scb->exceptset)) {
           do_signal = 1;
         }
       }
       if (do_signal) {
         scb->sem_signalled = 1;
-        /* Don't call SYS_ARCH_UNPROTECT() before signaling the semaphore, as this might
-           lead to the select thread taking itself off the list, invalidagin the semaphore. */
         sys_sem_signal(&scb->sem);
       }
     }
-    /* unlock interrupts with each step */
-    last_select_cb_ctr = select_cb_ctr;
-    SYS_ARCH_UNPROTECT(lev);
-    /* this makes sure interrupt protection time is short */
-    SYS_ARCH_PROTECT(lev);
-    if (last_select_cb_ctr != select_cb_ctr) {
-      /* someone has changed select_cb_list, restart at the beginning */
-      goto again;
-    }
   }
-  SYS_ARCH_UNPROTECT(lev);
+  sys_mutex_unlock(&select_lock);
 }
 
 /**
@@ -98,6 +98,9 @@ tcpip_thread(void *arg)
 #if !LWIP_TCPIP_CORE_LOCKING_INPUT
     case TCPIP_MSG_INPKT:
       LWIP_DEBUGF(TCPIP_DEBUG, ("tcpip_thread: PACKET %p\n", (void *)msg));
+#ifdef LWIP_HOOK_TCPIP_INPKT
+      LWIP_HOOK_TCPIP_INPKT(msg->msg.inp.p);
+#endif /* LWIP_HOOK_TCPIP_INPKT */
 #if LWIP_ETHERNET
       if (msg->msg.inp.netif->flags & (NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET)) {
         ethernet_input(msg->msg.inp.p, msg->msg.inp.netif);
@@ -344,6 +344,10 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
   p->ref = 1;
   /* set flags */
   p->flags = 0;
+#if LWIP_PBUF_STAMPS
+  /* no stage passed yet */
+  memset(p->stamps, 0, sizeof(p->stamps));
+#endif /* LWIP_PBUF_STAMPS */
   LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_alloc(length=%"U16_F") == %p\n", length, (void *)p));
   return p;
 }
@@ -407,6 +411,9 @@ pbuf_alloced_custom(pbuf_layer l, u16_t length, pbuf_type type, struct pbuf_cust
   p->pbuf.len = p->pbuf.tot_len = length;
   p->pbuf.type = type;
   p->pbuf.ref = 1;
+#if LWIP_PBUF_STAMPS
+  memset(p->pbuf.stamps, 0, sizeof(p->pbuf.stamps));
+#endif /* LWIP_PBUF_STAMPS */
   return &p->pbuf;
 }
 #endif /* LWIP_SUPPORT_CUSTOM_PBUF */
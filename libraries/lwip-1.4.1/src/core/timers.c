@@ -59,12 +59,46 @@
 #include "lwip/sys.h"
 #include "lwip/pbuf.h"
 
-
-/** The one and only timeout list */
-static struct sys_timeo *next_timeout;
-#if NO_SYS
-static u32_t timeouts_last_time;
-#endif /* NO_SYS */
+#include <string.h>
+
+
+/* The timeouts are kept in a hierarchical timer wheel. Level 0 has one slot
+ * per millisecond, each higher level has slots TIMEO_WHEEL_SLOTS times as
+ * wide. A timeout is placed on the lowest level that can hold its expiry
+ * time and moves down a level each time the wheel below wraps around, so
+ * inserting and removing a timeout takes constant time. Expired timeouts
+ * are moved to a list from where their handlers are called. */
+#define TIMEO_WHEEL_BITS      6
+#define TIMEO_WHEEL_SLOTS     (1UL << TIMEO_WHEEL_BITS)
+#define TIMEO_WHEEL_MASK      (TIMEO_WHEEL_SLOTS - 1)
+#define TIMEO_WHEEL_LEVELS    4
+#define TIMEO_WHEEL_SPAN      (1UL << (TIMEO_WHEEL_BITS * TIMEO_WHEEL_LEVELS))
+/** Level of timeouts on the expired list */
+#define TIMEO_EXPIRED         TIMEO_WHEEL_LEVELS
+
+/* Timeouts are also hashed by handler and argument for sys_untimeout() */
+#define TIMEO_HASH_SIZE       16
+#define TIMEO_HASH(h, arg)    ((((mem_ptr_t)(h) ^ (mem_ptr_t)(arg)) >> 2) & (TIMEO_HASH_SIZE - 1))
+
+/** The timer wheel */
+static struct sys_timeo *timeo_wheel[TIMEO_WHEEL_LEVELS][TIMEO_WHEEL_SLOTS];
+/** One bit per occupied wheel slot */
+static u32_t timeo_occupied[TIMEO_WHEEL_LEVELS][TIMEO_WHEEL_SLOTS / 32];
+/** Expired timeouts whose handlers have not been called yet */
+static struct sys_timeo *timeo_expired;
+static struct sys_timeo **timeo_expired_tail = &timeo_expired;
+/** Timeouts hashed by handler and argument */
+static struct sys_timeo *timeo_hash[TIMEO_HASH_SIZE];
+/** The next millisecond the wheel has to process */
+static u32_t timeo_now;
+/** Expiry time of the timeout whose handler is running */
+static u32_t timeo_handler_time;
+static u8_t timeo_in_handler;
+
+#if SYS_TIMEOUT_STATS
+/** Lateness statistics per timeout handler */
+static struct sys_timeo_stats timeo_stats[SYS_TIMEOUT_STATS_HANDLERS];
+#endif /* SYS_TIMEOUT_STATS */
 
 #if LWIP_TCP
 /** global variable that shows if the tcp timer is currently scheduled or not */
@@ -222,6 +256,9 @@ dns_timer(void *arg)
 /** Initialize this module */
 void sys_timeouts_init(void)
 {
+  /* Start the timer wheel at the current time */
+  timeo_now = sys_now();
+
 #if IP_REASSEMBLY
   sys_timeout(IP_TMR_INTERVAL, ip_reass_timer, NULL);
 #endif /* IP_REASSEMBLY */
@@ -242,10 +279,312 @@ void sys_timeouts_init(void)
   sys_timeout(DNS_TMR_INTERVAL, dns_timer, NULL);
 #endif /* LWIP_DNS */
 
-#if NO_SYS
-  /* Initialise timestamp for sys_check_timeouts */
-  timeouts_last_time = sys_now();
-#endif
+}
+
+/**
+ * Find the first occupied slot of a wheel level.
+ *
+ * @param level the wheel level
+ * @param slot the slot to start searching from
+ * @return the first occupied slot >= slot, or TIMEO_WHEEL_SLOTS if none
+ */
+static u32_t
+timeo_find_slot(int level, u32_t slot)
+{
+  u32_t bits;
+
+  while (slot < TIMEO_WHEEL_SLOTS) {
+    bits = timeo_occupied[level][slot >> 5] >> (slot & 31);
+    if (bits == 0) {
+      /* skip the rest of this word */
+      slot = (slot | 31) + 1;
+      continue;
+    }
+    while ((bits & 1) == 0) {
+      bits >>= 1;
+      slot++;
+    }
+    return slot;
+  }
+  return TIMEO_WHEEL_SLOTS;
+}
+
+/**
+ * Link a timeout at the head of a list.
+ */
+static void
+timeo_link(struct sys_timeo **head, struct sys_timeo *t)
+{
+  t->next = *head;
+  if (t->next != NULL) {
+    t->next->pprev = &t->next;
+  }
+  t->pprev = head;
+  *head = t;
+}
+
+/**
+ * Append a timeout to the expired list.
+ */
+static void
+timeo_append_expired(struct sys_timeo *t)
+{
+  t->level = TIMEO_EXPIRED;
+  t->next = NULL;
+  t->pprev = timeo_expired_tail;
+  *timeo_expired_tail = t;
+  timeo_expired_tail = &t->next;
+}
+
+/**
+ * Place a timeout on the wheel according to its expiry time, or on the
+ * expired list if it has already expired.
+ */
+static void
+timeo_insert(struct sys_timeo *t)
+{
+  u32_t delta = t->time - timeo_now;
+  u32_t slot;
+  u8_t level;
+
+  if ((s32_t)delta < 0) {
+    timeo_append_expired(t);
+    return;
+  }
+
+  /* find the lowest level that spans the delay */
+  for (level = 0; level < TIMEO_WHEEL_LEVELS - 1; level++) {
+    if (delta < (1UL << ((level + 1) * TIMEO_WHEEL_BITS))) {
+      break;
+    }
+  }
+  if (delta < TIMEO_WHEEL_SPAN) {
+    slot = (t->time >> (level * TIMEO_WHEEL_BITS)) & TIMEO_WHEEL_MASK;
+  } else {
+    /* beyond the wheel: park in the last slot, it is placed again later */
+    slot = ((timeo_now + TIMEO_WHEEL_SPAN - 1) >> (level * TIMEO_WHEEL_BITS)) & TIMEO_WHEEL_MASK;
+  }
+
+  t->level = level;
+  t->slot = (u8_t)slot;
+  timeo_link(&timeo_wheel[level][slot], t);
+  timeo_occupied[level][slot >> 5] |= 1UL << (slot & 31);
+}
+
+/**
+ * Take a timeout off the wheel or the expired list.
+ */
+static void
+timeo_remove(struct sys_timeo *t)
+{
+  *t->pprev = t->next;
+  if (t->next != NULL) {
+    t->next->pprev = t->pprev;
+  }
+  if (t->level == TIMEO_EXPIRED) {
+    if (timeo_expired_tail == &t->next) {
+      timeo_expired_tail = t->pprev;
+    }
+  } else if (timeo_wheel[t->level][t->slot] == NULL) {
+    timeo_occupied[t->level][t->slot >> 5] &= ~(1UL << (t->slot & 31));
+  }
+}
+
+/**
+ * Move the timeouts of the current slot of a wheel level (and of the levels
+ * above it, if they wrapped around too) down the wheel. This is done as
+ * soon as the wheel time reaches the slot, so the current slot of a higher
+ * level only ever holds timeouts for its next turn.
+ */
+static void
+timeo_cascade(int level)
+{
+  struct sys_timeo *t;
+  u32_t slot = (timeo_now >> (level * TIMEO_WHEEL_BITS)) & TIMEO_WHEEL_MASK;
+
+  if ((slot == 0) && (level < TIMEO_WHEEL_LEVELS - 1)) {
+    timeo_cascade(level + 1);
+  }
+  while ((t = timeo_wheel[level][slot]) != NULL) {
+    timeo_remove(t);
+    timeo_insert(t);
+  }
+}
+
+/**
+ * Advance the wheel up to and including 'now', moving all timeouts that
+ * expire on the way to the expired list.
+ */
+static void
+timeo_advance(u32_t now)
+{
+  struct sys_timeo *t;
+  u32_t slot, next;
+
+  while ((s32_t)(now - timeo_now) >= 0) {
+    slot = timeo_now & TIMEO_WHEEL_MASK;
+    while ((t = timeo_wheel[0][slot]) != NULL) {
+      timeo_remove(t);
+      timeo_append_expired(t);
+    }
+    /* skip empty slots, but stop at the end of level 0 to cascade */
+    next = timeo_find_slot(0, slot + 1);
+    timeo_now += next - slot;
+    if ((s32_t)(timeo_now - now) > 1) {
+      timeo_now = now + 1;
+    }
+    if ((timeo_now & TIMEO_WHEEL_MASK) == 0) {
+      /* level 0 wrapped around */
+      timeo_cascade(1);
+    }
+  }
+}
+
+/**
+ * Find the earliest expiry time of all timeouts on the wheel.
+ *
+ * @param time set to the earliest expiry time
+ * @return 1 if there is a timeout on the wheel, 0 otherwise
+ */
+static int
+timeo_next_expiry(u32_t *time)
+{
+  struct sys_timeo *t;
+  u32_t slot, current;
+  int level, found = 0;
+
+  /* level 0 slots hold a single expiry time each */
+  current = timeo_now & TIMEO_WHEEL_MASK;
+  slot = timeo_find_slot(0, current);
+  if (slot == TIMEO_WHEEL_SLOTS) {
+    slot = timeo_find_slot(0, 0);
+  }
+  if (slot != TIMEO_WHEEL_SLOTS) {
+    *time = timeo_now + ((slot - current) & TIMEO_WHEEL_MASK);
+    found = 1;
+  }
+
+  /* the first occupied slot after the current one holds the earliest
+     timeouts of a higher level */
+  for (level = 1; level < TIMEO_WHEEL_LEVELS; level++) {
+    if (level < TIMEO_WHEEL_LEVELS - 1) {
+      current = (timeo_now >> (level * TIMEO_WHEEL_BITS)) & TIMEO_WHEEL_MASK;
+      slot = timeo_find_slot(level, current + 1);
+      if (slot == TIMEO_WHEEL_SLOTS) {
+        slot = timeo_find_slot(level, 0);
+      }
+    } else {
+      /* timeouts beyond the wheel are parked out of order on the top
+         level, so check all of its slots */
+      slot = timeo_find_slot(level, 0);
+    }
+    while (slot != TIMEO_WHEEL_SLOTS) {
+      for (t = timeo_wheel[level][slot]; t != NULL; t = t->next) {
+        if (!found || ((s32_t)(t->time - *time) < 0)) {
+          *time = t->time;
+          found = 1;
+        }
+      }
+      if (level < TIMEO_WHEEL_LEVELS - 1) {
+        break;
+      }
+      slot = timeo_find_slot(level, slot + 1);
+    }
+  }
+
+  return found;
+}
+
+/**
+ * Unlink a timeout from the hash of handlers and arguments.
+ */
+static void
+timeo_unhash(struct sys_timeo *t)
+{
+  *t->hpprev = t->hnext;
+  if (t->hnext != NULL) {
+    t->hnext->hpprev = t->hpprev;
+  }
+}
+
+#if SYS_TIMEOUT_STATS
+/**
+ * Record the lateness of a timeout handler call.
+ */
+static void
+timeo_stats_update(struct sys_timeo *t, u32_t late)
+{
+  int i;
+
+  for (i = 0; i < SYS_TIMEOUT_STATS_HANDLERS; i++) {
+    if (timeo_stats[i].h == NULL) {
+      /* first call of this handler */
+      timeo_stats[i].h = t->h;
+#if LWIP_DEBUG_TIMERNAMES
+      timeo_stats[i].handler_name = t->handler_name;
+#endif /* LWIP_DEBUG_TIMERNAMES */
+    }
+    if (timeo_stats[i].h == t->h) {
+      timeo_stats[i].count++;
+      timeo_stats[i].late_total += late;
+      if (late > timeo_stats[i].late_max) {
+        timeo_stats[i].late_max = late;
+      }
+      return;
+    }
+  }
+}
+
+/**
+ * Get the lateness statistics of the timeout handlers. Unused entries have
+ * a NULL handler.
+ *
+ * @return array of SYS_TIMEOUT_STATS_HANDLERS entries
+ */
+const struct sys_timeo_stats *
+sys_timeouts_stats(void)
+{
+  return timeo_stats;
+}
+
+/** Reset the lateness statistics of the timeout handlers */
+void
+sys_timeouts_stats_reset(void)
+{
+  memset(timeo_stats, 0, sizeof(timeo_stats));
+}
+#endif /* SYS_TIMEOUT_STATS */
+
+/**
+ * Take the first timeout off the expired list and free it. The handler has
+ * to be called by the caller, followed by timeo_handler_done().
+ *
+ * @param arg set to the argument to pass to the handler
+ * @return the handler to call
+ */
+static sys_timeout_handler
+timeo_expire(void **arg)
+{
+  struct sys_timeo *t = timeo_expired;
+  sys_timeout_handler handler = t->h;
+
+  *arg = t->arg;
+  timeo_remove(t);
+  timeo_unhash(t);
+#if SYS_TIMEOUT_STATS
+  timeo_stats_update(t, sys_now() - t->time);
+#endif /* SYS_TIMEOUT_STATS */
+#if LWIP_DEBUG_TIMERNAMES
+  if (handler != NULL) {
+    LWIP_DEBUGF(TIMERS_DEBUG, ("sys_timeo calling h=%s arg=%p\n",
+      t->handler_name, *arg));
+  }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+  /* timeouts re-armed by the handler are relative to this expiry time */
+  timeo_handler_time = t->time;
+  timeo_in_handler = 1;
+  memp_free(MEMP_SYS_TIMEOUT, t);
+  return handler;
 }
 
 /**
@@ -254,6 +593,9 @@ void sys_timeouts_init(void)
  * - while waiting for a message using sys_timeouts_mbox_fetch()
  * - by calling sys_check_timeouts() (NO_SYS==1 only)
  *
+ * When called from a timeout handler, msecs is relative to the time the
+ * handler was due, so periodic timers do not drift.
+ *
  * @param msecs time in milliseconds after that the timer should expire
  * @param handler callback function to call when msecs have elapsed
  * @param arg argument to pass to the callback function
@@ -266,50 +608,46 @@ void
 sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 #endif /* LWIP_DEBUG_TIMERNAMES */
 {
-  struct sys_timeo *timeout, *t;
+  struct sys_timeo *timeout;
+  u32_t now;
 
   timeout = (struct sys_timeo *)memp_malloc(MEMP_SYS_TIMEOUT);
   if (timeout == NULL) {
     LWIP_ASSERT("sys_timeout: timeout != NULL, pool MEMP_SYS_TIMEOUT is empty", timeout != NULL);
     return;
   }
-  timeout->next = NULL;
+  now = sys_now();
   timeout->h = handler;
   timeout->arg = arg;
-  timeout->time = msecs;
+  if (timeo_in_handler) {
+    timeout->time = timeo_handler_time + msecs;
+    if ((s32_t)(timeout->time - now) < 0) {
+      /* the handler ran later than a whole period */
+      timeout->time = now;
+    }
+  } else {
+    timeout->time = now + msecs;
+  }
 #if LWIP_DEBUG_TIMERNAMES
   timeout->handler_name = handler_name;
   LWIP_DEBUGF(TIMERS_DEBUG, ("sys_timeout: %p msecs=%"U32_F" handler=%s arg=%p\n",
     (void *)timeout, msecs, handler_name, (void *)arg));
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
-  if (next_timeout == NULL) {
-    next_timeout = timeout;
-    return;
-  }
+  timeo_insert(timeout);
 
-  if (next_timeout->time > msecs) {
-    next_timeout->time -= msecs;
-    timeout->next = next_timeout;
-    next_timeout = timeout;
-  } else {
-    for(t = next_timeout; t != NULL; t = t->next) {
-      timeout->time -= t->time;
-      if (t->next == NULL || t->next->time > timeout->time) {
-        if (t->next != NULL) {
-          t->next->time -= timeout->time;
-        }
-        timeout->next = t->next;
-        t->next = timeout;
-        break;
-      }
-    }
+  /* hash by handler and argument for sys_untimeout() */
+  timeout->hnext = timeo_hash[TIMEO_HASH(handler, arg)];
+  if (timeout->hnext != NULL) {
+    timeout->hnext->hpprev = &timeout->hnext;
   }
+  timeout->hpprev = &timeo_hash[TIMEO_HASH(handler, arg)];
+  *timeout->hpprev = timeout;
 }
 
 /**
- * Go through timeout list (for this task only) and remove the first matching
- * entry, even though the timeout has not triggered yet.
+ * Remove the first matching timeout, even though the timeout has not
+ * triggered yet.
  *
  * @note This function only works as expected if there is only one timeout
  * calling 'handler' in the list of timeouts.
@@ -320,30 +658,17 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 void
 sys_untimeout(sys_timeout_handler handler, void *arg)
 {
-  struct sys_timeo *prev_t, *t;
+  struct sys_timeo *t;
 
-  if (next_timeout == NULL) {
-    return;
-  }
-
-  for (t = next_timeout, prev_t = NULL; t != NULL; prev_t = t, t = t->next) {
+  for (t = timeo_hash[TIMEO_HASH(handler, arg)]; t != NULL; t = t->hnext) {
     if ((t->h == handler) && (t->arg == arg)) {
       /* We have a match */
-      /* Unlink from previous in list */
-      if (prev_t == NULL) {
-        next_timeout = t->next;
-      } else {
-        prev_t->next = t->next;
-      }
-      /* If not the last one, add time of this one back to next */
-      if (t->next != NULL) {
-        t->next->time += t->time;
-      }
+      timeo_remove(t);
+      timeo_unhash(t);
       memp_free(MEMP_SYS_TIMEOUT, t);
       return;
     }
   }
-  return;
 }
 
 #if NO_SYS
@@ -357,45 +682,21 @@ sys_untimeout(sys_timeout_handler handler, void *arg)
 void
 sys_check_timeouts(void)
 {
-  if (next_timeout) {
-    struct sys_timeo *tmptimeout;
-    u32_t diff;
-    sys_timeout_handler handler;
-    void *arg;
-    u8_t had_one;
-    u32_t now;
-
-    now = sys_now();
-    /* this cares for wraparounds */
-    diff = now - timeouts_last_time;
-    do
-    {
+  sys_timeout_handler handler;
+  void *arg;
+
+  timeo_advance(sys_now());
+
+  /* call the handlers of all expired timers */
+  while (timeo_expired != NULL) {
 #if PBUF_POOL_FREE_OOSEQ
-      PBUF_CHECK_FREE_OOSEQ();
+    PBUF_CHECK_FREE_OOSEQ();
 #endif /* PBUF_POOL_FREE_OOSEQ */
-      had_one = 0;
-      tmptimeout = next_timeout;
-      if (tmptimeout && (tmptimeout->time <= diff)) {
-        /* timeout has expired */
-        had_one = 1;
-        timeouts_last_time = now;
-        diff -= tmptimeout->time;
-        next_timeout = tmptimeout->next;
-        handler = tmptimeout->h;
-        arg = tmptimeout->arg;
-#if LWIP_DEBUG_TIMERNAMES
-        if (handler != NULL) {
-          LWIP_DEBUGF(TIMERS_DEBUG, ("sct calling h=%s arg=%p\n",
-            tmptimeout->handler_name, arg));
-        }
-#endif /* LWIP_DEBUG_TIMERNAMES */
-        memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
-        if (handler != NULL) {
-          handler(arg);
-        }
-      }
-    /* repeat until all expired timers have been called */
-    }while(had_one);
+    handler = timeo_expire(&arg);
+    if (handler != NULL) {
+      handler(arg);
+    }
+    timeo_in_handler = 0;
   }
 }
 
@@ -407,7 +708,32 @@ sys_check_timeouts(void)
 void
 sys_restart_timeouts(void)
 {
-  timeouts_last_time = sys_now();
+  struct sys_timeo *pending = NULL;
+  struct sys_timeo *t;
+  u32_t now = sys_now();
+  u32_t passed = now - timeo_now;
+  u32_t slot;
+  int level;
+
+  /* take all timeouts off the wheel */
+  for (level = 0; level < TIMEO_WHEEL_LEVELS; level++) {
+    for (slot = 0; slot < TIMEO_WHEEL_SLOTS; slot++) {
+      while ((t = timeo_wheel[level][slot]) != NULL) {
+        timeo_remove(t);
+        t->next = pending;
+        pending = t;
+      }
+    }
+  }
+
+  /* and place them again with the time that passed added */
+  timeo_now = now;
+  while (pending != NULL) {
+    t = pending;
+    pending = t->next;
+    t->time += passed;
+    timeo_insert(t);
+  }
 }
 
 #else /* NO_SYS */
@@ -416,63 +742,53 @@ sys_restart_timeouts(void)
  * Wait (forever) for a message to arrive in an mbox.
  * While waiting, timeouts are processed.
  *
+ * The wait ends exactly at the expiry time of the next timeout.
+ *
  * @param mbox the mbox to fetch the message from
  * @param msg the place to store the message
  */
 void
 sys_timeouts_mbox_fetch(sys_mbox_t *mbox, void **msg)
 {
-  u32_t time_needed;
-  struct sys_timeo *tmptimeout;
+  u32_t now;
+  u32_t time;
+  int pending;
   sys_timeout_handler handler;
   void *arg;
 
  again:
-  if (!next_timeout) {
-    time_needed = sys_arch_mbox_fetch(mbox, msg, 0);
-  } else {
-    if (next_timeout->time > 0) {
-      time_needed = sys_arch_mbox_fetch(mbox, msg, next_timeout->time);
-    } else {
-      time_needed = SYS_ARCH_TIMEOUT;
+  /* For LWIP_TCPIP_CORE_LOCKING, other threads add and remove timeouts
+     while holding the core lock, so the wheel and the hash are only
+     touched with it held as well. It is released for the wait. A timeout
+     added during the wait that is due before the wait ends runs when
+     the wait ends. */
+  LOCK_TCPIP_CORE();
+  now = sys_now();
+  timeo_advance(now);
+
+  if (timeo_expired != NULL) {
+    /* a timeout expired: call its handler */
+    handler = timeo_expire(&arg);
+    if (handler != NULL) {
+      handler(arg);
     }
+    timeo_in_handler = 0;
+    UNLOCK_TCPIP_CORE();
+    LWIP_TCPIP_THREAD_ALIVE();
 
-    if (time_needed == SYS_ARCH_TIMEOUT) {
-      /* If time == SYS_ARCH_TIMEOUT, a timeout occured before a message
-         could be fetched. We should now call the timeout handler and
-         deallocate the memory allocated for the timeout. */
-      tmptimeout = next_timeout;
-      next_timeout = tmptimeout->next;
-      handler = tmptimeout->h;
-      arg = tmptimeout->arg;
-#if LWIP_DEBUG_TIMERNAMES
-      if (handler != NULL) {
-        LWIP_DEBUGF(TIMERS_DEBUG, ("stmf calling h=%s arg=%p\n",
-          tmptimeout->handler_name, arg));
-      }
-#endif /* LWIP_DEBUG_TIMERNAMES */
-      memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
-      if (handler != NULL) {
-        /* For LWIP_TCPIP_CORE_LOCKING, lock the core before calling the
-           timeout handler function. */
-        LOCK_TCPIP_CORE();
-        handler(arg);
-        UNLOCK_TCPIP_CORE();
-      }
-      LWIP_TCPIP_THREAD_ALIVE();
+    /* We try again to fetch a message from the mbox. */
+    goto again;
+  }
 
-      /* We try again to fetch a message from the mbox. */
-      goto again;
-    } else {
-      /* If time != SYS_ARCH_TIMEOUT, a message was received before the timeout
-         occured. The time variable is set to the number of
-         milliseconds we waited for the message. */
-      if (time_needed < next_timeout->time) {
-        next_timeout->time -= time_needed;
-      } else {
-        next_timeout->time = 0;
-      }
-    }
+  pending = timeo_next_expiry(&time);
+  UNLOCK_TCPIP_CORE();
+
+  if (!pending) {
+    /* no timeouts: wait forever */
+    sys_arch_mbox_fetch(mbox, msg, 0);
+  } else if (sys_arch_mbox_fetch(mbox, msg, time - now) == SYS_ARCH_TIMEOUT) {
+    /* the next timeout is due */
+    goto again;
   }
 }
 
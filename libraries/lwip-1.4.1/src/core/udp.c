@@ -79,6 +79,62 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if LWIP_UDP_PCB_HASH
+#if (UDP_PCB_HASH_SIZE & (UDP_PCB_HASH_SIZE - 1)) != 0
+#error "UDP_PCB_HASH_SIZE must be a power of 2"
+#endif
+
+/** Hash table of active UDP PCBs indexed by local port. Each bucket keeps
+ * its PCBs in the same relative order as udp_pcbs, so demultiplexing
+ * through a bucket selects the same PCB as scanning the whole list. */
+static struct udp_pcb *udp_pcb_hash[UDP_PCB_HASH_SIZE];
+
+#define UDP_PCB_HASH(port) ((((port) >> 8) ^ (port)) & (UDP_PCB_HASH_SIZE - 1))
+
+/**
+ * Remove a PCB from its local port hash bucket.
+ *
+ * @param pcb the pcb to remove, hashed by its current local port
+ */
+static void
+udp_hash_remove(struct udp_pcb *pcb)
+{
+  struct udp_pcb **ppcb;
+
+  for (ppcb = &udp_pcb_hash[UDP_PCB_HASH(pcb->local_port)]; *ppcb != NULL;
+       ppcb = &(*ppcb)->hash_next) {
+    if (*ppcb == pcb) {
+      *ppcb = pcb->hash_next;
+      break;
+    }
+  }
+  pcb->hash_next = NULL;
+}
+
+/**
+ * Insert a PCB that is already on udp_pcbs into its local port hash
+ * bucket, behind all bucket entries that precede it on udp_pcbs.
+ *
+ * @param pcb the pcb to insert, hashed by its current local port
+ */
+static void
+udp_hash_insert(struct udp_pcb *pcb)
+{
+  struct udp_pcb *ipcb;
+  struct udp_pcb **ppcb;
+  u16_t hash = UDP_PCB_HASH(pcb->local_port);
+
+  ppcb = &udp_pcb_hash[hash];
+  for (ipcb = udp_pcbs; (ipcb != NULL) && (ipcb != pcb); ipcb = ipcb->next) {
+    if (UDP_PCB_HASH(ipcb->local_port) == hash) {
+      ppcb = &ipcb->hash_next;
+    }
+  }
+  pcb->hash_next = *ppcb;
+  *ppcb = pcb;
+}
+#endif /* LWIP_UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -160,6 +216,10 @@ udp_input(struct pbuf *p, struct netif *inp)
 
   PERF_START;
 
+#ifdef LWIP_HOOK_UDP_INPUT
+  LWIP_HOOK_UDP_INPUT(p);
+#endif /* LWIP_HOOK_UDP_INPUT */
+
   UDP_STATS_INC(udp.recv);
 
   iphdr = (struct ip_hdr *)p->payload;
@@ -226,7 +286,12 @@ udp_input(struct pbuf *p, struct netif *inp)
      * 'Perfect match' pcbs (connected to the remote port & ip address) are
      * preferred. If no perfect match is found, the first unconnected pcb that
      * matches the local port and ip address gets the datagram. */
+#if LWIP_UDP_PCB_HASH
+    /* Only the pcbs hashed by the destination port can match. */
+    for (pcb = udp_pcb_hash[UDP_PCB_HASH(dest)]; pcb != NULL; pcb = pcb->hash_next) {
+#else /* LWIP_UDP_PCB_HASH */
     for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* LWIP_UDP_PCB_HASH */
       local_match = 0;
       /* print the PCB local and remote address */
       LWIP_DEBUGF(UDP_DEBUG,
@@ -268,6 +333,12 @@ udp_input(struct pbuf *p, struct netif *inp)
           (ip_addr_isany(&pcb->remote_ip) ||
            ip_addr_cmp(&(pcb->remote_ip), &current_iphdr_src))) {
         /* the first fully matching PCB */
+#if LWIP_UDP_PCB_HASH
+        /* the hash lookup makes reordering unnecessary, and the pcb list
+           order must stay in sync with the hash buckets */
+        LWIP_UNUSED_ARG(prev);
+        UDP_STATS_INC(udp.cachehit);
+#else /* LWIP_UDP_PCB_HASH */
         if (prev != NULL) {
           /* move the pcb to the front of udp_pcbs so that is
              found faster next time */
@@ -277,6 +348,7 @@ udp_input(struct pbuf *p, struct netif *inp)
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
+#endif /* LWIP_UDP_PCB_HASH */
         break;
       }
       prev = pcb;
@@ -817,6 +889,12 @@ udp_bind(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port)
       return ERR_USE;
     }
   }
+#if LWIP_UDP_PCB_HASH
+  if (rebind != 0) {
+    /* remove from the bucket of the old local port */
+    udp_hash_remove(pcb);
+  }
+#endif /* LWIP_UDP_PCB_HASH */
   pcb->local_port = port;
   snmp_insert_udpidx_tree(pcb);
   /* pcb not active yet? */
@@ -825,6 +903,9 @@ udp_bind(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port)
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
   }
+#if LWIP_UDP_PCB_HASH
+  udp_hash_insert(pcb);
+#endif /* LWIP_UDP_PCB_HASH */
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE,
               ("udp_bind: bound to %"U16_F".%"U16_F".%"U16_F".%"U16_F", port %"U16_F"\n",
                ip4_addr1_16(&pcb->local_ip), ip4_addr2_16(&pcb->local_ip),
@@ -899,6 +980,9 @@ udp_connect(struct udp_pcb *pcb, ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+#if LWIP_UDP_PCB_HASH
+  udp_hash_insert(pcb);
+#endif /* LWIP_UDP_PCB_HASH */
   return ERR_OK;
 }
 
@@ -948,6 +1032,9 @@ udp_remove(struct udp_pcb *pcb)
   struct udp_pcb *pcb2;
 
   snmp_delete_udpidx_tree(pcb);
+#if LWIP_UDP_PCB_HASH
+  udp_hash_remove(pcb);
+#endif /* LWIP_UDP_PCB_HASH */
   /* pcb to be removed is first in list? */
   if (udp_pcbs == pcb) {
     /* make list start at 2nd pcb */
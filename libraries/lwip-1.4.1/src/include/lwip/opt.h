@@ -896,6 +896,22 @@
 #define LWIP_NETBUF_RECVINFO            0
 #endif
 
+/**
+ * LWIP_UDP_PCB_HASH==1: Demultiplex incoming datagrams through a hash table
+ * of UDP pcbs indexed by local port instead of scanning the whole pcb list.
+ */
+#ifndef LWIP_UDP_PCB_HASH
+#define LWIP_UDP_PCB_HASH               0
+#endif
+
+/**
+ * UDP_PCB_HASH_SIZE: Number of buckets in the UDP pcb hash table.
+ * Must be a power of 2. (Only used if LWIP_UDP_PCB_HASH==1)
+ */
+#ifndef UDP_PCB_HASH_SIZE
+#define UDP_PCB_HASH_SIZE               16
+#endif
+
 /*
    ---------------------------------
    ---------- TCP options ----------
@@ -1104,6 +1120,15 @@
 #define PBUF_POOL_BUFSIZE               LWIP_MEM_ALIGN_SIZE(TCP_MSS+40+PBUF_LINK_HLEN)
 #endif
 
+/**
+ * LWIP_PBUF_STAMPS: the number of u32_t stamps in each pbuf, for a port to
+ * record when a received packet passed the stages of the stack (see
+ * LWIP_HOOK_TCPIP_INPKT and LWIP_HOOK_UDP_INPUT). 0 leaves them out.
+ */
+#ifndef LWIP_PBUF_STAMPS
+#define LWIP_PBUF_STAMPS                0
+#endif
+
 /*
    ------------------------------------------------
    ---------- Network Interfaces options ----------
@@ -1519,6 +1544,22 @@
 #define LWIP_STATS_DISPLAY              0
 #endif
 
+/**
+ * SYS_TIMEOUT_STATS==1: Record how late each timeout handler is called.
+ * Read the statistics with sys_timeouts_stats().
+ */
+#ifndef SYS_TIMEOUT_STATS
+#define SYS_TIMEOUT_STATS               0
+#endif
+
+/**
+ * SYS_TIMEOUT_STATS_HANDLERS: Number of timeout handlers statistics are
+ * recorded for.
+ */
+#ifndef SYS_TIMEOUT_STATS_HANDLERS
+#define SYS_TIMEOUT_STATS_HANDLERS      12
+#endif
+
 /**
  * LINK_STATS==1: Enable link stats.
  */
@@ -1861,6 +1902,18 @@
  * (i.e. free it when done).
  */
 
+/**
+ * LWIP_HOOK_TCPIP_INPKT(pbuf):
+ * - called from tcpip_thread() before a received packet is passed to the stack
+ * - pbuf: received struct pbuf
+ */
+
+/**
+ * LWIP_HOOK_UDP_INPUT(pbuf):
+ * - called from udp_input() for each received UDP packet
+ * - pbuf: received struct pbuf, payload at the IP header
+ */
+
 /**
  * LWIP_HOOK_IP4_ROUTE(dest):
  * - called from ip_route() (IPv4)
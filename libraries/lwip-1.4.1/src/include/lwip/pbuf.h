@@ -41,8 +41,10 @@ extern "C" {
 #endif
 
 /** Currently, the pbuf_custom code is only needed for one specific configuration
- * of IP_FRAG */
+ * of IP_FRAG, unless lwipopts.h enables it */
+#ifndef LWIP_SUPPORT_CUSTOM_PBUF
 #define LWIP_SUPPORT_CUSTOM_PBUF (IP_FRAG && !IP_FRAG_USES_STATIC_BUF && !LWIP_NETIF_TX_SINGLE_PBUF)
+#endif
 
 #define PBUF_TRANSPORT_HLEN 20
 #define PBUF_IP_HLEN        20
@@ -115,6 +117,11 @@ struct pbuf {
   s32_t time_sec;
   s32_t time_nsec;
 #endif
+
+#if LWIP_PBUF_STAMPS
+  /** stamps of a received packet, see LWIP_PBUF_STAMPS */
+  u32_t stamps[LWIP_PBUF_STAMPS];
+#endif
 };
 
 #if LWIP_SUPPORT_CUSTOM_PBUF
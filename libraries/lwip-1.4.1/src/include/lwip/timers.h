@@ -65,15 +65,39 @@ extern "C" {
 typedef void (* sys_timeout_handler)(void *arg);
 
 struct sys_timeo {
+  /** timer wheel slot or expired list links */
   struct sys_timeo *next;
+  struct sys_timeo **pprev;
+  /** handler and argument hash links */
+  struct sys_timeo *hnext;
+  struct sys_timeo **hpprev;
+  /** absolute expiry time in milliseconds (sys_now() based) */
   u32_t time;
   sys_timeout_handler h;
   void *arg;
+  /** wheel level and slot the timeout is on */
+  u8_t level;
+  u8_t slot;
 #if LWIP_DEBUG_TIMERNAMES
   const char* handler_name;
 #endif /* LWIP_DEBUG_TIMERNAMES */
 };
 
+#if SYS_TIMEOUT_STATS
+/** Lateness statistics of a timeout handler */
+struct sys_timeo_stats {
+  sys_timeout_handler h;
+#if LWIP_DEBUG_TIMERNAMES
+  const char* handler_name;
+#endif /* LWIP_DEBUG_TIMERNAMES */
+  /** number of calls */
+  u32_t count;
+  /** maximum and total milliseconds the calls were late */
+  u32_t late_max;
+  u32_t late_total;
+};
+#endif /* SYS_TIMEOUT_STATS */
+
 void sys_timeouts_init(void);
 
 #if LWIP_DEBUG_TIMERNAMES
@@ -84,6 +108,10 @@ void sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg);
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
 void sys_untimeout(sys_timeout_handler handler, void *arg);
+#if SYS_TIMEOUT_STATS
+const struct sys_timeo_stats *sys_timeouts_stats(void);
+void sys_timeouts_stats_reset(void);
+#endif /* SYS_TIMEOUT_STATS */
 #if NO_SYS
 void sys_check_timeouts(void);
 void sys_restart_timeouts(void);
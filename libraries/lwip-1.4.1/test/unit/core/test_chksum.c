@@ -0,0 +1,162 @@
+#include "test_chksum.h"
+
+#include "lwip/def.h"
+#include "lwip/inet_chksum.h"
+
+#include <string.h>
+
+/* Host emulation of the Cortex-M4 intrinsics used by the SIMD kernel */
+static u32_t
+emu_uxtab16(u32_t op1, u32_t op2)
+{
+  u32_t lo = (op1 + (op2 & 0xff)) & 0xffff;
+  u32_t hi = ((op1 >> 16) + ((op2 >> 16) & 0xff)) & 0xffff;
+  return (hi << 16) | lo;
+}
+
+/* Build the port checksum kernel twice: SIMD (emulated) and portable C */
+#define __UXTAB16 emu_uxtab16
+#define CHKSUM_SIMD 1
+#define chksum_blocks chksum_blocks_simd
+#define chksum_copy_blocks chksum_copy_blocks_simd
+#define chksum_common chksum_common_simd
+#define lwip_fast_chksum chksum_simd
+#define lwip_fast_chksum_copy chksum_copy_simd
+#include "../../../port/STM32F4x7/arch/chksum.c"
+#undef CHKSUM_WORD
+#undef CHKSUM_SIMD
+#undef chksum_blocks
+#undef chksum_copy_blocks
+#undef chksum_common
+#undef lwip_fast_chksum
+#undef lwip_fast_chksum_copy
+
+#define CHKSUM_SIMD 0
+#define chksum_blocks chksum_blocks_c
+#define chksum_copy_blocks chksum_copy_blocks_c
+#define chksum_common chksum_common_c
+#define lwip_fast_chksum chksum_c
+#define lwip_fast_chksum_copy chksum_copy_c
+#include "../../../port/STM32F4x7/arch/chksum.c"
+
+u16_t chksum_simd(void *dataptr, int len);
+u16_t chksum_copy_simd(void *dst, const void *src, u16_t len);
+u16_t chksum_c(void *dataptr, int len);
+u16_t chksum_copy_c(void *dst, const void *src, u16_t len);
+
+#define TEST_BUF_SIZE 2100
+#define TEST_ITERATIONS 20000
+
+static u8_t src_buf[TEST_BUF_SIZE + 8];
+static u8_t dst_buf[TEST_BUF_SIZE + 8];
+static u32_t rand_state;
+
+/* Helper functions */
+
+static u32_t
+test_rand(void)
+{
+  rand_state = rand_state * 1103515245UL + 12345UL;
+  return rand_state >> 8;
+}
+
+/** Reference checksum (lwip_standard_chksum version #1) */
+static u16_t
+reference_chksum(const u8_t *octetptr, int len)
+{
+  u32_t acc = 0;
+
+  while (len > 1) {
+    acc += ((u32_t)octetptr[0] << 8) | octetptr[1];
+    octetptr += 2;
+    len -= 2;
+  }
+  if (len > 0) {
+    acc += (u32_t)octetptr[0] << 8;
+  }
+  acc = (acc >> 16) + (acc & 0x0000ffffUL);
+  if ((acc & 0xffff0000UL) != 0) {
+    acc = (acc >> 16) + (acc & 0x0000ffffUL);
+  }
+  return htons((u16_t)acc);
+}
+
+/* Setups/teardown functions */
+
+static void
+chksum_setup(void)
+{
+  rand_state = 1;
+}
+
+static void
+chksum_teardown(void)
+{
+}
+
+
+/* Test functions */
+
+/** Compare both kernels against the reference on random data, lengths and
+ * alignments, including runs of 0xff that stress the carry folding */
+START_TEST(test_chksum_fuzz)
+{
+  int i, j, len, offset;
+  u16_t ref;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < TEST_ITERATIONS; i++) {
+    len = (int)(test_rand() % TEST_BUF_SIZE);
+    offset = (int)(test_rand() % 8);
+    for (j = 0; j < len; j++) {
+      src_buf[offset + j] = (i & 1) ? 0xff : (u8_t)test_rand();
+    }
+    ref = reference_chksum(&src_buf[offset], len);
+    fail_unless(chksum_simd(&src_buf[offset], len) == ref);
+    fail_unless(chksum_c(&src_buf[offset], len) == ref);
+  }
+}
+END_TEST
+
+/** The copy variants must copy exactly len bytes and return the checksum,
+ * for matching and mismatched source and destination alignments */
+START_TEST(test_chksum_copy_fuzz)
+{
+  int i, j, len, soff, doff;
+  u16_t ref;
+  LWIP_UNUSED_ARG(_i);
+
+  for (i = 0; i < TEST_ITERATIONS; i++) {
+    len = (int)(test_rand() % TEST_BUF_SIZE);
+    soff = (int)(test_rand() % 8);
+    doff = (i & 1) ? soff : (int)(test_rand() % 8);
+    for (j = 0; j < len; j++) {
+      src_buf[soff + j] = (u8_t)test_rand();
+    }
+    ref = reference_chksum(&src_buf[soff], len);
+
+    memset(dst_buf, 0x5a, sizeof(dst_buf));
+    fail_unless(chksum_copy_simd(&dst_buf[doff], &src_buf[soff], (u16_t)len) == ref);
+    fail_unless(memcmp(&dst_buf[doff], &src_buf[soff], len) == 0);
+    fail_unless((doff == 0) || (dst_buf[doff - 1] == 0x5a));
+    fail_unless(dst_buf[doff + len] == 0x5a);
+
+    memset(dst_buf, 0x5a, sizeof(dst_buf));
+    fail_unless(chksum_copy_c(&dst_buf[doff], &src_buf[soff], (u16_t)len) == ref);
+    fail_unless(memcmp(&dst_buf[doff], &src_buf[soff], len) == 0);
+    fail_unless(dst_buf[doff + len] == 0x5a);
+  }
+}
+END_TEST
+
+
+/** Create the suite including all tests for this module */
+Suite *
+chksum_suite(void)
+{
+  TFun tests[] = {
+    test_chksum_fuzz,
+    test_chksum_copy_fuzz
+  };
+  return create_suite("CHKSUM", tests, sizeof(tests)/sizeof(TFun), chksum_setup, chksum_teardown);
+}
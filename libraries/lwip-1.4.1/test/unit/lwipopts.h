@@ -47,4 +47,14 @@
 /* Minimal changes to opt.h required for etharp unit tests: */
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
 
+/* Enough UDP pcbs for the demux benchmark, which is built on request
+   with the hash on and off to compare them */
+#define MEMP_NUM_UDP_PCB                32
+#ifndef LWIP_UDP_PCB_HASH
+#define LWIP_UDP_PCB_HASH               1
+#endif
+#ifndef LWIP_UDP_DEMUX_BENCH
+#define LWIP_UDP_DEMUX_BENCH            0
+#endif
+
 #endif /* __LWIPOPTS_H__ */
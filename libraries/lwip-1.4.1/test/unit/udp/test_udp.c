@@ -1,12 +1,19 @@
 #include "test_udp.h"
 
 #include "lwip/udp.h"
+#include "lwip/ip.h"
 #include "lwip/stats.h"
 
+#include <stdio.h>
+#include <time.h>
+
 #if !LWIP_STATS || !UDP_STATS || !MEMP_STATS
 #error "This tests needs UDP- and MEMP-statistics enabled"
 #endif
 
+static struct netif test_netif;
+static int recv_ctr[MEMP_NUM_UDP_PCB];
+
 /* Helper functions */
 static void
 udp_remove_all(void)
@@ -22,12 +29,65 @@ udp_remove_all(void)
   fail_unless(lwip_stats.memp[MEMP_UDP_PCB].used == 0);
 }
 
+static void
+udp_recv_count(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+  recv_ctr[(int)(size_t)arg]++;
+  pbuf_free(p);
+}
+
+/** Create a pcb bound to ipaddr/port that counts received datagrams in
+ * recv_ctr[idx]. */
+static struct udp_pcb *
+udp_new_counting(int idx, ip_addr_t *ipaddr, u16_t port)
+{
+  struct udp_pcb *pcb = udp_new();
+  EXPECT_RETNULL(pcb != NULL);
+  udp_recv(pcb, udp_recv_count, (void *)(size_t)idx);
+  fail_unless(udp_bind(pcb, ipaddr, port) == ERR_OK);
+  return pcb;
+}
+
+/** Pass a datagram from src:sport to dst:dport into udp_input() */
+static void
+udp_input_datagram(ip_addr_t *src, u16_t sport, ip_addr_t *dst, u16_t dport)
+{
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, IP_HLEN + UDP_HLEN + 4, PBUF_RAM);
+  EXPECT_RET(p != NULL);
+  memset(p->payload, 0, p->len);
+
+  iphdr = (struct ip_hdr *)p->payload;
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  ip_addr_copy(iphdr->src, *src);
+  ip_addr_copy(iphdr->dest, *dst);
+  udphdr = (struct udp_hdr *)((u8_t *)p->payload + IP_HLEN);
+  udphdr->src = htons(sport);
+  udphdr->dest = htons(dport);
+  udphdr->len = htons(UDP_HLEN + 4);
+  /* checksum 0: no checksum */
+
+  ip_addr_copy(current_iphdr_src, *src);
+  ip_addr_copy(current_iphdr_dest, *dst);
+  udp_input(p, &test_netif);
+}
+
 /* Setups/teardown functions */
 
 static void
 udp_setup(void)
 {
   udp_remove_all();
+  memset(recv_ctr, 0, sizeof(recv_ctr));
+  memset(&test_netif, 0, sizeof(test_netif));
+  IP4_ADDR(&test_netif.ip_addr, 10,0,0,1);
+  IP4_ADDR(&test_netif.netmask, 255,255,255,0);
+  test_netif.flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_UP;
 }
 
 static void
@@ -56,6 +116,102 @@ START_TEST(test_udp_new_remove)
 }
 END_TEST
 
+/** Check that a connected pcb matching the sender is preferred, and that
+ * otherwise the first unconnected pcb on the list gets the datagram */
+START_TEST(test_udp_demux)
+{
+  ip_addr_t addr1, addr2, addr3, remote, other, bcast;
+  struct udp_pcb *pcb0, *pcb1, *pcb2;
+  LWIP_UNUSED_ARG(_i);
+
+  IP4_ADDR(&addr1, 10,0,0,1);
+  IP4_ADDR(&addr2, 10,0,0,2);
+  IP4_ADDR(&addr3, 10,0,0,3);
+  IP4_ADDR(&remote, 10,0,0,9);
+  IP4_ADDR(&other, 10,0,0,10);
+  IP4_ADDR(&bcast, 10,0,0,255);
+
+  /* all three pcbs share a local port and accept the subnet broadcast */
+  pcb0 = udp_new_counting(0, &addr1, 319);
+  pcb1 = udp_new_counting(1, &addr2, 319);
+  pcb2 = udp_new_counting(2, &addr3, 319);
+  EXPECT_RET((pcb0 != NULL) && (pcb1 != NULL) && (pcb2 != NULL));
+  fail_unless(udp_connect(pcb0, &remote, 5000) == ERR_OK);
+
+  /* the connected pcb is last on the list, but matches perfectly */
+  udp_input_datagram(&remote, 5000, &bcast, 319);
+  fail_unless(recv_ctr[0] == 1);
+  fail_unless(recv_ctr[1] == 0);
+  fail_unless(recv_ctr[2] == 0);
+
+  /* other senders go to the first unconnected pcb (the last one bound) */
+  udp_input_datagram(&other, 5000, &bcast, 319);
+  fail_unless(recv_ctr[0] == 1);
+  fail_unless(recv_ctr[1] == 0);
+  fail_unless(recv_ctr[2] == 1);
+
+  /* unicast only matches the pcb bound to that address */
+  udp_input_datagram(&other, 5000, &addr2, 319);
+  fail_unless(recv_ctr[1] == 1);
+
+  /* rebinding moves the pcb to another port */
+  fail_unless(udp_bind(pcb2, &addr3, 320) == ERR_OK);
+  udp_input_datagram(&other, 5000, &bcast, 319);
+  fail_unless(recv_ctr[1] == 2);
+  fail_unless(recv_ctr[2] == 1);
+  udp_input_datagram(&other, 5000, &bcast, 320);
+  fail_unless(recv_ctr[2] == 2);
+
+  /* removing a pcb removes it from the demux */
+  udp_remove(pcb1);
+  udp_input_datagram(&other, 5000, &bcast, 319);
+  fail_unless(recv_ctr[0] == 1);
+  fail_unless(recv_ctr[1] == 2);
+  fail_unless(recv_ctr[2] == 2);
+  udp_input_datagram(&remote, 5000, &bcast, 319);
+  fail_unless(recv_ctr[0] == 2);
+}
+END_TEST
+
+#if LWIP_UDP_DEMUX_BENCH
+/** Benchmark demultiplexing to the oldest of an increasing number of bound
+ * pcbs, timing udp_input() for each datagram. Not part of the default run:
+ * build with LWIP_UDP_DEMUX_BENCH set, once with LWIP_UDP_PCB_HASH 0 and
+ * once with 1, and compare the times at each count. */
+START_TEST(test_udp_demux_bench)
+{
+  int i;
+  int pcbs;
+  const int count = 100000;
+  clock_t start;
+  ip_addr_t remote;
+  struct udp_pcb *pcb;
+  LWIP_UNUSED_ARG(_i);
+
+  IP4_ADDR(&remote, 10,0,0,9);
+
+  for (pcbs = 1; pcbs <= MEMP_NUM_UDP_PCB; pcbs *= 2) {
+    udp_remove_all();
+    memset(recv_ctr, 0, sizeof(recv_ctr));
+
+    /* the first pcb bound ends up last on the pcb list */
+    for (i = 0; i < pcbs; i++) {
+      pcb = udp_new_counting(i, IP_ADDR_ANY, (u16_t)(1000 + i));
+      EXPECT_RET(pcb != NULL);
+    }
+
+    start = clock();
+    for (i = 0; i < count; i++) {
+      udp_input_datagram(&remote, 5000, &test_netif.ip_addr, 1000);
+    }
+    printf("udp demux (hash %d): %2d pcbs, %6.1f ns per datagram\n", LWIP_UDP_PCB_HASH, pcbs,
+           (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / count);
+    fail_unless(recv_ctr[0] == count);
+  }
+}
+END_TEST
+#endif /* LWIP_UDP_DEMUX_BENCH */
+
 
 /** Create the suite including all tests for this module */
 Suite *
@@ -63,6 +219,10 @@ udp_suite(void)
 {
   TFun tests[] = {
     test_udp_new_remove,
+    test_udp_demux,
+#if LWIP_UDP_DEMUX_BENCH
+    test_udp_demux_bench,
+#endif /* LWIP_UDP_DEMUX_BENCH */
   };
   return create_suite("UDP", tests, sizeof(tests)/sizeof(TFun), udp_setup, udp_teardown);
 }
@@ -21,6 +21,7 @@
 #define DEFAULT_NO_RESET_CLOCK          FALSE
 #define DEFAULT_DOMAIN_NUMBER           0
 #define DEFAULT_DELAY_MECHANISM         E2E
+#define DEFAULT_TRANSPORT               UDP_IPV4 /* UDP_IPV4 or IEE_802_3 */
 #define DEFAULT_AP                      2
 #define DEFAULT_AI                      16
 #define DEFAULT_DELAY_S                 6 /* exponencial smoothing - 2^s */
@@ -53,6 +54,7 @@
 #define DEFAULT_CALIBRATED_OFFSET_NS    10000 /* offset from master < 10us -> calibrated */
 #define DEFAULT_UNCALIBRATED_OFFSET_NS  1000000 /* offset from master > 1000us -> uncalibrated */
 #define MAX_ADJ_OFFSET_NS       100000000 /* max offset to try to adjust it < 100ms */
+#define MANAGEMENT_RATE         16 /* management responses per second, more requests are dropped */
 
 /* features, only change to refelect changes in implementation */
 #define NUMBER_PORTS      1
@@ -75,6 +77,8 @@
 #define PDELAY_RESP_LENGTH            54
 #define PDELAY_RESP_FOLLOW_UP_LENGTH  54
 #define MANAGEMENT_LENGTH             48
+#define MANAGEMENT_TLV_LENGTH         6 /* tlvType, lengthField and managementId */
+#define MANAGEMENT_ERROR_LENGTH       12 /* MANAGEMENT_ERROR_STATUS TLV without displayData */
 /** \}*/
 
 /* Enumeration  defined in tables of the spec */
@@ -186,6 +190,60 @@ enum
 	CTRL_OTHER,
 };
 
+/**
+ * \brief Management message actions (Table 38)
+ */
+enum
+{
+	ACTION_GET = 0,
+	ACTION_SET,
+	ACTION_RESPONSE,
+	ACTION_COMMAND,
+	ACTION_ACKNOWLEDGE
+};
+
+/**
+ * \brief TLV types of management messages (Table 34)
+ */
+enum
+{
+	TLV_MANAGEMENT = 0x0001,
+	TLV_MANAGEMENT_ERROR_STATUS = 0x0002
+};
+
+/**
+ * \brief Supported managementId values (Table 40)
+ */
+enum
+{
+	MM_NULL_MANAGEMENT = 0x0000,
+	MM_DEFAULT_DATA_SET = 0x2000,
+	MM_CURRENT_DATA_SET = 0x2001,
+	MM_PARENT_DATA_SET = 0x2002,
+	MM_TIME_PROPERTIES_DATA_SET = 0x2003,
+	MM_PORT_DATA_SET = 0x2004,
+	MM_PRIORITY1 = 0x2005,
+	MM_PRIORITY2 = 0x2006,
+	MM_DOMAIN = 0x2007,
+	MM_LOG_ANNOUNCE_INTERVAL = 0x2009,
+	MM_LOG_SYNC_INTERVAL = 0x200B,
+	MM_LOG_MIN_PDELAY_REQ_INTERVAL = 0x6001
+};
+
+/**
+ * \brief managementErrorId values (Table 72)
+ */
+enum
+{
+	MM_ERROR_RESPONSE_TOO_BIG = 0x0001,
+	MM_ERROR_NO_SUCH_ID = 0x0002,
+	MM_ERROR_WRONG_LENGTH = 0x0003,
+	MM_ERROR_WRONG_VALUE = 0x0004,
+	MM_ERROR_NOT_SETABLE = 0x0005,
+	MM_ERROR_NOT_SUPPORTED = 0x0006,
+	MM_ERROR_GENERAL_ERROR = 0xFFFE
+};
+
 /**
  * \brief Output statistics
  */
@@ -228,7 +228,12 @@ typedef struct
 		uint8_t startingBoundaryHops;
 		uint8_t boundaryHops;
 		enum4bit_t actionField;
-		char* tlv;
+		/* TLV, which stays in the receive buffer */
+		enum16bit_t tlvType;
+		int16_t lengthField;
+		enum16bit_t managementId;
+		const octet_t* data;
+		int16_t dataLength;
 }MsgManagement;
 
 
@@ -397,6 +402,7 @@ typedef struct
 		TimeInternal  inboundLatency, outboundLatency;
 		int16_t   maxForeignRecords;
 		enum8bit_t  delayMechanism;
+		enum8bit_t  transport;
 	Servo servo;
 } RunTimeOpts;
 
@@ -485,10 +491,32 @@ typedef struct
 
 		int32_t  events;
 
+		/* Management responses sent in the current second */
+		int32_t  managementSecond;
+		int16_t  managementResponses;
+
 		enum8bit_t  stats;
 
 		RunTimeOpts * rtOpts;
 
 } PtpClock;
 
+/**
+ * \struct PtpSnapshot
+ * \brief Clock state published by the PTP thread for readers in other threads
+ */
+
+typedef struct
+{
+		uint32_t  version; /**< changes published so far, clock updates and state changes */
+		uint32_t  updates; /**< clock updates published so far */
+		enum8bit_t  portState;
+		enum8bit_t  delayMechanism;
+		ClockIdentity  parentClockIdentity;
+		TimeInternal  offsetFromMaster;
+		TimeInternal  meanPathDelay; /**< path delay of the delay mechanism in use */
+		int32_t  observedDrift;
+		int32_t  adj; /**< last frequency adjustment */
+} PtpSnapshot;
+
 #endif /* DATATYPES_H_*/
@@ -64,10 +64,21 @@
 
 #define MM_STARTING_BOUNDARY_HOPS  0x7fff
 
+/* IEEE 802.3 dependent */
+
+#define PTP_ETHER_TYPE  0x88F7
+
+#define DEFAULT_PTP_ETHER_ADDRESS  { 0x01, 0x1B, 0x19, 0x00, 0x00, 0x00 }
+#define PEER_PTP_ETHER_ADDRESS     { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E }
+
 /* Must be a power of 2 */
 #define PBUF_QUEUE_SIZE 4
 #define PBUF_QUEUE_MASK (PBUF_QUEUE_SIZE - 1)
 
+/* Servo telemetry, samples per datagram and default collector port */
+#define TELEMETRY_BATCH_SIZE  16
+#define TELEMETRY_PORT        5319
+
 /* others */
 
 #define SCREEN_BUFSZ  128
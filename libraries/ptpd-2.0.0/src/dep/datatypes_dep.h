@@ -51,12 +51,15 @@ typedef struct
 	void      *pbuf[PBUF_QUEUE_SIZE];
 	int16_t   head;
 	int16_t   tail;
+	uint16_t  id;
 	sys_mutex_t mutex;
 } BufQueue;
 
 // Struct used  to store network datas
 typedef struct
 {
+	enum8bit_t  transport;
+
 	int32_t   multicastAddr;
 	int32_t   peerMulticastAddr;
 	int32_t   unicastAddr;
@@ -68,6 +71,17 @@ typedef struct
 	BufQueue    generalQ;
 } NetPath;
 
+// Telemetry configuration and counters
+typedef struct
+{
+	uint32_t  collector;
+	uint16_t  port;
+	uint32_t  decimation;
+	uint32_t  samples;
+	uint32_t  batches;
+	uint32_t  dropped;
+} TelemetryStats;
+
 // Define compiler specific symbols
 #if defined   ( __CC_ARM   )
 typedef long ssize_t;
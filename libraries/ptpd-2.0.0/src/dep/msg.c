@@ -288,3 +288,50 @@ void msgUnpackPDelayRespFollowUp(const octet_t *buf, MsgPDelayRespFollowUp *pres
 	memcpy(prespfollow->requestingPortIdentity.clockIdentity, (buf + 44), CLOCK_IDENTITY_LENGTH);
 	prespfollow->requestingPortIdentity.portNumber = flip16(*(int16_t*)(buf + 52));
 }
+
+/* Unpack Management message */
+void msgUnpackManagement(const octet_t *buf, MsgManagement *manage)
+{
+	memcpy(manage->targetPortIdentity.clockIdentity, (buf + 34), CLOCK_IDENTITY_LENGTH);
+	manage->targetPortIdentity.portNumber = flip16(*(int16_t*)(buf + 42));
+	manage->startingBoundaryHops = *(uint8_t*)(buf + 44);
+	manage->boundaryHops = *(uint8_t*)(buf + 45);
+	manage->actionField = (*(enum4bit_t*)(buf + 46)) & 0x0F;
+}
+
+/* Unpack the management TLV that follows the message, the data field is
+ * left in the buffer */
+void msgUnpackManagementPayload(const octet_t *buf, MsgManagement *manage)
+{
+	manage->tlvType = flip16(*(enum16bit_t*)(buf + 48));
+	manage->lengthField = flip16(*(int16_t*)(buf + 50));
+	manage->managementId = flip16(*(enum16bit_t*)(buf + 52));
+	manage->data = buf + MANAGEMENT_LENGTH + MANAGEMENT_TLV_LENGTH;
+	manage->dataLength = manage->lengthField - 2;
+}
+
+/* Pack the header and management fields of the response to a management
+ * message, the TLV of tlvLength bytes is already in the buffer */
+int16_t msgPackManagementResponse(const PtpClock *ptpClock, octet_t *buf, const MsgHeader *header, const MsgManagement *manage, int16_t tlvLength)
+{
+	int16_t length = MANAGEMENT_LENGTH + tlvLength;
+
+	/* Changes in header */
+	*(char*)(buf + 0) = *(char*)(buf + 0) & 0xF0; //RAZ messageType
+	*(char*)(buf + 0) = *(char*)(buf + 0) | MANAGEMENT; //Table 19
+	*(int16_t*)(buf + 2)  = flip16(length);
+	memset((buf + 8), 0, 8); /* correction field */
+	*(int16_t*)(buf + 30) = flip16(header->sequenceId);
+	*(uint8_t*)(buf + 32) = CTRL_MANAGEMENT; //Table 23
+	*(int8_t*)(buf + 33) = 0x7F; //Table 24
+
+	/* Management message, addressed to the requesting port (15.3.3) */
+	memcpy((buf + 34), header->sourcePortIdentity.clockIdentity, CLOCK_IDENTITY_LENGTH);
+	*(int16_t*)(buf + 42) = flip16(header->sourcePortIdentity.portNumber);
+	*(uint8_t*)(buf + 44) = manage->startingBoundaryHops - manage->boundaryHops;
+	*(uint8_t*)(buf + 45) = manage->startingBoundaryHops - manage->boundaryHops;
+	*(enum4bit_t*)(buf + 46) = (manage->actionField == ACTION_COMMAND) ? ACTION_ACKNOWLEDGE : ACTION_RESPONSE;
+	*(uint8_t*)(buf + 47) = 0;
+
+	return length;
+}
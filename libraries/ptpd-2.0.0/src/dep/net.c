@@ -2,11 +2,16 @@
 
 #include "../ptpd.h"
 
+/* IEEE 802.3 multicast destination addresses. */
+static const struct eth_addr ptpEtherAddr = {DEFAULT_PTP_ETHER_ADDRESS};
+static const struct eth_addr peerEtherAddr = {PEER_PTP_ETHER_ADDRESS};
+
 /* Initialize network queue. */
-static void netQInit(BufQueue *queue)
+static void netQInit(BufQueue *queue, uint16_t id)
 {
 	queue->head = 0;
 	queue->tail = 0;
+	queue->id = id;
 	sys_mutex_new(&queue->mutex);
 }
 
@@ -26,6 +31,8 @@ static bool netQPut(BufQueue *queue, void *pbuf)
 		retval = TRUE;
 	}
 
+	trace_event(TRACE_NETQ_PUT, queue->id, retval, (queue->head - queue->tail) & PBUF_QUEUE_MASK, 0, 0);
+
 	sys_mutex_unlock(&queue->mutex);
 
 	return retval;
@@ -44,6 +51,7 @@ static void *netQGet(BufQueue *queue)
 		// Get the buffer from the queue.
 		queue->tail = (queue->tail + 1) & PBUF_QUEUE_MASK;
 		pbuf = queue->pbuf[queue->tail];
+		trace_event(TRACE_NETQ_GET, queue->id, (queue->head - queue->tail) & PBUF_QUEUE_MASK, 0, 0, 0);
 	}
 
 	sys_mutex_unlock(&queue->mutex);
@@ -88,6 +96,26 @@ bool netShutdown(NetPath *netPath)
 
 	DBG("netShutdown\n");
 
+	/* Shut down the IEEE 802.3 transport. */
+	if (netPath->transport == IEE_802_3)
+	{
+		/* Stop receiving PTP ethernet frames. */
+		ethernetif_set_raw_input(PTP_ETHER_TYPE, NULL, NULL);
+		ethernetif_remove_mac_filter(&ptpEtherAddr);
+		ethernetif_remove_mac_filter(&peerEtherAddr);
+		netPath->transport = 0;
+
+		/* Free the frames still queued, netInit starts the queues afresh. */
+		netQEmpty(&netPath->eventQ);
+		netQEmpty(&netPath->generalQ);
+
+		/* Return a success code. */
+		return TRUE;
+	}
+
+	/* The raw API is called from the ptpd thread, not the tcpip thread. */
+	LOCK_TCPIP_CORE();
+
 	/* leave multicast group */
 	multicastAaddr.addr = netPath->multicastAddr;
 	igmp_leavegroup(IP_ADDR_ANY, &multicastAaddr);
@@ -108,6 +136,12 @@ bool netShutdown(NetPath *netPath)
 		netPath->generalPcb = NULL;
 	}
 
+	UNLOCK_TCPIP_CORE();
+
+	/* Free the datagrams still queued, netInit starts the queues afresh. */
+	netQEmpty(&netPath->eventQ);
+	netQEmpty(&netPath->generalQ);
+
 	/* Clear the network addresses. */
 	netPath->multicastAddr = 0;
 	netPath->unicastAddr = 0;
@@ -134,6 +168,8 @@ static void netRecvEventCallback(void *arg, struct udp_pcb *pcb, struct pbuf *p,
 {
 	NetPath *netPath = (NetPath *) arg;
 
+	latency_stamp(p->stamps, LATENCY_CALLBACK);
+
 	/* Place the incoming message on the Event Port QUEUE. */
 	if (!netQPut(&netPath->eventQ, p))
 	{
@@ -152,6 +188,8 @@ static void netRecvGeneralCallback(void *arg, struct udp_pcb *pcb, struct pbuf *
 {
 	NetPath *netPath = (NetPath *) arg;
 
+	latency_stamp(p->stamps, LATENCY_CALLBACK);
+
 	/* Place the incoming message on the Event Port QUEUE. */
 	if (!netQPut(&netPath->generalQ, p))
 	{
@@ -164,6 +202,61 @@ static void netRecvGeneralCallback(void *arg, struct udp_pcb *pcb, struct pbuf *
 	ptpd_alert();
 }
 
+/* Process an incoming PTP ethernet frame.  Called from the ethernet
+	 interface thread with the ethernet header already removed. */
+static void netRecvEtherCallback(void *arg, struct pbuf *p)
+{
+	NetPath *netPath = (NetPath *) arg;
+	BufQueue *queue;
+	u16_t length;
+
+	/* Verify the frame holds at least the message type and length. */
+	if (p->len < 4)
+	{
+		pbuf_free(p);
+		return;
+	}
+
+	/* Strip any padding added to reach the minimum ethernet frame size. */
+	length = (((u8_t *) p->payload)[2] << 8) | ((u8_t *) p->payload)[3];
+	if (length < p->tot_len) pbuf_realloc(p, length);
+
+	latency_stamp(p->stamps, LATENCY_CALLBACK);
+
+	/* Event messages have message type values below 8, others are general. */
+	queue = ((((u8_t *) p->payload)[0] & 0x0F) < 0x08) ? &netPath->eventQ : &netPath->generalQ;
+
+	/* Place the incoming message on the appropriate queue. */
+	if (!netQPut(queue, p))
+	{
+		pbuf_free(p);
+		ERROR("netRecvEtherCallback: queue full\n");
+		return;
+	}
+
+	/* Alert the PTP thread there is now something to do. */
+	ptpd_alert();
+}
+
+/* Start the IEEE 802.3 transport. */
+static bool netInitEther(NetPath *netPath)
+{
+	/* Accept the PTP multicast addresses in the MAC filter. */
+	if ((ethernetif_add_mac_filter(&ptpEtherAddr) != ERR_OK) ||
+			(ethernetif_add_mac_filter(&peerEtherAddr) != ERR_OK))
+	{
+		ERROR("netInitEther: Failed to add MAC filters\n");
+		ethernetif_remove_mac_filter(&ptpEtherAddr);
+		return FALSE;
+	}
+
+	/* Receive the PTP ethertype directly from the ethernet interface. */
+	ethernetif_set_raw_input(PTP_ETHER_TYPE, netRecvEtherCallback, netPath);
+
+	/* Return a success code. */
+	return TRUE;
+}
+
 /* Start  all of the UDP stuff */
 bool netInit(NetPath *netPath, PtpClock *ptpClock)
 {
@@ -174,17 +267,30 @@ bool netInit(NetPath *netPath, PtpClock *ptpClock)
 	DBG("netInit\n");
 
 	/* Initialize the buffer queues. */
-	netQInit(&netPath->eventQ);
-	netQInit(&netPath->generalQ);
+	netQInit(&netPath->eventQ, TRACE_QUEUE_EVENT);
+	netQInit(&netPath->generalQ, TRACE_QUEUE_GENERAL);
 
 	/* Find a network interface */
 	interfaceAddr.addr = findIface(ptpClock->rtOpts->ifaceName, ptpClock->portUuidField, netPath);
+
+	/* The IEEE 802.3 transport does not need an IP address. */
+	if (ptpClock->rtOpts->transport == IEE_802_3)
+	{
+		if (!netInitEther(netPath)) goto fail01;
+		netPath->transport = IEE_802_3;
+		return TRUE;
+	}
+
+	netPath->transport = UDP_IPV4;
 	if (!(interfaceAddr.addr))
 	{
 			ERROR("netInit: Failed to find interface address\n");
 			goto fail01;
 	}
 
+	/* The raw API is called from the ptpd thread, not the tcpip thread. */
+	LOCK_TCPIP_CORE();
+
 	/* Open lwIP raw udp interfaces for the event port. */
 	netPath->eventPcb = udp_new();
 	if (NULL == netPath->eventPcb)
@@ -242,6 +348,8 @@ bool netInit(NetPath *netPath, PtpClock *ptpClock)
 	udp_bind(netPath->generalPcb, IP_ADDR_ANY, PTP_GENERAL_PORT);
 	/*  udp_connect(netPath->generalPcb, &netAddr, PTP_GENERAL_PORT); */
 
+	UNLOCK_TCPIP_CORE();
+
 	/* Return a success code. */
 	return TRUE;
 
@@ -250,6 +358,7 @@ fail04:
 fail03:
 	udp_remove(netPath->eventPcb);
 fail02:
+	UNLOCK_TCPIP_CORE();
 fail01:
 	return FALSE;
 }
@@ -301,6 +410,8 @@ static ssize_t netRecv(octet_t *buf, TimeInternal *time, BufQueue *msgQueue)
 		return 0;
 	}
 
+	latency_recv(p->stamps);
+
 	if (time != NULL)
 	{
 #if LWIP_PTP
@@ -352,8 +463,9 @@ static ssize_t netSend(const octet_t *buf, int16_t  length, TimeInternal *time,
 	err_t result;
 	struct pbuf * p;
 
-	/* Allocate the tx pbuf based on the current size. */
-	p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
+	/* Allocate the tx pbuf based on the current size, a small one if it fits. */
+	p = pbuf_small_alloc(PBUF_SMALL_TX, PBUF_TRANSPORT, length);
+	if (NULL == p) p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
 	if (NULL == p)
 	{
 		ERROR("netSend: Failed to allocate Tx Buffer\n");
@@ -368,8 +480,10 @@ static ssize_t netSend(const octet_t *buf, int16_t  length, TimeInternal *time,
 		goto fail02;
 	}
 
-	/* send the buffer. */
+	/* send the buffer, in this thread under the lwIP core lock. */
+	LOCK_TCPIP_CORE();
 	result = udp_sendto(pcb, p, (void *)addr, pcb->local_port);
+	UNLOCK_TCPIP_CORE();
 	if (ERR_OK != result)
 	{
 		ERROR("netSend: Failed to send data (%d)\n", result);
@@ -404,22 +518,84 @@ fail01:
 	/*  return (0 == result) ? length : 0; */
 }
 
+static ssize_t netSendEther(const octet_t *buf, int16_t  length, TimeInternal *time, const struct eth_addr *dst)
+{
+	err_t result;
+	struct pbuf * p;
+
+	/* Allocate the tx pbuf with room for the ethernet header, a small one if it fits. */
+	p = pbuf_small_alloc(PBUF_SMALL_TX, PBUF_LINK, length);
+	if (NULL == p) p = pbuf_alloc(PBUF_LINK, length, PBUF_RAM);
+	if (NULL == p)
+	{
+		ERROR("netSendEther: Failed to allocate Tx Buffer\n");
+		goto fail01;
+	}
+
+	/* Copy the incoming data into the pbuf payload. */
+	result = pbuf_take(p, buf, length);
+	if (ERR_OK != result)
+	{
+		ERROR("netSendEther: Failed to copy data to Pbuf (%d)\n", result);
+		goto fail02;
+	}
+
+	/* send the frame. */
+	result = ethernetif_raw_output(netif_default, dst, PTP_ETHER_TYPE, p);
+	if (ERR_OK != result)
+	{
+		ERROR("netSendEther: Failed to send data (%d)\n", result);
+		goto fail02;
+	}
+
+	if (time != NULL)
+	{
+#if LWIP_PTP
+		time->seconds = p->time_sec;
+		time->nanoseconds = p->time_nsec;
+#else
+		getTime(time);
+#endif
+		DBGV("netSendEther: %d sec %d nsec\n", time->seconds, time->nanoseconds);
+	} else {
+		DBGV("netSendEther\n");
+	}
+
+fail02:
+	pbuf_free(p);
+
+fail01:
+	return length;
+}
+
 ssize_t netSendEvent(NetPath *netPath, const octet_t *buf, int16_t  length, TimeInternal *time)
 {
+	if (netPath->transport == IEE_802_3)
+		return netSendEther(buf, length, time, &ptpEtherAddr);
+
 	return netSend(buf, length, time, &netPath->multicastAddr, netPath->eventPcb);
 }
 
 ssize_t netSendGeneral(NetPath *netPath, const octet_t *buf, int16_t  length)
 {
+	if (netPath->transport == IEE_802_3)
+		return netSendEther(buf, length, NULL, &ptpEtherAddr);
+
 	return netSend(buf, length, NULL, &netPath->multicastAddr, netPath->generalPcb);
 }
 
 ssize_t netSendPeerGeneral(NetPath *netPath, const octet_t *buf, int16_t  length)
 {
+	if (netPath->transport == IEE_802_3)
+		return netSendEther(buf, length, NULL, &peerEtherAddr);
+
 	return netSend(buf, length, NULL, &netPath->peerMulticastAddr, netPath->generalPcb);
 }
 
 ssize_t netSendPeerEvent(NetPath *netPath, const octet_t *buf, int16_t  length, TimeInternal* time)
 {
+	if (netPath->transport == IEE_802_3)
+		return netSendEther(buf, length, time, &peerEtherAddr);
+
 	return netSend(buf, length, time, &netPath->peerMulticastAddr, netPath->eventPcb);
 }
@@ -1,13 +1,15 @@
 #ifndef PTPD_DEP_H_
 #define PTPD_DEP_H_
 
-/** \name Debug messages */
+/** \name Debug messages
+ * Messages go to the non-blocking log output and are only formatted when
+ * their log level is enabled. */
 /**\{*/
 #ifdef PTPD_DBGVV
 #define PTPD_DBGV
 #define PTPD_DBG
 #define PTPD_ERR
-#define DBGVV(...) printf("(V) " __VA_ARGS__)
+#define DBGVV(...) log_printf(LOG_VERBOSE, "(V) " __VA_ARGS__)
 #else
 #define DBGVV(...)
 #endif
@@ -15,14 +17,14 @@
 #ifdef PTPD_DBGV
 #define PTPD_DBG
 #define PTPD_ERR
-#define DBGV(...)  { TimeInternal tmpTime; getTime(&tmpTime); printf("(d %d.%09d) ", tmpTime.seconds, tmpTime.nanoseconds); printf(__VA_ARGS__); }
+#define DBGV(...)  logMessage(LOG_VERBOSE, 'd', __VA_ARGS__)
 #else
 #define DBGV(...)
 #endif
 
 #ifdef PTPD_DBG
 #define PTPD_ERR
-#define DBG(...)  { TimeInternal tmpTime; getTime(&tmpTime); printf("(D %d.%09d) ", tmpTime.seconds, tmpTime.nanoseconds); printf(__VA_ARGS__); }
+#define DBG(...)  logMessage(LOG_DEBUG, 'D', __VA_ARGS__)
 #else
 #define DBG(...)
 #endif
@@ -31,8 +33,7 @@
 /** \name System messages */
 /**\{*/
 #ifdef PTPD_ERR
-#define ERROR(...)  { TimeInternal tmpTime; getTime(&tmpTime); printf("(E %d.%09d) ", tmpTime.seconds, tmpTime.nanoseconds); printf(__VA_ARGS__); }
-/* #define ERROR(...)  { printf("(E) "); printf(__VA_ARGS__); } */
+#define ERROR(...)  logMessage(LOG_ERROR, 'E', __VA_ARGS__)
 #else
 #define ERROR(...)
 #endif
@@ -110,7 +111,7 @@ void msgPackPDelayReq(const PtpClock*, octet_t*, const Timestamp*);
 void msgPackPDelayResp(octet_t*, const MsgHeader*, const Timestamp*);
 void msgPackPDelayRespFollowUp(octet_t*, const MsgHeader*, const Timestamp*);
 int16_t msgPackManagement(const PtpClock*,  octet_t*, const MsgManagement*);
-int16_t msgPackManagementResponse(const PtpClock*,  octet_t*, MsgHeader*, const MsgManagement*);
+int16_t msgPackManagementResponse(const PtpClock*,  octet_t*, const MsgHeader*, const MsgManagement*, int16_t);
 /** \}*/
 
 /** \name net.c (Linux API dependent)
@@ -145,12 +146,15 @@ void updateClock(PtpClock*);
 /**\{*/
 int16_t ptpdStartup(PtpClock*, RunTimeOpts*, ForeignMasterRecord*);
 void ptpdShutdown(PtpClock *);
+/* Store the run-time options a management message changed, see ptpd.c */
+void saveRunTimeOpts(const RunTimeOpts *old, const RunTimeOpts *opts);
 /** \}*/
 
 /** \name sys.c (Linux API dependent)
  * -Manage timing system API */
 /**\{*/
 void displayStats(const PtpClock *ptpClock);
+void logMessage(int level, char tag, const char *fmt, ...);
 bool  nanoSleep(const TimeInternal*);
 void getTime(TimeInternal*);
 void setTime(const TimeInternal*);
@@ -159,6 +163,25 @@ bool  adjFreq(int32_t);
 uint32_t getRand(uint32_t);
 /** \}*/
 
+/** \name telemetry.c
+ * -Stream servo samples to a collector */
+/**\{*/
+void telemetryInit(void);
+void telemetryConfig(uint32_t, uint16_t, uint32_t);
+void telemetryStats(TelemetryStats*);
+void telemetryOffset(const PtpClock*, const TimeInternal*, const TimeInternal*);
+void telemetryClock(const PtpClock*, int32_t);
+/** \}*/
+
+/** \name snapshot.c
+ * -Publish the clock state to readers in other threads */
+/**\{*/
+void snapshotUpdate(const PtpClock*, int32_t);
+void snapshotState(const PtpClock*);
+void snapshotRead(PtpSnapshot*);
+void snapshotNotify(void*, int32_t);
+/** \}*/
+
 /** \name timer.c (Linux API dependent)
  * -Handle with timers */
 /**\{*/
@@ -156,6 +156,8 @@ void updateOffset(PtpClock *ptpClock, const TimeInternal *syncEventIngressTimest
 				break;
 	}
 
+	telemetryOffset(ptpClock, preciseOriginTimestamp, syncEventIngressTimestamp);
+
 	if (ptpClock->currentDS.offsetFromMaster.seconds != 0)
 	{
 		if (ptpClock->portDS.portState == PTP_SLAVE)
@@ -164,12 +166,16 @@ void updateOffset(PtpClock *ptpClock, const TimeInternal *syncEventIngressTimest
 		}
 
 		DBGV("updateOffset: cannot filter seconds\n");
+		trace_event(TRACE_OFFSET, FALSE, ptpClock->Tms.seconds, ptpClock->Tms.nanoseconds,
+								ptpClock->currentDS.offsetFromMaster.seconds, ptpClock->currentDS.offsetFromMaster.nanoseconds);
 
 		return;
 	}
 
 	/* Filter offsetFromMaster */
 	filter(&ptpClock->currentDS.offsetFromMaster.nanoseconds, &ptpClock->ofm_filt);
+	trace_event(TRACE_OFFSET, TRUE, ptpClock->Tms.seconds, ptpClock->Tms.nanoseconds,
+							ptpClock->currentDS.offsetFromMaster.seconds, ptpClock->currentDS.offsetFromMaster.nanoseconds);
 
 	/* Check results */
 	if (abs(ptpClock->currentDS.offsetFromMaster.nanoseconds) < DEFAULT_CALIBRATED_OFFSET_NS)
@@ -213,6 +219,9 @@ void updateDelay(PtpClock * ptpClock, const TimeInternal *delayEventEgressTimest
 	{
 		filter(&ptpClock->currentDS.meanPathDelay.nanoseconds, &ptpClock->owd_filt);
 	}
+
+	trace_event(TRACE_DELAY, 0, ptpClock->Tsm.seconds, ptpClock->Tsm.nanoseconds,
+							ptpClock->currentDS.meanPathDelay.seconds, ptpClock->currentDS.meanPathDelay.nanoseconds);
 }
 
 void updatePeerDelay(PtpClock *ptpClock, const TimeInternal *correctionField, bool  twoStep)
@@ -238,21 +247,24 @@ void updatePeerDelay(PtpClock *ptpClock, const TimeInternal *correctionField, bo
 	if (ptpClock->portDS.peerMeanPathDelay.seconds != 0)
 	{
 		DBGV("updatePeerDelay: cannot filter with seconds");
-		return;
 	}
 	else
 	{
 		filter(&ptpClock->portDS.peerMeanPathDelay.nanoseconds, &ptpClock->owd_filt);
 	}
+
+	trace_event(TRACE_PEER_DELAY, 0, ptpClock->portDS.peerMeanPathDelay.seconds,
+							ptpClock->portDS.peerMeanPathDelay.nanoseconds, 0, 0);
 }
 
 void updateClock(PtpClock *ptpClock)
 {
-	int32_t adj;
+	int32_t adj = 0;
 	TimeInternal timeTmp;
 	int32_t offsetNorm;
 
 	DBGV("updateClock\n");
+	latency_mark(LATENCY_CLOCK);
 
 	if (ptpClock->currentDS.offsetFromMaster.seconds != 0 || abs(ptpClock->currentDS.offsetFromMaster.nanoseconds) > MAX_ADJ_OFFSET_NS)
 	{
@@ -319,6 +331,11 @@ void updateClock(PtpClock *ptpClock)
 		}
 	}
 
+	trace_event(TRACE_CLOCK, 0, ptpClock->currentDS.offsetFromMaster.seconds,
+							ptpClock->currentDS.offsetFromMaster.nanoseconds, ptpClock->observedDrift, 0);
+	telemetryClock(ptpClock, -adj);
+	snapshotUpdate(ptpClock, -adj);
+
 	switch (ptpClock->portDS.delayMechanism)
 	{
 		case E2E:
@@ -0,0 +1,83 @@
+/* snapshot.c */
+
+#include "../ptpd.h"
+
+/* The PTP thread is the only writer and never waits for a reader.  It makes
+ * the sequence odd while it copies the clock state in and even again once
+ * done.  Readers copy the state out and retry if the sequence was odd or
+ * changed meanwhile, so they never see seconds and nanoseconds of different
+ * updates. */
+static volatile uint32_t sequence;
+static PtpSnapshot snapshot;
+
+/* Thread signalled after each update. */
+static osThreadId volatile notifyThread;
+static volatile int32_t notifySignals;
+
+/* Copy the clock state in, counting a clock update or not. */
+static void publish(const PtpClock *ptpClock, bool update, int32_t adj)
+{
+	sequence++;
+	__DMB();
+
+	snapshot.version++;
+	if (update) snapshot.updates++;
+	snapshot.portState = ptpClock->portDS.portState;
+	snapshot.delayMechanism = ptpClock->portDS.delayMechanism;
+	snapshot.offsetFromMaster = ptpClock->currentDS.offsetFromMaster;
+	snapshot.meanPathDelay = (ptpClock->portDS.delayMechanism == P2P) ?
+			ptpClock->portDS.peerMeanPathDelay : ptpClock->currentDS.meanPathDelay;
+	memcpy(snapshot.parentClockIdentity, ptpClock->parentDS.parentPortIdentity.clockIdentity, CLOCK_IDENTITY_LENGTH);
+	snapshot.observedDrift = ptpClock->observedDrift;
+	snapshot.adj = adj;
+
+	__DMB();
+	sequence++;
+}
+
+/* Called by the PTP thread after each clock update. */
+void snapshotUpdate(const PtpClock *ptpClock, int32_t adj)
+{
+	osThreadId thread;
+
+	publish(ptpClock, TRUE, adj);
+
+	/* Setting a signal does not block. */
+	thread = notifyThread;
+	if (thread != NULL) osSignalSet(thread, notifySignals);
+}
+
+/* Called by the PTP thread after each change of the port state. */
+void snapshotState(const PtpClock *ptpClock)
+{
+	publish(ptpClock, FALSE, snapshot.adj);
+}
+
+/* Copy the last published clock state.  Not for interrupts. */
+void snapshotRead(PtpSnapshot *copy)
+{
+	uint32_t start;
+
+	for (;;)
+	{
+		start = sequence;
+		if (start & 1)
+		{
+			/* Let a writer of lower priority finish. */
+			osDelay(1);
+			continue;
+		}
+		__DMB();
+		memcpy(copy, &snapshot, sizeof(*copy));
+		__DMB();
+		if (sequence == start) break;
+	}
+}
+
+/* Have the osThreadId thread signalled after each update, NULL for none. */
+void snapshotNotify(void *thread, int32_t signals)
+{
+	notifyThread = NULL;
+	notifySignals = signals;
+	notifyThread = (osThreadId) thread;
+}
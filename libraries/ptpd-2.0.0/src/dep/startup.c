@@ -19,6 +19,8 @@ int16_t ptpdStartup(PtpClock * ptpClock, RunTimeOpts *rtOpts, ForeignMasterRecor
 	if (rtOpts->servo.ap < 1) rtOpts->servo.ap = 1;
 	if (rtOpts->servo.ai < 1) rtOpts->servo.ai = 1;
 
+	telemetryInit();
+
 	DBG("event POWER UP\n");
 
 	toState(ptpClock, PTP_INITIALIZING);
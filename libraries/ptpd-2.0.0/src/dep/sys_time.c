@@ -1,5 +1,6 @@
 /* sys.c */
 
+#include <stdarg.h>
 #include "../ptpd.h"
 
 void displayStats(const PtpClock *ptpClock)
@@ -11,7 +12,7 @@ void displayStats(const PtpClock *ptpClock)
 	uuid = (unsigned char*) ptpClock->parentDS.parentPortIdentity.clockIdentity;
 
 	/* Master clock UUID */
-	printf("%02X%02X:%02X%02X:%02X%02X:%02X%02X\n",
+	log_printf(LOG_INFO, "%02X%02X:%02X%02X:%02X%02X:%02X%02X\n",
 					uuid[0], uuid[1],
 					uuid[2], uuid[3],
 					uuid[4], uuid[5],
@@ -32,19 +33,19 @@ void displayStats(const PtpClock *ptpClock)
 	}
 
 	/* State of the PTP */
-	printf("state: %s\n", s);
+	log_printf(LOG_INFO, "state: %s\n", s);
 
 	/* One way delay */
 	switch (ptpClock->portDS.delayMechanism)
 	{
 		case E2E:
-			printf("path delay: %d nsec\n", ptpClock->currentDS.meanPathDelay.nanoseconds);
+			log_printf(LOG_INFO, "path delay: %d nsec\n", ptpClock->currentDS.meanPathDelay.nanoseconds);
 			break;
 		case P2P:
-			printf("path delay: %d nsec\n", ptpClock->portDS.peerMeanPathDelay.nanoseconds);
+			log_printf(LOG_INFO, "path delay: %d nsec\n", ptpClock->portDS.peerMeanPathDelay.nanoseconds);
 			break;
 		default:
-			printf("path delay: unknown\n");
+			log_printf(LOG_INFO, "path delay: unknown\n");
 			/* none */
 			break;
 	}
@@ -52,11 +53,11 @@ void displayStats(const PtpClock *ptpClock)
 	/* Offset from master */
 	if (ptpClock->currentDS.offsetFromMaster.seconds)
 	{
-		printf("offset: %d sec\n", ptpClock->currentDS.offsetFromMaster.seconds);
+		log_printf(LOG_INFO, "offset: %d sec\n", ptpClock->currentDS.offsetFromMaster.seconds);
 	}
 	else
 	{
-		printf("offset: %d nsec\n", ptpClock->currentDS.offsetFromMaster.nanoseconds);
+		log_printf(LOG_INFO, "offset: %d nsec\n", ptpClock->currentDS.offsetFromMaster.nanoseconds);
 	}
 
 	/* Observed drift from master */
@@ -64,7 +65,32 @@ void displayStats(const PtpClock *ptpClock)
 	if (ptpClock->observedDrift > 0) sign = '+';
 	if (ptpClock->observedDrift < 0) sign = '-';
 
-	printf("drift: %c%d.%03d ppm\n", sign, abs(ptpClock->observedDrift / 1000), abs(ptpClock->observedDrift % 1000));
+	log_printf(LOG_INFO, "drift: %c%d.%03d ppm\n", sign, abs(ptpClock->observedDrift / 1000), abs(ptpClock->observedDrift % 1000));
+}
+
+/* Log a message with a timestamp. Nothing is formatted if the level is
+   not enabled. */
+void logMessage(int level, char tag, const char *fmt, ...)
+{
+	int len;
+	int n;
+	va_list ap;
+	TimeInternal tmpTime;
+	char buf[LOG_LINE_SIZE];
+
+	if (!log_enabled(level)) return;
+
+	getTime(&tmpTime);
+	len = snprintf(buf, sizeof(buf), "(%c %d.%09d) ", tag, tmpTime.seconds, tmpTime.nanoseconds);
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+	va_end(ap);
+
+	if (n < 0) return;
+	len += n;
+	if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+	log_write(buf, len);
 }
 
 void getTime(TimeInternal *time)
@@ -106,6 +132,8 @@ uint32_t getRand(uint32_t randMax)
 
 bool  adjFreq(int32_t adj)
 {
+	int32_t requested = adj;
+
 	DBGV("adjFreq %d\n", adj);
 
 	if (adj > ADJ_FREQ_MAX)
@@ -113,6 +141,8 @@ bool  adjFreq(int32_t adj)
 	else if (adj < -ADJ_FREQ_MAX)
 		adj = -ADJ_FREQ_MAX;
 
+	trace_event(TRACE_ADJ_FREQ, 0, requested, adj, 0, 0);
+
 	/* Fine update method */
 	ETH_PTPTime_AdjFreq(adj);
 
@@ -0,0 +1,223 @@
+/* telemetry.c */
+
+#include "../ptpd.h"
+#include "lwip/tcpip.h"
+
+/* Each datagram holds a batch of servo samples, all fields are in network
+ * byte order.  The header is the magic "PTEL", the version (16 bits), the
+ * number of samples (16 bits), the batch number and the number of samples
+ * dropped so far.  Each sample is the sample index followed by 32-bit signed
+ * values: t1, t2, t3 and t4 as seconds and nanoseconds, the raw and the
+ * filtered offsetFromMaster and the meanPathDelay as seconds and nanoseconds,
+ * the observedDrift and the adjFreq value.  tools/telemetry_recv.c is the
+ * matching receiver. */
+
+#define TELEMETRY_MAGIC          "PTEL"
+#define TELEMETRY_VERSION        1
+#define TELEMETRY_HEADER_LENGTH  16
+#define TELEMETRY_SAMPLE_LENGTH  68
+#define TELEMETRY_BATCH_LENGTH   (TELEMETRY_HEADER_LENGTH + TELEMETRY_BATCH_SIZE * TELEMETRY_SAMPLE_LENGTH)
+
+/* The PTP thread fills the batch pbuf while the tcpip thread is idle.  A
+ * full batch is passed to the tcpip thread with a static callback message,
+ * which sends it and allocates the pbuf for the next batch.  Samples taken
+ * while the tcpip thread owns the batch, or when there is no pbuf, are
+ * dropped. */
+static struct
+{
+	struct udp_pcb *pcb;
+	struct tcpip_callback_msg *msg;
+	struct pbuf *fill;              /* batch being filled by the PTP thread */
+	struct pbuf *full;              /* batch being sent by the tcpip thread */
+	volatile bool busy;             /* the tcpip thread owns the batches */
+	volatile uint32_t collector;
+	volatile uint16_t port;
+	volatile uint32_t decimation;
+	uint32_t count;                 /* updates since the last sample */
+	uint32_t index;                 /* samples taken */
+	uint32_t batch;                 /* batches handed to the tcpip thread */
+	uint16_t samples;               /* samples in the batch being filled */
+	volatile uint32_t sent;
+	volatile uint32_t dropped;
+	TimeInternal t1;
+	TimeInternal t2;
+	TimeInternal rawOffset;
+} telemetry;
+
+/* Store a 32-bit value in network byte order at any alignment. */
+static octet_t *put32(octet_t *buf, uint32_t value)
+{
+	buf[0] = (octet_t) (value >> 24);
+	buf[1] = (octet_t) (value >> 16);
+	buf[2] = (octet_t) (value >> 8);
+	buf[3] = (octet_t) value;
+	return buf + 4;
+}
+
+static octet_t *putTime(octet_t *buf, const TimeInternal *time)
+{
+	buf = put32(buf, time->seconds);
+	return put32(buf, time->nanoseconds);
+}
+
+/* Count dropped samples.  Both the PTP and the tcpip thread drop samples,
+ * so the counter is updated with an exclusive load/store pair. */
+static void telemetryDrop(uint32_t n)
+{
+	uint32_t dropped;
+
+	do
+	{
+		dropped = __LDREXW(&telemetry.dropped);
+	} while (__STREXW(dropped + n, &telemetry.dropped) != 0);
+}
+
+/* Runs in the tcpip thread.  Sends the full batch, if any, and allocates
+ * the pbuf for the next one. */
+static void telemetrySend(void *ctx)
+{
+	ip_addr_t addr;
+
+	if (telemetry.pcb == NULL) telemetry.pcb = udp_new();
+
+	if (telemetry.full != NULL)
+	{
+		addr.addr = telemetry.collector;
+		if ((telemetry.pcb != NULL) && (addr.addr != 0) &&
+				(udp_sendto(telemetry.pcb, telemetry.full, &addr, telemetry.port) == ERR_OK))
+		{
+			telemetry.sent++;
+		}
+		else
+		{
+			telemetryDrop(TELEMETRY_BATCH_SIZE);
+		}
+		pbuf_free(telemetry.full);
+		telemetry.full = NULL;
+	}
+
+	if (telemetry.fill == NULL)
+	{
+		telemetry.fill = pbuf_alloc(PBUF_TRANSPORT, TELEMETRY_BATCH_LENGTH, PBUF_RAM);
+	}
+
+	telemetry.busy = FALSE;
+}
+
+/* Hand the batches to the tcpip thread without blocking. */
+static bool telemetryPost(void)
+{
+	if (telemetry.msg == NULL) return FALSE;
+
+	telemetry.busy = TRUE;
+	if (tcpip_trycallback(telemetry.msg) != ERR_OK)
+	{
+		telemetry.busy = FALSE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void telemetryInit(void)
+{
+	telemetry.port = TELEMETRY_PORT;
+	telemetry.decimation = 1;
+
+	/* The callback message is reused for every batch. */
+	telemetry.msg = tcpip_callbackmsg_new(telemetrySend, NULL);
+	if (telemetry.msg == NULL)
+	{
+		ERROR("telemetryInit: failed to allocate callback message\n");
+		return;
+	}
+
+	/* Have the first batch allocated. */
+	telemetryPost();
+}
+
+/* Set the collector address (network byte order, zero to disable), the
+ * UDP port and the number of clock updates per sample. */
+void telemetryConfig(uint32_t collector, uint16_t port, uint32_t decimation)
+{
+	telemetry.port = port;
+	telemetry.decimation = (decimation > 0) ? decimation : 1;
+	telemetry.collector = collector;
+}
+
+void telemetryStats(TelemetryStats *stats)
+{
+	stats->collector = telemetry.collector;
+	stats->port = telemetry.port;
+	stats->decimation = telemetry.decimation;
+	stats->samples = telemetry.index;
+	stats->batches = telemetry.sent;
+	stats->dropped = telemetry.dropped;
+}
+
+/* Keep the timestamps and the unfiltered offset of the current Sync. */
+void telemetryOffset(const PtpClock *ptpClock, const TimeInternal *t1, const TimeInternal *t2)
+{
+	telemetry.t1 = *t1;
+	telemetry.t2 = *t2;
+	telemetry.rawOffset = ptpClock->currentDS.offsetFromMaster;
+}
+
+/* Add a sample for a clock update with the given frequency adjustment. */
+void telemetryClock(const PtpClock *ptpClock, int32_t adj)
+{
+	octet_t *buf;
+	const TimeInternal *delay;
+
+	if (telemetry.collector == 0) return;
+	if (++telemetry.count < telemetry.decimation) return;
+	telemetry.count = 0;
+	telemetry.index++;
+
+	/* The tcpip thread owns the batches, or the last allocation failed. */
+	if (telemetry.busy || (telemetry.fill == NULL))
+	{
+		telemetryDrop(1);
+		if (!telemetry.busy) telemetryPost();
+		return;
+	}
+
+	delay = (ptpClock->portDS.delayMechanism == P2P) ?
+			&ptpClock->portDS.peerMeanPathDelay : &ptpClock->currentDS.meanPathDelay;
+
+	buf = (octet_t *) telemetry.fill->payload + TELEMETRY_HEADER_LENGTH +
+			telemetry.samples * TELEMETRY_SAMPLE_LENGTH;
+	buf = put32(buf, telemetry.index);
+	buf = putTime(buf, &telemetry.t1);
+	buf = putTime(buf, &telemetry.t2);
+	buf = putTime(buf, &ptpClock->timestamp_delayReqSend);
+	buf = putTime(buf, &ptpClock->timestamp_delayReqRecieve);
+	buf = putTime(buf, &telemetry.rawOffset);
+	buf = putTime(buf, &ptpClock->currentDS.offsetFromMaster);
+	buf = putTime(buf, delay);
+	buf = put32(buf, ptpClock->observedDrift);
+	put32(buf, adj);
+
+	if (++telemetry.samples < TELEMETRY_BATCH_SIZE) return;
+
+	/* The batch is full, fill in the header and pass it on. */
+	buf = (octet_t *) telemetry.fill->payload;
+	memcpy(buf, TELEMETRY_MAGIC, 4);
+	buf[4] = 0;
+	buf[5] = TELEMETRY_VERSION;
+	buf[6] = 0;
+	buf[7] = TELEMETRY_BATCH_SIZE;
+	put32(buf + 8, telemetry.batch++);
+	put32(buf + 12, telemetry.dropped);
+
+	telemetry.samples = 0;
+	telemetry.full = telemetry.fill;
+	telemetry.fill = NULL;
+	if (!telemetryPost())
+	{
+		/* Congested, reuse the pbuf for the next batch. */
+		telemetry.fill = telemetry.full;
+		telemetry.full = NULL;
+		telemetryDrop(TELEMETRY_BATCH_SIZE);
+	}
+}
@@ -15,6 +15,7 @@ static void timerCallback(void const *arg)
 	{
 		/* Mark the indicated timer as expired. */
 		ptpdTimersExpired[index] = TRUE;
+		trace_event(TRACE_TIMER_EXPIRED, index, 0, 0, 0, 0);
 
 		/* Notify the PTP thread of a pending operation. */
 		ptpd_alert();
@@ -31,8 +32,9 @@ void initTimer(void)
   for (i = 0; i < TIMER_ARRAY_SIZE; i++)
   {
 		// Mark the timer as not expired.
-		// Initialize the timer.
-		sys_timer_new(&ptpdTimers[i], timerCallback, osTimerOnce, (void *) i);
+		// Initialize the timer. The timers are periodic, the protocol
+		// engine expects the sync and announce intervals to keep running.
+		sys_timer_new(&ptpdTimers[i], timerCallback, osTimerPeriodic, (void *) i);
 		ptpdTimersExpired[i] = FALSE;
 	}
 }
@@ -46,6 +48,7 @@ void timerStop(int32_t index)
 	DBGV("timerStop: stop timer %d\n", index);
   sys_timer_stop(&ptpdTimers[index]);
 	ptpdTimersExpired[index] = FALSE;
+	trace_event(TRACE_TIMER_STOP, index, 0, 0, 0, 0);
 }
 
 void timerStart(int32_t index, uint32_t interval_ms)
@@ -57,6 +60,7 @@ void timerStart(int32_t index, uint32_t interval_ms)
 	DBGV("timerStart: set timer %d to %d\n", index, interval_ms);
 	ptpdTimersExpired[index] = FALSE;
   sys_timer_start(&ptpdTimers[index], interval_ms);
+	trace_event(TRACE_TIMER_START, index, interval_ms, 0, 0, 0);
 }
 
 bool timerExpired(int32_t index)
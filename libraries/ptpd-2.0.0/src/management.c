@@ -0,0 +1,299 @@
+/* management.c */
+
+#include "ptpd.h"
+
+/**
+ *\file
+ * \brief Management messages (clause 15 of the spec)
+ *
+ * Each supported managementId has an entry with the length of its data
+ * field, a function packing the data field of a response and, if it can be
+ * set, a function applying the data field of a SET.  The response TLV is
+ * packed straight into the output buffer.
+ */
+
+typedef struct
+{
+	enum16bit_t id;
+	int16_t length;  /* of the data field */
+	void (*pack)(const PtpClock*, octet_t*);
+	bool (*set)(PtpClock*, const octet_t*);
+} ManagementEntry;
+
+/* TimeInterval in scaled nanoseconds (5.3.2) */
+static void packTimeInterval(octet_t *buf, const TimeInternal *time)
+{
+	int64_t scaled = ((int64_t) time->seconds * 1000000000 + time->nanoseconds) * 65536;
+
+	*(int32_t*)(buf + 0) = flip32((int32_t) (scaled >> 32));
+	*(uint32_t*)(buf + 4) = flip32((uint32_t) scaled);
+}
+
+static void packPortIdentity(octet_t *buf, const PortIdentity *identity)
+{
+	memcpy(buf, identity->clockIdentity, CLOCK_IDENTITY_LENGTH);
+	*(int16_t*)(buf + 8) = flip16(identity->portNumber);
+}
+
+static void packClockQuality(octet_t *buf, const ClockQuality *quality)
+{
+	*(uint8_t*)(buf + 0) = quality->clockClass;
+	*(enum8bit_t*)(buf + 1) = quality->clockAccuracy;
+	*(int16_t*)(buf + 2) = flip16(quality->offsetScaledLogVariance);
+}
+
+/* 15.5.3.3.1 */
+static void packDefaultDS(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(uint8_t*)(buf + 0) = (ptpClock->defaultDS.twoStepFlag ? 0x01 : 0) | (ptpClock->defaultDS.slaveOnly ? 0x02 : 0);
+	*(uint8_t*)(buf + 1) = 0;
+	*(int16_t*)(buf + 2) = flip16(ptpClock->defaultDS.numberPorts);
+	*(uint8_t*)(buf + 4) = ptpClock->defaultDS.priority1;
+	packClockQuality(buf + 5, &ptpClock->defaultDS.clockQuality);
+	*(uint8_t*)(buf + 9) = ptpClock->defaultDS.priority2;
+	memcpy((buf + 10), ptpClock->defaultDS.clockIdentity, CLOCK_IDENTITY_LENGTH);
+	*(uint8_t*)(buf + 18) = ptpClock->defaultDS.domainNumber;
+	*(uint8_t*)(buf + 19) = 0;
+}
+
+/* 15.5.3.4.1 */
+static void packCurrentDS(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(int16_t*)(buf + 0) = flip16(ptpClock->currentDS.stepsRemoved);
+	packTimeInterval(buf + 2, &ptpClock->currentDS.offsetFromMaster);
+	packTimeInterval(buf + 10, &ptpClock->currentDS.meanPathDelay);
+}
+
+/* 15.5.3.5.1 */
+static void packParentDS(const PtpClock *ptpClock, octet_t *buf)
+{
+	packPortIdentity(buf + 0, &ptpClock->parentDS.parentPortIdentity);
+	*(uint8_t*)(buf + 10) = ptpClock->parentDS.parentStats ? 0x01 : 0;
+	*(uint8_t*)(buf + 11) = 0;
+	*(int16_t*)(buf + 12) = flip16(ptpClock->parentDS.observedParentOffsetScaledLogVariance);
+	*(int32_t*)(buf + 14) = flip32(ptpClock->parentDS.observedParentClockPhaseChangeRate);
+	*(uint8_t*)(buf + 18) = ptpClock->parentDS.grandmasterPriority1;
+	packClockQuality(buf + 19, &ptpClock->parentDS.grandmasterClockQuality);
+	*(uint8_t*)(buf + 23) = ptpClock->parentDS.grandmasterPriority2;
+	memcpy((buf + 24), ptpClock->parentDS.grandmasterIdentity, CLOCK_IDENTITY_LENGTH);
+}
+
+/* 15.5.3.6.1 */
+static void packTimePropertiesDS(const PtpClock *ptpClock, octet_t *buf)
+{
+	const TimePropertiesDS *ds = &ptpClock->timePropertiesDS;
+
+	*(int16_t*)(buf + 0) = flip16(ds->currentUtcOffset);
+	*(uint8_t*)(buf + 2) = (ds->leap61 ? 0x01 : 0) | (ds->leap59 ? 0x02 : 0) |
+			(ds->currentUtcOffsetValid ? 0x04 : 0) | (ds->ptpTimescale ? 0x08 : 0) |
+			(ds->timeTraceable ? 0x10 : 0) | (ds->frequencyTraceable ? 0x20 : 0);
+	*(enum8bit_t*)(buf + 3) = ds->timeSource;
+}
+
+/* 15.5.3.7.1 */
+static void packPortDS(const PtpClock *ptpClock, octet_t *buf)
+{
+	packPortIdentity(buf + 0, &ptpClock->portDS.portIdentity);
+	*(enum8bit_t*)(buf + 10) = ptpClock->portDS.portState;
+	*(int8_t*)(buf + 11) = ptpClock->portDS.logMinDelayReqInterval;
+	packTimeInterval(buf + 12, &ptpClock->portDS.peerMeanPathDelay);
+	*(int8_t*)(buf + 20) = ptpClock->portDS.logAnnounceInterval;
+	*(uint8_t*)(buf + 21) = ptpClock->portDS.announceReceiptTimeout;
+	*(int8_t*)(buf + 22) = ptpClock->portDS.logSyncInterval;
+	*(enum8bit_t*)(buf + 23) = ptpClock->portDS.delayMechanism;
+	*(int8_t*)(buf + 24) = ptpClock->portDS.logMinPdelayReqInterval;
+	*(uint8_t*)(buf + 25) = ptpClock->portDS.versionNumber & 0x0F;
+}
+
+/* Members of the data sets, one octet followed by a reserved one */
+static void packPriority1(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(uint8_t*)(buf + 0) = ptpClock->defaultDS.priority1;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+static void packPriority2(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(uint8_t*)(buf + 0) = ptpClock->defaultDS.priority2;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+static void packDomain(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(uint8_t*)(buf + 0) = ptpClock->defaultDS.domainNumber;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+static void packLogAnnounceInterval(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(int8_t*)(buf + 0) = ptpClock->portDS.logAnnounceInterval;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+static void packLogSyncInterval(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(int8_t*)(buf + 0) = ptpClock->portDS.logSyncInterval;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+static void packLogMinPdelayReqInterval(const PtpClock *ptpClock, octet_t *buf)
+{
+	*(int8_t*)(buf + 0) = ptpClock->portDS.logMinPdelayReqInterval;
+	*(uint8_t*)(buf + 1) = 0;
+}
+
+/* The BMC uses the new priorities with the next Announce, a master
+ * announces them as its grandmaster priorities */
+static bool setPriority1(PtpClock *ptpClock, const octet_t *data)
+{
+	ptpClock->defaultDS.priority1 = *(uint8_t*)data;
+	ptpClock->rtOpts->priority1 = ptpClock->defaultDS.priority1;
+	if (ptpClock->portDS.portState == PTP_MASTER) m1(ptpClock);
+	return TRUE;
+}
+
+static bool setPriority2(PtpClock *ptpClock, const octet_t *data)
+{
+	ptpClock->defaultDS.priority2 = *(uint8_t*)data;
+	ptpClock->rtOpts->priority2 = ptpClock->defaultDS.priority2;
+	if (ptpClock->portDS.portState == PTP_MASTER) m1(ptpClock);
+	return TRUE;
+}
+
+/* The port restarts in the new domain once the response is sent */
+static bool setDomain(PtpClock *ptpClock, const octet_t *data)
+{
+	ptpClock->defaultDS.domainNumber = *(uint8_t*)data;
+	ptpClock->rtOpts->domainNumber = ptpClock->defaultDS.domainNumber;
+	return TRUE;
+}
+
+static bool setLogAnnounceInterval(PtpClock *ptpClock, const octet_t *data)
+{
+	int8_t interval = *(int8_t*)data;
+
+	if ((interval < -3) || (interval > 4)) return FALSE;
+
+	ptpClock->portDS.logAnnounceInterval = interval;
+	ptpClock->rtOpts->announceInterval = interval;
+	if (ptpClock->portDS.portState == PTP_MASTER) timerStart(ANNOUNCE_INTERVAL_TIMER, pow2ms(interval));
+	return TRUE;
+}
+
+static bool setLogSyncInterval(PtpClock *ptpClock, const octet_t *data)
+{
+	int8_t interval = *(int8_t*)data;
+
+	if ((interval < -7) || (interval > 4)) return FALSE;
+
+	ptpClock->portDS.logSyncInterval = interval;
+	ptpClock->rtOpts->syncInterval = interval;
+	if (ptpClock->portDS.portState == PTP_MASTER) timerStart(SYNC_INTERVAL_TIMER, pow2ms(interval));
+	return TRUE;
+}
+
+/* Used from the next Pdelay_Req, not stored */
+static bool setLogMinPdelayReqInterval(PtpClock *ptpClock, const octet_t *data)
+{
+	int8_t interval = *(int8_t*)data;
+
+	if ((interval < -7) || (interval > 5)) return FALSE;
+
+	ptpClock->portDS.logMinPdelayReqInterval = interval;
+	return TRUE;
+}
+
+static bool setNull(PtpClock *ptpClock, const octet_t *data)
+{
+	return TRUE;
+}
+
+static const ManagementEntry managementTable[] =
+{
+	{MM_NULL_MANAGEMENT, 0, NULL, setNull},
+	{MM_DEFAULT_DATA_SET, 20, packDefaultDS, NULL},
+	{MM_CURRENT_DATA_SET, 18, packCurrentDS, NULL},
+	{MM_PARENT_DATA_SET, 32, packParentDS, NULL},
+	{MM_TIME_PROPERTIES_DATA_SET, 4, packTimePropertiesDS, NULL},
+	{MM_PORT_DATA_SET, 26, packPortDS, NULL},
+	{MM_PRIORITY1, 2, packPriority1, setPriority1},
+	{MM_PRIORITY2, 2, packPriority2, setPriority2},
+	{MM_DOMAIN, 2, packDomain, setDomain},
+	{MM_LOG_ANNOUNCE_INTERVAL, 2, packLogAnnounceInterval, setLogAnnounceInterval},
+	{MM_LOG_SYNC_INTERVAL, 2, packLogSyncInterval, setLogSyncInterval},
+	{MM_LOG_MIN_PDELAY_REQ_INTERVAL, 2, packLogMinPdelayReqInterval, setLogMinPdelayReqInterval},
+};
+
+/* MANAGEMENT_ERROR_STATUS TLV (15.5.4) */
+static int16_t packManagementError(octet_t *buf, enum16bit_t managementId, enum16bit_t errorId)
+{
+	*(enum16bit_t*)(buf + 0) = flip16(TLV_MANAGEMENT_ERROR_STATUS);
+	*(int16_t*)(buf + 2) = flip16(MANAGEMENT_ERROR_LENGTH - 4);
+	*(enum16bit_t*)(buf + 4) = flip16(errorId);
+	*(enum16bit_t*)(buf + 6) = flip16(managementId);
+	memset((buf + 8), 0, 4);
+
+	return MANAGEMENT_ERROR_LENGTH;
+}
+
+/* Apply a GET, SET or COMMAND and pack the TLV of the response into buf.
+ * Returns the length of the TLV. */
+int16_t managementResponse(PtpClock *ptpClock, const MsgManagement *manage, octet_t *buf)
+{
+	int i;
+	RunTimeOpts old;
+	const ManagementEntry *entry = NULL;
+
+	for (i = 0; i < sizeof(managementTable) / sizeof(managementTable[0]); i++)
+	{
+		if (managementTable[i].id == manage->managementId)
+		{
+			entry = &managementTable[i];
+			break;
+		}
+	}
+
+	if (entry == NULL)
+	{
+		return packManagementError(buf, manage->managementId, MM_ERROR_NO_SUCH_ID);
+	}
+
+	switch (manage->actionField)
+	{
+		case ACTION_GET:
+			break;
+
+		case ACTION_SET:
+			if (entry->set == NULL)
+				return packManagementError(buf, manage->managementId, MM_ERROR_NOT_SETABLE);
+			if (manage->dataLength != entry->length)
+				return packManagementError(buf, manage->managementId, MM_ERROR_WRONG_LENGTH);
+			old = *ptpClock->rtOpts;
+			if (!entry->set(ptpClock, manage->data))
+				return packManagementError(buf, manage->managementId, MM_ERROR_WRONG_VALUE);
+			saveRunTimeOpts(&old, ptpClock->rtOpts);
+			break;
+
+		case ACTION_COMMAND:
+			/* Only NULL_MANAGEMENT is a command, it is acknowledged */
+			if (entry->pack != NULL)
+				return packManagementError(buf, manage->managementId, MM_ERROR_NOT_SUPPORTED);
+			break;
+
+		default:
+			return packManagementError(buf, manage->managementId, MM_ERROR_NOT_SUPPORTED);
+	}
+
+	if (MANAGEMENT_LENGTH + MANAGEMENT_TLV_LENGTH + entry->length > PACKET_SIZE)
+	{
+		return packManagementError(buf, manage->managementId, MM_ERROR_RESPONSE_TOO_BIG);
+	}
+
+	/* The data fields all have an even length */
+	*(enum16bit_t*)(buf + 0) = flip16(TLV_MANAGEMENT);
+	*(int16_t*)(buf + 2) = flip16(2 + entry->length);
+	*(enum16bit_t*)(buf + 4) = flip16(manage->managementId);
+	if (entry->pack != NULL) entry->pack(ptpClock, buf + MANAGEMENT_TLV_LENGTH);
+
+	return MANAGEMENT_TLV_LENGTH + entry->length;
+}
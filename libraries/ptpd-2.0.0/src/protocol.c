@@ -23,7 +23,7 @@ static void issueDelayResp(PtpClock*, const TimeInternal*, const MsgHeader*);
 static void issuePDelayReq(PtpClock*);
 static void issuePDelayResp(PtpClock*, TimeInternal*, const MsgHeader*);
 static void issuePDelayRespFollowUp(PtpClock*, const TimeInternal*, const MsgHeader*);
-//static void issueManagement(const MsgHeader*,MsgManagement*,PtpClock*);
+static void issueManagement(PtpClock*, const MsgHeader*, const MsgManagement*);
 
 static bool doInit(PtpClock*);
 
@@ -52,6 +52,8 @@ void toState(PtpClock *ptpClock, uint8_t state)
 {
 	ptpClock->messageActivity = TRUE;
 
+	trace_event(TRACE_STATE, state, ptpClock->portDS.portState, 0, 0, 0);
+
 	DBG("leaving state %s\n", stateString(ptpClock->portDS.portState));
 
 	/* leaving state tasks */
@@ -211,6 +213,8 @@ void toState(PtpClock *ptpClock, uint8_t state)
 
 			break;
 	}
+
+	snapshotState(ptpClock);
 }
 
 
@@ -512,6 +516,9 @@ static void handle(PtpClock *ptpClock)
 		}
 
 		msgUnpackHeader(ptpClock->msgIbuf, &ptpClock->msgTmpHeader);
+		trace_event(TRACE_MSG_RECV, ptpClock->msgTmpHeader.messageType, ptpClock->msgTmpHeader.sequenceId,
+								ptpClock->msgIbufLength, time.seconds, time.nanoseconds);
+		latency_mark(LATENCY_HANDLE);
 		DBGV("handle: unpacked message type %d\n", ptpClock->msgTmpHeader.messageType);
 
 		if (ptpClock->msgTmpHeader.versionPTP != ptpClock->portDS.versionNumber)
@@ -1224,10 +1231,74 @@ static void handlePDelayRespFollowUp(PtpClock *ptpClock, bool isFromSelf)
 	}
 }
 
+/* spec 15.3 */
 static void handleManagement(PtpClock *ptpClock, bool isFromSelf)
 {
-	/* ENABLE_PORT -> DESIGNATED_ENABLED -> toState(PTP_INITIALIZING) */
-	/* DISABLE_PORT -> DESIGNATED_DISABLED -> toState(PTP_DISABLED) */
+	TimeInternal now;
+	ssize_t length;
+	MsgManagement *manage = &ptpClock->msgTmp.manage;
+	static const ClockIdentity allClocks = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+	/* Malformed management messages are dropped, they do not make the port faulty */
+	length = min(ptpClock->msgIbufLength, ptpClock->msgTmpHeader.messageLength);
+	if (length < MANAGEMENT_LENGTH + MANAGEMENT_TLV_LENGTH)
+	{
+			DBG("handleManagement: short message\n");
+			return;
+	}
+
+	if (isFromSelf || (ptpClock->portDS.portState == PTP_INITIALIZING))
+	{
+			DBGV("handleManagement: ignore\n");
+			return;
+	}
+
+	msgUnpackManagement(ptpClock->msgIbuf, manage);
+
+	/* Requests only, to all clocks or this one and to all ports or this one */
+	if ((manage->actionField != ACTION_GET) && (manage->actionField != ACTION_SET) &&
+			(manage->actionField != ACTION_COMMAND))
+	{
+			return;
+	}
+
+	if (memcmp(manage->targetPortIdentity.clockIdentity, allClocks, CLOCK_IDENTITY_LENGTH) &&
+			memcmp(manage->targetPortIdentity.clockIdentity, ptpClock->defaultDS.clockIdentity, CLOCK_IDENTITY_LENGTH))
+	{
+			return;
+	}
+
+	if ((manage->targetPortIdentity.portNumber != (int16_t) 0xFFFF) &&
+			(manage->targetPortIdentity.portNumber != ptpClock->portDS.portIdentity.portNumber))
+	{
+			return;
+	}
+
+	msgUnpackManagementPayload(ptpClock->msgIbuf, manage);
+	if ((manage->tlvType != TLV_MANAGEMENT) || (manage->dataLength < 0) ||
+			(MANAGEMENT_LENGTH + MANAGEMENT_TLV_LENGTH + manage->dataLength > length))
+	{
+			DBG("handleManagement: bad TLV\n");
+			return;
+	}
+
+	/* Limit the responses so a flood of requests leaves time for the
+	   time critical messages */
+	getTime(&now);
+	if (now.seconds != ptpClock->managementSecond)
+	{
+			ptpClock->managementSecond = now.seconds;
+			ptpClock->managementResponses = 0;
+	}
+
+	if (ptpClock->managementResponses >= MANAGEMENT_RATE)
+	{
+			DBGV("handleManagement: rate limited\n");
+			return;
+	}
+
+	ptpClock->managementResponses++;
+	issueManagement(ptpClock, &ptpClock->msgTmpHeader, manage);
 }
 
 static void handleSignaling(PtpClock *ptpClock, bool  isFromSelf)
@@ -1465,3 +1536,28 @@ static void issuePDelayRespFollowUp(PtpClock *ptpClock, const TimeInternal *time
 	}
 }
 
+/* Pack and send on general multicast ip address the response to a Management message */
+static void issueManagement(PtpClock *ptpClock, const MsgHeader *header, const MsgManagement *manage)
+{
+	int16_t length;
+
+	length = managementResponse(ptpClock, manage, ptpClock->msgObuf + MANAGEMENT_LENGTH);
+	length = msgPackManagementResponse(ptpClock, ptpClock->msgObuf, header, manage, length);
+
+	if (!netSendGeneral(&ptpClock->netPath, ptpClock->msgObuf, length))
+	{
+		ERROR("issueManagement: can't sent\n");
+		toState(ptpClock, PTP_FAULTY);
+	}
+	else
+	{
+		DBGV("issueManagement\n");
+	}
+
+	/* A new domain takes effect once the port is initialized again */
+	if (ptpClock->defaultDS.domainNumber != header->domainNumber)
+	{
+		toState(ptpClock, PTP_INITIALIZING);
+	}
+}
+
@@ -1,11 +1,31 @@
 /* ptpd.c */
 
+#include <stddef.h>
 #include "ptpd.h"
+#include "config.h"
 
 #define PTPD_THREAD_PRIO    (tskIDLE_PRIORITY + 2)
 
+#define PTPD_OPTION(name, field, def, min, max, restart) \
+	{name, offsetof(RunTimeOpts, field), sizeof(((RunTimeOpts *) 0)->field), restart, def, min, max, NULL, 0}
+#define PTPD_OPTION_VALUES(name, field, def, min, max, values, restart) \
+	{name, offsetof(RunTimeOpts, field), sizeof(((RunTimeOpts *) 0)->field), restart, def, min, max, \
+	values, sizeof(values) / sizeof(values[0])}
+
+// Management SETs are stored by a low priority thread once they stop
+// arriving for PTPD_SAVE_DELAY, and at most once every PTPD_SAVE_INTERVAL,
+// so a peer cannot wear the flash, and cannot stall the whole CPU for the
+// second or two of a sector erase more than once an interval.
+#define PTPD_SAVE_DELAY     10000
+#define PTPD_SAVE_INTERVAL  60000
+#define PTPD_SAVE_SIGNAL    0x01
+
 static sys_mbox_t ptp_alert_queue;
 
+static void ptpd_save_thread(void const *arg);
+osThreadDef(ptpd_save_thread, osPriorityLow, 1, DEFAULT_THREAD_STACKSIZE);
+static osThreadId ptpd_save_id;
+
 // Statically allocated run-time configuration data.
 RunTimeOpts rtOpts;
 PtpClock ptpClock;
@@ -13,35 +33,152 @@ ForeignMasterRecord ptpForeignRecords[DEFAULT_MAX_FOREIGN_RECORDS];
 
 __IO uint32_t PTPTimer = 0;
 
+// Transports the network code implements, there is no UDP over IPv6.
+static const int32_t ptpd_transports[] = {UDP_IPV4, IEE_802_3};
+
+// Run-time options kept in the configuration store, the index of an option
+// is its key so new options must be added at the end. The servo settings
+// and the latencies are applied while running, the others restart the port.
+static const struct ptpd_option ptpd_options[] =
+{
+	PTPD_OPTION("domain", domainNumber, DEFAULT_DOMAIN_NUMBER, 0, 255, true),
+	PTPD_OPTION("announce_interval", announceInterval, DEFAULT_ANNOUNCE_INTERVAL, -3, 4, true),
+	PTPD_OPTION("sync_interval", syncInterval, DEFAULT_SYNC_INTERVAL, -7, 4, true),
+	PTPD_OPTION("priority1", priority1, DEFAULT_PRIORITY1, 0, 255, true),
+	PTPD_OPTION("priority2", priority2, DEFAULT_PRIORITY2, 0, 255, true),
+	PTPD_OPTION("slave_only", slaveOnly, SLAVE_ONLY, 0, 1, true),
+	PTPD_OPTION("utc_offset", currentUtcOffset, DEFAULT_UTC_OFFSET, -32768, 32767, true),
+	PTPD_OPTION("delay_mechanism", delayMechanism, DEFAULT_DELAY_MECHANISM, E2E, P2P, true),
+	PTPD_OPTION_VALUES("transport", transport, DEFAULT_TRANSPORT, UDP_IPV4, IEE_802_3, ptpd_transports, true),
+	PTPD_OPTION("ap", servo.ap, DEFAULT_AP, 1, 32767, false),
+	PTPD_OPTION("ai", servo.ai, DEFAULT_AI, 1, 32767, false),
+	PTPD_OPTION("s_delay", servo.sDelay, DEFAULT_DELAY_S, 0, 15, false),
+	PTPD_OPTION("s_offset", servo.sOffset, DEFAULT_OFFSET_S, 0, 15, false),
+	PTPD_OPTION("no_adjust", servo.noAdjust, NO_ADJUST, 0, 1, false),
+	PTPD_OPTION("no_reset_clock", servo.noResetClock, DEFAULT_NO_RESET_CLOCK, 0, 1, false),
+	PTPD_OPTION("inbound_latency", inboundLatency.nanoseconds, DEFAULT_INBOUND_LATENCY, -1000000, 1000000, false),
+	PTPD_OPTION("outbound_latency", outboundLatency.nanoseconds, DEFAULT_OUTBOUND_LATENCY, -1000000, 1000000, false),
+};
+
+#define PTPD_OPTION_COUNT (sizeof(ptpd_options) / sizeof(ptpd_options[0]))
+
+// The options management SETs changed, one bit for each of the at most
+// 32 options, and their values, guarded by the mutex. Storing an option
+// from the shell drops its pending value.
+osMutexDef(ptpd_save_mutex);
+static osMutexId ptpd_save_mutex;
+static uint32_t ptpd_save_dirty;
+static int32_t ptpd_save_values[PTPD_OPTION_COUNT];
+
+// Drop the pending management values of the options in the mask.
+static void ptpd_save_drop(uint32_t mask)
+{
+	osMutexWait(ptpd_save_mutex, osWaitForever);
+	ptpd_save_dirty &= ~mask;
+	osMutexRelease(ptpd_save_mutex);
+}
+
+// Set when an option changed, the PTP thread then applies them.
+static volatile bool ptpd_options_changed = false;
+
+// Read an option field of the run-time options.
+static int32_t ptpd_option_read(const RunTimeOpts *opts, const struct ptpd_option *option)
+{
+	const uint8_t *field = (const uint8_t *) opts + option->offset;
+
+	switch (option->size)
+	{
+		case 1: return (option->min < 0) ? *(const int8_t *) field : *field;
+		case 2: return (option->min < 0) ? *(const int16_t *) field : *(const uint16_t *) field;
+		default: return *(const int32_t *) field;
+	}
+}
+
+// Write an option field of the run-time options.
+static void ptpd_option_write(RunTimeOpts *opts, const struct ptpd_option *option, int32_t value)
+{
+	uint8_t *field = (uint8_t *) opts + option->offset;
+
+	switch (option->size)
+	{
+		case 1: *field = (uint8_t) value; break;
+		case 2: *(int16_t *) field = (int16_t) value; break;
+		default: *(int32_t *) field = value; break;
+	}
+}
+
+// Set the options to their stored or default values.
+static void ptpd_options_load(RunTimeOpts *opts)
+{
+	int i;
+	int32_t value;
+
+	for (i = 0; i < PTPD_OPTION_COUNT; ++i)
+	{
+		ptpd_option_get(i, &value);
+		ptpd_option_write(opts, &ptpd_options[i], value);
+	}
+
+	/* 9.2.2 */
+	opts->clockQuality.clockClass = opts->slaveOnly ? DEFAULT_CLOCK_CLASS_SLAVE_ONLY : DEFAULT_CLOCK_CLASS;
+}
+
+// Apply changed options in the PTP thread.
+static void ptpd_options_apply(void)
+{
+	int i;
+	bool restart = false;
+	RunTimeOpts previous = rtOpts;
+
+	ptpd_options_load(&rtOpts);
+
+	for (i = 0; i < PTPD_OPTION_COUNT; ++i)
+	{
+		if (ptpd_options[i].restart &&
+		    (ptpd_option_read(&previous, &ptpd_options[i]) != ptpd_option_read(&rtOpts, &ptpd_options[i])))
+		{
+			restart = true;
+		}
+	}
+
+	// The servo settings and the latencies are used from the next message.
+	ptpClock.servo = rtOpts.servo;
+	ptpClock.owd_filt.s = rtOpts.servo.sDelay;
+	ptpClock.ofm_filt.s = rtOpts.servo.sOffset;
+	ptpClock.inboundLatency = rtOpts.inboundLatency;
+	ptpClock.outboundLatency = rtOpts.outboundLatency;
+
+	// The others are only read when the port initializes.
+	if (restart)
+	{
+		log_printf(LOG_INFO, "PTPD: options changed, restarting port\n");
+		toState(&ptpClock, PTP_INITIALIZING);
+	}
+}
+
+// Have the PTP thread apply the stored options.
+static void ptpd_options_notify(void)
+{
+	ptpd_options_changed = true;
+	ptpd_alert();
+}
+
 static void ptpd_thread(void *arg)
 {
 	// Initialize run-time options to default values.
-	rtOpts.announceInterval = DEFAULT_ANNOUNCE_INTERVAL;
-	rtOpts.syncInterval = DEFAULT_SYNC_INTERVAL;
 	rtOpts.clockQuality.clockAccuracy = DEFAULT_CLOCK_ACCURACY;
 	rtOpts.clockQuality.clockClass = DEFAULT_CLOCK_CLASS;
 	rtOpts.clockQuality.offsetScaledLogVariance = DEFAULT_CLOCK_VARIANCE; /* 7.6.3.3 */
-	rtOpts.priority1 = DEFAULT_PRIORITY1;
-	rtOpts.priority2 = DEFAULT_PRIORITY2;
-	rtOpts.domainNumber = DEFAULT_DOMAIN_NUMBER;
-	rtOpts.slaveOnly = SLAVE_ONLY;
-	rtOpts.currentUtcOffset = DEFAULT_UTC_OFFSET;
-	rtOpts.servo.noResetClock = DEFAULT_NO_RESET_CLOCK;
-	rtOpts.servo.noAdjust = NO_ADJUST;
-	rtOpts.inboundLatency.nanoseconds = DEFAULT_INBOUND_LATENCY;
-	rtOpts.outboundLatency.nanoseconds = DEFAULT_OUTBOUND_LATENCY;
-	rtOpts.servo.sDelay = DEFAULT_DELAY_S;
-	rtOpts.servo.sOffset = DEFAULT_OFFSET_S;
-	rtOpts.servo.ap = DEFAULT_AP;
-	rtOpts.servo.ai = DEFAULT_AI;
 	rtOpts.maxForeignRecords = sizeof(ptpForeignRecords) / sizeof(ptpForeignRecords[0]);
 	rtOpts.stats = PTP_TEXT_STATS;
-	rtOpts.delayMechanism = DEFAULT_DELAY_MECHANISM;
+
+	// The configurable options from the configuration store.
+	ptpd_options_load(&rtOpts);
 
 	// Initialize run time options.
 	if (ptpdStartup(&ptpClock, &rtOpts, ptpForeignRecords) != 0)
 	{
-		printf("PTPD: startup failed");
+		log_printf(LOG_ERROR, "PTPD: startup failed\n");
 		return;
 	}
 
@@ -59,6 +196,13 @@ static void ptpd_thread(void *arg)
 	{
 		void *msg;
 
+		// Apply options changed from the shell.
+		if (ptpd_options_changed)
+		{
+			ptpd_options_changed = false;
+			ptpd_options_apply();
+		}
+
 		// Process the current state.
 		do
 		{
@@ -75,6 +219,169 @@ static void ptpd_thread(void *arg)
 	}
 }
 
+// Number of run-time options.
+int ptpd_option_count(void)
+{
+	return PTPD_OPTION_COUNT;
+}
+
+// The description of an option.
+const struct ptpd_option *ptpd_option(int index)
+{
+	return &ptpd_options[index];
+}
+
+// Index of the option with the name, or -1.
+int ptpd_option_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < PTPD_OPTION_COUNT; ++i)
+	{
+		if (!strcasecmp(ptpd_options[i].name, name)) return i;
+	}
+
+	return -1;
+}
+
+// Whether a value is in the range of an option and one of its allowed
+// values, if it has a list of them.
+bool ptpd_option_valid(const struct ptpd_option *option, int32_t value)
+{
+	int i;
+
+	if ((value < option->min) || (value > option->max)) return false;
+	if (option->values == NULL) return true;
+
+	for (i = 0; i < option->count; ++i)
+	{
+		if (option->values[i] == value) return true;
+	}
+
+	return false;
+}
+
+// Get the stored value of an option, or the default. Returns true if the
+// value is stored. A stored value out of the range of the option is ignored.
+bool ptpd_option_get(int index, int32_t *value)
+{
+	const struct ptpd_option *option = &ptpd_options[index];
+
+	if (config_get(index, value) && ptpd_option_valid(option, *value)) return true;
+
+	*value = option->def;
+
+	return false;
+}
+
+// Store the value of an option and apply it.
+bool ptpd_option_set(int index, int32_t value)
+{
+	const struct ptpd_option *option = &ptpd_options[index];
+
+	if (!ptpd_option_valid(option, value)) return false;
+	ptpd_save_drop(1UL << index);
+	if (!config_set(index, value)) return false;
+
+	ptpd_options_notify();
+
+	return true;
+}
+
+// Return an option to its default.
+bool ptpd_option_default(int index)
+{
+	ptpd_save_drop(1UL << index);
+	if (!config_clear(index)) return false;
+
+	ptpd_options_notify();
+
+	return true;
+}
+
+// Return all stored values to their defaults.
+bool ptpd_options_reset(void)
+{
+	ptpd_save_drop(0xffffffffUL);
+	if (!config_reset()) return false;
+
+	ptpd_options_notify();
+
+	return true;
+}
+
+// Store the options in the mask that differ from the stored values.
+static void ptpd_save(uint32_t dirty, const int32_t *values)
+{
+	int i;
+	int32_t current;
+
+	for (i = 0; i < PTPD_OPTION_COUNT; ++i)
+	{
+		if (!(dirty & (1UL << i))) continue;
+		ptpd_option_get(i, &current);
+		if ((values[i] != current) && !config_set(i, values[i]))
+		{
+			log_printf(LOG_WARNING, "PTPD: cannot store option %s\n", ptpd_options[i].name);
+		}
+	}
+}
+
+// Store the options changed by management messages once they settle.
+static void ptpd_save_thread(void const *arg)
+{
+	uint32_t dirty;
+	int32_t values[PTPD_OPTION_COUNT];
+	uint32_t saved = 0;
+	uint32_t elapsed;
+	bool first = true;
+
+	for (;;)
+	{
+		// Wait for a change, then until no change arrives for a while.
+		osSignalWait(PTPD_SAVE_SIGNAL, osWaitForever);
+		while (osSignalWait(PTPD_SAVE_SIGNAL, PTPD_SAVE_DELAY).status == osEventSignal);
+
+		// Keep the minimum interval since the last store.
+		elapsed = sys_now() - saved;
+		if (!first && (elapsed < PTPD_SAVE_INTERVAL)) osDelay(PTPD_SAVE_INTERVAL - elapsed);
+
+		osMutexWait(ptpd_save_mutex, osWaitForever);
+		dirty = ptpd_save_dirty;
+		ptpd_save_dirty = 0;
+		memcpy(values, ptpd_save_values, sizeof(values));
+		osMutexRelease(ptpd_save_mutex);
+
+		if (dirty == 0) continue;
+		ptpd_save(dirty, values);
+		saved = sys_now();
+		first = false;
+	}
+}
+
+// Queue the options a management message changed in the PTP thread for
+// the save thread, only those differing between the old and the new
+// options. They are already in use, so the PTP thread is not notified.
+void saveRunTimeOpts(const RunTimeOpts *old, const RunTimeOpts *opts)
+{
+	int i;
+	int32_t value;
+	uint32_t dirty = 0;
+
+	osMutexWait(ptpd_save_mutex, osWaitForever);
+	for (i = 0; i < PTPD_OPTION_COUNT; ++i)
+	{
+		value = ptpd_option_read(opts, &ptpd_options[i]);
+		if (value == ptpd_option_read(old, &ptpd_options[i])) continue;
+		ptpd_save_values[i] = value;
+		dirty |= 1UL << i;
+	}
+	ptpd_save_dirty |= dirty;
+	osMutexRelease(ptpd_save_mutex);
+
+	if (dirty) osSignalSet(ptpd_save_id, PTPD_SAVE_SIGNAL);
+}
+
 // Notify the PTP thread of a pending operation.
 void ptpd_alert(void)
 {
@@ -87,9 +394,13 @@ void ptpd_init(void)
 	// Create the alert queue mailbox.
   if (sys_mbox_new(&ptp_alert_queue, 8) != ERR_OK)
 	{
-    printf("PTPD: failed to create ptp_alert_queue mbox");
+    log_printf(LOG_ERROR, "PTPD: failed to create ptp_alert_queue mbox\n");
   }
 
+	// Create the thread storing management changes.
+	ptpd_save_mutex = osMutexCreate(osMutex(ptpd_save_mutex));
+	ptpd_save_id = osThreadCreate(osThread(ptpd_save_thread), NULL);
+
 	// Create the PTP daemon thread.
 	sys_thread_new("PTPD", ptpd_thread, NULL, DEFAULT_THREAD_STACKSIZE * 2, osPriorityAboveNormal);
 }
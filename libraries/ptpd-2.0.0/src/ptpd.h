@@ -30,9 +30,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#ifdef PTPD_SIM
+/* Host build of the protocol engine, see sim/host.h */
+#include "sim/host.h"
+#else
 #include <stm32f4xx.h>
 #include <stm32f4x7_eth.h>
-#include <limits.h>
 #include "main.h"
 #include "cmsis_os.h"
 #include "lwip/opt.h"
@@ -43,7 +47,13 @@
 #include "lwip/igmp.h"
 #include "lwip/arch.h"
 #include "lwip/timers.h"
+#include "lwip/tcpip.h"
 #include "ethernetif.h"
+#include "pbuf_small.h"
+#endif
+#include "log.h"
+#include "trace.h"
+#include "latency.h"
 
 #include "constants.h"
 #include "dep/constants_dep.h"
@@ -153,6 +163,18 @@ void addForeign(PtpClock*, const MsgHeader*, const MsgAnnounce*);
 /** \}*/
 
 
+/** \name management.c
+ * -Management messages */
+/**\{*/
+/* management.c */
+/**
+ * \brief Apply a management request and pack the TLV of its response
+ * \return The length of the TLV
+ */
+int16_t managementResponse(PtpClock*, const MsgManagement*, octet_t*);
+/** \}*/
+
+
 /** \name protocol.c
  * -Execute the protocol engine */
 /**\{*/
@@ -172,6 +194,29 @@ void doState(PtpClock*);
 void toState(PtpClock*, uint8_t);
 /** \}*/
 
+// A run-time option of the PTP daemon kept in the configuration store.
+struct ptpd_option
+{
+	const char *name;
+	uint16_t offset;        // of the field in RunTimeOpts
+	uint8_t size;
+	bool restart;           // the port restarts when it changes
+	int32_t def;
+	int32_t min;
+	int32_t max;
+	const int32_t *values;  // allowed values in the range, NULL for all
+	uint8_t count;
+};
+
+int ptpd_option_count(void);
+const struct ptpd_option *ptpd_option(int index);
+int ptpd_option_find(const char *name);
+bool ptpd_option_valid(const struct ptpd_option *option, int32_t value);
+bool ptpd_option_get(int index, int32_t *value);
+bool ptpd_option_set(int index, int32_t value);
+bool ptpd_option_default(int index);
+bool ptpd_options_reset(void);
+
 // Send an alert to the PTP daemon thread.
 void ptpd_alert(void);
 
@@ -0,0 +1,30 @@
+/* host.h */
+
+#ifndef SIM_HOST_H_
+#define SIM_HOST_H_
+
+/**
+ *\file
+ * \brief Host substitutes for the firmware headers
+ *
+ * The protocol engine is built on the host with PTPD_SIM defined.  ptpd.h
+ * then includes this header in place of the STM32, RTX and lwIP headers,
+ * and the simulated dep layer in sim/ takes the place of net.c, timer.c,
+ * sys_time.c and telemetry.c.
+ */
+
+#include <stdint.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#define __INLINE  inline
+
+#define NETIF_MAX_HWADDR_LEN  6
+
+/* The network queues are only used by the replay thread. */
+typedef int sys_mutex_t;
+
+struct udp_pcb;
+
+#endif /* SIM_HOST_H_*/
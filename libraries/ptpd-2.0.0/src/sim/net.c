@@ -0,0 +1,336 @@
+/* net.c */
+
+#include "sim.h"
+
+/* Master side used to answer Delay_Req messages during a capture replay. */
+static __thread PtpClock responder;
+
+SimNode *simNodeOf(const PtpClock *ptpClock)
+{
+	return (SimNode *) ((char *) ptpClock - offsetof(SimNode, ptpClock));
+}
+
+static SimNode *simNodeOfPath(const NetPath *netPath)
+{
+	return simNodeOf((const PtpClock *) ((const char *) netPath - offsetof(PtpClock, netPath)));
+}
+
+static SimPacket *simAlloc(void)
+{
+	SimPacket *p = sim.free;
+
+	if (p != NULL)
+	{
+		sim.free = p->next;
+		return p;
+	}
+
+	p = malloc(sizeof(SimPacket));
+	if (p == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	return p;
+}
+
+static void simRelease(SimPacket *p)
+{
+	p->next = sim.free;
+	sim.free = p;
+}
+
+/* Queue a packet to arrive at the node at the given time.  Packets with
+ * the same arrival time keep their order. */
+void simInject(SimNode *dst, int64_t at, const octet_t *buf, int16_t length, bool captured)
+{
+	SimPacket **link = &sim.pending;
+	SimPacket *p = simAlloc();
+
+	p->at = at;
+	p->dst = dst;
+	p->captured = captured;
+	p->length = length;
+	memcpy(p->data, buf, length);
+
+	/* Captures are queued in order, append them without a search. */
+	if ((sim.last != NULL) && (sim.last->at <= at)) link = &sim.last->next;
+
+	while ((*link != NULL) && ((*link)->at <= at)) link = &(*link)->next;
+	p->next = *link;
+	*link = p;
+	if (p->next == NULL) sim.last = p;
+}
+
+/* Arrival time of the next packet in flight, -1 if there is none. */
+int64_t simNextPacket(void)
+{
+	return (sim.pending != NULL) ? sim.pending->at : -1;
+}
+
+/* Initialize network queue. */
+static void netQInit(BufQueue *queue, uint16_t id)
+{
+	queue->head = 0;
+	queue->tail = 0;
+	queue->id = id;
+}
+
+/* Put data to the network queue. */
+static bool netQPut(BufQueue *queue, void *pbuf)
+{
+	/* Is there room on the queue for the buffer? */
+	if (((queue->head + 1) & PBUF_QUEUE_MASK) == queue->tail) return FALSE;
+
+	queue->head = (queue->head + 1) & PBUF_QUEUE_MASK;
+	queue->pbuf[queue->head] = pbuf;
+
+	return TRUE;
+}
+
+/* Get data from the network queue. */
+static void *netQGet(BufQueue *queue)
+{
+	if (queue->tail == queue->head) return NULL;
+
+	queue->tail = (queue->tail + 1) & PBUF_QUEUE_MASK;
+
+	return queue->pbuf[queue->tail];
+}
+
+/* Free any remaining packets in the queue. */
+static void netQEmpty(BufQueue *queue)
+{
+	SimPacket *p;
+
+	while ((p = netQGet(queue)) != NULL) simRelease(p);
+}
+
+/* Follow the master time in a capture.  The Sync origin plus the path
+ * delay is the master time when the Sync was captured at the slave. */
+static void simCaptureSeen(const SimPacket *p)
+{
+	MsgHeader header;
+	MsgSync sync;
+	MsgFollowUp follow;
+	TimeInternal time;
+	TimeInternal correction;
+
+	/* Follow the first master seen in the capture. */
+	if (!sim.capture.haveMaster)
+	{
+		memcpy(sim.capture.master, p->data + 20, sizeof(sim.capture.master));
+		sim.capture.haveMaster = TRUE;
+	}
+	else if (memcmp(sim.capture.master, p->data + 20, sizeof(sim.capture.master)))
+	{
+		return;
+	}
+
+	msgUnpackHeader(p->data, &header);
+	scaledNanosecondsToInternalTime(&header.correctionfield, &correction);
+	memcpy(sim.capture.header, p->data, HEADER_LENGTH);
+
+	switch (header.messageType)
+	{
+		case SYNC:
+			msgUnpackSync(p->data, &sync);
+			toInternalTime(&time, &sync.originTimestamp);
+			sim.capture.syncSequenceId = header.sequenceId;
+			sim.capture.syncArrival = p->at;
+			sim.capture.origin = simFromInternal(&time) + simFromInternal(&correction);
+			sim.capture.waitingForFollowUp = getFlag(header.flagField[0], FLAG0_TWO_STEP);
+			if (!sim.capture.waitingForFollowUp) sim.capture.valid = TRUE;
+			break;
+
+		case FOLLOW_UP:
+			if (!sim.capture.waitingForFollowUp || (header.sequenceId != sim.capture.syncSequenceId)) break;
+			msgUnpackFollowUp(p->data, &follow);
+			toInternalTime(&time, &follow.preciseOriginTimestamp);
+			sim.capture.origin += simFromInternal(&time) + simFromInternal(&correction);
+			sim.capture.waitingForFollowUp = FALSE;
+			sim.capture.valid = TRUE;
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Master time at the given virtual time, the first node is the master of a
+ * synthetic run. */
+int64_t simReferenceTime(int64_t at)
+{
+	if (!sim.capture.enabled) return simPhcRead(&sim.nodes[0]->phc, at);
+
+	return sim.capture.origin + sim.pathDelay + (at - sim.capture.syncArrival);
+}
+
+/* Answer a Delay_Req sent during a capture replay with the master time at
+ * which it arrives. */
+static void simRespond(SimNode *src, const octet_t *buf)
+{
+	MsgHeader header;
+	Timestamp receiveTimestamp;
+	TimeInternal time;
+	octet_t resp[PACKET_SIZE];
+
+	if (!sim.capture.valid) return;
+
+	msgUnpackHeader(buf, &header);
+	simToInternal(simReferenceTime(sim.now + sim.pathDelay), &time);
+	fromInternalTime(&time, &receiveTimestamp);
+
+	/* Reply with the identity of the captured master. */
+	memcpy(resp, sim.capture.header, HEADER_LENGTH);
+	responder.portDS.logMinDelayReqInterval = DEFAULT_DELAYREQ_INTERVAL;
+	msgPackDelayResp(&responder, resp, &header, &receiveTimestamp);
+
+	simInject(src, sim.now + 2 * sim.pathDelay, resp, DELAY_RESP_LENGTH, FALSE);
+	sim.capture.responses++;
+}
+
+/* Move the packets that arrived by now into the node queues, with the
+ * receive timestamp of the node clock. */
+void simDeliver(int64_t now)
+{
+	SimPacket *p;
+	SimNode *dst;
+	BufQueue *queue;
+
+	while ((sim.pending != NULL) && (sim.pending->at <= now))
+	{
+		p = sim.pending;
+		sim.pending = p->next;
+		if (sim.pending == NULL) sim.last = NULL;
+		dst = p->dst;
+
+		if (p->captured) simCaptureSeen(p);
+
+		simPhcStamp(&dst->phc, p->at, &dst->rng, &p->stamp);
+
+		/* Event messages have message type values below 8, others are general. */
+		queue = ((p->data[0] & 0x0F) < 0x08) ? &dst->ptpClock.netPath.eventQ : &dst->ptpClock.netPath.generalQ;
+
+		if (!netQPut(queue, p))
+		{
+			dst->dropped++;
+			simRelease(p);
+			continue;
+		}
+
+		/* Alert the PTP thread there is now something to do. */
+		dst->wake = now;
+	}
+}
+
+bool netShutdown(NetPath *netPath)
+{
+	netQEmpty(&netPath->eventQ);
+	netQEmpty(&netPath->generalQ);
+	netPath->transport = 0;
+
+	return TRUE;
+}
+
+bool netInit(NetPath *netPath, PtpClock *ptpClock)
+{
+	SimNode *node = simNodeOf(ptpClock);
+
+	netQInit(&netPath->eventQ, TRACE_QUEUE_EVENT);
+	netQInit(&netPath->generalQ, TRACE_QUEUE_GENERAL);
+
+	memcpy(ptpClock->portUuidField, node->mac, NETIF_MAX_HWADDR_LEN);
+	netPath->transport = ptpClock->rtOpts->transport;
+
+	return TRUE;
+}
+
+int32_t netSelect(NetPath *netPath, const TimeInternal *timeout)
+{
+	if ((netPath->eventQ.tail != netPath->eventQ.head) ||
+			(netPath->generalQ.tail != netPath->generalQ.head)) return 1;
+
+	return 0;
+}
+
+void netEmptyEventQ(NetPath *netPath)
+{
+	netQEmpty(&netPath->eventQ);
+}
+
+static ssize_t netRecv(NetPath *netPath, octet_t *buf, TimeInternal *time, BufQueue *queue)
+{
+	ssize_t length;
+	SimPacket *p;
+
+	if ((p = netQGet(queue)) == NULL) return 0;
+
+	if (time != NULL) *time = p->stamp;
+	length = p->length;
+	memcpy(buf, p->data, length);
+	simRelease(p);
+	simNodeOfPath(netPath)->received++;
+
+	return length;
+}
+
+ssize_t netRecvEvent(NetPath *netPath, octet_t *buf, TimeInternal *time)
+{
+	return netRecv(netPath, buf, time, &netPath->eventQ);
+}
+
+ssize_t netRecvGeneral(NetPath *netPath, octet_t *buf, TimeInternal *time)
+{
+	return netRecv(netPath, buf, time, &netPath->generalQ);
+}
+
+/* Multicast the message to every other node after the path delay, or the
+ * next of the recorded delays.  The network keeps the messages of a node
+ * in order.  Event messages get the transmit timestamp of the sender
+ * clock. */
+static ssize_t netSend(NetPath *netPath, const octet_t *buf, int16_t length, TimeInternal *time)
+{
+	int i;
+	int64_t at;
+	SimNode *src = simNodeOfPath(netPath);
+
+	if (time != NULL) simPhcStamp(&src->phc, sim.now, &src->rng, time);
+
+	for (i = 0; i < sim.nodeCount; i++)
+	{
+		if (sim.nodes[i] == src) continue;
+		if (sim.delays != NULL)
+			at = sim.now + sim.delays->delay[sim.delayIndex++ % sim.delays->count];
+		else
+			at = sim.now + sim.pathDelay + abs(simGauss(&src->rng, sim.jitter));
+		if (at < src->sent) at = src->sent;
+		src->sent = at;
+		simInject(sim.nodes[i], at, buf, length, FALSE);
+	}
+
+	if (sim.capture.enabled && ((buf[0] & 0x0F) == DELAY_REQ)) simRespond(src, buf);
+
+	return length;
+}
+
+ssize_t netSendEvent(NetPath *netPath, const octet_t *buf, int16_t length, TimeInternal *time)
+{
+	return netSend(netPath, buf, length, time);
+}
+
+ssize_t netSendGeneral(NetPath *netPath, const octet_t *buf, int16_t length)
+{
+	return netSend(netPath, buf, length, NULL);
+}
+
+ssize_t netSendPeerGeneral(NetPath *netPath, const octet_t *buf, int16_t length)
+{
+	return netSend(netPath, buf, length, NULL);
+}
+
+ssize_t netSendPeerEvent(NetPath *netPath, const octet_t *buf, int16_t length, TimeInternal *time)
+{
+	return netSend(netPath, buf, length, time);
+}
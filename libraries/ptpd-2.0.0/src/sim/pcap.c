@@ -0,0 +1,239 @@
+/* pcap.c */
+
+#include "sim.h"
+
+/* Classic libpcap files with microsecond or nanosecond timestamps in
+ * either byte order.  PTP messages are taken from UDP ports 319 and 320
+ * over IPv4 and from the PTP ethertype.  Delay traces are text files with
+ * one one way delay in nsec per line. */
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define PCAP_HEADER_LENGTH  24
+#define PCAP_RECORD_LENGTH  16
+
+#define LINKTYPE_ETHERNET   1
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LINUX_SLL  113
+
+#define ETHERTYPE_IP        0x0800
+#define ETHERTYPE_VLAN      0x8100
+
+static __thread bool swapped;
+
+static uint32_t get32(const uint8_t *p)
+{
+	if (swapped) return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+	return ((uint32_t) p[3] << 24) | ((uint32_t) p[2] << 16) | ((uint32_t) p[1] << 8) | p[0];
+}
+
+static uint16_t getNet16(const uint8_t *p)
+{
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+/* Find the PTP message in an IPv4 packet. */
+static const uint8_t *simIpPayload(const uint8_t *ip, uint32_t length, uint32_t *payloadLength)
+{
+	uint32_t ihl;
+	uint16_t port;
+	uint16_t udpLength;
+
+	if ((length < 20) || ((ip[0] >> 4) != 4) || (ip[9] != 17)) return NULL;
+
+	/* Skip fragments. */
+	if (getNet16(ip + 6) & 0x3fff) return NULL;
+
+	ihl = (ip[0] & 0x0f) * 4;
+	if (length < ihl + 8) return NULL;
+
+	port = getNet16(ip + ihl + 2);
+	if ((port != PTP_EVENT_PORT) && (port != PTP_GENERAL_PORT)) return NULL;
+
+	udpLength = getNet16(ip + ihl + 4);
+	if ((udpLength < 8) || (ihl + udpLength > length)) return NULL;
+
+	*payloadLength = udpLength - 8;
+
+	return ip + ihl + 8;
+}
+
+/* Find the PTP message in a captured frame. */
+static const uint8_t *simPayload(uint32_t linkType, const uint8_t *frame, uint32_t length, uint32_t *payloadLength)
+{
+	uint32_t offset;
+	uint16_t type;
+
+	switch (linkType)
+	{
+		case LINKTYPE_ETHERNET:
+			offset = 12;
+			break;
+		case LINKTYPE_LINUX_SLL:
+			offset = 14;
+			break;
+		case LINKTYPE_RAW:
+			return simIpPayload(frame, length, payloadLength);
+		default:
+			return NULL;
+	}
+
+	if (length < offset + 2) return NULL;
+	type = getNet16(frame + offset);
+
+	/* Skip a VLAN tag. */
+	if ((type == ETHERTYPE_VLAN) && (length >= offset + 6))
+	{
+		offset += 4;
+		type = getNet16(frame + offset);
+	}
+	offset += 2;
+
+	if (type == ETHERTYPE_IP) return simIpPayload(frame + offset, length - offset, payloadLength);
+
+	if (type != PTP_ETHER_TYPE) return NULL;
+
+	*payloadLength = length - offset;
+
+	return frame + offset;
+}
+
+/* Queue the Announce, Sync and Follow_Up messages of the capture for the
+ * node, starting one poll interval into the replay.  The node takes the
+ * domain of the first message.  Returns the arrival time of the last one,
+ * or -1 if the file cannot be read. */
+int64_t simLoadCapture(const char *name, SimNode *node)
+{
+	FILE *file;
+	long size;
+	uint8_t *data;
+	uint32_t magic;
+	uint32_t linkType;
+	uint32_t offset;
+	uint32_t captured;
+	uint32_t length;
+	uint8_t type;
+	bool nsec;
+	bool first = TRUE;
+	int64_t stamp;
+	int64_t start = 0;
+	int64_t last = -1;
+	const uint8_t *msg;
+
+	if ((file = fopen(name, "rb")) == NULL)
+	{
+		perror(name);
+		return -1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = malloc(size > 0 ? size : 1);
+	if ((data == NULL) || (fread(data, 1, size, file) != (size_t) size) || (size < PCAP_HEADER_LENGTH))
+	{
+		fprintf(stderr, "%s: cannot read capture\n", name);
+		fclose(file);
+		free(data);
+		return -1;
+	}
+	fclose(file);
+
+	swapped = FALSE;
+	magic = get32(data);
+	if ((magic != PCAP_MAGIC) && (magic != PCAP_MAGIC_NSEC))
+	{
+		swapped = TRUE;
+		magic = get32(data);
+	}
+	if ((magic != PCAP_MAGIC) && (magic != PCAP_MAGIC_NSEC))
+	{
+		fprintf(stderr, "%s: not a pcap file\n", name);
+		free(data);
+		return -1;
+	}
+	nsec = (magic == PCAP_MAGIC_NSEC);
+	linkType = get32(data + 20);
+
+	for (offset = PCAP_HEADER_LENGTH; offset + PCAP_RECORD_LENGTH <= size; offset += PCAP_RECORD_LENGTH + captured)
+	{
+		captured = get32(data + offset + 8);
+		if (offset + PCAP_RECORD_LENGTH + captured > size) break;
+
+		msg = simPayload(linkType, data + offset + PCAP_RECORD_LENGTH, captured, &length);
+		if ((msg == NULL) || (length < HEADER_LENGTH) || (length > PACKET_SIZE)) continue;
+		if ((msg[1] & 0x0F) != VERSION_PTP) continue;
+
+		type = msg[0] & 0x0F;
+		if ((type != SYNC) && (type != FOLLOW_UP) && (type != ANNOUNCE)) continue;
+
+		stamp = get32(data + offset) * SIM_NSEC + get32(data + offset + 4) * (nsec ? 1 : 1000);
+		if (first)
+		{
+			start = stamp - SIM_POLL_NS;
+			node->rtOpts.domainNumber = msg[4];
+			first = FALSE;
+		}
+
+		/* Keep the replay in order if the capture is not. */
+		last = (stamp - start > last) ? stamp - start : last;
+		simInject(node, last, (const octet_t *) msg, (int16_t) length, TRUE);
+		sim.capture.packets++;
+	}
+
+	free(data);
+
+	if (first) fprintf(stderr, "%s: no PTP messages found\n", name);
+
+	return last;
+}
+
+/* Read a delay trace.  Lines that do not start with a delay, such as a
+ * header or comments, are skipped. */
+bool simLoadDelays(const char *name, SimDelays *delays)
+{
+	FILE *file;
+	char line[128];
+	long long value;
+	size_t capacity = 0;
+	int64_t *delay;
+
+	if ((file = fopen(name, "r")) == NULL)
+	{
+		perror(name);
+		return FALSE;
+	}
+
+	delays->name = name;
+	delays->delay = NULL;
+	delays->count = 0;
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if ((sscanf(line, "%lld", &value) != 1) || (value < 0)) continue;
+
+		if (delays->count == capacity)
+		{
+			capacity = capacity ? 2 * capacity : 4096;
+			if ((delay = realloc(delays->delay, capacity * sizeof(int64_t))) == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			delays->delay = delay;
+		}
+		delays->delay[delays->count++] = value;
+	}
+
+	fclose(file);
+
+	if (delays->count == 0)
+	{
+		fprintf(stderr, "%s: no delays found\n", name);
+		free(delays->delay);
+		return FALSE;
+	}
+
+	return TRUE;
+}
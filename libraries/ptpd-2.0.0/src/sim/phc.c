@@ -0,0 +1,274 @@
+/* phc.c */
+
+#include <math.h>
+#include "sim.h"
+
+/* Register values programmed by ETH_PTPStart() for a 144MHz HCLK, see
+ * ethernetif.h. */
+#define ADJ_FREQ_BASE_ADDEND      0x58C8EC2B
+#define ADJ_FREQ_BASE_INCREMENT   43
+
+/* The subseconds roll over into the seconds at 2^31. */
+#define SUBSECOND_ROLLOVER        0x80000000ULL
+
+/* The oscillator error is updated every 100ms of virtual time. */
+#define OSCILLATOR_STEP           100000000LL
+
+/* Timestamps are taken up to this long before the latest clock read, so
+ * the registers are only advanced this far behind it. */
+#define TIMESTAMP_WINDOW          1000000LL
+
+/* xorshift64* generator, deterministic for a given seed. */
+uint64_t simRandom(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Normally distributed value with the given standard deviation. */
+int32_t simGauss(uint64_t *state, int32_t sigma)
+{
+	double u1, u2;
+
+	if (sigma == 0) return 0;
+
+	/* Box-Muller transform of two uniform values in (0, 1]. */
+	u1 = ((simRandom(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+	u2 = ((simRandom(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+
+	return (int32_t) lrint(sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+void simToInternal(int64_t ns, TimeInternal *time)
+{
+	time->seconds = (int32_t) (ns / SIM_NSEC);
+	time->nanoseconds = (int32_t) (ns % SIM_NSEC);
+}
+
+int64_t simFromInternal(const TimeInternal *time)
+{
+	return time->seconds * SIM_NSEC + time->nanoseconds;
+}
+
+/* ETH_PTPSubSecond2NanoSecond() */
+static uint32_t subSecondToNanoSecond(uint32_t subSecondValue)
+{
+	return (uint32_t) ((subSecondValue * 1000000000ULL) >> 31);
+}
+
+/* ETH_PTPNanoSecond2SubSecond() */
+static uint32_t nanoSecondToSubSecond(uint32_t nanoSecondValue)
+{
+	return (uint32_t) ((nanoSecondValue * SUBSECOND_ROLLOVER) / 1000000000ULL);
+}
+
+/* HCLK cycles per nsec for the oscillator error at the given time. */
+static void simPhcRate(SimPhc *phc, int64_t at)
+{
+	double error = phc->drift + phc->walkError;
+
+	if (phc->period > 0) error += phc->temperature * sin(2.0 * M_PI * at / (phc->period * SIM_NSEC));
+
+	phc->rate = phc->hclk * (1.0 + error * 1e-9) * 1e-9;
+}
+
+/* Run the time stamp unit for a number of HCLK cycles. */
+static void simPhcTick(SimPhc *phc, uint64_t cycles)
+{
+	uint64_t total;
+	uint64_t subseconds;
+
+	if (phc->fine)
+	{
+		total = phc->accumulator + cycles * phc->addend;
+		phc->accumulator = (uint32_t) total;
+		cycles = total >> 32;
+	}
+
+	subseconds = phc->subseconds + cycles * phc->increment;
+	phc->seconds += (uint32_t) (subseconds / SUBSECOND_ROLLOVER);
+	phc->subseconds = (uint32_t) (subseconds % SUBSECOND_ROLLOVER);
+}
+
+/* Advance the registers to the given virtual time. */
+static void simPhcAdvance(SimPhc *phc, int64_t at)
+{
+	int64_t end;
+	double cycles;
+	uint64_t whole;
+
+	while (phc->at < at)
+	{
+		end = (at < phc->step) ? at : phc->step;
+
+		cycles = phc->phase + (end - phc->at) * phc->rate;
+		whole = (uint64_t) cycles;
+		phc->phase = cycles - whole;
+		simPhcTick(phc, whole);
+		phc->at = end;
+
+		if (end == phc->step)
+		{
+			phc->walkError += phc->walk * sqrt(OSCILLATOR_STEP * 1e-9) * simGauss(&phc->rng, 1000) * 1e-3;
+			phc->step += OSCILLATOR_STEP;
+			simPhcRate(phc, end);
+		}
+	}
+}
+
+/* The registers at the given time, which may be before the last read. */
+static void simPhcAt(SimPhc *phc, int64_t at, SimPhc *regs)
+{
+	if (at - TIMESTAMP_WINDOW > phc->at) simPhcAdvance(phc, at - TIMESTAMP_WINDOW);
+
+	*regs = *phc;
+	simPhcAdvance(regs, at);
+}
+
+/* Start the clock at zero as ETH_PTPStart() does.  A zero increment
+ * selects the one for a 20ns (fine) or one HCLK cycle (coarse) tick. */
+void simPhcInit(SimPhc *phc, double hclk, uint32_t increment, bool fine, uint64_t seed)
+{
+	memset(phc, 0, sizeof(*phc));
+
+	if (increment == 0) increment = fine ? ADJ_FREQ_BASE_INCREMENT : (uint32_t) lrint(SUBSECOND_ROLLOVER / hclk);
+
+	phc->hclk = hclk;
+	phc->fine = fine;
+	phc->increment = increment;
+	phc->rng = seed;
+	phc->step = OSCILLATOR_STEP;
+
+	/* The addend that makes the accumulator carry 2^31 / increment times a
+	 * second, which is ADJ_FREQ_BASE_ADDEND for the firmware settings. */
+	phc->baseAddend = (uint32_t) llrint(SUBSECOND_ROLLOVER * 4294967296.0 / (increment * hclk));
+	phc->addend = phc->baseAddend;
+
+	simPhcRate(phc, 0);
+}
+
+/* Oscillator errors: static in ppb, peak ppb of a temperature cycle of the
+ * given period in seconds, and random walk in ppb per square root second. */
+void simPhcOscillator(SimPhc *phc, int32_t drift, double temperature, double period, double walk)
+{
+	phc->drift = drift;
+	phc->temperature = temperature;
+	phc->period = period;
+	phc->walk = walk;
+	simPhcRate(phc, phc->at);
+}
+
+/* Clock time in nsec including the fraction of the current tick, for
+ * comparing clocks. */
+int64_t simPhcRead(SimPhc *phc, int64_t at)
+{
+	SimPhc regs;
+	double fraction;
+
+	simPhcAt(phc, at, &regs);
+
+	if (regs.fine) fraction = regs.accumulator / 4294967296.0;
+	else fraction = regs.phase;
+
+	return regs.seconds * SIM_NSEC +
+			(int64_t) ((regs.subseconds + fraction * regs.increment) * SIM_NSEC / SUBSECOND_ROLLOVER);
+}
+
+/* ETH_PTPTime_GetTime() */
+void simPhcGetTime(SimPhc *phc, int64_t at, TimeInternal *time)
+{
+	SimPhc regs;
+
+	simPhcAt(phc, at, &regs);
+	time->seconds = (int32_t) regs.seconds;
+	time->nanoseconds = (int32_t) subSecondToNanoSecond(regs.subseconds);
+}
+
+/* Snapshot of the registers for a packet sent or received at the given
+ * time, moved by the timestamp noise. */
+void simPhcStamp(SimPhc *phc, int64_t at, uint64_t *rng, TimeInternal *time)
+{
+	int64_t noise = simGauss(rng, phc->noise);
+
+	/* Keep the noise within the window that is still available. */
+	if (noise < -TIMESTAMP_WINDOW) noise = -TIMESTAMP_WINDOW;
+	at += noise;
+	if (at < phc->at) at = phc->at;
+
+	simPhcGetTime(phc, at, time);
+}
+
+/* ETH_PTPTime_SetTime(), initializes the registers with the time. */
+void simPhcSetTime(SimPhc *phc, int64_t at, const TimeInternal *time)
+{
+	uint32_t secondValue;
+	uint32_t nanoSecondValue;
+
+	simPhcAdvance(phc, at);
+
+	/* The sign bit is ignored when the time is initialized. */
+	if ((time->seconds < 0) || ((time->seconds == 0) && (time->nanoseconds < 0)))
+	{
+		secondValue = -time->seconds;
+		nanoSecondValue = -time->nanoseconds;
+	}
+	else
+	{
+		secondValue = time->seconds;
+		nanoSecondValue = time->nanoseconds;
+	}
+
+	phc->seconds = secondValue;
+	phc->subseconds = nanoSecondToSubSecond(nanoSecondValue) % SUBSECOND_ROLLOVER;
+}
+
+/* ETH_PTPTime_UpdateOffset(), adds the offset to the registers or
+ * subtracts it, borrowing from the seconds. */
+void simPhcUpdateOffset(SimPhc *phc, int64_t at, const TimeInternal *offset)
+{
+	bool negative;
+	uint32_t secondValue;
+	uint32_t subSecondValue;
+	uint64_t subseconds;
+
+	simPhcAdvance(phc, at);
+
+	negative = (offset->seconds < 0) || ((offset->seconds == 0) && (offset->nanoseconds < 0));
+	secondValue = negative ? -offset->seconds : offset->seconds;
+	subSecondValue = nanoSecondToSubSecond(negative ? -offset->nanoseconds : offset->nanoseconds);
+
+	if (negative)
+	{
+		phc->seconds -= secondValue;
+		if (phc->subseconds < subSecondValue)
+		{
+			phc->seconds--;
+			phc->subseconds += SUBSECOND_ROLLOVER;
+		}
+		phc->subseconds -= subSecondValue;
+	}
+	else
+	{
+		subseconds = (uint64_t) phc->subseconds + subSecondValue;
+		phc->seconds += secondValue + (uint32_t) (subseconds / SUBSECOND_ROLLOVER);
+		phc->subseconds = (uint32_t) (subseconds % SUBSECOND_ROLLOVER);
+	}
+}
+
+/* ETH_PTPTime_AdjFreq(), the 32-bit estimate of the addend for an
+ * adjustment in ppb.  The addend has no effect with the coarse method. */
+void simPhcAdjFreq(SimPhc *phc, int64_t at, int32_t adj)
+{
+	simPhcAdvance(phc, at);
+
+	if (adj > 5120000) adj = 5120000;
+	if (adj < -5120000) adj = -5120000;
+
+	phc->addend = (uint32_t) (((((275LL * adj) >> 8) * (phc->baseAddend >> 24)) >> 6) + phc->baseAddend);
+}
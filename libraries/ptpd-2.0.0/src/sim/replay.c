@@ -0,0 +1,154 @@
+/* replay.c */
+
+#include <math.h>
+#include <unistd.h>
+#include "sim.h"
+
+/**
+ *\file
+ * \brief Offline replay of the protocol engine
+ *
+ * Runs protocol.c, bmc.c and servo.c against a simulated network and PTP
+ * hardware clock, either as a synthetic master and slave pair or as a
+ * slave fed with the master messages of a pcap capture.  Reports how fast
+ * the slave converges and what the engine costs per message.
+ */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-r capture.pcap] [-s seconds] [-d drift_ppb] [-n noise_ns]\n"
+			"       [-D delay_ns] [-j jitter_ns] [-O offset_ns] [-S log_sync_interval]\n"
+			"       [-a ap] [-i ai] [-x s_delay] [-y s_offset] [-R delays] [-p]\n"
+			"       [-t threshold_ns] [-e seed] [-o csv] [-v]\n"
+			"       [-T temperature_ppb:period_s] [-w walk_ppb] [-H hclk_hz] [-I increment] [-c]\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	int opt;
+	int verbose = 0;
+	const char *csvName = NULL;
+	const char *delayName = NULL;
+	char *colon;
+	int64_t end;
+	int64_t wall;
+	int64_t cpu = 0;
+	uint32_t received = 0;
+	uint32_t dropped = 0;
+	uint32_t runs = 0;
+	struct timespec start;
+	SimConfig config;
+	SimDelays delays;
+	SimStats *stats;
+	SimNode *slave;
+
+	simConfigInit(&config);
+
+	while ((opt = getopt(argc, argv, "r:s:d:n:D:j:O:S:a:i:x:y:R:pt:e:o:vT:w:H:I:c")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': config.capture = optarg; break;
+			case 's': config.seconds = atof(optarg); break;
+			case 'd': config.drift = atoi(optarg); break;
+			case 'n': config.noise = atoi(optarg); break;
+			case 'D': config.pathDelay = atoll(optarg); break;
+			case 'j': config.jitter = atoi(optarg); break;
+			case 'O': config.offset = atoll(optarg); break;
+			case 'S': config.syncInterval = atoi(optarg); break;
+			case 'a': config.servo.ap = atoi(optarg); break;
+			case 'i': config.servo.ai = atoi(optarg); break;
+			case 'x': config.servo.sDelay = atoi(optarg); break;
+			case 'y': config.servo.sOffset = atoi(optarg); break;
+			case 'R': delayName = optarg; break;
+			case 'p': config.p2p = TRUE; break;
+			case 't': config.threshold = atoll(optarg); break;
+			case 'e': config.seed = strtoull(optarg, NULL, 0); break;
+			case 'o': csvName = optarg; break;
+			case 'v': verbose++; break;
+			case 'T':
+				config.temperature = strtod(optarg, &colon);
+				if (*colon != ':') usage(argv[0]);
+				config.period = atof(colon + 1);
+				break;
+			case 'w': config.walk = atof(optarg); break;
+			case 'H': config.hclk = atof(optarg); break;
+			case 'I': config.increment = strtoul(optarg, NULL, 0); break;
+			case 'c': config.fine = FALSE; break;
+			default: usage(argv[0]);
+		}
+	}
+	if ((optind != argc) || (config.capture && config.p2p) || (config.hclk <= 0)) usage(argv[0]);
+
+	log_level = LOG_ERROR + verbose;
+
+	if (delayName != NULL)
+	{
+		if (!simLoadDelays(delayName, &delays)) return 2;
+		config.delays = &delays;
+	}
+
+	if (csvName != NULL)
+	{
+		if ((config.csv = fopen(csvName, "w")) == NULL)
+		{
+			perror(csvName);
+			return 2;
+		}
+		fprintf(config.csv, "time,offset,measured_raw,measured,delay,drift,adj\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	end = simSession(&config);
+	wall = simElapsed(&start);
+	if (end < 0) return 2;
+
+	stats = &sim.stats;
+	slave = sim.slave;
+
+	for (i = 0; i < sim.nodeCount; i++)
+	{
+		cpu += sim.nodes[i]->cpu;
+		received += sim.nodes[i]->received;
+		dropped += sim.nodes[i]->dropped;
+		runs += sim.nodes[i]->runs;
+	}
+
+	if (config.capture != NULL)
+	{
+		printf("capture: %s, %u messages, %u delay responses\n", config.capture,
+				sim.capture.packets, sim.capture.responses);
+	}
+	if (config.delays != NULL)
+	{
+		printf("delays: %s, %zu samples\n", delays.name, delays.count);
+	}
+	printf("simulated: %.3f s in %.3f s (%.0fx real time)\n",
+			(double) end / SIM_NSEC, (double) wall / SIM_NSEC, wall > 0 ? (double) end / wall : 0.0);
+	printf("clock: %.0f Hz HCLK, %s update, increment %u, addend 0x%08X\n", slave->phc.hclk,
+			slave->phc.fine ? "fine" : "coarse", slave->phc.increment, slave->phc.baseAddend);
+	printf("messages: %u handled, %u dropped, %u thread wake ups\n", received, dropped, runs);
+	printf("cpu: %.0f ns per message, %.0f ns per wake up\n",
+			received ? (double) cpu / received : 0.0, runs ? (double) cpu / runs : 0.0);
+	printf("slave: %u clock updates, state %d, offset %lld ns, drift %d ppb\n",
+			stats->samples, slave->ptpClock.portDS.portState, (long long) stats->lastOffset,
+			slave->ptpClock.observedDrift);
+
+	if (config.csv != NULL) fclose(config.csv);
+
+	if (stats->converged < 0)
+	{
+		printf("servo: not converged (|offset| < %lld ns)\n", (long long) stats->threshold);
+		return 1;
+	}
+
+	printf("servo: converged after %.3f s (|offset| < %lld ns)\n",
+			(double) stats->converged / SIM_NSEC, (long long) stats->threshold);
+	printf("steady state: rms %.1f ns, max %lld ns over %u clock updates\n",
+			sqrt(stats->sumSquares / stats->settled), (long long) stats->maxOffset, stats->settled);
+
+	return 0;
+}
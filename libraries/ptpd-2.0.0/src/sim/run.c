@@ -0,0 +1,235 @@
+/* run.c */
+
+#include "sim.h"
+
+/* Start of the master clock, an arbitrary PTP time. */
+#define SIM_EPOCH  (1600000000LL * SIM_NSEC)
+
+/* HCLK of the board, see SystemInit(). */
+#define SIM_HCLK   144000000.0
+
+/* Length of a synthetic run without a set time. */
+#define SIM_DEFAULT_SECONDS  300
+
+__thread Sim sim;
+
+static __thread SimNode master;
+static __thread SimNode slave;
+
+/* The defaults of ptpd_thread(), a slave oscillator 20ppm off and a 10us
+ * path to the master. */
+void simConfigInit(SimConfig *config)
+{
+	memset(config, 0, sizeof(*config));
+
+	config->pathDelay = 10000;
+	config->drift = 20000;
+	config->noise = 20;
+	config->offset = 100000;
+	config->hclk = SIM_HCLK;
+	config->fine = TRUE;
+	config->syncInterval = DEFAULT_SYNC_INTERVAL;
+	config->servo.noResetClock = DEFAULT_NO_RESET_CLOCK;
+	config->servo.noAdjust = NO_ADJUST;
+	config->servo.ap = DEFAULT_AP;
+	config->servo.ai = DEFAULT_AI;
+	config->servo.sDelay = DEFAULT_DELAY_S;
+	config->servo.sOffset = DEFAULT_OFFSET_S;
+	config->threshold = 1000;
+	config->seed = 1;
+}
+
+/* Run-time options as set by ptpd_thread(). */
+static void simNodeInit(SimNode *node, const char *name, int index, const SimConfig *config)
+{
+	int i;
+	RunTimeOpts *rtOpts = &node->rtOpts;
+
+	memset(node, 0, sizeof(*node));
+	node->name = name;
+	node->mac[0] = 0x02;
+	node->mac[5] = (octet_t) index;
+	node->rng = config->seed * 0x9E3779B97F4A7C15ULL + index + 1;
+	for (i = 0; i < TIMER_ARRAY_SIZE; i++) node->timerDeadline[i] = -1;
+
+	rtOpts->announceInterval = DEFAULT_ANNOUNCE_INTERVAL;
+	rtOpts->syncInterval = config->syncInterval;
+	rtOpts->clockQuality.clockAccuracy = DEFAULT_CLOCK_ACCURACY;
+	rtOpts->clockQuality.clockClass = DEFAULT_CLOCK_CLASS;
+	rtOpts->clockQuality.offsetScaledLogVariance = DEFAULT_CLOCK_VARIANCE;
+	rtOpts->priority1 = DEFAULT_PRIORITY1;
+	rtOpts->priority2 = DEFAULT_PRIORITY2;
+	rtOpts->domainNumber = DEFAULT_DOMAIN_NUMBER;
+	rtOpts->slaveOnly = SLAVE_ONLY;
+	rtOpts->currentUtcOffset = DEFAULT_UTC_OFFSET;
+	rtOpts->servo = config->servo;
+	rtOpts->inboundLatency.nanoseconds = DEFAULT_INBOUND_LATENCY;
+	rtOpts->outboundLatency.nanoseconds = DEFAULT_OUTBOUND_LATENCY;
+	rtOpts->maxForeignRecords = DEFAULT_MAX_FOREIGN_RECORDS;
+	rtOpts->stats = PTP_TEXT_STATS;
+	rtOpts->delayMechanism = config->p2p ? P2P : DEFAULT_DELAY_MECHANISM;
+	rtOpts->transport = DEFAULT_TRANSPORT;
+
+	sim.nodes[sim.nodeCount++] = node;
+}
+
+/* Options set by management messages only last for the run. */
+void saveRunTimeOpts(const RunTimeOpts *old, const RunTimeOpts *rtOpts)
+{
+}
+
+/* Start the time stamp unit of the node and set its clock. */
+static void simNodeClock(SimNode *node, const SimConfig *config, int64_t time)
+{
+	TimeInternal start;
+
+	simPhcInit(&node->phc, config->hclk, config->increment, config->fine, simRandom(&node->rng));
+	node->phc.noise = config->noise;
+	simToInternal(time, &start);
+	simPhcSetTime(&node->phc, 0, &start);
+}
+
+int64_t simElapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * SIM_NSEC + (now.tv_nsec - start->tv_nsec);
+}
+
+/* One wake up of the PTP thread, as in ptpd_thread(). */
+static void simRun(SimNode *node)
+{
+	struct timespec start;
+
+	sim.current = node;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	do
+	{
+		doState(&node->ptpClock);
+	}
+	while (netSelect(&node->ptpClock.netPath, 0) > 0);
+
+	node->cpu += simElapsed(&start);
+	node->runs++;
+	node->wake = sim.now + SIM_POLL_NS;
+}
+
+/* Advance the virtual time from event to event until the end time. */
+static void simLoop(int64_t end)
+{
+	int i;
+	int64_t next;
+	int64_t timer;
+	SimNode *node;
+
+	for (;;)
+	{
+		next = simNextPacket();
+		for (i = 0; i < sim.nodeCount; i++)
+		{
+			node = sim.nodes[i];
+			if ((next < 0) || (node->wake < next)) next = node->wake;
+			timer = simNextTimer(node);
+			if ((timer >= 0) && (timer < next)) next = timer;
+		}
+
+		if (next > end) break;
+		sim.now = next;
+
+		simDeliver(sim.now);
+		for (i = 0; i < sim.nodeCount; i++)
+		{
+			if (simUpdateTimers(sim.nodes[i], sim.now)) sim.nodes[i]->wake = sim.now;
+		}
+
+		for (i = 0; i < sim.nodeCount; i++)
+		{
+			if (sim.nodes[i]->wake <= sim.now) simRun(sim.nodes[i]);
+		}
+	}
+
+	sim.now = end;
+}
+
+/* Return the packets of the previous run to the free list of the thread
+ * and clear the rest of its state. */
+static void simReset(void)
+{
+	int i;
+	SimPacket *p;
+	SimPacket *free;
+
+	for (i = 0; i < sim.nodeCount; i++)
+	{
+		sim.current = sim.nodes[i];
+		ptpdShutdown(&sim.nodes[i]->ptpClock);
+	}
+
+	while ((p = sim.pending) != NULL)
+	{
+		sim.pending = p->next;
+		p->next = sim.free;
+		sim.free = p;
+	}
+
+	free = sim.free;
+	memset(&sim, 0, sizeof(sim));
+	sim.free = free;
+}
+
+/* Run the slave, and for a synthetic run a master ahead of it with a
+ * better priority and an ideal oscillator, for the configured time.  The
+ * nodes and the slave statistics stay in the thread state until the next
+ * run.  Returns the virtual run time, or -1 if the capture cannot be
+ * read. */
+int64_t simSession(const SimConfig *config)
+{
+	int i;
+	int64_t end;
+
+	simReset();
+	sim.pathDelay = config->pathDelay;
+	sim.jitter = config->jitter;
+	sim.delays = config->delays;
+	sim.stats.threshold = config->threshold;
+	sim.stats.csv = config->csv;
+	sim.stats.converged = -1;
+
+	if (config->capture == NULL)
+	{
+		simNodeInit(&master, "master", 1, config);
+		master.rtOpts.slaveOnly = FALSE;
+		master.rtOpts.priority1 = 128;
+		simNodeClock(&master, config, SIM_EPOCH);
+	}
+
+	simNodeInit(&slave, "slave", 2, config);
+	simNodeClock(&slave, config, config->capture ? 0 : SIM_EPOCH + config->offset);
+	simPhcOscillator(&slave.phc, config->drift, config->temperature, config->period, config->walk);
+	sim.slave = &slave;
+
+	if (config->capture != NULL)
+	{
+		sim.capture.enabled = TRUE;
+		end = simLoadCapture(config->capture, &slave);
+		if (end < 0) return -1;
+		if (config->seconds > 0) end = (int64_t) (config->seconds * SIM_NSEC);
+	}
+	else
+	{
+		end = (int64_t) ((config->seconds > 0 ? config->seconds : SIM_DEFAULT_SECONDS) * SIM_NSEC);
+	}
+
+	for (i = 0; i < sim.nodeCount; i++)
+	{
+		sim.current = sim.nodes[i];
+		ptpdStartup(&sim.nodes[i]->ptpClock, &sim.nodes[i]->rtOpts, sim.nodes[i]->foreign);
+	}
+
+	simLoop(end);
+
+	return end;
+}
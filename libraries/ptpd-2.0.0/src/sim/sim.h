@@ -0,0 +1,239 @@
+/* sim.h */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+/**
+ *\file
+ * \brief Simulated dep layer for replaying the protocol engine on the host
+ *
+ * Every ptpd instance is a node with its own PtpClock, timers and PTP
+ * hardware clock.  Time is virtual and advances from one event (a packet
+ * arrival, a timer or the 100ms wake up of the PTP thread) to the next, so
+ * runs are deterministic for a given seed and much faster than real time.
+ * The state of a run is thread local, so independent runs can share the
+ * threads of a process.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include "../ptpd.h"
+
+#define SIM_NSEC          1000000000LL
+
+/* The PTP thread waits at most 100ms for an alert, see ptpd_thread(). */
+#define SIM_POLL_NS       100000000LL
+
+#define SIM_MAX_NODES     2
+
+/** \name Simulated PTP hardware clock
+ * Model of the STM32F4 MAC time stamp unit as programmed by ethernetif.c.
+ * Every HCLK cycle adds the addend to a 32-bit accumulator, and every
+ * carry (every cycle with the coarse update method) adds the subsecond
+ * increment to the subsecond register, which rolls over into the seconds
+ * at 2^31.  HCLK comes from an oscillator with a static error, a
+ * sinusoidal temperature driven error and random walk frequency noise. */
+/**\{*/
+typedef struct
+{
+	double    hclk;         /* nominal HCLK frequency in Hz */
+	int32_t   drift;        /* static oscillator error in ppb */
+	double    temperature;  /* peak temperature driven error in ppb */
+	double    period;       /* temperature cycle in seconds */
+	double    walk;         /* random walk frequency noise in ppb/sqrt(s) */
+	double    walkError;    /* current random walk error in ppb */
+	double    rate;         /* current HCLK cycles per nsec */
+	double    phase;        /* fraction of the current HCLK cycle */
+	int64_t   step;         /* virtual time of the next oscillator update */
+	uint64_t  rng;          /* oscillator noise generator */
+
+	bool      fine;         /* fine update method */
+	uint32_t  increment;    /* subsecond increment register */
+	uint32_t  baseAddend;   /* addend for the nominal rate */
+	uint32_t  addend;       /* addend register */
+	uint32_t  accumulator;
+	uint32_t  seconds;      /* system time seconds register */
+	uint32_t  subseconds;   /* system time subseconds register */
+	int64_t   at;           /* virtual time of the register values */
+
+	int32_t   noise;        /* timestamp noise standard deviation in nsec */
+} SimPhc;
+/** \}*/
+
+/** \name Packet in flight or waiting in a node queue */
+/**\{*/
+typedef struct SimPacket
+{
+	struct SimPacket *next;
+	int64_t   at;           /* virtual arrival time */
+	struct SimNode *dst;
+	bool      captured;     /* read from the capture file */
+	TimeInternal stamp;     /* receive timestamp */
+	int16_t   length;
+	octet_t   data[PACKET_SIZE];
+} SimPacket;
+/** \}*/
+
+/** \name A ptpd instance */
+/**\{*/
+typedef struct SimNode
+{
+	const char *name;
+	PtpClock  ptpClock;
+	RunTimeOpts rtOpts;
+	ForeignMasterRecord foreign[DEFAULT_MAX_FOREIGN_RECORDS];
+	SimPhc    phc;
+	uint64_t  rng;
+	octet_t   mac[NETIF_MAX_HWADDR_LEN];
+
+	int64_t   timerDeadline[TIMER_ARRAY_SIZE];
+	uint32_t  timerInterval[TIMER_ARRAY_SIZE];
+	bool      timerExpired[TIMER_ARRAY_SIZE];
+
+	int64_t   sent;         /* arrival time of the last packet sent */
+	int64_t   wake;         /* next run of the PTP thread */
+	uint32_t  received;
+	uint32_t  dropped;
+	uint32_t  runs;
+	int64_t   cpu;          /* host nsec spent in doState() */
+} SimNode;
+/** \}*/
+
+/** \name Servo statistics of the slave */
+/**\{*/
+typedef struct
+{
+	int64_t   threshold;    /* converged when |offset| stays below this */
+	int64_t   converged;    /* time of the first sample after the last miss */
+	uint32_t  samples;
+	uint32_t  settled;      /* samples since convergence */
+	double    sumSquares;
+	int64_t   maxOffset;
+	int64_t   lastOffset;
+	FILE      *csv;
+} SimStats;
+/** \}*/
+
+/** \name Capture replay state */
+/**\{*/
+typedef struct
+{
+	bool      enabled;
+	bool      valid;        /* master reference is known */
+	bool      haveMaster;
+	octet_t   master[10];   /* source port identity of the followed master */
+	bool      waitingForFollowUp;
+	uint16_t  syncSequenceId;
+	int64_t   syncArrival;
+	int64_t   origin;       /* master time when the last Sync was sent */
+	octet_t   header[HEADER_LENGTH]; /* header of the last master message */
+	uint32_t  packets;
+	uint32_t  responses;
+} SimCapture;
+/** \}*/
+
+/** \name Recorded one way delays
+ * Applied in turn to the messages of a run in place of the fixed path
+ * delay and jitter. */
+/**\{*/
+typedef struct
+{
+	const char *name;
+	int64_t   *delay;       /* nsec */
+	size_t    count;
+} SimDelays;
+/** \}*/
+
+/** \name Settings of a run */
+/**\{*/
+typedef struct
+{
+	const char *capture;    /* pcap file to replay, NULL for a synthetic master */
+	const SimDelays *delays; /* NULL for the fixed path delay */
+	double    seconds;      /* virtual run time, 0 for the whole capture */
+	int64_t   pathDelay;
+	int32_t   jitter;
+	int32_t   drift;        /* static slave oscillator error in ppb */
+	double    temperature;  /* peak temperature driven error in ppb */
+	double    period;       /* temperature cycle in seconds */
+	double    walk;         /* random walk frequency noise in ppb/sqrt(s) */
+	double    hclk;
+	uint32_t  increment;    /* 0 for the firmware setting */
+	bool      fine;
+	int32_t   noise;        /* timestamp noise in nsec */
+	int64_t   offset;       /* initial slave offset in nsec */
+	int8_t    syncInterval;
+	Servo     servo;
+	bool      p2p;
+	int64_t   threshold;
+	uint64_t  seed;
+	FILE      *csv;         /* servo samples, may be NULL */
+} SimConfig;
+/** \}*/
+
+typedef struct
+{
+	int64_t   now;
+	SimNode   *nodes[SIM_MAX_NODES];
+	int       nodeCount;
+	SimNode   *current;     /* node whose PTP thread is running */
+	SimPacket *pending;     /* packets in flight, by arrival time */
+	SimPacket *last;        /* last packet in flight */
+	SimPacket *free;
+	int64_t   pathDelay;
+	int32_t   jitter;
+	const SimDelays *delays;
+	size_t    delayIndex;
+	SimNode   *slave;
+	SimCapture capture;
+	SimStats  stats;
+} Sim;
+
+extern __thread Sim sim;
+
+/** \name run.c */
+/**\{*/
+void simConfigInit(SimConfig*);
+int64_t simSession(const SimConfig*);
+int64_t simElapsed(const struct timespec*);
+/** \}*/
+
+/** \name phc.c */
+/**\{*/
+uint64_t simRandom(uint64_t*);
+int32_t simGauss(uint64_t*, int32_t);
+void simToInternal(int64_t, TimeInternal*);
+int64_t simFromInternal(const TimeInternal*);
+void simPhcInit(SimPhc*, double, uint32_t, bool, uint64_t);
+void simPhcOscillator(SimPhc*, int32_t, double, double, double);
+int64_t simPhcRead(SimPhc*, int64_t);
+void simPhcGetTime(SimPhc*, int64_t, TimeInternal*);
+void simPhcStamp(SimPhc*, int64_t, uint64_t*, TimeInternal*);
+void simPhcSetTime(SimPhc*, int64_t, const TimeInternal*);
+void simPhcUpdateOffset(SimPhc*, int64_t, const TimeInternal*);
+void simPhcAdjFreq(SimPhc*, int64_t, int32_t);
+/** \}*/
+
+/** \name net.c */
+/**\{*/
+SimNode *simNodeOf(const PtpClock*);
+void simInject(SimNode*, int64_t, const octet_t*, int16_t, bool);
+int64_t simNextPacket(void);
+void simDeliver(int64_t);
+int64_t simReferenceTime(int64_t);
+/** \}*/
+
+/** \name timer.c */
+/**\{*/
+int64_t simNextTimer(const SimNode*);
+bool simUpdateTimers(SimNode*, int64_t);
+/** \}*/
+
+/** \name pcap.c */
+/**\{*/
+int64_t simLoadCapture(const char*, SimNode*);
+bool simLoadDelays(const char*, SimDelays*);
+/** \}*/
+
+#endif /* SIM_H_*/
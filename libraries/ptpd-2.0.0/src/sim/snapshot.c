@@ -0,0 +1,23 @@
+/* snapshot.c */
+
+#include "sim.h"
+
+/* The simulated nodes share one thread, the replay reads the clock state
+ * directly. */
+
+void snapshotUpdate(const PtpClock *ptpClock, int32_t adj)
+{
+}
+
+void snapshotState(const PtpClock *ptpClock)
+{
+}
+
+void snapshotRead(PtpSnapshot *copy)
+{
+	memset(copy, 0, sizeof(*copy));
+}
+
+void snapshotNotify(void *thread, int32_t signals)
+{
+}
@@ -0,0 +1,82 @@
+/* sys_time.c */
+
+#include <stdarg.h>
+#include "sim.h"
+
+/* Messages go to stderr instead of the USART. */
+volatile int log_level = LOG_ERROR;
+
+void log_write(const char *str, int len)
+{
+	fwrite(str, 1, len, stderr);
+}
+
+void log_printf(int level, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!log_enabled(level)) return;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+/* Log a message with the virtual time and the clock time of the node. */
+void logMessage(int level, char tag, const char *fmt, ...)
+{
+	va_list ap;
+	TimeInternal tmpTime;
+
+	if (!log_enabled(level)) return;
+
+	getTime(&tmpTime);
+	fprintf(stderr, "%lld.%09lld %s (%c %d.%09d) ", sim.now / SIM_NSEC, sim.now % SIM_NSEC,
+			sim.current->name, tag, tmpTime.seconds, tmpTime.nanoseconds);
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+void getTime(TimeInternal *time)
+{
+	simPhcGetTime(&sim.current->phc, sim.now, time);
+}
+
+void setTime(const TimeInternal *time)
+{
+	simPhcSetTime(&sim.current->phc, sim.now, time);
+	DBG("resetting system clock to %d sec %d nsec\n", time->seconds, time->nanoseconds);
+}
+
+void updateTime(const TimeInternal *time)
+{
+	TimeInternal timeoffset;
+
+	DBGV("updateTime: %d sec %d nsec\n", time->seconds, time->nanoseconds);
+
+	timeoffset.seconds = -time->seconds;
+	timeoffset.nanoseconds = -time->nanoseconds;
+
+	simPhcUpdateOffset(&sim.current->phc, sim.now, &timeoffset);
+}
+
+uint32_t getRand(uint32_t randMax)
+{
+	return (uint32_t) (simRandom(&sim.current->rng) % randMax);
+}
+
+bool adjFreq(int32_t adj)
+{
+	DBGV("adjFreq %d\n", adj);
+
+	if (adj > ADJ_FREQ_MAX)
+		adj = ADJ_FREQ_MAX;
+	else if (adj < -ADJ_FREQ_MAX)
+		adj = -ADJ_FREQ_MAX;
+
+	simPhcAdjFreq(&sim.current->phc, sim.now, adj);
+
+	return TRUE;
+}
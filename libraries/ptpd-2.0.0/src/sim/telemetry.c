@@ -0,0 +1,70 @@
+/* telemetry.c */
+
+#include "sim.h"
+
+/* The servo samples of the replay go to the statistics and the CSV file
+ * rather than to a collector. */
+
+static __thread TimeInternal rawOffset;
+
+void telemetryInit(void)
+{
+}
+
+void telemetryConfig(uint32_t collector, uint16_t port, uint32_t decimation)
+{
+}
+
+void telemetryStats(TelemetryStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+void telemetryOffset(const PtpClock *ptpClock, const TimeInternal *t1, const TimeInternal *t2)
+{
+	rawOffset = ptpClock->currentDS.offsetFromMaster;
+}
+
+/* Compare the clock of the node with the master at every clock update.
+ * The slave has converged at the first sample after the last one with an
+ * offset above the threshold, the steady state statistics cover the
+ * samples from there on. */
+void telemetryClock(const PtpClock *ptpClock, int32_t adj)
+{
+	int64_t offset;
+	int64_t magnitude;
+	SimStats *stats = &sim.stats;
+	const TimeInternal *delay;
+
+	offset = simPhcRead(&simNodeOf(ptpClock)->phc, sim.now) - simReferenceTime(sim.now);
+	magnitude = (offset < 0) ? -offset : offset;
+
+	stats->samples++;
+	stats->lastOffset = offset;
+
+	if (magnitude >= stats->threshold)
+	{
+		stats->converged = -1;
+		stats->settled = 0;
+		stats->sumSquares = 0;
+		stats->maxOffset = 0;
+	}
+	else
+	{
+		if (stats->settled == 0) stats->converged = sim.now;
+		stats->settled++;
+		stats->sumSquares += (double) offset * offset;
+		if (magnitude > stats->maxOffset) stats->maxOffset = magnitude;
+	}
+
+	if (stats->csv == NULL) return;
+
+	delay = (ptpClock->portDS.delayMechanism == P2P) ?
+			&ptpClock->portDS.peerMeanPathDelay : &ptpClock->currentDS.meanPathDelay;
+
+	fprintf(stats->csv, "%lld.%09lld,%lld,%lld,%lld,%lld,%d,%d\n",
+			sim.now / SIM_NSEC, sim.now % SIM_NSEC, (long long) offset,
+			(long long) simFromInternal(&rawOffset),
+			(long long) simFromInternal(&ptpClock->currentDS.offsetFromMaster),
+			(long long) simFromInternal(delay), ptpClock->observedDrift, adj);
+}
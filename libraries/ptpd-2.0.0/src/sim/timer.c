@@ -0,0 +1,94 @@
+/* timer.c */
+
+#include "sim.h"
+
+/* The timers are periodic like the RTX timers of dep/timer.c.  A timer
+ * that expired stays armed with the same interval until it is stopped or
+ * started again. */
+
+void initTimer(void)
+{
+	int32_t i;
+	SimNode *node = sim.current;
+
+	DBG("initTimer\n");
+
+	for (i = 0; i < TIMER_ARRAY_SIZE; i++)
+	{
+		node->timerDeadline[i] = -1;
+		node->timerExpired[i] = FALSE;
+	}
+}
+
+void timerStop(int32_t index)
+{
+	SimNode *node = sim.current;
+
+	if (index >= TIMER_ARRAY_SIZE) return;
+
+	DBGV("timerStop: stop timer %d\n", index);
+	node->timerDeadline[index] = -1;
+	node->timerExpired[index] = FALSE;
+}
+
+void timerStart(int32_t index, uint32_t interval_ms)
+{
+	SimNode *node = sim.current;
+
+	if (index >= TIMER_ARRAY_SIZE) return;
+
+	/* RTX runs a zero interval timer on the next tick. */
+	if (interval_ms == 0) interval_ms = 1;
+
+	DBGV("timerStart: set timer %d to %d\n", index, interval_ms);
+	node->timerInterval[index] = interval_ms;
+	node->timerDeadline[index] = sim.now + interval_ms * 1000000LL;
+	node->timerExpired[index] = FALSE;
+}
+
+bool timerExpired(int32_t index)
+{
+	SimNode *node = sim.current;
+
+	if (index >= TIMER_ARRAY_SIZE) return FALSE;
+
+	if (!node->timerExpired[index]) return FALSE;
+	DBGV("timerExpired: timer %d expired\n", index);
+	node->timerExpired[index] = FALSE;
+
+	return TRUE;
+}
+
+/* Deadline of the next timer of the node, -1 if none is running. */
+int64_t simNextTimer(const SimNode *node)
+{
+	int32_t i;
+	int64_t next = -1;
+
+	for (i = 0; i < TIMER_ARRAY_SIZE; i++)
+	{
+		if (node->timerDeadline[i] < 0) continue;
+		if ((next < 0) || (node->timerDeadline[i] < next)) next = node->timerDeadline[i];
+	}
+
+	return next;
+}
+
+/* Mark the timers due by now as expired and rearm them.  Returns TRUE if
+ * any expired, which alerts the PTP thread. */
+bool simUpdateTimers(SimNode *node, int64_t now)
+{
+	int32_t i;
+	bool alert = FALSE;
+
+	for (i = 0; i < TIMER_ARRAY_SIZE; i++)
+	{
+		if ((node->timerDeadline[i] < 0) || (node->timerDeadline[i] > now)) continue;
+
+		node->timerExpired[i] = TRUE;
+		while (node->timerDeadline[i] <= now) node->timerDeadline[i] += node->timerInterval[i] * 1000000LL;
+		alert = TRUE;
+	}
+
+	return alert;
+}
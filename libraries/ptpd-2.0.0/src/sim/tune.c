@@ -0,0 +1,337 @@
+/* tune.c */
+
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "sim.h"
+
+/**
+ *\file
+ * \brief Servo parameter sweep
+ *
+ * Replays every combination of the ap, ai, sDelay, sOffset and sync
+ * interval values on a pool of threads, each run with its own thread local
+ * simulation.  Every combination runs against each delay trace (or the
+ * fixed path delay) with each seed, and is scored on the worst settling
+ * time and the RMS and maximum of the steady state offset over all of its
+ * runs.  Prints the best combinations and the constants.h settings of the
+ * best one.
+ */
+
+#define TUNE_MAX_VALUES   64
+#define TUNE_MAX_TRACES   16
+
+typedef struct
+{
+	int       count;
+	int       value[TUNE_MAX_VALUES];
+} TuneRange;
+
+typedef struct
+{
+	int16_t   ap;
+	int16_t   ai;
+	int16_t   sDelay;
+	int16_t   sOffset;
+	int8_t    syncInterval;
+	uint32_t  failed;       /* runs that did not converge */
+	double    settle;       /* worst settling time in seconds */
+	double    rms;          /* steady state over all runs */
+	int64_t   max;
+	double    score;
+} TuneResult;
+
+static SimConfig base;
+static SimDelays traces[TUNE_MAX_TRACES];
+static int traceCount;
+static int seeds = 1;
+
+/* Score per second of settling time, per nsec of RMS and of maximum offset. */
+static double weight[3] = {1.0, 1.0, 0.1};
+
+static TuneResult *results;
+static int resultCount;
+static int nextResult;  /* next combination to run, shared by the workers */
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [-a ap] [-i ai] [-x s_delay] [-y s_offset] [-S log_sync_interval]\n"
+			"       [-R delays]... [-N seeds] [-P threads] [-k top] [-W settle:rms:max] [-o csv]\n"
+			"       [-s seconds] [-d drift_ppb] [-n noise_ns] [-D delay_ns] [-j jitter_ns]\n"
+			"       [-O offset_ns] [-T temperature_ppb:period_s] [-w walk_ppb] [-t threshold_ns]\n"
+			"       [-e seed]\n"
+			"values are lists of numbers and first:last[:step] ranges, as in 1,2,4:16:4\n", name);
+	exit(2);
+}
+
+/* Parse a list of values within the limits. */
+static bool tuneParseRange(const char *text, TuneRange *range, int min, int max)
+{
+	int first;
+	int last;
+	int step;
+	int value;
+	int n;
+
+	range->count = 0;
+
+	for (;;)
+	{
+		step = 1;
+		if (sscanf(text, "%d%n", &first, &n) != 1) return FALSE;
+		text += n;
+		last = first;
+		if (*text == ':')
+		{
+			if (sscanf(text + 1, "%d%n", &last, &n) != 1) return FALSE;
+			text += n + 1;
+			if ((*text == ':') && ((sscanf(text + 1, "%d%n", &step, &n) != 1) || (step < 1))) return FALSE;
+			if (*text == ':') text += n + 1;
+		}
+
+		if ((first < min) || (last > max) || (first > last)) return FALSE;
+
+		for (value = first; value <= last; value += step)
+		{
+			if (range->count == TUNE_MAX_VALUES) return FALSE;
+			range->value[range->count++] = value;
+		}
+
+		if (*text == '\0') return TRUE;
+		if (*text++ != ',') return FALSE;
+	}
+}
+
+/* Run a combination against every trace and seed. */
+static void tuneRun(TuneResult *result)
+{
+	int t;
+	int s;
+	double sumSquares = 0;
+	uint32_t settled = 0;
+	double settle;
+	SimConfig config = base;
+	SimStats *stats = &sim.stats;
+
+	config.servo.ap = result->ap;
+	config.servo.ai = result->ai;
+	config.servo.sDelay = result->sDelay;
+	config.servo.sOffset = result->sOffset;
+	config.syncInterval = result->syncInterval;
+
+	for (t = 0; t < (traceCount ? traceCount : 1); t++)
+	{
+		config.delays = traceCount ? &traces[t] : NULL;
+
+		for (s = 0; s < seeds; s++)
+		{
+			config.seed = base.seed + s;
+			simSession(&config);
+
+			if (stats->converged < 0)
+			{
+				result->failed++;
+				continue;
+			}
+
+			settle = (double) stats->converged / SIM_NSEC;
+			if (settle > result->settle) result->settle = settle;
+			if (stats->maxOffset > result->max) result->max = stats->maxOffset;
+			sumSquares += stats->sumSquares;
+			settled += stats->settled;
+		}
+	}
+
+	if (settled > 0) result->rms = sqrt(sumSquares / settled);
+
+	if (result->failed)
+		result->score = INFINITY;
+	else
+		result->score = weight[0] * result->settle + weight[1] * result->rms + weight[2] * result->max;
+}
+
+static void *tuneWorker(void *arg)
+{
+	int i;
+
+	while ((i = __atomic_fetch_add(&nextResult, 1, __ATOMIC_RELAXED)) < resultCount)
+	{
+		tuneRun(&results[i]);
+	}
+
+	return NULL;
+}
+
+/* Best score first, then the order of the sweep. */
+static int tuneCompare(const void *a, const void *b)
+{
+	const TuneResult *ra = a;
+	const TuneResult *rb = b;
+
+	if (ra->score < rb->score) return -1;
+	if (ra->score > rb->score) return 1;
+
+	return (ra < rb) ? -1 : (ra > rb);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	int opt;
+	int a, b, c, d, e;
+	int top = 10;
+	int threadCount;
+	int failed = 0;
+	int64_t wall;
+	char *colon;
+	const char *csvName = NULL;
+	FILE *csv = NULL;
+	pthread_t *threads;
+	struct timespec start;
+	TuneResult *r;
+	TuneRange ap;
+	TuneRange ai;
+	TuneRange sDelay;
+	TuneRange sOffset;
+	TuneRange syncInterval;
+
+	simConfigInit(&base);
+	threadCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+	tuneParseRange("1,2,4,8,16", &ap, 1, 32767);
+	tuneParseRange("4,8,16,32,64,128", &ai, 1, 32767);
+	tuneParseRange("2:8:2", &sDelay, 0, 15);
+	tuneParseRange("0:3", &sOffset, 0, 15);
+	tuneParseRange("-2:1", &syncInterval, -7, 4);
+
+	while ((opt = getopt(argc, argv, "a:i:x:y:S:R:N:P:k:W:o:s:d:n:D:j:O:T:w:t:e:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a': if (!tuneParseRange(optarg, &ap, 1, 32767)) usage(argv[0]); break;
+			case 'i': if (!tuneParseRange(optarg, &ai, 1, 32767)) usage(argv[0]); break;
+			case 'x': if (!tuneParseRange(optarg, &sDelay, 0, 15)) usage(argv[0]); break;
+			case 'y': if (!tuneParseRange(optarg, &sOffset, 0, 15)) usage(argv[0]); break;
+			case 'S': if (!tuneParseRange(optarg, &syncInterval, -7, 4)) usage(argv[0]); break;
+			case 'R':
+				if (traceCount == TUNE_MAX_TRACES) usage(argv[0]);
+				if (!simLoadDelays(optarg, &traces[traceCount])) return 2;
+				traceCount++;
+				break;
+			case 'N': seeds = atoi(optarg); break;
+			case 'P': threadCount = atoi(optarg); break;
+			case 'k': top = atoi(optarg); break;
+			case 'W':
+				if (sscanf(optarg, "%lf:%lf:%lf", &weight[0], &weight[1], &weight[2]) != 3) usage(argv[0]);
+				break;
+			case 'o': csvName = optarg; break;
+			case 's': base.seconds = atof(optarg); break;
+			case 'd': base.drift = atoi(optarg); break;
+			case 'n': base.noise = atoi(optarg); break;
+			case 'D': base.pathDelay = atoll(optarg); break;
+			case 'j': base.jitter = atoi(optarg); break;
+			case 'O': base.offset = atoll(optarg); break;
+			case 'T':
+				base.temperature = strtod(optarg, &colon);
+				if (*colon != ':') usage(argv[0]);
+				base.period = atof(colon + 1);
+				break;
+			case 'w': base.walk = atof(optarg); break;
+			case 't': base.threshold = atoll(optarg); break;
+			case 'e': base.seed = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]);
+		}
+	}
+	if ((optind != argc) || (seeds < 1) || (threadCount < 1)) usage(argv[0]);
+
+	if ((csvName != NULL) && ((csv = fopen(csvName, "w")) == NULL))
+	{
+		perror(csvName);
+		return 2;
+	}
+
+	resultCount = ap.count * ai.count * sDelay.count * sOffset.count * syncInterval.count;
+	results = calloc(resultCount, sizeof(TuneResult));
+	threads = calloc(threadCount, sizeof(pthread_t));
+	if ((results == NULL) || (threads == NULL))
+	{
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	r = results;
+	for (a = 0; a < ap.count; a++)
+		for (b = 0; b < ai.count; b++)
+			for (c = 0; c < sDelay.count; c++)
+				for (d = 0; d < sOffset.count; d++)
+					for (e = 0; e < syncInterval.count; e++)
+					{
+						r->ap = ap.value[a];
+						r->ai = ai.value[b];
+						r->sDelay = sDelay.value[c];
+						r->sOffset = sOffset.value[d];
+						r->syncInterval = syncInterval.value[e];
+						r++;
+					}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < threadCount; i++)
+	{
+		if (pthread_create(&threads[i], NULL, tuneWorker, NULL) != 0)
+		{
+			fprintf(stderr, "cannot start thread %d\n", i);
+			return 1;
+		}
+	}
+	for (i = 0; i < threadCount; i++) pthread_join(threads[i], NULL);
+	wall = simElapsed(&start);
+
+	if (csv != NULL)
+	{
+		fprintf(csv, "ap,ai,s_delay,s_offset,log_sync_interval,failed,settle_s,rms_ns,max_ns,score\n");
+		for (i = 0; i < resultCount; i++)
+		{
+			r = &results[i];
+			fprintf(csv, "%d,%d,%d,%d,%d,%u,%.3f,%.1f,%lld,%.3f\n", r->ap, r->ai, r->sDelay, r->sOffset,
+					r->syncInterval, r->failed, r->settle, r->rms, (long long) r->max, r->score);
+		}
+		fclose(csv);
+	}
+
+	qsort(results, resultCount, sizeof(TuneResult), tuneCompare);
+
+	for (i = 0; i < resultCount; i++)
+	{
+		if (results[i].failed) failed++;
+	}
+
+	printf("sweep: %d combinations x %d runs on %d threads in %.1f s (%.0f runs/s)\n",
+			resultCount, (traceCount ? traceCount : 1) * seeds, threadCount, (double) wall / SIM_NSEC,
+			(double) resultCount * (traceCount ? traceCount : 1) * seeds * SIM_NSEC / (wall > 0 ? wall : 1));
+	if (failed) printf("%d combinations did not converge in every run\n", failed);
+
+	if (failed == resultCount)
+	{
+		printf("no recommendation, nothing converged (|offset| < %lld ns)\n", (long long) base.threshold);
+		return 1;
+	}
+
+	printf("\nrank     ap     ai s_delay s_offset sync  settle_s   rms_ns   max_ns     score\n");
+	for (i = 0; (i < top) && (i < resultCount - failed); i++)
+	{
+		r = &results[i];
+		printf("%4d %6d %6d %7d %8d %4d %9.1f %8.1f %8lld %9.1f\n", i + 1, r->ap, r->ai, r->sDelay,
+				r->sOffset, r->syncInterval, r->settle, r->rms, (long long) r->max, r->score);
+	}
+
+	r = &results[0];
+	printf("\nrecommended settings for constants.h:\n");
+	printf("#define DEFAULT_AP                      %d\n", r->ap);
+	printf("#define DEFAULT_AI                      %d\n", r->ai);
+	printf("#define DEFAULT_DELAY_S                 %d\n", r->sDelay);
+	printf("#define DEFAULT_OFFSET_S                %d\n", r->sOffset);
+	printf("#define DEFAULT_SYNC_INTERVAL           %d\n", r->syncInterval);
+
+	return 0;
+}
@@ -0,0 +1,685 @@
+/* offset_stats.cpp
+ *
+ * Offset statistics of a capture, the native replacement for the analysis
+ * done by offset_stats.m.  Reads the t and tr files written by
+ * telemetry_recv (or a single column of offsets) of any length and prints
+ * a JSON summary with the offset and tick rate statistics, the offset
+ * histogram, and the overlapping Allan deviation, time deviation and MTIE
+ * over tau.
+ *
+ *   c++ -O2 -std=c++11 -pthread -o offset_stats offset_stats.cpp
+ *   ./offset_stats [options] [t tr]
+ *   ./offset_stats [options] -x offsets
+ *
+ *   -x file   read the offsets (phase, seconds) from a single file
+ *   -i tau0   sample interval in seconds, by default the mean step of tr
+ *   -b begin  histogram begin, seconds (-15e-6)
+ *   -e end    histogram end, seconds (15e-6)
+ *   -w width  histogram bin width, seconds (1e-6)
+ *   -d n      tau values per decade (10), 0 evaluates every tau
+ *   -j n      worker threads, by default one per CPU
+ *
+ * The samples are parsed once into a temporary binary file which is then
+ * memory mapped, so memory use does not grow with the capture beyond the
+ * page cache.  The temporary files are created in $TMPDIR, or /tmp.  The
+ * deviations for one tau are computed in a single pass over the samples
+ * and the tau values are shared out over the worker threads.  MTIE is
+ * computed for all tau together in O(N log N) with the samples split over
+ * the worker threads.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+/* Reads one number per line from a text file through a large buffer. */
+class NumberReader
+{
+public:
+	explicit NumberReader(const char *name)
+		: name_(name), file_(std::fopen(name, "rb")), buf_(1 << 20), pos_(0), len_(0), eof_(false)
+	{
+		if (!file_)
+		{
+			std::fprintf(stderr, "%s: %s\n", name, std::strerror(errno));
+			std::exit(1);
+		}
+	}
+
+	~NumberReader()
+	{
+		if (file_) std::fclose(file_);
+	}
+
+	/* Get the next number, false at the end of the file. */
+	bool next(double &value)
+	{
+		for (;;)
+		{
+			char *line = &buf_[pos_];
+			char *end = (char *) std::memchr(line, '\n', len_ - pos_);
+
+			if (end == NULL)
+			{
+				/* Keep the partial line and read more behind it. */
+				if (!eof_ && fill()) continue;
+				if (pos_ == len_) return false;
+				end = &buf_[len_];
+			}
+			pos_ = (size_t) (end - buf_.data()) + (end < &buf_[len_] ? 1 : 0);
+
+			/* Trim the line, skip blank lines and Octave comments. */
+			while (line < end && std::isspace((unsigned char) *line)) ++line;
+			while (end > line && std::isspace((unsigned char) end[-1])) --end;
+			if (line == end || *line == '#' || *line == '%') continue;
+
+			*end = 0;
+			value = parse(line);
+			return true;
+		}
+	}
+
+private:
+	/* Move the unread data to the start of the buffer and read more after
+	   it.  Returns false at the end of the file. */
+	bool fill()
+	{
+		size_t rest = len_ - pos_;
+
+		std::memmove(buf_.data(), &buf_[pos_], rest);
+		pos_ = 0;
+		len_ = rest;
+		if (len_ == buf_.size() - 1)
+		{
+			std::fprintf(stderr, "%s: line too long\n", name_);
+			std::exit(1);
+		}
+
+		size_t n = std::fread(&buf_[len_], 1, buf_.size() - 1 - len_, file_);
+		len_ += n;
+		if (n == 0) eof_ = true;
+		return n > 0;
+	}
+
+	/* Plain decimals are converted directly, which is much faster than
+	   strtod() and exact to the nanosecond digits written by the receiver. */
+	double parse(const char *s)
+	{
+		static const double scale[] =
+		{
+			1e0, 1e-1, 1e-2, 1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8, 1e-9,
+			1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18
+		};
+		const char *p = s;
+		bool negative = false;
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int fraction = -1;
+
+		if (*p == '-' || *p == '+') negative = (*p++ == '-');
+		for (; *p; ++p)
+		{
+			if (*p >= '0' && *p <= '9')
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (++digits > 18) return strtod(s);
+				if (fraction >= 0) ++fraction;
+			}
+			else if (*p == '.' && fraction < 0)
+			{
+				fraction = 0;
+			}
+			else
+			{
+				return strtod(s);
+			}
+		}
+		if (digits == 0) return strtod(s);
+
+		double value = (double) mantissa * scale[fraction > 0 ? fraction : 0];
+		return negative ? -value : value;
+	}
+
+	double strtod(const char *s)
+	{
+		char *end;
+		double value = std::strtod(s, &end);
+		if (end == s || *end)
+		{
+			std::fprintf(stderr, "%s: bad number '%s'\n", name_, s);
+			std::exit(1);
+		}
+		return value;
+	}
+
+	const char *name_;
+	std::FILE *file_;
+	std::vector<char> buf_;
+	size_t pos_;
+	size_t len_;
+	bool eof_;
+};
+
+/* Running mean and variance (Welford) with the extremes. */
+struct Moments
+{
+	Moments() : n(0), mean(0), m2(0), min(HUGE_VAL), max(-HUGE_VAL) {}
+
+	void add(double v)
+	{
+		double d = v - mean;
+		mean += d / (double) ++n;
+		m2 += d * (v - mean);
+		if (v < min) min = v;
+		if (v > max) max = v;
+	}
+
+	double stddev() const
+	{
+		return n > 1 ? std::sqrt(m2 / (double) (n - 1)) : 0.0;
+	}
+
+	uint64_t n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+};
+
+struct Histogram
+{
+	Histogram(double begin, double end, double width)
+		: begin(begin), width(width), under(0), over(0),
+		  counts((size_t) std::max(1.0, std::ceil((end - begin) / width - 1e-9)), 0) {}
+
+	void add(double v)
+	{
+		double bin = std::floor((v - begin) / width);
+		if (bin < 0) ++under;
+		else if (bin >= (double) counts.size()) ++over;
+		else ++counts[(size_t) bin];
+	}
+
+	double begin;
+	double width;
+	uint64_t under;
+	uint64_t over;
+	std::vector<uint64_t> counts;
+};
+
+struct Stability
+{
+	uint64_t m;
+	double oadev;
+	double tdev;
+	double mtie;
+};
+
+/* Open an unnamed temporary file. */
+int tempFile()
+{
+	const char *dir = std::getenv("TMPDIR");
+	std::string name = std::string(dir && *dir ? dir : "/tmp") + "/offset_stats.XXXXXX";
+	std::vector<char> path(name.begin(), name.end());
+	path.push_back(0);
+
+	int fd = mkstemp(path.data());
+	if (fd < 0)
+	{
+		std::perror("mkstemp");
+		std::exit(1);
+	}
+	unlink(path.data());
+	return fd;
+}
+
+/* The offsets, parsed into a temporary file and mapped read only. */
+class PhaseFile
+{
+public:
+	PhaseFile() : fd_(tempFile()), data_(NULL), size_(0), buf_(1 << 16), used_(0) {}
+
+	~PhaseFile()
+	{
+		if (data_) munmap((void *) data_, size_ * sizeof(double));
+		if (fd_ >= 0) close(fd_);
+	}
+
+	void add(double v)
+	{
+		buf_[used_++] = v;
+		if (used_ == buf_.size()) flush();
+	}
+
+	/* Finish writing and map the file. */
+	void map()
+	{
+		flush();
+		if (size_ == 0) return;
+		void *p = mmap(NULL, size_ * sizeof(double), PROT_READ, MAP_SHARED, fd_, 0);
+		if (p == MAP_FAILED)
+		{
+			std::perror("mmap");
+			std::exit(1);
+		}
+		madvise(p, size_ * sizeof(double), MADV_SEQUENTIAL);
+		data_ = (const double *) p;
+	}
+
+	const double *data() const { return data_; }
+	uint64_t size() const { return size_; }
+
+private:
+	void flush()
+	{
+		const char *p = (const char *) buf_.data();
+		size_t len = used_ * sizeof(double);
+
+		while (len > 0)
+		{
+			ssize_t n = write(fd_, p, len);
+			if (n < 0)
+			{
+				std::perror("write");
+				std::exit(1);
+			}
+			p += n;
+			len -= (size_t) n;
+		}
+		size_ += used_;
+		used_ = 0;
+	}
+
+	int fd_;
+	const double *data_;
+	uint64_t size_;
+	std::vector<double> buf_;
+	size_t used_;
+};
+
+/* Overlapping Allan deviation and time deviation for an averaging factor
+   m, in one pass over the offsets x. */
+void deviations(const double *x, uint64_t n, uint64_t m, double tau0, Stability &s)
+{
+	double adevSum = 0.0;
+	double tdevSum = 0.0;
+	double window = 0.0;
+	uint64_t i;
+
+	/* Second differences for the Allan variance, their running sum over m
+	   terms for the time variance. */
+	for (i = 0; i < m && i + 2 * m < n; ++i)
+	{
+		double d = x[i + 2 * m] - 2.0 * x[i + m] + x[i];
+		adevSum += d * d;
+		window += d;
+	}
+	if (n >= 3 * m) tdevSum = window * window;
+	for (; i + 2 * m < n; ++i)
+	{
+		double d = x[i + 2 * m] - 2.0 * x[i + m] + x[i];
+		adevSum += d * d;
+		window += d - (x[i + m] - 2.0 * x[i] + x[i - m]);
+		tdevSum += window * window;
+	}
+
+	double tau = (double) m * tau0;
+	s.oadev = (n > 2 * m) ? std::sqrt(adevSum / (2.0 * tau * tau * (double) (n - 2 * m))) : NAN;
+	s.tdev = (n >= 3 * m) ? std::sqrt(tdevSum / (6.0 * (double) m * (double) m * (double) (n - 3 * m + 1))) : NAN;
+}
+
+/* Largest and smallest offset in the block of samples starting at an
+   index. */
+struct Extrema
+{
+	double hi;
+	double lo;
+};
+
+/* A scratch array in a temporary file, so that it lives in the page cache
+   rather than in the process. */
+class ScratchArray
+{
+public:
+	explicit ScratchArray(uint64_t size) : fd_(tempFile()), data_(NULL), size_(size)
+	{
+		if (size_ == 0) return;
+		if (ftruncate(fd_, (off_t) (size_ * sizeof(Extrema))) < 0)
+		{
+			std::perror("ftruncate");
+			std::exit(1);
+		}
+		void *p = mmap(NULL, size_ * sizeof(Extrema), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+		if (p == MAP_FAILED)
+		{
+			std::perror("mmap");
+			std::exit(1);
+		}
+		data_ = (Extrema *) p;
+	}
+
+	~ScratchArray()
+	{
+		if (data_) munmap(data_, size_ * sizeof(Extrema));
+		close(fd_);
+	}
+
+	Extrema *data() { return data_; }
+
+private:
+	int fd_;
+	Extrema *data_;
+	uint64_t size_;
+};
+
+/* Run a function over the index range [0, n) split into one chunk per
+   thread.  The function gets the chunk and the thread number. */
+template <typename Function>
+void parallelFor(unsigned threads, uint64_t n, Function f)
+{
+	std::vector<std::thread> workers;
+	uint64_t chunk = (n + threads - 1) / threads;
+
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		uint64_t begin = std::min(n, t * chunk);
+		uint64_t end = std::min(n, begin + chunk);
+		workers.push_back(std::thread(f, begin, end, t));
+	}
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+}
+
+/* MTIE for each averaging factor in the ascending list, the largest peak
+   to peak offset in any window of m + 1 samples.  The extremes of every
+   block of 2^p samples are built up by doubling, a window of L samples is
+   covered by two overlapping blocks of the largest 2^p <= L.  Each doubling
+   pass also evaluates the windows of its level. */
+void mtie(const double *x, uint64_t n, const std::vector<uint64_t> &taus, unsigned threads, std::vector<Stability> &results)
+{
+	ScratchArray bufferA(n);
+	ScratchArray bufferB(n);
+	Extrema *cur = bufferA.data();
+	Extrema *next = bufferB.data();
+	uint64_t span = 1;
+	size_t j = 0;
+
+	parallelFor(threads, n, [&](uint64_t begin, uint64_t end, unsigned)
+	{
+		for (uint64_t k = begin; k < end; ++k)
+		{
+			cur[k].hi = x[k];
+			cur[k].lo = x[k];
+		}
+	});
+
+	while (j < taus.size())
+	{
+		/* The windows covered by two blocks of this level. */
+		size_t first = j;
+		while (j < taus.size() && taus[j] + 1 < 2 * span) ++j;
+		bool last = (j == taus.size());
+		std::vector<double> peak(threads * (j - first), 0.0);
+
+		parallelFor(threads, n, [&](uint64_t begin, uint64_t end, unsigned t)
+		{
+			for (size_t l = first; l < j; ++l)
+			{
+				uint64_t len = taus[l] + 1;
+				uint64_t stop = std::min(end, n - len + 1);
+				double p = 0.0;
+				for (uint64_t k = begin; k < stop; ++k)
+				{
+					double hi = std::max(cur[k].hi, cur[k + len - span].hi);
+					double lo = std::min(cur[k].lo, cur[k + len - span].lo);
+					p = std::max(p, hi - lo);
+				}
+				peak[t * (j - first) + (l - first)] = p;
+			}
+
+			if (last) return;
+
+			/* Blocks of twice the length for the next level. */
+			uint64_t stop = (n >= 2 * span) ? std::min(end, n - 2 * span + 1) : 0;
+			for (uint64_t k = begin; k < stop; ++k)
+			{
+				next[k].hi = std::max(cur[k].hi, cur[k + span].hi);
+				next[k].lo = std::min(cur[k].lo, cur[k + span].lo);
+			}
+		});
+
+		for (size_t l = first; l < j; ++l)
+		{
+			double p = 0.0;
+			for (unsigned t = 0; t < threads; ++t) p = std::max(p, peak[t * (j - first) + (l - first)]);
+			results[l].mtie = p;
+		}
+
+		std::swap(cur, next);
+		span *= 2;
+	}
+}
+
+/* Averaging factors up to the longest MTIE window, spaced evenly on a log
+   scale or every one of them. */
+std::vector<uint64_t> tauList(uint64_t n, int perDecade)
+{
+	std::vector<uint64_t> list;
+
+	if (n < 2) return list;
+	if (perDecade <= 0)
+	{
+		for (uint64_t m = 1; m < n; ++m) list.push_back(m);
+		return list;
+	}
+
+	for (int k = 0; ; ++k)
+	{
+		uint64_t m = (uint64_t) std::llround(std::pow(10.0, (double) k / perDecade));
+		if (m >= n) break;
+		if (list.empty() || m != list.back()) list.push_back(m);
+	}
+
+	return list;
+}
+
+void printNumber(double v)
+{
+	if (std::isfinite(v)) std::printf("%.9g", v);
+	else std::printf("null");
+}
+
+void usage(const char *name)
+{
+	std::fprintf(stderr, "usage: %s [-i tau0] [-b begin] [-e end] [-w width] [-d per_decade] [-j threads] [t tr | -x offsets]\n", name);
+	std::exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	int opt;
+	int perDecade = 10;
+	unsigned threads = std::thread::hardware_concurrency();
+	double tau0 = 0.0;
+	double histBegin = -15e-6;
+	double histEnd = 15e-6;
+	double histWidth = 1e-6;
+	const char *phaseName = NULL;
+	const char *tName = "t";
+	const char *trName = "tr";
+
+	while ((opt = getopt(argc, argv, "x:i:b:e:w:d:j:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'x': phaseName = optarg; break;
+			case 'i': tau0 = std::atof(optarg); break;
+			case 'b': histBegin = std::atof(optarg); break;
+			case 'e': histEnd = std::atof(optarg); break;
+			case 'w': histWidth = std::atof(optarg); break;
+			case 'd': perDecade = std::atoi(optarg); break;
+			case 'j': threads = (unsigned) std::atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+	if (phaseName && optind != argc) usage(argv[0]);
+	if (!phaseName && optind != argc && optind + 2 != argc) usage(argv[0]);
+	if (optind + 2 == argc)
+	{
+		tName = argv[optind];
+		trName = argv[optind + 1];
+	}
+	if (histWidth <= 0.0 || histEnd <= histBegin) usage(argv[0]);
+	if (threads == 0) threads = 1;
+
+	/* First pass: parse the samples, collect the offset and tick rate
+	   statistics and the histogram. */
+	PhaseFile phase;
+	Moments offset;
+	Moments rate;
+	Histogram histogram(histBegin, histEnd, histWidth);
+	double first = 0.0;
+	double last = 0.0;
+	double previous = 0.0;
+
+	if (phaseName)
+	{
+		NumberReader in(phaseName);
+		double x;
+
+		while (in.next(x))
+		{
+			if (offset.n > 0) rate.add(x - previous);
+			previous = x;
+			offset.add(x);
+			histogram.add(x);
+			phase.add(x);
+		}
+	}
+	else
+	{
+		NumberReader inT(tName);
+		NumberReader inTr(trName);
+		double t, tr;
+
+		for (;;)
+		{
+			bool haveT = inT.next(t);
+			bool haveTr = inTr.next(tr);
+			if (haveT != haveTr)
+			{
+				std::fprintf(stderr, "%s and %s differ in length\n", tName, trName);
+				return 1;
+			}
+			if (!haveT) break;
+
+			double x = t - tr;
+			if (offset.n == 0) first = tr;
+			else rate.add(x - previous);
+			last = tr;
+			previous = x;
+			offset.add(x);
+			histogram.add(x);
+			phase.add(x);
+		}
+	}
+
+	phase.map();
+	uint64_t n = phase.size();
+
+	if (tau0 <= 0.0)
+	{
+		tau0 = (!phaseName && n > 1) ? (last - first) / (double) (n - 1) : 1.0;
+		if (!(tau0 > 0.0)) tau0 = 1.0;
+	}
+
+	/* Second pass: the stability figures for each tau, shared out over
+	   the worker threads. */
+	std::vector<uint64_t> taus = tauList(n, perDecade);
+	std::vector<Stability> results(taus.size());
+	std::atomic<size_t> nextTau(0);
+	std::vector<std::thread> workers;
+
+	for (size_t j = 0; j < taus.size(); ++j) results[j].m = taus[j];
+
+	/* Hand out the shortest taus last, they take the least time. */
+	for (unsigned k = 0; k < threads && k < taus.size(); ++k)
+	{
+		workers.push_back(std::thread([&]()
+		{
+			size_t j;
+			while ((j = nextTau++) < taus.size())
+			{
+				size_t l = taus.size() - 1 - j;
+				deviations(phase.data(), n, taus[l], tau0, results[l]);
+			}
+		}));
+	}
+	for (size_t k = 0; k < workers.size(); ++k) workers[k].join();
+
+	mtie(phase.data(), n, taus, threads, results);
+
+	/* The summary. */
+	std::printf("{\n");
+	std::printf("  \"samples\": %llu,\n", (unsigned long long) n);
+	std::printf("  \"tau0\": ");
+	printNumber(tau0);
+	std::printf(",\n  \"offset\": {\"min\": ");
+	printNumber(n ? offset.min : NAN);
+	std::printf(", \"max\": ");
+	printNumber(n ? offset.max : NAN);
+	std::printf(", \"mean\": ");
+	printNumber(n ? offset.mean : NAN);
+	std::printf(", \"stddev\": ");
+	printNumber(offset.stddev());
+	std::printf("},\n  \"rate\": {\"min\": ");
+	printNumber(rate.n ? rate.min : NAN);
+	std::printf(", \"max\": ");
+	printNumber(rate.n ? rate.max : NAN);
+	std::printf(", \"mean\": ");
+	printNumber(rate.n ? rate.mean : NAN);
+	std::printf(", \"stddev\": ");
+	printNumber(rate.stddev());
+	std::printf("},\n  \"histogram\": {\"begin\": ");
+	printNumber(histogram.begin);
+	std::printf(", \"width\": ");
+	printNumber(histogram.width);
+	std::printf(", \"under\": %llu, \"over\": %llu, \"counts\": [",
+			(unsigned long long) histogram.under, (unsigned long long) histogram.over);
+	for (size_t k = 0; k < histogram.counts.size(); ++k)
+	{
+		std::printf("%s%llu", k ? ", " : "", (unsigned long long) histogram.counts[k]);
+	}
+	std::printf("]},\n  \"stability\": [");
+	for (size_t k = 0; k < results.size(); ++k)
+	{
+		std::printf("%s\n    {\"m\": %llu, \"tau\": ", k ? "," : "", (unsigned long long) results[k].m);
+		printNumber((double) results[k].m * tau0);
+		std::printf(", \"oadev\": ");
+		printNumber(results[k].oadev);
+		std::printf(", \"tdev\": ");
+		printNumber(results[k].tdev);
+		std::printf(", \"mtie\": ");
+		printNumber(results[k].mtie);
+		std::printf("}");
+	}
+	std::printf("\n  ]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/* telemetry_recv.c
+ *
+ * Receive the servo telemetry datagrams sent by the firmware (see
+ * src/dep/telemetry.c) and write the t and tr files read by offset_stats
+ * and offset_stats.m, plus a CSV file with every sample field.
+ *
+ *   cc -O2 -o telemetry_recv telemetry_recv.c
+ *   ./telemetry_recv [-p port] [-n samples] [-f] [-o csv]
+ *
+ * Enable the stream on the board with the shell command
+ * "telemetry <host address> [port [decimation]]".
+ *
+ * t holds the Sync receive time t2 and tr the master reference time
+ * t2 - offset, so that t - tr in offset_stats.m is the offset from
+ * master.  The raw offset before the servo filter is used unless -f is
+ * given.  Both are in seconds relative to the whole second of the first
+ * sample, which keeps nanosecond resolution in double precision.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define TELEMETRY_MAGIC         "PTEL"
+#define TELEMETRY_VERSION       1
+#define TELEMETRY_PORT          5319
+#define TELEMETRY_HEADER_LENGTH 16
+#define TELEMETRY_SAMPLE_LENGTH 68
+
+/* Sample fields following the index, in datagram order. */
+enum
+{
+	T1_SEC, T1_NSEC, T2_SEC, T2_NSEC, T3_SEC, T3_NSEC, T4_SEC, T4_NSEC,
+	RAW_SEC, RAW_NSEC, OFFSET_SEC, OFFSET_NSEC, DELAY_SEC, DELAY_NSEC,
+	DRIFT, ADJ, FIELDS
+};
+
+static uint32_t get32(const unsigned char *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p port] [-n samples] [-f] [-o csv]\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	int k;
+	int opt;
+	int sock;
+	int count;
+	int filtered = 0;
+	int havePrevious = 0;
+	ssize_t len;
+	long epoch = 0;
+	long limit = 0;
+	long total = 0;
+	uint32_t index;
+	uint32_t previous = 0;
+	unsigned long lost = 0;
+	int32_t f[FIELDS];
+	double t2;
+	double offset;
+	const unsigned char *s;
+	const char *csvName = "telemetry.csv";
+	unsigned short port = TELEMETRY_PORT;
+	unsigned char buf[2048];
+	struct sockaddr_in addr;
+	FILE *t, *tr, *csv;
+
+	while ((opt = getopt(argc, argv, "p:n:fo:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': port = (unsigned short) atoi(optarg); break;
+			case 'n': limit = atol(optarg); break;
+			case 'f': filtered = 1; break;
+			case 'o': csvName = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind != argc) usage(argv[0]);
+
+	if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+	{
+		perror("bind");
+		return 1;
+	}
+
+	t = fopen("t", "w");
+	tr = fopen("tr", "w");
+	csv = fopen(csvName, "w");
+	if (!t || !tr || !csv)
+	{
+		perror("fopen");
+		return 1;
+	}
+
+	fprintf(csv, "index,t1,t2,t3,t4,raw_offset,offset,delay,drift,adj\n");
+	fprintf(stderr, "listening on port %u\n", port);
+
+	while ((limit == 0) || (total < limit))
+	{
+		len = recv(sock, buf, sizeof(buf), 0);
+		if (len < 0)
+		{
+			perror("recv");
+			break;
+		}
+
+		/* Check the header. */
+		if ((len < TELEMETRY_HEADER_LENGTH) || memcmp(buf, TELEMETRY_MAGIC, 4) ||
+				(((buf[4] << 8) | buf[5]) != TELEMETRY_VERSION))
+		{
+			fprintf(stderr, "ignored %ld byte datagram\n", (long) len);
+			continue;
+		}
+		count = (buf[6] << 8) | buf[7];
+		if (len < TELEMETRY_HEADER_LENGTH + count * TELEMETRY_SAMPLE_LENGTH)
+		{
+			fprintf(stderr, "ignored truncated datagram\n");
+			continue;
+		}
+
+		for (i = 0; (i < count) && ((limit == 0) || (total < limit)); ++i)
+		{
+			s = &buf[TELEMETRY_HEADER_LENGTH + i * TELEMETRY_SAMPLE_LENGTH];
+			index = get32(s);
+			for (k = 0; k < FIELDS; ++k) f[k] = (int32_t) get32(s + 4 + 4 * k);
+
+			/* Samples dropped on the board or lost on the way. */
+			if (havePrevious && (index != previous + 1))
+			{
+				fprintf(stderr, "lost %u samples before %u\n", index - previous - 1, index);
+				lost += index - previous - 1;
+			}
+			previous = index;
+
+			if (!havePrevious) epoch = f[T2_SEC];
+			havePrevious = 1;
+
+			t2 = (double) (f[T2_SEC] - epoch) + f[T2_NSEC] * 1e-9;
+			if (filtered) offset = f[OFFSET_SEC] + f[OFFSET_NSEC] * 1e-9;
+			else offset = f[RAW_SEC] + f[RAW_NSEC] * 1e-9;
+
+			fprintf(t, "%.9f\n", t2);
+			fprintf(tr, "%.9f\n", t2 - offset);
+
+			fprintf(csv, "%u,%d.%09d,%d.%09d,%d.%09d,%d.%09d,%lld,%lld,%lld,%d,%d\n", index,
+					f[T1_SEC], f[T1_NSEC], f[T2_SEC], f[T2_NSEC],
+					f[T3_SEC], f[T3_NSEC], f[T4_SEC], f[T4_NSEC],
+					f[RAW_SEC] * 1000000000LL + f[RAW_NSEC],
+					f[OFFSET_SEC] * 1000000000LL + f[OFFSET_NSEC],
+					f[DELAY_SEC] * 1000000000LL + f[DELAY_NSEC],
+					f[DRIFT], f[ADJ]);
+			++total;
+		}
+
+		fflush(t);
+		fflush(tr);
+		fflush(csv);
+	}
+
+	fprintf(stderr, "%ld samples, %lu lost\n", total, lost);
+
+	fclose(t);
+	fclose(tr);
+	fclose(csv);
+	close(sock);
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+/* trace_decode.c
+ *
+ * Convert the binary trace stream served on TCP port 4000 (see
+ * code/inc/trace.h) into CSV for analysis.
+ *
+ *   cc -O2 -o trace_decode trace_decode.c
+ *   nc <board> 4000 | ./trace_decode > trace.csv
+ *   ./trace_decode trace.bin > trace.csv
+ *
+ * Each line holds the record sequence number, the PTP time of the event,
+ * the event name and its arguments.  Records lost because the ring was
+ * overwritten show up as gaps in the sequence numbers and are reported on
+ * stderr.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TRACE_MAGIC       "PTRC"
+#define TRACE_VERSION     1
+#define TRACE_RECORD_SIZE 32
+
+static const char *eventNames[] =
+{
+	"unknown",
+	"msg_recv",
+	"state",
+	"offset",
+	"delay",
+	"peer_delay",
+	"clock",
+	"adj_freq",
+	"timer_start",
+	"timer_stop",
+	"timer_expired",
+	"netq_put",
+	"netq_get",
+};
+
+#define EVENT_COUNT (sizeof(eventNames) / sizeof(eventNames[0]))
+
+/* The firmware writes little endian records. */
+static uint32_t get32(const unsigned char *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t get16(const unsigned char *p)
+{
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+int main(int argc, char **argv)
+{
+	int i;
+	FILE *in = stdin;
+	uint16_t event;
+	uint32_t seq;
+	uint32_t seconds;
+	uint32_t nanoseconds;
+	uint32_t expected = 0;
+	unsigned long records = 0;
+	unsigned long lost = 0;
+	unsigned char header[8];
+	unsigned char record[TRACE_RECORD_SIZE];
+
+	if (argc > 2)
+	{
+		fprintf(stderr, "usage: %s [trace.bin]\n", argv[0]);
+		return 2;
+	}
+
+	if ((argc == 2) && ((in = fopen(argv[1], "rb")) == NULL))
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	if ((fread(header, sizeof(header), 1, in) != 1) || memcmp(header, TRACE_MAGIC, 4))
+	{
+		fprintf(stderr, "not a trace stream\n");
+		return 1;
+	}
+
+	if ((get16(&header[4]) != TRACE_VERSION) || (get16(&header[6]) != TRACE_RECORD_SIZE))
+	{
+		fprintf(stderr, "unsupported trace version %u record size %u\n", get16(&header[4]), get16(&header[6]));
+		return 1;
+	}
+
+	printf("seq,time,event,arg0,arg1,arg2,arg3,arg4\n");
+
+	while (fread(record, sizeof(record), 1, in) == 1)
+	{
+		seq = get32(&record[0]);
+		seconds = get32(&record[4]);
+		event = get16(&record[12]);
+
+		/* The subseconds count 2^31 per second. */
+		nanoseconds = (uint32_t) (((uint64_t) (get32(&record[8]) & 0x7fffffff) * 1000000000) >> 31);
+
+		if ((records > 0) && (seq != expected))
+		{
+			fprintf(stderr, "lost %u records before %u\n", seq - expected, seq);
+			lost += seq - expected;
+		}
+		expected = seq + 1;
+		++records;
+
+		printf("%u,%u.%09u,", seq, seconds, nanoseconds);
+		if (event < EVENT_COUNT) printf("%s", eventNames[event]);
+		else printf("event%u", event);
+		printf(",%u", get16(&record[14]));
+		for (i = 0; i < 4; ++i) printf(",%d", (int32_t) get32(&record[16 + 4 * i]));
+		printf("\n");
+	}
+
+	fprintf(stderr, "%lu records, %lu lost\n", records, lost);
+
+	return 0;
+}